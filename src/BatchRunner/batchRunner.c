@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "emulatorShell.h"
+#include "flags8080.h"
+#include "batch8080.h"
+#include "profile8080.h"
+#include "trace8080.h"
+#include "flowGraph8080.h"
+#include "file8080.h"
+#include "memory8080.h"
+#include "blockCache8080.h"
+#include "jit8080.h"
+#include "validate8080.h"
+#include "aot8080.h"
+
+#define REPORT_LINES 20 // lines per profile table
+#define VALIDATE_CYCLES 100000000ULL // -v budget without -c
+
+/*
+ * run a rom with a tier and with the reference interpreter side by
+ * side, print where they first disagree
+ * @return 0 when they agree, 1 when they don't, -1 on error
+ */
+static int validateRom(const char *name, const uint8_t *rom, size_t size,
+                       uint16_t loadAddress, const BatchOptions8080 *options,
+                       uint64_t maxCycles)
+{
+  State8080 reference, candidate;
+  Divergence8080 divergence;
+  RunTier8080 run = Run8080;
+  int diverged;
+
+  if (size > (size_t)0x10000 - loadAddress)
+	size = 0x10000 - loadAddress;
+  memset(&reference, 0, sizeof(reference));
+  InitMemory8080(&reference);
+  LoadMemory8080(&reference, loadAddress, rom, size);
+  reference.pc = loadAddress;
+  Fork8080(&reference, &candidate);
+  if (options->tier == TIER_BLOCKS)
+  {
+	if (EnableBlockCache8080(&candidate))
+	{
+	  FreeMemory8080(&candidate);
+	  FreeMemory8080(&reference);
+	  return -1;
+	}
+	run = RunBlocks8080;
+  }
+  else if (options->tier == TIER_JIT)
+  {
+	if (EnableJit8080(&candidate))
+	  fprintf(stderr, "no JIT on this host, validating the interpreter\n");
+	run = RunJit8080;
+  }
+  else if (options->tier == TIER_AOT)
+  {
+	if (EnableAot8080(&candidate, options->aotDir ? options->aotDir : ".",
+	                  rom, loadAddress, size))
+	  fprintf(stderr, "no module for %s, validating the interpreter\n",
+	          name);
+	run = RunAot8080;
+  }
+
+  diverged = Validate8080(&reference, &candidate, run,
+                          maxCycles ? maxCycles : VALIDATE_CYCLES,
+                          &divergence);
+  if (diverged)
+  {
+	printf("%s ", name);
+	ReportDivergence8080(stdout, &reference, &candidate, &divergence);
+  }
+  else
+	printf("%s ok cycles=%llu pc=%04x\n", name,
+	       (unsigned long long)candidate.cycles, candidate.pc);
+
+  DisableBlockCache8080(&candidate);
+  DisableJit8080(&candidate);
+  DisableAot8080(&candidate);
+  FreeMemory8080(&candidate);
+  FreeMemory8080(&reference);
+  return diverged;
+}
+
+/*
+ * parse base,width,height[,ccw][,gray], white on black
+ * @return 0 on success, -1 on a malformed spec
+ */
+static int parseVideo(const char *spec, VideoConfig8080 *video)
+{
+  static const VideoConfig8080 defaults = {
+	0, 0, 0, VIDEO8080_ROTATE_NONE, VIDEO8080_RGBA,
+	{ 0xff, 0xff, 0xff, 0xff }, { 0, 0, 0, 0xff }, VIDEO8080_KERNEL_AUTO
+  };
+  char *end;
+
+  *video = defaults;
+  video->base = strtoul(spec, &end, 0);
+  if (*end++ != ',')
+	return -1;
+  video->width = strtoul(end, &end, 0);
+  if (*end++ != ',')
+	return -1;
+  video->height = strtoul(end, &end, 0);
+  while (*end == ',')
+  {
+	end++;
+	if (!strncmp(end, "ccw", 3))
+	  video->rotate = VIDEO8080_ROTATE_CCW;
+	else if (!strncmp(end, "gray", 4))
+	  video->format = VIDEO8080_GRAY;
+	else
+	  return -1;
+	end += strcspn(end, ",");
+  }
+  return *end ? -1 : 0;
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-j threads] [-s slice cycles] [-c max cycles]\n"
+          "       [-t interp|blocks|jit|aot|lockstep] [-o load address]\n"
+          "       [-A dir of aot modules, default .]\n"
+          "       [-p profile period, 1 for every instruction]\n"
+          "       [-T, record rom.trace for each rom]\n"
+          "       [-i interrupt period in cycles[,rst], default RST 7]\n"
+          "       [-v, check the tier against the reference interpreter]\n"
+          "       [-V frame buffer base,width,height[,ccw][,gray]]\n"
+          "       [-F cycles per frame] [-S, stream frames to rom.rgba]\n"
+          "       [-g port[,job], serve a job to GDB on localhost]\n"
+          "       [-x, read rom.idx from disassmbler -r -x for the profile\n"
+          "       report and to decode the blocks of -t blocks up front]\n"
+          "       rom...\n",
+          name);
+}
+
+int main(int argc, char **argv)
+{
+  BatchOptions8080 options = { 0, 0, TIER_INTERPRETER, 0, 0, 0, 0, NULL, NULL,
+                               0, 0, 0 };
+  uint64_t maxCycles = 0;
+  uint16_t loadAddress = 0;
+  BatchJob8080 *jobs;
+  VideoConfig8080 video;
+  int opt, count, i, trace = 0, validate = 0, stream = 0, index = 0;
+  char *end;
+
+  while ((opt = getopt(argc, argv, "j:s:c:t:o:p:Ti:vA:V:F:Sg:x")) != -1)
+  {
+	switch (opt)
+	{
+	  case 'j': options.threads = atoi(optarg); break;
+	  case 's': options.sliceCycles = strtoull(optarg, NULL, 0); break;
+	  case 'c': maxCycles = strtoull(optarg, NULL, 0); break;
+	  case 'o': loadAddress = strtoul(optarg, NULL, 0); break;
+	  case 'p': options.profilePeriod = strtoul(optarg, NULL, 0); break;
+	  case 'T': trace = 1; break;
+	  case 'v': validate = 1; break;
+	  case 'A': options.aotDir = optarg; break;
+	  case 'F': options.framePeriod = strtoull(optarg, NULL, 0); break;
+	  case 'S': stream = 1; break;
+	  case 'x': index = 1; break;
+	  case 'V':
+		if (parseVideo(optarg, &video))
+		{
+		  usage(argv[0]);
+		  return 1;
+		}
+		options.video = &video;
+		break;
+	  case 'g':
+		options.gdbPort = strtoul(optarg, &end, 0);
+		options.gdbJob = *end == ',' ? strtoul(end + 1, NULL, 0) : 0;
+		break;
+	  case 'i':
+		options.interruptPeriod = strtoull(optarg, &end, 0);
+		options.interruptRst = *end == ',' ? strtoul(end + 1, NULL, 0) & 7 : 7;
+		break;
+	  case 't':
+		if (!strcmp(optarg, "blocks"))
+		  options.tier = TIER_BLOCKS;
+		else if (!strcmp(optarg, "jit"))
+		  options.tier = TIER_JIT;
+		else if (!strcmp(optarg, "aot"))
+		  options.tier = TIER_AOT;
+		else if (!strcmp(optarg, "lockstep"))
+		  options.tier = TIER_LOCKSTEP;
+		else
+		  options.tier = TIER_INTERPRETER;
+		break;
+	  default:
+		usage(argv[0]);
+		return 1;
+	}
+  }
+
+  if (options.profilePeriod && !EMU8080_PROFILE &&
+	  options.tier != TIER_INTERPRETER)
+	fprintf(stderr, "built without profiling (make PROFILE=1), "
+	                "-p runs on the interpreter\n");
+  if (trace && !EMU8080_TRACE && options.tier != TIER_INTERPRETER)
+	fprintf(stderr, "built without tracing (make TRACE=1), "
+	                "-T runs on the interpreter\n");
+
+  count = argc - optind;
+  if (count <= 0)
+  {
+	usage(argv[0]);
+	return 1;
+  }
+
+  if (validate)
+  {
+	int ret = 0;
+
+	for (i = optind; i < argc; i++)
+	{
+	  size_t size;
+	  uint8_t *rom = ReadFile8080(argv[i], &size);
+	  int result = rom ? validateRom(argv[i], rom, size, loadAddress,
+	                                 &options, maxCycles) : -1;
+
+	  if (result < 0)
+		printf("failed to validate %s!\n", argv[i]);
+	  if (result)
+		ret = 1;
+	  free(rom);
+	}
+	return ret;
+  }
+
+  jobs = calloc(count, sizeof(BatchJob8080));
+  if (!jobs)
+	return 1;
+  for (i = 0; i < count; i++)
+  {
+	size_t size;
+	uint8_t *rom = ReadFile8080(argv[optind + i], &size);
+
+	if (!rom)
+	{
+	  printf("failed to open %s!\n", argv[optind + i]);
+	  return 1;
+	}
+	jobs[i].rom = rom;
+	jobs[i].romSize = size;
+	jobs[i].loadAddress = loadAddress;
+	jobs[i].initial.pc = loadAddress;
+	jobs[i].maxCycles = maxCycles;
+	if (stream && options.video)
+	{
+	  const char *ext = options.video->format == VIDEO8080_GRAY ?
+		".gray" : ".rgba";
+	  char *path = malloc(strlen(argv[optind + i]) + strlen(ext) + 1);
+
+	  if (!path)
+		return 1;
+	  sprintf(path, "%s%s", argv[optind + i], ext);
+	  jobs[i].videoPath = path;
+	}
+	if (trace)
+	{
+	  char *path = malloc(strlen(argv[optind + i]) + sizeof(".trace"));
+
+	  if (!path)
+		return 1;
+	  sprintf(path, "%s.trace", argv[optind + i]);
+	  jobs[i].tracePath = path;
+	}
+	if (index || options.profilePeriod)
+	{
+	  char *path = NULL;
+
+	  if (index)
+	  {
+		path = malloc(strlen(argv[optind + i]) + sizeof(".idx"));
+		if (!path)
+		  return 1;
+		sprintf(path, "%s.idx", argv[optind + i]);
+	  }
+	  jobs[i].graph = OpenFlowGraph8080(path, rom, loadAddress, size, NULL,
+	                                    0);
+	  free(path);
+	}
+  }
+
+  if (options.gdbPort && options.gdbJob < (size_t)count)
+	fprintf(stderr, "serving %s to GDB on 127.0.0.1:%u\n",
+	        argv[optind + options.gdbJob], options.gdbPort);
+  if (RunBatch8080(jobs, count, &options))
+  {
+	printf("failed to start the batch!\n");
+	return 1;
+  }
+
+  for (i = 0; i < count; i++)
+  {
+	State8080 *s = &jobs[i].final;
+
+	if (jobs[i].error)
+	{
+	  printf("%s error\n", argv[optind + i]);
+	  continue;
+	}
+	printf("%s %s cycles=%llu pc=%04x sp=%04x a=%02x b=%02x c=%02x "
+	       "d=%02x e=%02x h=%02x l=%02x psw=%02x\n",
+	       argv[optind + i],
+	       jobs[i].reason == RUN8080_HALT ? "halt" : "budget",
+	       (unsigned long long)jobs[i].cycles, s->pc, s->sp, s->a, s->b,
+	       s->c, s->d, s->e, s->h, s->l, peekFlags8080(s));
+	if (options.video)
+	  printf("  frames %llu hash %016llx\n",
+	         (unsigned long long)jobs[i].frames,
+	         (unsigned long long)jobs[i].frameHash);
+	if (jobs[i].skipped)
+	  printf("  skipped %llu idle cycles\n",
+	         (unsigned long long)jobs[i].skipped);
+	if (s->profile)
+	{
+	  ReportProfile8080(stdout, s->profile, jobs[i].rom, loadAddress,
+	                    jobs[i].romSize, jobs[i].graph, REPORT_LINES);
+	  DisableProfile8080(s);
+	}
+	FreeFlowGraph8080((FlowGraph8080 *)jobs[i].graph);
+	free((void *)jobs[i].rom);
+	free((void *)jobs[i].tracePath);
+	free((void *)jobs[i].videoPath);
+  }
+  free(jobs);
+  return 0;
+}
@@ -0,0 +1,835 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "blockCache8080.h"
+#include "jit8080.h"
+#include "saveState8080.h"
+#include "scheduler8080.h"
+#include "flowGraph8080.h"
+#include "file8080.h"
+#include "video8080.h"
+#include "profile8080.h"
+#include "trace8080.h"
+#include "coverage8080.h"
+#include "core8080.h"
+#include "lockstep8080.h"
+
+#ifndef BENCH8080_CFLAGS
+#define BENCH8080_CFLAGS "unknown"
+#endif
+
+#define BENCH8080_VERSION 1 // bumped when the JSON layout changes
+#define DEFAULT_CYCLES 100000000ULL // machine states per kernel run
+#define DEFAULT_REPEAT 3 // runs per measurement, the fastest is kept
+#define SNAPSHOT_OPS 20000 // forks, restores and save states timed
+#define SNAPSHOT_PAGES 32 // pages dirtied before each of them
+#define DISASM_BYTES ((size_t)16 << 20) // input of the disassembler runs
+#define FLOW_ENTRIES 256 // entry points of the flow graph run
+#define FLOW_OPS 20 // flow graphs built per run
+#define VIDEO_FRAMES 5000 // frames converted per video run
+#define VIDEO_DIRTY 8 // memory lines written before each partial frame
+#define LOCKSTEP_LANES 64 // machines run together, the budget is shared
+
+/*
+ * instruction mix kernels, each one an endless loop at address 0
+ */
+typedef struct Kernel {
+	const char *name;
+	const uint8_t *code;
+	size_t size;
+}Kernel;
+
+// ALU and register ops, flags read and written
+static const uint8_t aluKernel[] = {
+  0x31, 0x00, 0x40, // LXI SP,4000
+  0x80, 0x89, 0x92, 0xa3, // 0003: ADD B  ADC C  SUB D  ANA E
+  0xac, 0xb5, 0xb8, 0x3c, // XRA H  ORA L  CMP B  INR A
+  0x0d, 0x07, 0x27, 0x23, // DCR C  RLC  DAA  INX H
+  0x09, 0x2f, 0xc6, 0x11, // DAD B  CMA  ADI 11
+  0xc3, 0x03, 0x00 // JMP 0003
+};
+
+// loads and stores through HL, BC, DE and direct addresses
+static const uint8_t memKernel[] = {
+  0x31, 0x00, 0x40, // LXI SP,4000
+  0x21, 0x00, 0x10, // LXI H,1000
+  0x01, 0x00, 0x30, // LXI B,3000
+  0x11, 0x00, 0x31, // LXI D,3100
+  0x7e, 0x70, 0x23, 0x1a, 0x02, // 000c: MOV A,M  MOV M,B  INX H  LDAX D  STAX B
+  0x3a, 0x34, 0x12, // LDA 1234
+  0x32, 0x35, 0x12, // STA 1235
+  0x22, 0x00, 0x20, // SHLD 2000
+  0x2a, 0x00, 0x20, // LHLD 2000
+  0x34, 0x7c, // INR M  MOV A,H
+  0xe6, 0x1f, 0xf6, 0x10, 0x67, // ANI 1f  ORI 10  MOV H,A, HL stays in 1xxx
+  0xc3, 0x0c, 0x00 // JMP 000c
+};
+
+// conditional jumps, taken and not taken
+static const uint8_t branchKernel[] = {
+  0x31, 0x00, 0x40, // LXI SP,4000
+  0x04, 0x78, 0xe6, 0x01, // 0003: INR B  MOV A,B  ANI 01
+  0xca, 0x0d, 0x00, // JZ 000d
+  0xc3, 0x10, 0x00, // JMP 0010
+  0x0d, 0x00, 0x00, // 000d: DCR C  NOP  NOP
+  0x78, 0xe6, 0x02, // 0010: MOV A,B  ANI 02
+  0xc2, 0x19, 0x00, // JNZ 0019
+  0xda, 0x03, 0x00, // JC 0003
+  0xfe, 0x80, // 0019: CPI 80
+  0xd2, 0x03, 0x00, // JNC 0003
+  0xc3, 0x03, 0x00 // JMP 0003
+};
+
+// calls, returns and stack traffic
+static const uint8_t callKernel[] = {
+  0x31, 0x00, 0x40, // LXI SP,4000
+  0xcd, 0x10, 0x00, // 0003: CALL 0010
+  0xc5, 0xe1, // PUSH B  POP H
+  0xcc, 0x10, 0x00, // CZ 0010
+  0xc3, 0x03, 0x00, // JMP 0003
+  0x00, 0x00, // padding
+  0x3c, 0xc8, // 0010: INR A  RZ
+  0xf5, 0xf1, 0xc9 // PUSH PSW  POP PSW  RET
+};
+
+static const Kernel kernels[] = {
+  { "alu", aluKernel, sizeof(aluKernel) },
+  { "memory", memKernel, sizeof(memKernel) },
+  { "branch", branchKernel, sizeof(branchKernel) },
+  { "call", callKernel, sizeof(callKernel) }
+};
+
+typedef struct Tier {
+	const char *name;
+	RunTier8080 run; // NULL for single steps with Emulate8080Op
+	int (*enable)(State8080 *state);
+	void (*disable)(State8080 *state);
+}Tier;
+
+static const Tier tiers[] = {
+  { "step", NULL, NULL, NULL },
+  { "interp", Run8080, NULL, NULL },
+  { "blocks", RunBlocks8080, EnableBlockCache8080, DisableBlockCache8080 },
+  { "jit", RunJit8080, EnableJit8080, DisableJit8080 }
+};
+
+#define TIER_COUNT (sizeof(tiers) / sizeof(tiers[0]))
+
+typedef struct Bench {
+	uint64_t cycles; // budget of each run
+	int repeat;
+	FILE *out;
+	int first; // no result written yet in the current JSON array
+}Bench;
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * xorshift, the same input bytes on every run
+ */
+static uint32_t nextRandom(uint32_t *seed)
+{
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return *seed;
+}
+
+static void fillRandom(uint8_t *buffer, size_t size)
+{
+  uint32_t seed = 0x8080;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+	buffer[i] = nextRandom(&seed);
+}
+
+/*
+ * start a result object in the current array
+ */
+static void beginResult(Bench *bench, const char *group, const char *name)
+{
+  fprintf(bench->out, "%s\n    { \"group\": \"%s\", \"name\": \"",
+          bench->first ? "" : ",", group);
+  // names may be ROM paths
+  for (; *name; name++)
+	if (*name == '"' || *name == '\\')
+	  fprintf(bench->out, "\\%c", *name);
+	else if ((unsigned char)*name >= 0x20)
+	  fputc(*name, bench->out);
+  fprintf(bench->out, "\"");
+  bench->first = 0;
+}
+
+static void loadMachine(State8080 *state, const uint8_t *code, size_t size,
+                        uint16_t origin)
+{
+  memset(state, 0, sizeof(State8080));
+  InitMemory8080(state);
+  LoadMemory8080(state, origin, code, size);
+  state->pc = origin;
+}
+
+/*
+ * run a machine with a tier until the budget is spent or it halts,
+ * IN and OUT are ignored
+ * @return instructions run, only counted when stepping
+ */
+static uint64_t runMachine(State8080 *state, const Tier *tier,
+                           uint64_t cycle_budget)
+{
+  uint64_t end = state->cycles + cycle_budget, count = 0;
+
+  if (!tier->run)
+  {
+	while (state->cycles < end && !state->halted)
+	{
+	  state->cycles += Emulate8080Op(state);
+	  count++;
+	}
+	return count;
+  }
+  while (state->cycles < end)
+	if (tier->run(state, end - state->cycles).reason == RUN8080_HALT)
+	  break;
+  return count;
+}
+
+/*
+ * time one program on every tier. the instruction count comes from
+ * the stepping run, the tiers run the same instructions for the
+ * same budget. the tiers after the interpreter also get their speed
+ * relative to it, vs_interp above 1 is faster.
+ */
+static void benchProgram(Bench *bench, const char *group, const char *name,
+                         const uint8_t *code, size_t size, uint16_t origin)
+{
+  uint64_t instructions = 0;
+  double interp = 0;
+  size_t t;
+
+  for (t = 0; t < TIER_COUNT; t++)
+  {
+	const Tier *tier = &tiers[t];
+	double best = 0;
+	uint64_t cycles = 0;
+	int r, native = 1;
+
+	for (r = 0; r < bench->repeat; r++)
+	{
+	  State8080 state;
+	  double start;
+	  uint64_t count;
+
+	  loadMachine(&state, code, size, origin);
+	  if (tier->enable && tier->enable(&state))
+		native = 0;
+	  start = now();
+	  count = runMachine(&state, tier, bench->cycles);
+	  start = now() - start;
+	  if (!tier->run)
+		instructions = count;
+	  if (r == 0 || start < best)
+		best = start;
+	  cycles = state.cycles;
+	  if (tier->disable)
+		tier->disable(&state);
+	  FreeMemory8080(&state);
+	}
+
+	beginResult(bench, group, name);
+	fprintf(bench->out, ", \"tier\": \"%s\", \"native\": %s, "
+	        "\"instructions\": %llu, \"cycles\": %llu, \"seconds\": %.6f, "
+	        "\"mips\": %.2f, \"mhz\": %.2f", tier->name,
+	        native ? "true" : "false", (unsigned long long)instructions,
+	        (unsigned long long)cycles, best,
+	        best > 0 ? instructions / best / 1e6 : 0.0,
+	        best > 0 ? cycles / best / 1e6 : 0.0);
+	if (tier->run == Run8080)
+	  interp = best;
+	else if (interp > 0 && best > 0)
+	  fprintf(bench->out, ", \"vs_interp\": %.2f", interp / best);
+	fprintf(bench->out, " }");
+	fflush(bench->out);
+  }
+}
+
+/*
+ * attach the hooks of a core variant, the trace is written to
+ * /dev/null so the file system stays out of the timing
+ * @return 0 on success, -1 when a hook can't be set up
+ */
+static int enableHooks(State8080 *state, unsigned features)
+{
+  if ((features & CORE8080_PROFILE) && EnableProfile8080(state, 1))
+	return -1;
+  if ((features & CORE8080_TRACE) && EnableTrace8080(state, "/dev/null", 0))
+	return -1;
+  if ((features & CORE8080_COVERAGE) && EnableCoverage8080(state))
+	return -1;
+  SelectCore8080(state, features);
+  return 0;
+}
+
+static void disableHooks(State8080 *state)
+{
+  DisableCoverage8080(state);
+  DisableTrace8080(state);
+  DisableProfile8080(state);
+}
+
+/*
+ * time a kernel on every variant of the interpreter, each with its
+ * hooks attached
+ * @return 0 on success, -1 when a hook can't be set up
+ */
+static int benchCores(Bench *bench, const Kernel *kernel)
+{
+  uint64_t instructions;
+  State8080 state;
+  int c, r;
+
+  loadMachine(&state, kernel->code, kernel->size, 0);
+  instructions = runMachine(&state, &tiers[0], bench->cycles);
+  FreeMemory8080(&state);
+
+  for (c = 0; c < CORE8080_COUNT; c++)
+  {
+	const Core8080 *core = &cores8080[c];
+	double best = 0;
+	uint64_t cycles = 0;
+
+	for (r = 0; r < bench->repeat; r++)
+	{
+	  double start;
+
+	  loadMachine(&state, kernel->code, kernel->size, 0);
+	  if (enableHooks(&state, core->features))
+	  {
+		disableHooks(&state);
+		FreeMemory8080(&state);
+		return -1;
+	  }
+	  start = now();
+	  runMachine(&state, &tiers[1], bench->cycles);
+	  start = now() - start;
+	  if (r == 0 || start < best)
+		best = start;
+	  cycles = state.cycles;
+	  disableHooks(&state);
+	  FreeMemory8080(&state);
+	}
+
+	beginResult(bench, "core", kernel->name);
+	fprintf(bench->out, ", \"core\": \"%s\", \"instructions\": %llu, "
+	        "\"cycles\": %llu, \"seconds\": %.6f, \"mips\": %.2f, "
+	        "\"mhz\": %.2f }", core->name, (unsigned long long)instructions,
+	        (unsigned long long)cycles, best,
+	        best > 0 ? instructions / best / 1e6 : 0.0,
+	        best > 0 ? cycles / best / 1e6 : 0.0);
+	fflush(bench->out);
+  }
+  return 0;
+}
+
+/*
+ * fork LOCKSTEP_LANES machines from one with a kernel loaded, each
+ * with its own register values so data and branches can differ
+ */
+static void loadLanes(State8080 *lanes, const Kernel *kernel)
+{
+  State8080 image;
+  int n;
+
+  loadMachine(&image, kernel->code, kernel->size, 0);
+  for (n = 0; n < LOCKSTEP_LANES; n++)
+  {
+	Fork8080(&image, &lanes[n]);
+	lanes[n].b = n;
+	lanes[n].c = n * 3;
+	lanes[n].d = n ^ 0x5a;
+	lanes[n].e = ~n;
+  }
+  FreeMemory8080(&image);
+}
+
+/*
+ * a kernel on LOCKSTEP_LANES machines, run one after the other by
+ * the interpreter and all together by the lockstep engine, both with
+ * bench->cycles machine states in total. vs_scalar above 1 is faster.
+ * @return 0 on success, -1 when out of memory
+ */
+static int benchLockstep(Bench *bench, const Kernel *kernel)
+{
+  static State8080 lanes[LOCKSTEP_LANES];
+  uint64_t budget = bench->cycles / LOCKSTEP_LANES, cycles = 0;
+  uint64_t simdSteps = 0, scalarSteps = 0, emulatedSteps = 0;
+  double scalar = 0, lockstep = 0;
+  int n, r;
+
+  for (r = 0; r < bench->repeat; r++)
+  {
+	double start;
+
+	loadLanes(lanes, kernel);
+	start = now();
+	for (n = 0; n < LOCKSTEP_LANES; n++)
+	  runMachine(&lanes[n], &tiers[1], budget);
+	start = now() - start;
+	if (r == 0 || start < scalar)
+	  scalar = start;
+	for (n = 0; n < LOCKSTEP_LANES; n++)
+	  FreeMemory8080(&lanes[n]);
+  }
+
+  for (r = 0; r < bench->repeat; r++)
+  {
+	Lockstep8080 *engine = CreateLockstep8080(LOCKSTEP_LANES);
+	double start;
+
+	if (!engine)
+	  return -1;
+	loadLanes(lanes, kernel);
+	for (n = 0; n < LOCKSTEP_LANES; n++)
+	  LoadLane8080(engine, n, &lanes[n]);
+	start = now();
+	RunLockstep8080(engine, budget);
+	start = now() - start;
+	if (r == 0 || start < lockstep)
+	  lockstep = start;
+	for (cycles = 0, n = 0; n < LOCKSTEP_LANES; n++)
+	{
+	  cycles += engine->cycles[n];
+	  FreeMemory8080(&lanes[n]);
+	}
+	simdSteps = engine->simdSteps;
+	scalarSteps = engine->scalarSteps;
+	emulatedSteps = engine->emulatedSteps;
+	DestroyLockstep8080(engine);
+  }
+
+  beginResult(bench, "lockstep", kernel->name);
+  fprintf(bench->out, ", \"lanes\": %d, \"cycles\": %llu, "
+          "\"scalar_seconds\": %.6f, \"lockstep_seconds\": %.6f, "
+          "\"mhz\": %.2f, \"simd_steps\": %llu, \"scalar_steps\": %llu, "
+          "\"emulated_steps\": %llu, \"vs_scalar\": %.2f }", LOCKSTEP_LANES,
+          (unsigned long long)cycles, scalar, lockstep,
+          lockstep > 0 ? cycles / lockstep / 1e6 : 0.0,
+          (unsigned long long)simdSteps, (unsigned long long)scalarSteps,
+          (unsigned long long)emulatedSteps,
+          lockstep > 0 ? scalar / lockstep : 0.0);
+  fflush(bench->out);
+  return 0;
+}
+
+static void dirtyPages(State8080 *state, uint8_t value)
+{
+  int n;
+
+  for (n = 0; n < SNAPSHOT_PAGES; n++)
+	writeMemory8080(state, 0x4000 + n * PAGE8080_SIZE, value);
+}
+
+static void putOpResult(Bench *bench, const char *name, double seconds,
+                        size_t bytes)
+{
+  beginResult(bench, "snapshot", name);
+  fprintf(bench->out, ", \"pages\": %d, \"ops\": %d, \"seconds\": %.6f, "
+          "\"ns_per_op\": %.1f, \"bytes\": %zu }", SNAPSHOT_PAGES,
+          SNAPSHOT_OPS, seconds, seconds / SNAPSHOT_OPS * 1e9, bytes);
+}
+
+/*
+ * fork, restore and save state cost of a machine with the call
+ * kernel loaded and SNAPSHOT_PAGES pages written before each op
+ */
+static int benchSnapshot(Bench *bench)
+{
+  State8080 state, snapshot, child;
+  size_t bufferSize = (PAGE8080_COUNT + 1) * (PAGE8080_SIZE + 1) + 256;
+  uint8_t *buffer = malloc(bufferSize);
+  FILE *file;
+  double start;
+  size_t bytes = 0;
+  int i;
+
+  if (!buffer)
+	return -1;
+  file = fmemopen(buffer, bufferSize, "wb");
+  if (!file)
+  {
+	free(buffer);
+	return -1;
+  }
+  loadMachine(&state, callKernel, sizeof(callKernel), 0);
+  dirtyPages(&state, 1);
+
+  start = now();
+  for (i = 0; i < SNAPSHOT_OPS; i++)
+  {
+	Fork8080(&state, &child);
+	dirtyPages(&child, i);
+	FreeMemory8080(&child);
+  }
+  putOpResult(bench, "fork", now() - start, 0);
+
+  Fork8080(&state, &snapshot);
+  start = now();
+  for (i = 0; i < SNAPSHOT_OPS; i++)
+  {
+	dirtyPages(&state, i);
+	Restore8080(&state, &snapshot);
+  }
+  putOpResult(bench, "restore", now() - start, 0);
+
+  start = now();
+  for (i = 0; i < SNAPSHOT_OPS; i++)
+  {
+	dirtyPages(&state, i);
+	rewind(file);
+	SaveState8080(file, &state, SAVE8080_FULL, NULL, 0);
+	bytes = ftell(file);
+  }
+  putOpResult(bench, "save_full", now() - start, bytes);
+
+  start = now();
+  for (i = 0; i < SNAPSHOT_OPS; i++)
+  {
+	dirtyPages(&state, i);
+	rewind(file);
+	SaveState8080(file, &state, SAVE8080_DELTA, NULL, 0);
+	bytes = ftell(file);
+  }
+  putOpResult(bench, "save_delta", now() - start, bytes);
+
+  fclose(file);
+  free(buffer);
+  FreeMemory8080(&snapshot);
+  FreeMemory8080(&state);
+  return 0;
+}
+
+/*
+ * frame conversion cost of the 256x224 arcade layout at 0x2400 for
+ * every kernel, format and rotation, with every line and with
+ * VIDEO_DIRTY lines written before each frame
+ */
+static int benchVideo(Bench *bench)
+{
+  static const char *kernelNames[] = { NULL, "scalar", "sse2", "avx2" };
+  VideoConfig8080 config = {
+	0x2400, 256, 224, VIDEO8080_ROTATE_NONE, VIDEO8080_RGBA,
+	{ 0xff, 0xff, 0xff, 0xff }, { 0, 0, 0, 0xff }, VIDEO8080_KERNEL_SCALAR
+  };
+  uint32_t seed = 0x8080;
+  State8080 state;
+  int kernel, format, rotate, full, i, line;
+
+  memset(&state, 0, sizeof(state));
+  InitMemory8080(&state);
+  for (i = 0x2400; i < 0x4000; i++)
+	writeMemory8080(&state, i, nextRandom(&seed));
+
+  for (kernel = VIDEO8080_KERNEL_SCALAR; kernel <= VIDEO8080_KERNEL_AVX2;
+	   kernel++)
+	for (format = VIDEO8080_RGBA; format <= VIDEO8080_GRAY; format++)
+	  for (rotate = VIDEO8080_ROTATE_NONE; rotate <= VIDEO8080_ROTATE_CCW;
+		   rotate++)
+		for (full = 1; full >= 0; full--)
+		{
+		  char name[64];
+		  uint64_t lines;
+		  double start, seconds;
+
+		  config.kernel = kernel;
+		  config.format = format;
+		  config.rotate = rotate;
+		  if (EnableVideo8080(&state, &config))
+			continue; // the host lacks the kernel
+		  RenderFrame8080(&state);
+		  lines = state.video->linesConverted;
+		  start = now();
+		  for (i = 0; i < VIDEO_FRAMES; i++)
+		  {
+			for (line = 0; line < (full ? 224 : VIDEO_DIRTY); line++)
+			  writeMemory8080(&state, 0x2400 + (line * 29 + i) % 224 * 32,
+			                  i);
+			RenderFrame8080(&state);
+		  }
+		  seconds = now() - start;
+		  lines = state.video->linesConverted - lines;
+		  DisableVideo8080(&state);
+
+		  snprintf(name, sizeof(name), "%s_%s%s_%s", kernelNames[kernel],
+		           format == VIDEO8080_GRAY ? "gray" : "rgba",
+		           rotate == VIDEO8080_ROTATE_CCW ? "_ccw" : "",
+		           full ? "full" : "dirty");
+		  beginResult(bench, "video", name);
+		  fprintf(bench->out, ", \"frames\": %d, \"lines_per_frame\": %.1f, "
+		          "\"seconds\": %.6f, \"ns_per_frame\": %.1f }",
+		          VIDEO_FRAMES, (double)lines / VIDEO_FRAMES, seconds,
+		          seconds / VIDEO_FRAMES * 1e9);
+		}
+
+  FreeMemory8080(&state);
+  return 0;
+}
+
+/*
+ * run the disassembler on a file with its output thrown away
+ * @return seconds taken, negative when it could not be run
+ */
+static double runDisassembler(const char *program, const char *path,
+                              int threads)
+{
+  char threadArg[16];
+  double start = now();
+  int status;
+  pid_t pid;
+
+  snprintf(threadArg, sizeof(threadArg), "%d", threads);
+  pid = fork();
+  if (pid < 0)
+	return -1;
+  if (pid == 0)
+  {
+	int null = open("/dev/null", O_WRONLY);
+
+	if (null >= 0)
+	  dup2(null, STDOUT_FILENO);
+	execl(program, program, "-j", threadArg, path, (char *)NULL);
+	_exit(127);
+  }
+  if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	  WEXITSTATUS(status) != 0)
+	return -1;
+  return now() - start;
+}
+
+static void putRateResult(Bench *bench, const char *name, int threads,
+                          size_t bytes, double seconds)
+{
+  beginResult(bench, "disassembler", name);
+  fprintf(bench->out, ", \"threads\": %d, \"bytes\": %zu, "
+          "\"seconds\": %.6f, \"bytes_per_sec\": %.0f }", threads, bytes,
+          seconds, seconds > 0 ? bytes / seconds : 0.0);
+}
+
+/*
+ * linear disassembly through the disassembler binary, on one thread
+ * and on all cores, and flow graphs built in process
+ * @param program path of the disassembler, NULL to skip those runs
+ */
+static int benchDisassembler(Bench *bench, const char *program)
+{
+  static const int threadCounts[] = { 1, 0 };
+  uint8_t *data = malloc(DISASM_BYTES);
+  uint16_t entries[FLOW_ENTRIES];
+  char indexPath[] = "/tmp/bench8080XXXXXX";
+  FlowGraph8080 *index = NULL;
+  size_t i;
+  double start;
+  int r, indexFd;
+
+  if (!data)
+	return -1;
+  fillRandom(data, DISASM_BYTES);
+
+  if (program)
+  {
+	char path[] = "/tmp/bench8080XXXXXX";
+	int fd = mkstemp(path);
+
+	if (fd < 0 || write(fd, data, DISASM_BYTES) != (ssize_t)DISASM_BYTES)
+	{
+	  fprintf(stderr, "can't write the disassembler input!\n");
+	  program = NULL;
+	}
+	if (fd >= 0)
+	  close(fd);
+	for (i = 0; program && i < 2; i++)
+	{
+	  double best = -1;
+
+	  for (r = 0; r < bench->repeat; r++)
+	  {
+		double seconds = runDisassembler(program, path, threadCounts[i]);
+
+		if (seconds < 0)
+		{
+		  fprintf(stderr, "failed to run %s!\n", program);
+		  program = NULL;
+		  break;
+		}
+		if (best < 0 || seconds < best)
+		  best = seconds;
+	  }
+	  if (program)
+		putRateResult(bench, "linear", threadCounts[i], DISASM_BYTES, best);
+	}
+	unlink(path);
+  }
+
+  for (i = 0; i < FLOW_ENTRIES; i++)
+	entries[i] = i << 8;
+  start = now();
+  for (r = 0; r < FLOW_OPS; r++)
+  {
+	FlowGraph8080 *graph = BuildFlowGraph8080(data, 0, 0x10000, entries,
+	                                          FLOW_ENTRIES);
+
+	if (!graph)
+	{
+	  free(data);
+	  return -1;
+	}
+	if (r == FLOW_OPS - 1)
+	  index = graph;
+	else
+	  FreeFlowGraph8080(graph);
+  }
+  putRateResult(bench, "flow_graph", 1, (size_t)0x10000 * FLOW_OPS,
+                now() - start);
+
+  // the same graph mapped back from its index, as the tools do
+  indexFd = mkstemp(indexPath);
+  if (indexFd >= 0)
+	close(indexFd);
+  if (indexFd < 0 || SaveFlowGraph8080(index, indexPath))
+	fprintf(stderr, "can't write the flow graph index!\n");
+  else
+  {
+	start = now();
+	for (r = 0; r < FLOW_OPS; r++)
+	{
+	  FlowGraph8080 *graph = OpenFlowGraph8080(indexPath, data, 0, 0x10000,
+	                                           entries, FLOW_ENTRIES);
+
+	  if (!graph)
+		break;
+	  FreeFlowGraph8080(graph);
+	}
+	if (r == FLOW_OPS)
+	  putRateResult(bench, "flow_graph_index", 1,
+	                (size_t)0x10000 * FLOW_OPS, now() - start);
+  }
+  if (indexFd >= 0)
+	unlink(indexPath);
+  FreeFlowGraph8080(index);
+  free(data);
+  return 0;
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-c cycles per run] [-r repeat] [-o rom load address]\n"
+          "       [-d disassembler binary] [-O output.json] [rom...]\n"
+          "       times the instruction mix kernels and each rom on every\n"
+          "       tier, the kernels on every interpreter variant and on\n"
+          "       many machines in lockstep, fork and save state cost, frame\n"
+          "       conversion and disassembly, and writes the results as JSON\n",
+          name);
+}
+
+int main(int argc, char **argv)
+{
+  Bench bench = { DEFAULT_CYCLES, DEFAULT_REPEAT, stdout, 1 };
+  const char *disassembler = NULL, *outPath = NULL;
+  uint16_t loadAddress = 0;
+  size_t k;
+  int opt, i, ret = 0;
+
+  while ((opt = getopt(argc, argv, "c:r:o:d:O:")) != -1)
+  {
+	switch (opt)
+	{
+	  case 'c': bench.cycles = strtoull(optarg, NULL, 0); break;
+	  case 'r': bench.repeat = atoi(optarg); break;
+	  case 'o': loadAddress = strtoul(optarg, NULL, 0); break;
+	  case 'd': disassembler = optarg; break;
+	  case 'O': outPath = optarg; break;
+	  default:
+		usage(argv[0]);
+		return 1;
+	}
+  }
+  if (bench.repeat <= 0 || !bench.cycles)
+  {
+	usage(argv[0]);
+	return 1;
+  }
+  if (outPath)
+  {
+	bench.out = fopen(outPath, "w");
+	if (!bench.out)
+	{
+	  printf("failed to open %s!\n", outPath);
+	  return 1;
+	}
+  }
+
+  fprintf(bench.out, "{\n  \"version\": %d,\n  \"cflags\": \"%s\",\n"
+          "  \"cycles\": %llu,\n  \"repeat\": %d,\n  \"results\": [",
+          BENCH8080_VERSION, BENCH8080_CFLAGS,
+          (unsigned long long)bench.cycles, bench.repeat);
+
+  for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+	benchProgram(&bench, "kernel", kernels[k].name, kernels[k].code,
+	             kernels[k].size, 0);
+
+  for (i = optind; i < argc; i++)
+  {
+	size_t size;
+	uint8_t *rom = ReadFile8080(argv[i], &size);
+
+	if (!rom)
+	{
+	  fprintf(stderr, "failed to open %s!\n", argv[i]);
+	  ret = 1;
+	  continue;
+	}
+	benchProgram(&bench, "rom", argv[i], rom, size, loadAddress);
+	free(rom);
+  }
+
+  for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+	if (benchCores(&bench, &kernels[k]))
+	{
+	  fprintf(stderr, "failed to set up the hooks of %s!\n",
+	          kernels[k].name);
+	  ret = 1;
+	}
+
+  for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+	if (benchLockstep(&bench, &kernels[k]))
+	{
+	  fprintf(stderr, "out of memory!\n");
+	  ret = 1;
+	}
+
+  if (benchSnapshot(&bench) || benchVideo(&bench) ||
+	  benchDisassembler(&bench, disassembler))
+  {
+	fprintf(stderr, "out of memory!\n");
+	ret = 1;
+  }
+
+  fprintf(bench.out, "\n  ]\n}\n");
+  if (outPath && fclose(bench.out))
+	ret = 1;
+  return ret;
+}
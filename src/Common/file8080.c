@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "file8080.h"
+
+/*
+ * read a whole file into a malloc'd buffer
+ * @param size set to the length of the file
+ * @return the buffer, free it with free, NULL on error
+ */
+uint8_t *ReadFile8080(const char *path, size_t *size)
+{
+  FILE *fHandle = fopen(path, "rb");
+  uint8_t *buffer;
+  long fsize;
+
+  if (!fHandle)
+	return NULL;
+  fseek(fHandle, 0L, SEEK_END);
+  fsize = ftell(fHandle);
+  fseek(fHandle, 0L, SEEK_SET);
+  buffer = fsize >= 0 ? malloc(fsize ? fsize : 1) : NULL;
+  if (buffer && fread(buffer, 1, fsize, fHandle) != (size_t)fsize)
+  {
+	free(buffer);
+	buffer = NULL;
+  }
+  fclose(fHandle);
+  *size = fsize;
+  return buffer;
+}
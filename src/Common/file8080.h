@@ -0,0 +1,14 @@
+#ifndef FILE_8080_H
+#define FILE_8080_H
+
+/*
+ * file8080.h
+ * file helpers shared by the tools
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint8_t *ReadFile8080(const char *path, size_t *size);
+
+#endif
@@ -0,0 +1,502 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "opcodes8080.h"
+#include "flowGraph8080.h"
+
+#define FLOW_MAGIC "8080FLOW"
+#define FLOW_MAGIC_LENGTH 8
+#define FLOW_HEADER_SIZE 32
+#define FLOW_BYTE_ORDER 0x01020304 // reads back differently on big endian
+
+/*
+ * the index file is the in-memory layout, keep the records packed
+ */
+_Static_assert(sizeof(FlowBlock8080) == 28, "FlowBlock8080 layout");
+_Static_assert(sizeof(FlowEdge8080) == 8, "FlowEdge8080 layout");
+
+/*
+ * per address marks while building
+ */
+#define MARK_INSN     0x01 // an instruction starts here
+#define MARK_LEADER   0x02 // a block must start here
+#define MARK_CONT     0x04 // reached by falling through inside a block
+#define MARK_ENTRY    0x08
+#define MARK_FUNCTION 0x10
+
+/*
+ * file header, also the first bytes of graph->storage
+ */
+typedef struct FlowHeader8080 {
+	char magic[FLOW_MAGIC_LENGTH];
+	uint16_t version;
+	uint16_t headerSize;
+	uint32_t byteOrder;
+	uint32_t imageHash;
+	uint32_t blockCount;
+	uint32_t edgeCount;
+	uint32_t xrefCount;
+}FlowHeader8080;
+
+_Static_assert(sizeof(FlowHeader8080) == FLOW_HEADER_SIZE, "header layout");
+
+typedef struct FlowBuilder8080 {
+	const uint8_t *image;
+	uint16_t origin;
+	size_t size;
+	uint8_t *marks;
+	uint16_t *stack;
+	size_t depth;
+}FlowBuilder8080;
+
+/*
+ * FNV-1a of an image, stored in the index to spot stale graphs
+ */
+uint32_t FlowImageHash8080(const uint8_t *image, size_t size)
+{
+  uint32_t hash = 2166136261u;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+	hash = (hash ^ image[i]) * 16777619u;
+  return hash;
+}
+
+static inline int inImage(const FlowBuilder8080 *b, uint16_t addr)
+{
+  return (uint16_t)(addr - b->origin) < b->size;
+}
+
+static inline uint8_t imageByte(const FlowBuilder8080 *b, uint16_t addr)
+{
+  return inImage(b, addr) ? b->image[(uint16_t)(addr - b->origin)] : 0;
+}
+
+static inline uint16_t target(const FlowBuilder8080 *b, uint16_t addr)
+{
+  return imageByte(b, addr + 1) | (imageByte(b, addr + 2) << 8);
+}
+
+/*
+ * queue a block start inside the image
+ */
+static void pushLeader(FlowBuilder8080 *b, uint16_t addr, uint8_t marks)
+{
+  if (!inImage(b, addr))
+	return;
+  if (!(b->marks[addr] & MARK_LEADER))
+	b->stack[b->depth++] = addr;
+  b->marks[addr] |= MARK_LEADER | marks;
+}
+
+/*
+ * walk every path from the queued leaders, marking instructions
+ */
+static void traceCode(FlowBuilder8080 *b)
+{
+  while (b->depth > 0)
+  {
+	uint16_t addr = b->stack[--b->depth];
+	int stop = 0;
+
+	while (!stop && inImage(b, addr) && !(b->marks[addr] & MARK_INSN))
+	{
+	  uint8_t opcode = imageByte(b, addr);
+	  const OpcodeInfo8080 *info = &opcodeTable8080[opcode];
+	  uint16_t next = addr + info->length;
+
+	  b->marks[addr] |= MARK_INSN;
+	  stop = 1;
+	  switch (info->kind)
+	  {
+		case OPK_JMP:
+		  pushLeader(b, target(b, addr), 0);
+		  break;
+		case OPK_JCC:
+		  pushLeader(b, target(b, addr), 0);
+		  pushLeader(b, next, 0);
+		  break;
+		case OPK_CALL:
+		case OPK_CCC:
+		  pushLeader(b, target(b, addr), MARK_FUNCTION);
+		  pushLeader(b, next, 0);
+		  break;
+		case OPK_RST:
+		  pushLeader(b, opcode & 0x38, MARK_FUNCTION);
+		  pushLeader(b, next, 0);
+		  break;
+		case OPK_RCC:
+		case OPK_HLT:
+		  pushLeader(b, next, 0);
+		  break;
+		case OPK_RET:
+		case OPK_PCHL:
+		  break;
+		default:
+		  stop = 0;
+		  addr = next;
+		  break;
+	  }
+	}
+  }
+}
+
+/*
+ * successors of the last instruction of a block
+ * @return number of edges written
+ */
+static int blockEdges(const FlowBuilder8080 *b, uint16_t last,
+                      FlowEdge8080 *edges)
+{
+  uint8_t opcode = imageByte(b, last);
+  const OpcodeInfo8080 *info = &opcodeTable8080[opcode];
+  uint16_t next = last + info->length;
+  int n = 0;
+
+  memset(edges, 0, 2 * sizeof(FlowEdge8080));
+  switch (info->kind)
+  {
+	case OPK_JMP:
+	case OPK_JCC:
+	  edges[n].type = EDGE_JUMP;
+	  edges[n++].to = target(b, last);
+	  break;
+	case OPK_CALL:
+	case OPK_CCC:
+	  edges[n].type = EDGE_CALL;
+	  edges[n++].to = target(b, last);
+	  break;
+	case OPK_RST:
+	  edges[n].type = EDGE_CALL;
+	  edges[n++].to = opcode & 0x38;
+	  break;
+	default:
+	  break;
+  }
+  if (info->kind != OPK_JMP && info->kind != OPK_RET &&
+	  info->kind != OPK_PCHL && inImage(b, next))
+  {
+	edges[n].type = EDGE_FALL;
+	edges[n++].to = next;
+  }
+  edges[0].from = edges[1].from = last;
+  return n;
+}
+
+static int endsBlock(uint8_t kind)
+{
+  return kind != OPK_NONE && kind != OPK_IN && kind != OPK_OUT &&
+         kind != OPK_EI && kind != OPK_DI;
+}
+
+/*
+ * build the control flow graph of an image
+ * @param image bytes loaded at origin
+ * @param origin address of image[0]
+ * @param size bytes in the image, at most 64 KiB
+ * @param entries addresses to start from, NULL for just origin
+ * @param entryCount number of entries
+ * @return the graph, NULL when out of memory
+ */
+FlowGraph8080 *BuildFlowGraph8080(const uint8_t *image, uint16_t origin,
+                                  size_t size, const uint16_t *entries,
+                                  size_t entryCount)
+{
+  FlowBuilder8080 b = { image, origin, size > 0x10000 ? 0x10000 : size,
+                        NULL, NULL, 0 };
+  FlowGraph8080 *graph = calloc(1, sizeof(FlowGraph8080));
+  FlowBlock8080 *blocks = NULL;
+  FlowEdge8080 *edges = NULL;
+  int32_t *blockAt = NULL;
+  uint32_t *xrefs = NULL, *fill = NULL;
+  uint32_t blockCount = 0, edgeCount = 0, xrefCount = 0, i;
+  FlowHeader8080 *header;
+  size_t n;
+
+  b.marks = calloc(0x10000, 1);
+  b.stack = malloc((0x10000 + entryCount + 1) * sizeof(uint16_t));
+  blocks = malloc(0x10000 * sizeof(FlowBlock8080));
+  edges = malloc(2 * 0x10000 * sizeof(FlowEdge8080));
+  blockAt = malloc(0x10000 * sizeof(int32_t));
+  if (!graph || !b.marks || !b.stack || !blocks || !edges || !blockAt)
+	goto fail;
+
+  if (!entries || entryCount == 0)
+	pushLeader(&b, origin, MARK_ENTRY);
+  for (n = 0; entries && n < entryCount; n++)
+	pushLeader(&b, entries[n], MARK_ENTRY);
+  traceCode(&b);
+
+  // cut the marked instructions into blocks, in address order
+  memset(blockAt, 0xff, 0x10000 * sizeof(int32_t));
+  for (n = 0; n < b.size; n++)
+  {
+	uint16_t addr = origin + n, last = addr;
+	FlowBlock8080 *block = &blocks[blockCount];
+	uint8_t marks = b.marks[addr];
+
+	if (!(marks & MARK_INSN) ||
+		((marks & MARK_CONT) && !(marks & MARK_LEADER)))
+	  continue;
+	memset(block, 0, sizeof(FlowBlock8080));
+	block->start = addr;
+	block->flags = (marks & MARK_ENTRY ? FLOW_ENTRY : 0) |
+	               (marks & MARK_FUNCTION ? FLOW_FUNCTION : 0);
+	for (;;)
+	{
+	  const OpcodeInfo8080 *info = &opcodeTable8080[imageByte(&b, last)];
+	  uint16_t next = last + info->length;
+
+	  block->count++;
+	  block->length += info->length;
+	  block->end = info->kind;
+	  if (endsBlock(info->kind) || !inImage(&b, next) ||
+		  !(b.marks[next] & MARK_INSN) || (b.marks[next] & MARK_LEADER) ||
+		  block->length >= b.size)
+		break;
+	  b.marks[next] |= MARK_CONT;
+	  last = next;
+	}
+	block->firstEdge = edgeCount;
+	block->edgeCount = blockEdges(&b, last, &edges[edgeCount]);
+	edgeCount += block->edgeCount;
+	blockAt[addr] = blockCount++;
+  }
+
+  // references, grouped by the block they lead to
+  for (i = 0; i < edgeCount; i++)
+	if (blockAt[edges[i].to] >= 0)
+	{
+	  blocks[blockAt[edges[i].to]].xrefCount++;
+	  xrefCount++;
+	}
+  fill = calloc(blockCount + 1, sizeof(uint32_t));
+  if (!fill)
+	goto fail;
+  for (i = 0, n = 0; i < blockCount; i++)
+  {
+	blocks[i].firstXref = n;
+	fill[i] = n;
+	n += blocks[i].xrefCount;
+  }
+
+  graph->storageSize = FLOW_HEADER_SIZE + blockCount * sizeof(FlowBlock8080) +
+                       edgeCount * sizeof(FlowEdge8080) +
+                       xrefCount * sizeof(uint32_t);
+  graph->storage = calloc(1, graph->storageSize);
+  if (!graph->storage)
+	goto fail;
+  header = graph->storage;
+  memcpy(header->magic, FLOW_MAGIC, FLOW_MAGIC_LENGTH);
+  header->version = FLOW_VERSION;
+  header->headerSize = FLOW_HEADER_SIZE;
+  header->byteOrder = FLOW_BYTE_ORDER;
+  header->imageHash = FlowImageHash8080(image, b.size);
+  header->blockCount = blockCount;
+  header->edgeCount = edgeCount;
+  header->xrefCount = xrefCount;
+
+  graph->imageHash = header->imageHash;
+  graph->blockCount = blockCount;
+  graph->edgeCount = edgeCount;
+  graph->xrefCount = xrefCount;
+  graph->blocks = (FlowBlock8080 *)((char *)graph->storage + FLOW_HEADER_SIZE);
+  graph->edges = (FlowEdge8080 *)(graph->blocks + blockCount);
+  graph->xrefs = (uint32_t *)(graph->edges + edgeCount);
+  xrefs = (uint32_t *)graph->xrefs;
+  memcpy((FlowBlock8080 *)graph->blocks, blocks,
+         blockCount * sizeof(FlowBlock8080));
+  memcpy((FlowEdge8080 *)graph->edges, edges,
+         edgeCount * sizeof(FlowEdge8080));
+  for (i = 0; i < edgeCount; i++)
+	if (blockAt[edges[i].to] >= 0)
+	  xrefs[fill[blockAt[edges[i].to]]++] = i;
+
+  free(fill);
+  free(blockAt);
+  free(edges);
+  free(blocks);
+  free(b.stack);
+  free(b.marks);
+  return graph;
+
+fail:
+  free(fill);
+  free(blockAt);
+  free(edges);
+  free(blocks);
+  free(b.stack);
+  free(b.marks);
+  FreeFlowGraph8080(graph);
+  return NULL;
+}
+
+/*
+ * write the index file of a graph
+ * @return 0 on success, -1 on failure
+ */
+int SaveFlowGraph8080(const FlowGraph8080 *graph, const char *path)
+{
+  FILE *file = fopen(path, "wb");
+  int ret = 0;
+
+  if (!file)
+	return -1;
+  if (fwrite(graph->storage, 1, graph->storageSize, file) != graph->storageSize)
+	ret = -1;
+  if (fclose(file))
+	ret = -1;
+  return ret;
+}
+
+/*
+ * check that every index in a mapped graph stays inside its arrays
+ */
+static int validGraph(const FlowGraph8080 *graph)
+{
+  uint32_t i;
+
+  for (i = 0; i < graph->blockCount; i++)
+  {
+	const FlowBlock8080 *block = &graph->blocks[i];
+
+	if (block->firstEdge > graph->edgeCount ||
+		block->edgeCount > graph->edgeCount - block->firstEdge ||
+		block->firstXref > graph->xrefCount ||
+		block->xrefCount > graph->xrefCount - block->firstXref)
+	  return 0;
+  }
+  for (i = 0; i < graph->xrefCount; i++)
+	if (graph->xrefs[i] >= graph->edgeCount)
+	  return 0;
+  return 1;
+}
+
+/*
+ * map an index file written by SaveFlowGraph8080
+ * @return the graph, NULL if the file is missing, damaged or from
+ * a host with another byte order
+ */
+FlowGraph8080 *LoadFlowGraph8080(const char *path)
+{
+  FlowGraph8080 *graph = calloc(1, sizeof(FlowGraph8080));
+  const FlowHeader8080 *header;
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+
+  if (!graph || fd < 0 || fstat(fd, &st) || st.st_size < FLOW_HEADER_SIZE)
+	goto fail;
+  graph->storageSize = st.st_size;
+  graph->storage = mmap(NULL, graph->storageSize, PROT_READ, MAP_PRIVATE,
+                        fd, 0);
+  if (graph->storage == MAP_FAILED)
+  {
+	graph->storage = NULL;
+	goto fail;
+  }
+  graph->mapped = 1;
+  close(fd);
+  fd = -1;
+
+  header = graph->storage;
+  if (memcmp(header->magic, FLOW_MAGIC, FLOW_MAGIC_LENGTH) ||
+	  header->version != FLOW_VERSION ||
+	  header->headerSize != FLOW_HEADER_SIZE ||
+	  header->byteOrder != FLOW_BYTE_ORDER ||
+	  graph->storageSize != FLOW_HEADER_SIZE +
+	    (size_t)header->blockCount * sizeof(FlowBlock8080) +
+	    (size_t)header->edgeCount * sizeof(FlowEdge8080) +
+	    (size_t)header->xrefCount * sizeof(uint32_t))
+	goto fail;
+  graph->imageHash = header->imageHash;
+  graph->blockCount = header->blockCount;
+  graph->edgeCount = header->edgeCount;
+  graph->xrefCount = header->xrefCount;
+  graph->blocks = (const FlowBlock8080 *)((const char *)graph->storage +
+                                         FLOW_HEADER_SIZE);
+  graph->edges = (const FlowEdge8080 *)(graph->blocks + graph->blockCount);
+  graph->xrefs = (const uint32_t *)(graph->edges + graph->edgeCount);
+  if (!validGraph(graph))
+	goto fail;
+  return graph;
+
+fail:
+  if (fd >= 0)
+	close(fd);
+  FreeFlowGraph8080(graph);
+  return NULL;
+}
+
+/*
+ * the graph of an image from its index file, built from the image
+ * when there is no index or it was written for other bytes
+ * @param path index file written by SaveFlowGraph8080, NULL to build
+ * @param image, origin, size, entries, entryCount as for
+ * BuildFlowGraph8080, the entries only matter when building
+ * @return the graph, NULL when out of memory
+ */
+FlowGraph8080 *OpenFlowGraph8080(const char *path, const uint8_t *image,
+                                 uint16_t origin, size_t size,
+                                 const uint16_t *entries, size_t entryCount)
+{
+  FlowGraph8080 *graph = path ? LoadFlowGraph8080(path) : NULL;
+
+  if (size > (size_t)0x10000 - origin)
+	size = 0x10000 - origin;
+  // same bytes at another origin put the blocks outside the image
+  if (graph && (graph->imageHash != FlowImageHash8080(image, size) ||
+	            (graph->blockCount &&
+	             (graph->blocks[0].start < origin ||
+	              (size_t)(graph->blocks[graph->blockCount - 1].start -
+	                       origin) >= size))))
+  {
+	FreeFlowGraph8080(graph);
+	graph = NULL;
+  }
+  if (!graph)
+	graph = BuildFlowGraph8080(image, origin, size, entries, entryCount);
+  return graph;
+}
+
+void FreeFlowGraph8080(FlowGraph8080 *graph)
+{
+  if (!graph)
+	return;
+  if (graph->mapped)
+	munmap(graph->storage, graph->storageSize);
+  else
+	free(graph->storage);
+  free(graph);
+}
+
+/*
+ * find the block an address lies in
+ * @return the block, NULL when the address isn't known code
+ */
+const FlowBlock8080 *FindBlock8080(const FlowGraph8080 *graph, uint16_t addr)
+{
+  uint32_t lo = 0, hi = graph->blockCount;
+
+  // last block starting at or before addr
+  while (lo < hi)
+  {
+	uint32_t mid = lo + (hi - lo) / 2;
+
+	if (graph->blocks[mid].start <= addr)
+	  lo = mid + 1;
+	else
+	  hi = mid;
+  }
+  if (lo == 0)
+	return NULL;
+  if ((uint32_t)(addr - graph->blocks[lo - 1].start) <
+	  graph->blocks[lo - 1].length)
+	return &graph->blocks[lo - 1];
+  return NULL;
+}
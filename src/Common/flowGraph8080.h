@@ -0,0 +1,79 @@
+#ifndef FLOW_GRAPH_8080_H
+#define FLOW_GRAPH_8080_H
+
+/*
+ * flowGraph8080.h
+ * control flow graph of an 8080 image, found by recursive descent
+ * from entry points through JMP/Jcc/CALL/Ccc/RST targets. blocks end
+ * at every control transfer and before every branch target. edges
+ * are kept per block (successors) and sorted by target (xrefs), so
+ * the call graph is the set of EDGE_CALL edges.
+ *
+ * the graph is saved as an index file that is mapped back in
+ * without parsing: a 32 byte header followed by the block, edge and
+ * xref arrays exactly as laid out below, little endian.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FLOW_VERSION 1
+
+/*
+ * FlowEdge8080 types
+ */
+#define EDGE_FALL 0 // falls through to the next instruction
+#define EDGE_JUMP 1 // JMP or taken Jcc
+#define EDGE_CALL 2 // CALL, Ccc or RST
+
+/*
+ * FlowBlock8080 flags
+ */
+#define FLOW_ENTRY    0x01 // an entry point passed to the builder
+#define FLOW_FUNCTION 0x02 // target of a call
+
+typedef struct FlowBlock8080 {
+	uint16_t start;
+	uint8_t end; // OpcodeKind8080 of the last instruction
+	uint8_t flags; // FLOW_* bits
+	uint32_t length; // bytes
+	uint32_t count; // instructions
+	uint32_t firstEdge; // successors, edges[firstEdge ...]
+	uint32_t edgeCount;
+	uint32_t firstXref; // references, xrefs[firstXref ...]
+	uint32_t xrefCount;
+}FlowBlock8080;
+
+typedef struct FlowEdge8080 {
+	uint16_t from; // address of the instruction taking the edge
+	uint16_t to; // target address, may lie outside the image
+	uint8_t type; // EDGE_* type
+	uint8_t pad[3];
+}FlowEdge8080;
+
+typedef struct FlowGraph8080 {
+	uint32_t imageHash; // FNV-1a of the image the graph was built from
+	uint32_t blockCount;
+	uint32_t edgeCount;
+	uint32_t xrefCount;
+	const FlowBlock8080 *blocks; // sorted by start
+	const FlowEdge8080 *edges; // grouped by source block
+	const uint32_t *xrefs; // edge indices, sorted by target
+	void *storage; // allocation or mapping behind the arrays
+	size_t storageSize;
+	int mapped;
+}FlowGraph8080;
+
+uint32_t FlowImageHash8080(const uint8_t *image, size_t size);
+FlowGraph8080 *BuildFlowGraph8080(const uint8_t *image, uint16_t origin,
+                                  size_t size, const uint16_t *entries,
+                                  size_t entryCount);
+int SaveFlowGraph8080(const FlowGraph8080 *graph, const char *path);
+FlowGraph8080 *LoadFlowGraph8080(const char *path);
+FlowGraph8080 *OpenFlowGraph8080(const char *path, const uint8_t *image,
+                                 uint16_t origin, size_t size,
+                                 const uint16_t *entries, size_t entryCount);
+void FreeFlowGraph8080(FlowGraph8080 *graph);
+const FlowBlock8080 *FindBlock8080(const FlowGraph8080 *graph, uint16_t addr);
+
+#endif
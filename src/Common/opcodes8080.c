@@ -0,0 +1,13 @@
+#include "opcodes8080.h"
+
+/*
+ * the opcode table, expanded from opcodes8080.def
+ */
+const OpcodeInfo8080 opcodeTable8080[256] = {
+#define OPCODE8080(code, mnemonic, length, cycles, cyclesTaken, \
+                   flagsRead, flagsWritten, kind, attr) \
+  [code] = { mnemonic, length, cycles, cyclesTaken, \
+             flagsRead, flagsWritten, kind, attr },
+#include "opcodes8080.def"
+#undef OPCODE8080
+};
@@ -0,0 +1,63 @@
+#ifndef OPCODES_8080_H
+#define OPCODES_8080_H
+
+#include <stdint.h>
+
+/*
+ * 8080 flag bits, laid out as in the PSW byte pushed by PUSH PSW
+ */
+#define FLAG_CY 0x01
+#define FLAG_P  0x04
+#define FLAG_AC 0x10
+#define FLAG_Z  0x40
+#define FLAG_S  0x80
+
+#define FLAGS_SZAP (FLAG_S | FLAG_Z | FLAG_AC | FLAG_P)
+#define FLAGS_ALL  (FLAGS_SZAP | FLAG_CY)
+
+/*
+ * control flow / event kind of an opcode
+ */
+enum OpcodeKind8080 {
+  OPK_NONE = 0,
+  OPK_JMP,    // unconditional jump
+  OPK_JCC,    // conditional jump
+  OPK_CALL,   // unconditional call
+  OPK_CCC,    // conditional call
+  OPK_RET,    // unconditional return
+  OPK_RCC,    // conditional return
+  OPK_RST,    // restart
+  OPK_PCHL,   // jump to HL
+  OPK_HLT,
+  OPK_IN,
+  OPK_OUT,
+  OPK_EI,
+  OPK_DI
+};
+
+/*
+ * opcode attribute bits
+ */
+#define OPA_BRANCH   0x01 // ends a basic block
+#define OPA_STOP     0x02 // hands control back to the run loop
+#define OPA_MEMREAD  0x04 // reads memory other than the instruction bytes
+#define OPA_MEMWRITE 0x08 // writes memory (stores and stack pushes)
+#define OPA_UNDOC    0x10 // undocumented alias of another opcode
+
+/*
+ * static description of a single opcode
+ */
+typedef struct OpcodeInfo8080 {
+	const char *mnemonic; // disassembly text without immediate operands
+	uint8_t length; // instruction length in bytes, 1 - 3
+	uint8_t cycles; // machine states (not taken for conditional CALL/RET)
+	uint8_t cyclesTaken; // machine states when a conditional CALL/RET is taken
+	uint8_t flagsRead; // FLAG_* bits the instruction depends on
+	uint8_t flagsWritten; // FLAG_* bits the instruction changes
+	uint8_t kind; // enum OpcodeKind8080
+	uint8_t attr; // OPA_* bits
+}OpcodeInfo8080;
+
+extern const OpcodeInfo8080 opcodeTable8080[256];
+
+#endif
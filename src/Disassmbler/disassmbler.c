@@ -1,320 +1,640 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-int Disassmble8080op(unsigned char *codeBuffer, size_t pc)
+#include "opcodes8080.h"
+#include "flowGraph8080.h"
+
+#define OUT_BUFFER_SIZE (1 << 20) // formatted text between writes
+#define LINE_MAX_LENGTH 64 // longest formatted line, with room to spare
+#define MAP_WINDOW ((size_t)64 << 20) // bytes of input mapped at a time
+#define READ_CHUNK (1 << 20) // bytes per read() for pipes
+#define CHUNK_SIZE ((size_t)1 << 20) // input bytes per parallel chunk
+#define MAX_OP_LENGTH 3
+#define MAX_ENTRIES 256 // -e entry points in recursive mode
+#define ADDRESS_SPACE 0x10000
+
+/*
+ * formatted output. with a file descriptor it is written out with
+ * one write() per fill, without one (fd < 0) it grows in memory.
+ */
+typedef struct OutBuffer {
+	char *data;
+	size_t length;
+	size_t capacity;
+	int fd;
+	int error;
+}OutBuffer;
+
+/*
+ * one chunk of a parallel run. the chunk is decoded from its start,
+ * and the paths from start + 1 and start + 2 are followed until they
+ * meet that path, so the chunk can be stitched on whichever offset
+ * the previous chunk ends at.
+ */
+typedef struct Chunk {
+	size_t start; // instructions starting in [start, stop)
+	size_t stop;
+	size_t exit; // offset after the last instruction
+	OutBuffer text; // path from start
+	size_t sync[MAX_OP_LENGTH]; // where the path from start + k meets it
+	size_t syncText[MAX_OP_LENGTH]; // length of text before sync[k]
+	int synced[MAX_OP_LENGTH];
+	OutBuffer prefix[MAX_OP_LENGTH]; // path from start + k up to sync[k]
+}Chunk;
+
+/*
+ * chunks of one parallel round and the mapping they decode
+ */
+typedef struct Round {
+	const unsigned char *bytes; // byte at offset base
+	size_t base;
+	size_t limit; // end of the readable input
+	Chunk *chunks;
+	size_t count;
+	int threads;
+}Round;
+
+typedef struct Worker {
+	Round *round;
+	int id;
+}Worker;
+
+static size_t mnemonicLength[256];
+
+static void flushOut(OutBuffer *out)
+{
+  size_t done = 0;
+
+  if (out->fd < 0)
+  {
+	size_t capacity = out->capacity ? out->capacity * 2 : OUT_BUFFER_SIZE;
+	char *data = realloc(out->data, capacity);
+
+	if (!data)
+	{
+	  out->error = 1;
+	  out->length = 0;
+	  return;
+	}
+	out->data = data;
+	out->capacity = capacity;
+	return;
+  }
+
+  while (done < out->length && !out->error)
+  {
+	ssize_t n = write(out->fd, out->data + done, out->length - done);
+
+	if (n < 0 && errno == EINTR)
+	  continue;
+	if (n <= 0)
+	  out->error = 1;
+	else
+	  done += n;
+  }
+  out->length = 0;
+}
+
+static char *putHex(char *p, size_t value, int digits)
+{
+  static const char hex[] = "0123456789abcdef";
+  char tmp[2 * sizeof(size_t)];
+  int n = 0;
+
+  do
+  {
+	tmp[n++] = hex[value & 0xf];
+	value >>= 4;
+  } while (value || n < digits);
+  while (n > 0)
+	*p++ = tmp[--n];
+  return p;
+}
+
+/*
+ * disassemble the instruction at pc into the output buffer
+ * @param codeBuffer bytes of the instruction, MAX_OP_LENGTH readable
+ * @param pc address printed for the instruction
+ * @param out output buffer
+ * @return length of the instruction in bytes
+ */
+int Disassmble8080op(const unsigned char *codeBuffer, size_t pc, OutBuffer *out)
+{
+	const OpcodeInfo8080 *info = &opcodeTable8080[codeBuffer[0]];
+	char *p;
+
+	if (out->length + LINE_MAX_LENGTH > out->capacity)
+	  flushOut(out);
+	p = putHex(out->data + out->length, pc, 4);
+	*p++ = ' ';
+	memcpy(p, info->mnemonic, mnemonicLength[codeBuffer[0]]);
+	p += mnemonicLength[codeBuffer[0]];
+
+	switch(info->length)
+	{
+	  case 2: *p++ = '#'; p = putHex(p, codeBuffer[1], 2); break;
+	  case 3: *p++ = '#'; p = putHex(p, codeBuffer[2] << 8 | codeBuffer[1], 4);
+	          break;
+	  default: break;
+	}
+
+	*p++ = '\n';
+	out->length = p - out->data;
+
+	return info->length;
+}
+
+/*
+ * disassemble the instruction at pos
+ * @param bytes input, bytes[0] is the byte at offset base
+ * @param limit end of the readable input, operands past it read as 0
+ * @return length of the instruction
+ */
+static int disassembleAt(const unsigned char *bytes, size_t base, size_t pos,
+                         size_t limit, OutBuffer *out)
+{
+  unsigned char tail[MAX_OP_LENGTH] = { 0 };
+
+  if (pos + MAX_OP_LENGTH <= limit)
+	return Disassmble8080op(bytes + (pos - base), pos, out);
+  memcpy(tail, bytes + (pos - base), limit - pos);
+  return Disassmble8080op(tail, pos, out);
+}
+
+/*
+ * disassemble the instructions starting in [pos, stop)
+ * @return offset of the next instruction, can be past stop
+ */
+static size_t disassembleBytes(const unsigned char *bytes, size_t base,
+                               size_t pos, size_t stop, size_t limit,
+                               OutBuffer *out)
+{
+  while (pos < stop)
+	pos += disassembleAt(bytes, base, pos, limit, out);
+  return pos;
+}
+
+static void putText(OutBuffer *out, const char *text, size_t length)
+{
+  if (out->length + length > out->capacity)
+	flushOut(out);
+  if (length > out->capacity)
+  {
+	OutBuffer direct = { (char *)text, length, length, out->fd, 0 };
+
+	flushOut(&direct);
+	out->error |= direct.error;
+	return;
+  }
+  memcpy(out->data + out->length, text, length);
+  out->length += length;
+}
+
+/*
+ * decode a chunk from its start and find where the paths from the
+ * other candidate entry offsets join it
+ */
+static void decodeChunk(const Round *round, Chunk *chunk)
+{
+  const unsigned char *bytes = round->bytes;
+  size_t base = round->base;
+  size_t pos;
+  int k;
+
+  for (k = 1; k < MAX_OP_LENGTH; k++)
+  {
+	size_t a = chunk->start, b = chunk->start + k;
+
+	while (a != b && a < chunk->stop && b < chunk->stop)
+	{
+	  if (a < b)
+		a += opcodeTable8080[bytes[a - base]].length;
+	  else
+		b += opcodeTable8080[bytes[b - base]].length;
+	}
+	chunk->synced[k] = a == b;
+	chunk->sync[k] = a;
+	if (chunk->synced[k])
+	  disassembleBytes(bytes, base, chunk->start + k, a, round->limit,
+	                   &chunk->prefix[k]);
+  }
+
+  pos = chunk->start;
+  while (pos < chunk->stop)
+  {
+	for (k = 1; k < MAX_OP_LENGTH; k++)
+	  if (pos == chunk->sync[k])
+		chunk->syncText[k] = chunk->text.length;
+	pos += disassembleAt(bytes, base, pos, round->limit, &chunk->text);
+  }
+  for (k = 1; k < MAX_OP_LENGTH; k++)
+	if (pos == chunk->sync[k])
+	  chunk->syncText[k] = chunk->text.length;
+  chunk->exit = pos;
+}
+
+static void *workerMain(void *arg)
+{
+  Worker *worker = arg;
+  Round *round = worker->round;
+  size_t i;
+
+  for (i = worker->id; i < round->count; i += round->threads)
+	decodeChunk(round, &round->chunks[i]);
+  return NULL;
+}
+
+/*
+ * write the chunks of a round in order, each entered at the offset
+ * the previous one ended at. a chunk whose candidate path never
+ * joined is decoded again from that offset.
+ * @return offset after the last instruction
+ */
+static size_t stitchRound(Round *round, size_t pos, OutBuffer *out)
+{
+  size_t i;
+
+  for (i = 0; i < round->count; i++)
+  {
+	Chunk *chunk = &round->chunks[i];
+	size_t k = pos - chunk->start;
+
+	if (k == 0)
+	  putText(out, chunk->text.data, chunk->text.length);
+	else if (k < MAX_OP_LENGTH && chunk->synced[k])
+	{
+	  putText(out, chunk->prefix[k].data, chunk->prefix[k].length);
+	  putText(out, chunk->text.data + chunk->syncText[k],
+	          chunk->text.length - chunk->syncText[k]);
+	}
+	else
+	{
+	  pos = disassembleBytes(round->bytes, round->base, pos, chunk->stop,
+	                         round->limit, out);
+	  continue;
+	}
+	pos = chunk->exit;
+  }
+  return pos;
+}
+
+/*
+ * disassemble [pos, stop) of a mapping on several threads, in
+ * rounds of two chunks per thread so memory stays bounded
+ * @return offset of the next instruction, can be past stop
+ */
+static size_t disassembleParallel(const unsigned char *bytes, size_t base,
+                                  size_t pos, size_t stop, size_t limit,
+                                  int threads, OutBuffer *out)
 {
-	unsigned char *opcode = &codeBuffer[pc];
-	int opbytes = 1;
-	printf("%04zx ", pc);
+  size_t perRound = (size_t)threads * 2;
+  Chunk *chunks = calloc(perRound, sizeof(Chunk));
+  Worker *workers = calloc(threads, sizeof(Worker));
+  pthread_t *ids = calloc(threads, sizeof(pthread_t));
+  Round round = { bytes, base, limit, chunks, 0, threads };
+  size_t i;
+  int t, k;
+
+  if (!chunks || !workers || !ids)
+	pos = disassembleBytes(bytes, base, pos, stop, limit, out);
+
+  while (chunks && workers && ids && pos < stop)
+  {
+	size_t start = pos;
+
+	for (round.count = 0; round.count < perRound && start < stop; round.count++)
+	{
+	  Chunk *chunk = &chunks[round.count];
+
+	  chunk->start = start;
+	  chunk->stop = stop - start > CHUNK_SIZE ? start + CHUNK_SIZE : stop;
+	  chunk->text.length = 0;
+	  chunk->text.fd = -1;
+	  for (k = 0; k < MAX_OP_LENGTH; k++)
+	  {
+		chunk->prefix[k].length = 0;
+		chunk->prefix[k].fd = -1;
+		chunk->syncText[k] = 0;
+	  }
+	  start = chunk->stop;
+	}
 
-	switch(*opcode)
+	for (t = 0; t < threads; t++)
 	{
-	  case 0x00: printf("NOP"); break;
-	  case 0x01: printf("LXI    B,#%02x%02x\n", opcode[2], opcode[1]);
-		opbytes = 3; break;
-	  case 0x02: printf("STAX   B"); break;
-	  case 0x03: printf("INX    B"); break;
-	  case 0x04: printf("INR    B"); break;
-	  case 0x05: printf("DCR    B"); break;
-	  case 0x06: printf("MVI    B,#%02x", opcode[1]); opbytes = 2; break;
-	  case 0x07: printf("RLC"); break;
-	  case 0x09: printf("DAD    B"); break;
-	  case 0x0a: printf("LDAX   B"); break;
-	  case 0x0b: printf("DCX    B"); break;
-	  case 0x0c: printf("INC    C"); break;
-	  case 0x0d: printf("DCR    C"); break;
-	  case 0x0e: printf("MVI    C,#%02x", opcode[1]); opbytes = 2; break;
-	  case 0x0f: printf("RRC"); break;
-	  case 0x11: printf("LXI    D,#%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0x12: printf("STAX   D"); break;
-	  case 0x13: printf("INX    D"); break;
-	  case 0x14: printf("INR    D"); break;
-	  case 0x15: printf("DCR    D"); break;
-	  case 0x16: printf("MVI    D,#%02x", opcode[1]); opbytes = 2; break;
-	  case 0x17: printf("RAL"); break;
-	  case 0x19: printf("DAD    D"); break;
-	  case 0x1a: printf("LDAX   D"); break;
-	  case 0x1b: printf("DCX    D"); break;
-	  case 0x1c: printf("INR    E"); break;
-	  case 0x1d: printf("DCR    E"); break;
-	  case 0x1e: printf("MVI    E,#%02x", opcode[1]); opbytes = 2; break;
-	  case 0x1f: printf("RAR"); break;
-	  case 0x20: printf("RIM"); break;
-	  case 0x21: printf("LXI    H,#%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0x22: printf("SHLD   #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0x23: printf("INX    H"); break;
-	  case 0x24: printf("INR    H"); break;
-	  case 0x25: printf("DCR    H"); break;
-	  case 0x26: printf("MVI    H,#%02x", opcode[1]); opbytes = 2; break;
-	  case 0x27: printf("DAA"); break;
-	  case 0x29: printf("DAD    H"); break;
-	  case 0x2a: printf("LHLD   #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0x2b: printf("DCX    H"); break;
-	  case 0x2c: printf("INR    L"); break;
-	  case 0x2d: printf("DCR    L"); break;
-	  case 0x2e: printf("MVI    L,#%02x", opcode[1]); opbytes = 2; break;
-	  case 0x2f: printf("CMA"); break;
-	  case 0x30: printf("SIM"); break;
-	  case 0x31: printf("LXI    SP,#%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0x32: printf("STA    #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0x33: printf("INX    SP"); break;
-	  case 0x34: printf("INR    M"); break;
-	  case 0x35: printf("DCR    M"); break;
-	  case 0x36: printf("MVI    M,#%02x", opcode[1]); opbytes = 2; break;
-	  case 0x37: printf("STC"); break;
-	  case 0x39: printf("DAD    SP"); break;
-	  case 0x3a: printf("LDA    #%02x%02x", opcode[2], opcode[1]);
-				 opbytes = 3; break;
-	  case 0x3b: printf("DCX    SP"); break;
-	  case 0x3c: printf("INR    A"); break;
-	  case 0x3d: printf("DCR    A"); break;
-	  case 0x3e: printf("MVI    A,#%02x", opcode[1]); opbytes = 2; break;
-	  case 0x3f: printf("CMC"); break;
-	  case 0x40: printf("MOV    B,B"); break;
-	  case 0x41: printf("MOV    B,C"); break;
-	  case 0x42: printf("MOV    B,D"); break;
-	  case 0x43: printf("MOV    B,E"); break;
-	  case 0x44: printf("MOV    B,H"); break;
-	  case 0x45: printf("MOV    B,L"); break;
-	  case 0x46: printf("MOV    B,M"); break;
-	  case 0x47: printf("MOV    B,A"); break;
-	  case 0x48: printf("MOV    C,B"); break;
-	  case 0x49: printf("MOV    C,C"); break;
-	  case 0x4a: printf("MOV    C,D"); break;
-	  case 0x4b: printf("MOV    C,E"); break;
-	  case 0x4c: printf("MOV    C,H"); break;
-	  case 0x4d: printf("MOV    C,L"); break;
-	  case 0x4e: printf("MOV    C,M"); break;
-	  case 0x4f: printf("MOV    C,A"); break;
-	  case 0x50: printf("MOV    D,B"); break;
-	  case 0x51: printf("MOV    D,C"); break;
-	  case 0x52: printf("MOV    D,D"); break;
-	  case 0x53: printf("MOV    D,E"); break;
-	  case 0x54: printf("MOV    D,H"); break;
-	  case 0x55: printf("MOV    D,L"); break;
-	  case 0x56: printf("MOV    D,M"); break;
-	  case 0x57: printf("MOV    D,A"); break;
-	  case 0x58: printf("MOV    E,B"); break;
-	  case 0x59: printf("MOV    E,C"); break;
-	  case 0x5a: printf("MOV    E,D"); break;
-	  case 0x5b: printf("MOV    E,E"); break;
-	  case 0x5c: printf("MOV    E,H"); break;
-	  case 0x5d: printf("MOV    E,L"); break;
-	  case 0x5e: printf("MOV    E,M"); break;
-	  case 0x5f: printf("MOV    E,A"); break;
-	  case 0x60: printf("MOV    H,B"); break;
-	  case 0x61: printf("MOV    H,C"); break;
-	  case 0x62: printf("MOV    H,D"); break;
-	  case 0x63: printf("MOV    H,E"); break;
-	  case 0x64: printf("MOV    H,H"); break;
-	  case 0x65: printf("MOV    H,L"); break;
-	  case 0x66: printf("MOV    H,M"); break;
-	  case 0x67: printf("MOV    H,A"); break;
-	  case 0x68: printf("MOV    L,B"); break;
-	  case 0x69: printf("MOV    L,C"); break;
-	  case 0x6a: printf("MOV    L,D"); break;
-	  case 0x6b: printf("MOV    L,E"); break;
-	  case 0x6c: printf("MOV    L,H"); break;
-	  case 0x6d: printf("MOV    L,L"); break;
-	  case 0x6e: printf("MOV    L,M"); break;
-	  case 0x6f: printf("MOV    L,A"); break;
-	  case 0x70: printf("MOV    M,B"); break;
-	  case 0x71: printf("MOV    M,C"); break;
-	  case 0x72: printf("MOV    M,D"); break;
-	  case 0x73: printf("MOV    M,E"); break;
-	  case 0x74: printf("MOV    M,H"); break;
-	  case 0x75: printf("MOV    M,L"); break;
-	  case 0x76: printf("HLT"); break;
-	  case 0x77: printf("MOV    M,A"); break;
-	  case 0x78: printf("MOV    A,B"); break;
-	  case 0x79: printf("MOV    A,C"); break;
-	  case 0x7a: printf("MOV    A,D"); break;
-	  case 0x7b: printf("MOV    A,E"); break;
-	  case 0x7c: printf("MOV    A,H"); break;
-	  case 0x7d: printf("MOV    A,L"); break;
-	  case 0x7e: printf("MOV    A,M"); break;
-	  case 0x7f: printf("MOV    A,A"); break;
-	  case 0x80: printf("ADD    B"); break;
-	  case 0x81: printf("ADD    C"); break;
-	  case 0x82: printf("ADD    D"); break;
-	  case 0x83: printf("ADD    E"); break;
-	  case 0x84: printf("ADD    H"); break;
-	  case 0x85: printf("ADD    L"); break;
-	  case 0x86: printf("ADD    M"); break;
-	  case 0x87: printf("ADD    A"); break;
-	  case 0x88: printf("ADC    B"); break;
-	  case 0x89: printf("ADC    C"); break;
-	  case 0x8a: printf("ADC    D"); break;
-	  case 0x8b: printf("ADC    E"); break;
-	  case 0x8c: printf("ADC    H"); break;
-	  case 0x8d: printf("ADC    L"); break;
-	  case 0x8e: printf("ADC    M"); break;
-	  case 0x8f: printf("ADC    A"); break;
-	  case 0x90: printf("SUB    B"); break;
-	  case 0x91: printf("SUB    C"); break;
-	  case 0x92: printf("SUB    D"); break;
-	  case 0x93: printf("SUB    E"); break;
-	  case 0x94: printf("SUB    H"); break;
-	  case 0x95: printf("SUB    L"); break;
-	  case 0x96: printf("SUB    M"); break;
-	  case 0x97: printf("SUB    A"); break;
-	  case 0x98: printf("SBB    B"); break;
-	  case 0x99: printf("SBB    C"); break;
-	  case 0x9a: printf("SBB    D"); break;
-	  case 0x9b: printf("SBB    E"); break;
-	  case 0x9c: printf("SBB    H"); break;
-	  case 0x9d: printf("SBB    L"); break;
-	  case 0x9e: printf("SBB    M"); break;
-	  case 0x9f: printf("SBB    A"); break;
-	  case 0xa0: printf("ANA    B"); break;
-	  case 0xa1: printf("ANA    C"); break;
-	  case 0xa2: printf("ANA    D"); break;
-	  case 0xa3: printf("ANA    E"); break;
-	  case 0xa4: printf("ANA    H"); break;
-	  case 0xa5: printf("ANA    L"); break;
-	  case 0xa6: printf("ANA    M"); break;
-	  case 0xa7: printf("ANA    A"); break;
-	  case 0xa8: printf("SRA    B"); break;
-	  case 0xa9: printf("SRA    C"); break;
-	  case 0xaa: printf("SRA    D"); break;
-	  case 0xab: printf("SRA    E"); break;
-	  case 0xac: printf("SRA    H"); break;
-	  case 0xad: printf("SRA    L"); break;
-	  case 0xae: printf("SRA    M"); break;
-	  case 0xaf: printf("SRA    A"); break;
-	  case 0xb0: printf("ORA    B"); break;
-	  case 0xb1: printf("ORA    C"); break;
-	  case 0xb2: printf("ORA    D"); break;
-	  case 0xb3: printf("ORA    E"); break;
-	  case 0xb4: printf("ORA    H"); break;
-	  case 0xb5: printf("ORA    L"); break;
-	  case 0xb6: printf("ORA    M"); break;
-	  case 0xb7: printf("ORA    A"); break;
-	  case 0xb8: printf("CMP    B"); break;
-	  case 0xb9: printf("CMP    C"); break;
-	  case 0xba: printf("CMP    D"); break;
-	  case 0xbb: printf("CMP    E"); break;
-	  case 0xbc: printf("CMP    H"); break;
-	  case 0xbd: printf("CMP    L"); break;
-	  case 0xbe: printf("CMP    M"); break;
-	  case 0xbf: printf("CMP    A"); break;
-	  case 0xc0: printf("RNZ"); break;
-	  case 0xc1: printf("POP    B"); break;
-	  case 0xc2: printf("JNZ    #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xc3: printf("JMP    #%02x%02x", opcode[2], opcode[1]);
-				 opbytes = 3; break;
-	  case 0xc4: printf("CNZ    #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xc5: printf("PUSH   B"); break;
-	  case 0xc6: printf("ADI    #%02x", opcode[1]); opbytes = 2; break;
-	  case 0xc7: printf("RST    0"); break;
-	  case 0xc8: printf("RZ"); break;
-	  case 0xc9: printf("RET"); break;
-	  case 0xca: printf("JZ     #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xcc: printf("CZ     #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xcd: printf("CALL   #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xce: printf("ACI    #%02x", opcode[1]); opbytes = 2; break;
-	  case 0xcf: printf("RST    1"); break;
-	  case 0xd0: printf("RNC"); break;
-	  case 0xd1: printf("POP    D"); break;
-	  case 0xd2: printf("JNC    #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xd3: printf("OUT    #%02x", opcode[1]); opbytes = 2; break;
-	  case 0xd4: printf("CNC    #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xd5: printf("PUSH   D"); break;
-	  case 0xd6: printf("SUI    #%02x", opcode[1]); opbytes = 2; break;
-	  case 0xd7: printf("RST    2"); break;
-	  case 0xd8: printf("RC"); break;
-	  case 0xda: printf("JC     #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xdb: printf("IN     #%02x", opcode[1]); opbytes = 2; break;
-	  case 0xdc: printf("CC     #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xde: printf("SBI    #%02x", opcode[1]); opbytes = 2; break;
-	  case 0xdf: printf("RST    3"); break;
-	  case 0xe0: printf("RPO"); break;
-	  case 0xe1: printf("POP    H"); break;
-	  case 0xe2: printf("JPO    #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xe3: printf("XTHL"); break;
-	  case 0xe4: printf("CPO    #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xe5: printf("PUSH   H"); break;
-	  case 0xe6: printf("ANI    #%02x", opcode[1]); opbytes = 2; break;
-	  case 0xe7: printf("RST    4"); break;
-	  case 0xe8: printf("RPE"); break;
-	  case 0xe9: printf("PCHL"); break;
-	  case 0xea: printf("JPE    #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xeb: printf("XCHG"); break;
-	  case 0xec: printf("CPE    #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xee: printf("XRI    #%02x", opcode[1]); opbytes = 2; break;
-	  case 0xef: printf("RST    5"); break;
-	  case 0xf0: printf("RP"); break;
-	  case 0xf1: printf("POP    PSW"); break;
-	  case 0xf2: printf("JP     #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xf3: printf("DI"); break;
-	  case 0xf4: printf("CP     #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xf5: printf("PUSH   PSW"); break;
-	  case 0xf6: printf("ORI    #%02x", opcode[1]); opbytes = 2; break;
-	  case 0xf7: printf("RST    6"); break;
-	  case 0xf8: printf("RM"); break;
-	  case 0xf9: printf("SPHL"); break;
-	  case 0xfa: printf("JM     #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xfb: printf("EI"); break;
-	  case 0xfc: printf("CM     #%02x%02x", opcode[2], opcode[1]);
-	             opbytes = 3; break;
-	  case 0xfe: printf("CPI    #%02x", opcode[1]); opbytes = 2; break;
-	  case 0xff: printf("RST    7"); break;
+	  workers[t].round = &round;
+	  workers[t].id = t;
 	}
+	for (t = 1; t < threads; t++)
+	  if (pthread_create(&ids[t], NULL, workerMain, &workers[t]))
+		break;
+	workerMain(&workers[0]);
+	// chunks of threads that failed to start are decoded here
+	for (i = t; i < round.count; i++)
+	  if (i % threads >= (size_t)t)
+		decodeChunk(&round, &chunks[i]);
+	while (--t > 0)
+	  pthread_join(ids[t], NULL);
+
+	for (i = 0; i < round.count; i++)
+	{
+	  out->error |= chunks[i].text.error;
+	  for (k = 1; k < MAX_OP_LENGTH; k++)
+		out->error |= chunks[i].prefix[k].error;
+	}
+	pos = stitchRound(&round, pos, out);
+  }
+
+  for (i = 0; chunks && i < perRound; i++)
+  {
+	free(chunks[i].text.data);
+	for (k = 0; k < MAX_OP_LENGTH; k++)
+	  free(chunks[i].prefix[k].data);
+  }
+  free(chunks);
+  free(workers);
+  free(ids);
+  return pos;
+}
 
-	printf("\n");
+/*
+ * disassemble a regular file through read-only mappings of
+ * MAP_WINDOW bytes, so memory use doesn't grow with the file
+ * @return offset reached, before size if a mapping failed
+ */
+static size_t disassembleMapped(int fd, size_t size, int threads,
+                                OutBuffer *out)
+{
+  size_t pageMask = (size_t)sysconf(_SC_PAGESIZE) - 1;
+  size_t pos = 0;
+
+  while (pos < size)
+  {
+	size_t start = pos & ~pageMask;
+	size_t stop = start + MAP_WINDOW < size ? start + MAP_WINDOW : size;
+	size_t limit = stop + MAX_OP_LENGTH < size ? stop + MAX_OP_LENGTH : size;
+	void *map = mmap(NULL, limit - start, PROT_READ, MAP_PRIVATE, fd, start);
+
+	if (map == MAP_FAILED)
+	  break;
+	madvise(map, limit - start, MADV_SEQUENTIAL);
+	if (threads > 1)
+	  pos = disassembleParallel(map, start, pos, stop, limit, threads, out);
+	else
+	  pos = disassembleBytes(map, start, pos, stop, limit, out);
+	munmap(map, limit - start);
+  }
+  return pos;
+}
+
+/*
+ * disassemble a pipe or any other unmappable input in chunks
+ * @param start offset of the next byte read from fd
+ * @return 0 on success, -1 on a read error
+ */
+static int disassembleStream(int fd, size_t start, OutBuffer *out)
+{
+  unsigned char *buffer = malloc(READ_CHUNK + MAX_OP_LENGTH);
+  size_t base = start, pos = start, filled = 0;
+  int eof = 0, ret = 0;
+
+  if (!buffer)
+	return -1;
+  while (!eof)
+  {
+	ssize_t n = read(fd, buffer + filled, READ_CHUNK + MAX_OP_LENGTH - filled);
 
-	return opbytes;
+	if (n < 0 && errno == EINTR)
+	  continue;
+	if (n < 0)
+	{
+	  ret = -1;
+	  break;
+	}
+	eof = n == 0;
+	filled += n;
+	if (!eof && filled < MAX_OP_LENGTH + 1)
+	  continue;
+
+	// keep the bytes of an instruction that may run past the buffer
+	pos = disassembleBytes(buffer, base, pos,
+	                       eof ? base + filled : base + filled - MAX_OP_LENGTH + 1,
+	                       base + filled, out);
+	if (pos < base + filled)
+	{
+	  memmove(buffer, buffer + (pos - base), base + filled - pos);
+	  filled = base + filled - pos;
+	}
+	else
+	  filled = 0;
+	base = pos;
+  }
+  free(buffer);
+  return ret;
+}
+
+/*
+ * print the block header of recursive mode: address, flags and the
+ * instructions that lead to it
+ */
+static void putBlockHeader(const FlowGraph8080 *graph,
+                           const FlowBlock8080 *block, OutBuffer *out)
+{
+  static const char *edgeNames[] = { "fall", "jump", "call" };
+  char line[LINE_MAX_LENGTH];
+  uint32_t k;
+  int n;
+
+  n = snprintf(line, sizeof(line), "; block %04x%s%s\n", block->start,
+               block->flags & FLOW_ENTRY ? " entry" : "",
+               block->flags & FLOW_FUNCTION ? " function" : "");
+  putText(out, line, n);
+  for (k = 0; k < block->xrefCount; k++)
+  {
+	const FlowEdge8080 *edge = &graph->edges[graph->xrefs[block->firstXref + k]];
+
+	n = snprintf(line, sizeof(line), "; from %04x %s\n", edge->from,
+	             edgeNames[edge->type]);
+	putText(out, line, n);
+  }
+}
+
+/*
+ * recursive mode: disassemble only the code reachable from the
+ * entry points, block by block, and optionally save the block index
+ * @param fd image, loaded at origin and read up to the end of memory
+ * @param indexPath where to save the index, NULL for none
+ * @return 0 on success, -1 on failure
+ */
+static int disassembleFlow(int fd, uint16_t origin, const uint16_t *entries,
+                           size_t entryCount, const char *indexPath,
+                           OutBuffer *out)
+{
+  unsigned char *memory = calloc(ADDRESS_SPACE + MAX_OP_LENGTH, 1);
+  size_t size = 0, room = ADDRESS_SPACE - origin;
+  FlowGraph8080 *graph;
+  uint32_t i, k;
+  int ret = 0;
+
+  if (!memory)
+	return -1;
+  while (size < room)
+  {
+	ssize_t n = read(fd, memory + origin + size, room - size);
+
+	if (n < 0 && errno == EINTR)
+	  continue;
+	if (n < 0)
+	  ret = -1;
+	if (n <= 0)
+	  break;
+	size += n;
+  }
+  graph = ret ? NULL : BuildFlowGraph8080(memory + origin, origin, size,
+                                          entries, entryCount);
+  if (!graph)
+  {
+	free(memory);
+	return -1;
+  }
+
+  for (i = 0; i < graph->blockCount; i++)
+  {
+	const FlowBlock8080 *block = &graph->blocks[i];
+	uint16_t addr = block->start;
+
+	putBlockHeader(graph, block, out);
+	for (k = 0; k < block->count; k++)
+	  addr += Disassmble8080op(memory + addr, addr, out);
+	putText(out, "\n", 1);
+  }
+  if (indexPath && SaveFlowGraph8080(graph, indexPath))
+  {
+	fprintf(stderr, "failed to write %s!\n", indexPath);
+	ret = -1;
+  }
+  FreeFlowGraph8080(graph);
+  free(memory);
+  return ret;
 }
 
 int main(int argc, char **argv)
 {
-  FILE *fHandle = fopen (argv[1], "rb");
+  OutBuffer output = { malloc(OUT_BUFFER_SIZE), 0, OUT_BUFFER_SIZE,
+                       STDOUT_FILENO, 0 };
+  OutBuffer *out = &output;
+  uint16_t entries[MAX_ENTRIES];
+  size_t entryCount = 0;
+  const char *indexPath = NULL;
+  int threads = 1, recursive = 0, bad = 0;
+  long origin = 0;
+  int i, opt, ret = 0;
 
-  // return 1 on file error
-  if (!fHandle)
+  while ((opt = getopt(argc, argv, "j:re:o:x:")) != -1)
   {
-	printf("failed to open file for disassembly!\n");
+	switch (opt)
+	{
+	  case 'j':
+		threads = atoi(optarg);
+		if (threads <= 0)
+		{
+		  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		  threads = cpus > 0 ? (int)cpus : 1;
+		}
+		break;
+	  case 'e':
+		if (entryCount == MAX_ENTRIES)
+		  bad = 1;
+		else
+		  entries[entryCount++] = strtol(optarg, NULL, 0);
+		recursive = 1;
+		break;
+	  case 'o':
+		origin = strtol(optarg, NULL, 0);
+		bad |= origin < 0 || origin >= ADDRESS_SPACE;
+		recursive = 1;
+		break;
+	  case 'x':
+		indexPath = optarg;
+		recursive = 1;
+		break;
+	  case 'r':
+		recursive = 1;
+		break;
+	  default:
+		bad = 1;
+		break;
+	}
+  }
+  if (optind >= argc || bad || !out->data ||
+	  (indexPath && optind + 1 != argc))
+  {
+	fprintf(stderr, "usage: %s [-j threads, 0 for all cores] file... "
+	                "(- for stdin)\n"
+	                "       %s -r [-o origin] [-e entry]... [-x index] file\n"
+	                "       (recursive descent from the entries, default "
+	                "origin)\n", argv[0], argv[0]);
+	free(out->data);
 	return 1;
   }
+  for (i = 0; i < 256; i++)
+	mnemonicLength[i] = strlen(opcodeTable8080[i].mnemonic);
 
-  // get the size of the file
-  fseek(fHandle, 0L, SEEK_END);
-  size_t fsize = ftell(fHandle);
-  fseek(fHandle, 0L, SEEK_SET);
+  for (i = optind; i < argc && !out->error; i++)
+  {
+	int fd = strcmp(argv[i], "-") ? open(argv[i], O_RDONLY) : STDIN_FILENO;
+	struct stat st;
+	int regular;
+	size_t pos = 0, size = 0;
 
-  // put contents of file in buffer and close file
-  unsigned char *inBuffer = malloc(fsize);
-  fread (inBuffer, 1, fsize, fHandle);
-  fclose (fHandle);
+	// return 1 on file error
+	if (fd < 0)
+	{
+	  fprintf(stderr, "failed to open %s for disassembly!\n", argv[i]);
+	  ret = 1;
+	  continue;
+	}
 
-  size_t pc = 0;
-  while(pc < fsize)
-  {
-	// disassmble file, incrememnt by amount of bytes for opcode
-	pc += Disassmble8080op(inBuffer, pc);
+	if (recursive)
+	{
+	  if (disassembleFlow(fd, origin, entries, entryCount, indexPath, out))
+	  {
+		fprintf(stderr, "failed to disassemble %s!\n", argv[i]);
+		ret = 1;
+	  }
+	  if (fd != STDIN_FILENO)
+		close(fd);
+	  continue;
+	}
+
+	// each input starts at address 0, mapped when it is a file
+	regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+	if (regular)
+	{
+	  size = st.st_size;
+	  pos = disassembleMapped(fd, size, threads, out);
+	}
+	if ((!regular || pos < size) &&
+		((regular && lseek(fd, pos, SEEK_SET) < 0) ||
+		 disassembleStream(fd, pos, out)))
+	{
+	  fprintf(stderr, "failed to read %s!\n", argv[i]);
+	  ret = 1;
+	}
+	if (fd != STDIN_FILENO)
+	  close(fd);
   }
 
-  return 0;
+  flushOut(out);
+  if (out->error)
+	ret = 1;
+  free(out->data);
+  return ret;
 }
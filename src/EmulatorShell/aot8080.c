@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "flags8080.h"
+#include "flowGraph8080.h"
+#include "aot8080.h"
+
+/*
+ * file name of the module compiled from an image
+ * @return 0 on success, -1 if the name doesn't fit
+ */
+int AotModuleName8080(char *name, size_t size, const uint8_t *image,
+                      size_t imageSize)
+{
+  int n = snprintf(name, size, "aot8080-%08x.so",
+                   FlowImageHash8080(image, imageSize));
+
+  return n < 0 || (size_t)n >= size ? -1 : 0;
+}
+
+/*
+ * check the compiled bytes of a page against memory
+ * @return 1 when they still match
+ */
+static int checkPage(const State8080 *state, const AotModule8080 *module,
+                     int page)
+{
+  uint32_t addr;
+
+  for (addr = page << 8; addr < (uint32_t)(page + 1) << 8; addr++)
+  {
+	uint32_t offset = (addr - module->origin) & 0xffff;
+
+	if (offset < module->size && aotBit8080(module->codeMap, addr) &&
+		readMemory8080(state, addr) != module->image[offset])
+	  return 0;
+  }
+  return 1;
+}
+
+/*
+ * load the module compiled for an image, if there is one
+ * @param dir directory holding the modules
+ * @param image bytes loaded at origin, already in memory
+ * @return 0 when a module was loaded, -1 when there is none or it
+ * doesn't match the image or memory
+ */
+int EnableAot8080(State8080 *state, const char *dir, const uint8_t *image,
+                  uint16_t origin, size_t size)
+{
+  const AotModule8080 *module;
+  char name[32], path[4096];
+  Aot8080 *aot;
+  void *handle;
+  int page;
+
+  if (state->aot)
+	return 0;
+  if (AotModuleName8080(name, sizeof(name), image, size) ||
+	  snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path))
+	return -1;
+  handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!handle)
+	return -1;
+  module = dlsym(handle, AOT8080_SYMBOL);
+  if (!module || module->version != AOT8080_VERSION ||
+	  module->stateSize != sizeof(State8080) || module->origin != origin ||
+	  module->size != size ||
+	  module->imageHash != FlowImageHash8080(image, size) ||
+	  memcmp(module->image, image, size))
+  {
+	dlclose(handle);
+	return -1;
+  }
+
+  aot = calloc(1, sizeof(Aot8080));
+  if (!aot)
+  {
+	dlclose(handle);
+	return -1;
+  }
+  aot->handle = handle;
+  aot->module = module;
+  for (page = 0; page < 256; page++)
+	if (!checkPage(state, module, page))
+	{
+	  free(aot);
+	  dlclose(handle);
+	  return -1;
+	}
+  for (page = 0; page < 256; page++)
+  {
+	int i;
+
+	for (i = 0; i < 32 && !module->codeMap[page * 32 + i]; i++)
+	  ;
+	if (i < 32)
+	  markCode8080(state, page, CODE_AOT);
+  }
+  state->aot = aot;
+  return 0;
+}
+
+void DisableAot8080(State8080 *state)
+{
+  Aot8080 *aot = state->aot;
+  int page;
+
+  if (!aot)
+	return;
+  for (page = 0; page < 256; page++)
+	state->codePages[page] &= ~CODE_AOT;
+  dlclose(aot->handle);
+  free(aot);
+  state->aot = NULL;
+}
+
+/*
+ * a store or a page swap touched a page holding compiled code. a
+ * store into the code itself stops the module at once, any other
+ * change has the page checked before the module runs again.
+ */
+void InvalidateAot8080(State8080 *state, uint16_t addr)
+{
+  Aot8080 *aot = state->aot;
+
+  if (aotBit8080(aot->module->codeMap, addr))
+	aot->stale = 1;
+  aot->check[addr >> 8] = 1;
+  aot->checks = 1;
+}
+
+/*
+ * a page holding compiled code was replaced, by Restore8080,
+ * LoadMemory8080 or LoadState8080. it is checked against the image
+ * before the module runs again, the same bytes keep the module.
+ */
+void InvalidateAotPage8080(State8080 *state, uint8_t page)
+{
+  Aot8080 *aot = state->aot;
+
+  aot->check[page] = 1;
+  aot->checks = 1;
+}
+
+/*
+ * drop the module when the code it was compiled from changed
+ * @return 1 if the module can still run
+ */
+static int aotValid(State8080 *state, Aot8080 *aot)
+{
+  int page;
+
+  if (aot->disabled)
+	return 0;
+  if (aot->stale)
+	aot->disabled = 1;
+  for (page = 0; aot->checks && page < 256; page++)
+	if (aot->check[page])
+	{
+	  aot->check[page] = 0;
+	  if (!checkPage(state, aot->module, page))
+		aot->disabled = 1;
+	}
+  aot->checks = 0;
+  return !aot->disabled;
+}
+
+/*
+ * Run8080 with compiled blocks where the module has them. the module
+ * checks the budget at block starts, so the budget may be overshot
+ * by one block.
+ */
+RunResult8080 RunAot8080(State8080 *state, uint64_t cycle_budget)
+{
+  RunResult8080 result = { 0, RUN8080_BUDGET };
+  Aot8080 *aot = state->aot;
+  uint64_t start = state->cycles;
+
+  if (!aot || state->halted || (state->intPending && state->int_enable))
+	return Run8080(state, cycle_budget);
+
+  while (state->cycles - start < cycle_budget)
+  {
+	uint64_t left = cycle_budget - (state->cycles - start);
+	RunResult8080 step;
+
+	if (!aotValid(state, aot))
+	{
+	  step = Run8080(state, left);
+	  result.reason = step.reason;
+	  break;
+	}
+	if (aotBit8080(aot->module->entryMap, state->pc))
+	{
+	  // compiled code writes whole flag bytes
+	  settleFlags8080(state);
+	  step = aot->module->run(state, left);
+	}
+	else
+	  step = Run8080(state, left < AOT8080_SLICE ? left : AOT8080_SLICE);
+	if (step.reason != RUN8080_RUNNING && step.reason != RUN8080_BUDGET)
+	{
+	  result.reason = step.reason;
+	  break;
+	}
+  }
+  result.cycles = state->cycles - start;
+  return result;
+}
@@ -0,0 +1,78 @@
+#ifndef AOT_8080_H
+#define AOT_8080_H
+
+/*
+ * aot8080.h
+ * ahead-of-time compiled ROMs. the recompiler turns every basic
+ * block of a ROM into a labelled run of calls to the op8080_*
+ * handlers of ops8080.h with the operands folded in, one C function
+ * per 256 byte page. blocks are linked by direct gotos where the
+ * target is known and in the same page, by a switch on the pc for
+ * RET, PCHL and other computed jumps. the C file is built into
+ * a shared object named after the hash of the ROM, which
+ * EnableAot8080 loads when the same bytes sit at the same address.
+ *
+ * anything the module doesn't know, a pc outside its blocks or a
+ * store into its code, hands the machine back to Run8080. a store
+ * into compiled code drops the module for good, self-modifying
+ * programs just run interpreted. pages swapped in by Restore8080 or
+ * LoadState8080 are checked against the ROM on the next run,
+ * LoadMemory8080 over the ROM needs a new EnableAot8080.
+ *
+ * hosts loading modules export their symbols (-rdynamic), the
+ * module calls back into the interpreter core.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emulatorShell.h"
+
+#define AOT8080_VERSION 2
+#define AOT8080_SYMBOL "aotModule8080"
+#define AOT8080_SLICE 64 // machine states interpreted between module lookups
+
+/*
+ * what a compiled module exports as AOT8080_SYMBOL
+ */
+typedef struct AotModule8080 {
+	uint32_t version; // AOT8080_VERSION
+	uint32_t stateSize; // sizeof(State8080) it was compiled against
+	uint32_t imageHash; // FlowImageHash8080 of the image
+	uint16_t origin; // where the image was compiled for
+	uint32_t size;
+	const uint8_t *image; // the bytes it was compiled from
+	const uint8_t *codeMap; // bit per address, set for instruction bytes
+	const uint8_t *entryMap; // bit per address, set for labels
+	// run compiled blocks until the budget is spent, a stop, or a pc
+	// it has no block for (RUN8080_RUNNING)
+	RunResult8080 (*run)(State8080 *state, uint64_t cycle_budget);
+}AotModule8080;
+
+/*
+ * a module loaded for a machine
+ */
+typedef struct Aot8080 {
+	void *handle; // dlopen handle
+	const AotModule8080 *module;
+	uint8_t check[256]; // pages to check against the image before running
+	int checks; // any page to check
+	int stale; // a store hit compiled code, read by the module
+	int disabled; // the module no longer matches memory
+}Aot8080;
+
+static inline int aotBit8080(const uint8_t *map, uint16_t addr)
+{
+  return (map[addr >> 3] >> (addr & 7)) & 1;
+}
+
+int EnableAot8080(State8080 *state, const char *dir, const uint8_t *image,
+                  uint16_t origin, size_t size);
+void DisableAot8080(State8080 *state);
+void InvalidateAot8080(State8080 *state, uint16_t addr);
+void InvalidateAotPage8080(State8080 *state, uint8_t page);
+RunResult8080 RunAot8080(State8080 *state, uint64_t cycle_budget);
+int AotModuleName8080(char *name, size_t size, const uint8_t *image,
+                      size_t imageSize);
+
+#endif
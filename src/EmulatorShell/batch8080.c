@@ -0,0 +1,630 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "emulatorShell.h"
+#include "jit8080.h"
+#include "blockCache8080.h"
+#include "memory8080.h"
+#include "profile8080.h"
+#include "trace8080.h"
+#include "flags8080.h"
+#include "core8080.h"
+#include "aot8080.h"
+#include "debug8080.h"
+#include "gdb8080.h"
+#include "lockstep8080.h"
+#include "batch8080.h"
+
+#define DEFAULT_SLICE_CYCLES 2000000 // about a second of 2 MHz 8080 time
+#define DEFAULT_FRAME_CYCLES 33333 // 60 Hz at 2 MHz
+
+/*
+ * a job while it is in flight
+ */
+typedef struct BatchTask8080 {
+	BatchJob8080 *job;
+	State8080 state;
+	Scheduler8080 scheduler;
+	GdbStub8080 *stub; // debugger port of the gdbJob, NULL for other jobs
+	int started;
+}BatchTask8080;
+
+/*
+ * per worker deque of task indices. the owner pushes and pops at
+ * the bottom, idle workers steal from the top, so the machines in
+ * flight stay close to the number of workers.
+ */
+typedef struct WorkDeque8080 {
+	pthread_mutex_t lock;
+	size_t *items; // ring buffer, capacity is the number of tasks
+	size_t top;
+	size_t bottom;
+}WorkDeque8080;
+
+typedef struct BatchPool8080 {
+	const BatchOptions8080 *options;
+	BatchTask8080 *tasks;
+	size_t count;
+	WorkDeque8080 *deques;
+	GdbStub8080 stub;
+	int workers;
+	atomic_size_t remaining; // tasks not finished yet
+	// idle workers sleep on wake until a task is pushed or the
+	// last one finishes
+	pthread_mutex_t idleLock;
+	pthread_cond_t wake;
+	size_t pushes; // tasks pushed so far, under idleLock
+}BatchPool8080;
+
+typedef struct BatchWorker8080 {
+	BatchPool8080 *pool;
+	int id;
+}BatchWorker8080;
+
+static void pushBottom(BatchPool8080 *pool, WorkDeque8080 *deque, size_t task)
+{
+  pthread_mutex_lock(&deque->lock);
+  deque->items[deque->bottom++ % pool->count] = task;
+  pthread_mutex_unlock(&deque->lock);
+}
+
+/*
+ * requeue a task after its slice and wake an idle worker to steal it
+ */
+static void pushTask(BatchPool8080 *pool, WorkDeque8080 *deque, size_t task)
+{
+  pushBottom(pool, deque, task);
+  pthread_mutex_lock(&pool->idleLock);
+  pool->pushes++;
+  pthread_cond_signal(&pool->wake);
+  pthread_mutex_unlock(&pool->idleLock);
+}
+
+/*
+ * the last task is done, wake every idle worker to leave
+ */
+static void finishPool(BatchPool8080 *pool)
+{
+  pthread_mutex_lock(&pool->idleLock);
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->idleLock);
+}
+
+/*
+ * wait while no task was pushed since pushes was seen and tasks are
+ * left, they are all in flight on other workers
+ */
+static void waitForWork(BatchPool8080 *pool, size_t seen)
+{
+  pthread_mutex_lock(&pool->idleLock);
+  while (pool->pushes == seen && atomic_load(&pool->remaining) > 0)
+	pthread_cond_wait(&pool->wake, &pool->idleLock);
+  pthread_mutex_unlock(&pool->idleLock);
+}
+
+static int popBottom(BatchPool8080 *pool, WorkDeque8080 *deque, size_t *task)
+{
+  int found = 0;
+
+  pthread_mutex_lock(&deque->lock);
+  if (deque->bottom > deque->top)
+  {
+	*task = deque->items[--deque->bottom % pool->count];
+	found = 1;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+/*
+ * @param wait block on a busy deque, else give up on it
+ */
+static int stealTop(BatchPool8080 *pool, WorkDeque8080 *deque, size_t *task,
+                    int wait)
+{
+  int found = 0;
+
+  if (wait)
+	pthread_mutex_lock(&deque->lock);
+  else if (pthread_mutex_trylock(&deque->lock))
+	return 0;
+  if (deque->bottom > deque->top)
+  {
+	*task = deque->items[deque->top++ % pool->count];
+	found = 1;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+static RunTier8080 tierRun(ExecTier8080 tier)
+{
+  switch (tier)
+  {
+	case TIER_BLOCKS: return RunBlocks8080;
+	case TIER_JIT: return RunJit8080;
+	case TIER_AOT: return RunAot8080;
+	default: return Run8080;
+  }
+}
+
+/*
+ * convert the job's frame buffer once per frame period
+ * @return 0 on success, -1 when the video or its stream can't be set up
+ */
+static int startVideo(BatchPool8080 *pool, BatchTask8080 *task)
+{
+  uint64_t period = pool->options->framePeriod ? pool->options->framePeriod :
+	DEFAULT_FRAME_CYCLES;
+
+  if (EnableVideo8080(&task->state, pool->options->video) ||
+	  (task->job->videoPath &&
+	   StreamVideo8080(&task->state, task->job->videoPath)))
+	return -1;
+  return ScheduleEvent8080(&task->scheduler, period, period, 0,
+                           RenderFrameEvent8080, NULL) ? 0 : -1;
+}
+
+/*
+ * set up the machine of a task on its first slice
+ * @return 0 on success, -1 when out of memory or the trace or the
+ * video can't be started
+ */
+static int startTask(BatchPool8080 *pool, BatchTask8080 *task)
+{
+  BatchJob8080 *job = task->job;
+  size_t size = job->romSize;
+  // hooks this build leaves out of the other tiers keep the interpreter
+  int interpOnly = (job->tracePath && !EMU8080_TRACE) ||
+	(pool->options->profilePeriod && !EMU8080_PROFILE);
+
+  if (size > (size_t)0x10000 - job->loadAddress)
+	size = 0x10000 - job->loadAddress;
+
+  task->state = job->initial;
+  task->state.cycles = 0;
+  task->state.jit = NULL;
+  task->state.blocks = NULL;
+  task->state.bus = NULL;
+  task->state.profile = NULL;
+  task->state.trace = NULL;
+  task->state.coverage = NULL;
+  task->state.aot = NULL;
+  task->state.video = NULL;
+  task->state.debug = NULL;
+  task->state.core = NULL;
+  memset(task->state.codePages, 0, sizeof(task->state.codePages));
+  InitMemory8080(&task->state);
+  if (job->image)
+	MapImage8080(&task->state, job->image);
+  if (job->rom)
+	LoadMemory8080(&task->state, job->loadAddress, job->rom, size);
+  if (job->tracePath && EnableTrace8080(&task->state, job->tracePath, 0))
+  {
+	FreeMemory8080(&task->state);
+	return -1;
+  }
+  if (pool->options->tier == TIER_BLOCKS && !interpOnly)
+  {
+	if (job->graph)
+	  PreloadBlockCache8080(&task->state, job->graph);
+	else
+	  EnableBlockCache8080(&task->state);
+  }
+  else if (pool->options->tier == TIER_JIT && !job->tracePath && !interpOnly)
+	EnableJit8080(&task->state);
+  else if (pool->options->tier == TIER_AOT && job->rom && !interpOnly)
+	EnableAot8080(&task->state, pool->options->aotDir ?
+	              pool->options->aotDir : ".", job->rom, job->loadAddress,
+	              size);
+  if (pool->options->profilePeriod)
+	EnableProfile8080(&task->state, pool->options->profilePeriod);
+  InitScheduler8080(&task->scheduler);
+  if ((pool->options->interruptPeriod &&
+	   !ScheduleEvent8080(&task->scheduler, pool->options->interruptPeriod,
+	                      pool->options->interruptPeriod, EVENT8080_WAKE,
+	                      RaiseInterrupt8080,
+	                      (void *)(uintptr_t)pool->options->interruptRst)) ||
+	  (pool->options->video && startVideo(pool, task)) ||
+	  (task->stub &&
+	   EnableDebug8080(&task->state, tierRun(pool->options->tier))))
+  {
+	FreeScheduler8080(&task->scheduler);
+	DisableDebug8080(&task->state);
+	DisableVideo8080(&task->state);
+	DisableProfile8080(&task->state);
+	DisableTrace8080(&task->state);
+	DisableAot8080(&task->state);
+	DisableJit8080(&task->state);
+	DisableBlockCache8080(&task->state);
+	FreeMemory8080(&task->state);
+	return -1;
+  }
+  SelectCore8080(&task->state, EMU8080_LAZY_FLAGS ? CORE8080_LAZY : 0);
+  task->started = 1;
+  return 0;
+}
+
+/*
+ * hand the results back to the job and release the machine
+ */
+static void finishTask(BatchPool8080 *pool, BatchTask8080 *task,
+                       StopReason8080 reason)
+{
+  BatchJob8080 *job = task->job;
+
+  if (task->state.video)
+  {
+	job->frames = task->state.video->frames;
+	job->frameHash = task->state.video->hash;
+	if (task->state.video->error)
+	  job->error = 1;
+	DisableVideo8080(&task->state);
+  }
+  DisableDebug8080(&task->state);
+  DisableAot8080(&task->state);
+  DisableJit8080(&task->state);
+  DisableBlockCache8080(&task->state);
+  if (DisableTrace8080(&task->state))
+	job->error = 1;
+  job->reason = reason;
+  job->cycles = task->state.cycles;
+  job->skipped = task->scheduler.skipped + task->scheduler.spun;
+  FreeScheduler8080(&task->scheduler);
+  if (!pool->options->keepMemory)
+	FreeMemory8080(&task->state);
+  job->final = task->state;
+}
+
+/*
+ * GdbRun8080 of the debugged task, keeps to the job's cycle limit
+ */
+static StopReason8080 runDebugged(State8080 *state, void *opaque,
+                                  uint64_t cycle_budget)
+{
+  BatchTask8080 *task = opaque;
+  uint64_t limit = task->job->maxCycles ? task->job->maxCycles : UINT64_MAX;
+  RunResult8080 result;
+
+  if (state->cycles >= limit)
+	return RUN8080_BUDGET;
+  if (cycle_budget > limit - state->cycles)
+	cycle_budget = limit - state->cycles;
+  result = RunScheduled8080(state, &task->scheduler, RunDebug8080,
+                            cycle_budget);
+  if (result.reason == RUN8080_HALT)
+	return RUN8080_HALT;
+  return state->cycles >= limit ? RUN8080_BUDGET : RUN8080_RUNNING;
+}
+
+/*
+ * run one time slice of a task. a debugger waiting for the task is
+ * served first, the slice goes on once it detaches.
+ * @return 1 when the job is finished
+ */
+static int runSlice(BatchPool8080 *pool, BatchTask8080 *task)
+{
+  BatchJob8080 *job = task->job;
+  State8080 *state = &task->state;
+  uint64_t limit = job->maxCycles ? job->maxCycles : UINT64_MAX;
+  uint64_t end = state->cycles + pool->options->sliceCycles;
+  RunTier8080 run;
+
+  if (!task->started && startTask(pool, task))
+  {
+	job->error = 1;
+	return 1;
+  }
+  if (end > limit)
+	end = limit;
+
+  run = tierRun(pool->options->tier);
+  if (task->stub)
+  {
+	run = RunDebug8080;
+	if (PollGdbStub8080(task->stub))
+	{
+	  StopReason8080 reason = ServeGdb8080(task->stub, state, runDebugged,
+	                                       task);
+
+	  if (reason != RUN8080_RUNNING)
+	  {
+		finishTask(pool, task, reason);
+		return 1;
+	  }
+	}
+  }
+
+  while (state->cycles < end)
+  {
+	RunResult8080 result;
+
+	result = RunScheduled8080(state, &task->scheduler, run,
+	                          end - state->cycles);
+	if (result.reason == RUN8080_HALT)
+	{
+	  finishTask(pool, task, RUN8080_HALT);
+	  return 1;
+	}
+  }
+
+  if (state->cycles >= limit)
+  {
+	finishTask(pool, task, RUN8080_BUDGET);
+	return 1;
+  }
+  return 0;
+}
+
+/*
+ * TIER_LOCKSTEP: a run of consecutive jobs, the lanes of one engine
+ */
+typedef struct LockstepShard8080 {
+	BatchPool8080 *pool;
+	size_t first; // task of lane 0
+	size_t count;
+	int error; // the engine could not be created
+}LockstepShard8080;
+
+/*
+ * run the lanes of a shard a slice at a time, until every lane
+ * halted or reached its maxCycles
+ */
+static void *runShard(void *arg)
+{
+  LockstepShard8080 *shard = arg;
+  BatchPool8080 *pool = shard->pool;
+  BatchTask8080 *tasks = &pool->tasks[shard->first];
+  Lockstep8080 *engine = CreateLockstep8080(shard->count);
+  size_t n;
+
+  if (!engine)
+  {
+	shard->error = 1;
+	return NULL;
+  }
+  for (n = 0; n < shard->count; n++)
+  {
+	// a lane that never starts is left at limit 0
+	engine->limit[n] = 0;
+	if (startTask(pool, &tasks[n]))
+	{
+	  tasks[n].job->error = 1;
+	  continue;
+	}
+	LoadLane8080(engine, n, &tasks[n].state);
+	if (tasks[n].job->maxCycles)
+	  engine->limit[n] = tasks[n].job->maxCycles;
+	else
+	  engine->limit[n] = UINT64_MAX;
+  }
+
+  for (;;)
+  {
+	RunLockstep8080(engine, pool->options->sliceCycles);
+	for (n = 0; n < shard->count; n++)
+	  if (!engine->halted[n] && engine->cycles[n] < engine->limit[n])
+		break;
+	if (n == shard->count)
+	  break;
+  }
+
+  for (n = 0; n < shard->count; n++)
+  {
+	if (!tasks[n].started)
+	  continue;
+	StoreLane8080(engine, n, &tasks[n].state);
+	finishTask(pool, &tasks[n],
+	           engine->halted[n] ? RUN8080_HALT : RUN8080_BUDGET);
+  }
+  DestroyLockstep8080(engine);
+  return NULL;
+}
+
+/*
+ * TIER_LOCKSTEP: the jobs are split into a shard of consecutive
+ * jobs per worker, the calling thread runs the first
+ * @return 0 on success, -1 when out of memory
+ */
+static int runLockstep(BatchPool8080 *pool, pthread_t *threads)
+{
+  LockstepShard8080 *shards = calloc(pool->workers, sizeof(LockstepShard8080));
+  size_t first = 0;
+  int started, i, ret = 0;
+
+  if (!shards)
+	return -1;
+  for (i = 0; i < pool->workers; i++)
+  {
+	shards[i].pool = pool;
+	shards[i].first = first;
+	shards[i].count = (pool->count - first) / (pool->workers - i);
+	first += shards[i].count;
+  }
+  for (started = 1; started < pool->workers; started++)
+	if (pthread_create(&threads[started], NULL, runShard, &shards[started]))
+	  break;
+  runShard(&shards[0]);
+  // shards left without a thread of their own run here as well
+  for (i = started; i < pool->workers; i++)
+	runShard(&shards[i]);
+  for (i = 1; i < started; i++)
+	pthread_join(threads[i], NULL);
+  for (i = 0; i < pool->workers; i++)
+	if (shards[i].error)
+	  ret = -1;
+  free(shards);
+  return ret;
+}
+
+/*
+ * whether a batch can run in lockstep, the engine has no scheduler
+ * and no hooks
+ */
+static int lockstepFits(const BatchJob8080 *jobs, size_t count,
+                        const BatchOptions8080 *options)
+{
+  size_t n;
+
+  if (options->interruptPeriod || options->video || options->profilePeriod ||
+	  (options->gdbPort && options->gdbJob < count))
+	return 0;
+  for (n = 0; n < count; n++)
+	if (jobs[n].tracePath)
+	  return 0;
+  return 1;
+}
+
+static void *workerMain(void *arg)
+{
+  BatchWorker8080 *worker = arg;
+  BatchPool8080 *pool = worker->pool;
+  WorkDeque8080 *own = &pool->deques[worker->id];
+
+  while (atomic_load(&pool->remaining) > 0)
+  {
+	size_t task, seen;
+	int found, i, wait;
+
+	pthread_mutex_lock(&pool->idleLock);
+	seen = pool->pushes;
+	pthread_mutex_unlock(&pool->idleLock);
+	found = popBottom(pool, own, &task);
+	// busy victims are skipped at first, and waited for before
+	// going to sleep
+	for (wait = 0; !found && wait < 2; wait++)
+	  for (i = 1; !found && i < pool->workers; i++)
+		found = stealTop(pool,
+		                 &pool->deques[(worker->id + i) % pool->workers],
+		                 &task, wait);
+	if (!found)
+	{
+	  waitForWork(pool, seen);
+	  continue;
+	}
+
+	if (runSlice(pool, &pool->tasks[task]))
+	{
+	  if (atomic_fetch_sub(&pool->remaining, 1) == 1)
+		finishPool(pool);
+	}
+	else
+	  pushTask(pool, own, task);
+  }
+  return NULL;
+}
+
+/*
+ * run a batch of jobs to completion
+ * @param jobs jobs to run, results are written back into them
+ * @param count number of jobs
+ * @param options threads, slice length, tier, NULL for defaults
+ * @return 0 on success, -1 if the pool or the debugger port could
+ * not be set up
+ */
+int RunBatch8080(BatchJob8080 *jobs, size_t count,
+                 const BatchOptions8080 *options)
+{
+  BatchOptions8080 opts = { 0, 0, TIER_INTERPRETER, 0, 0, 0, 0, NULL, NULL, 0,
+                            0, 0 };
+  BatchPool8080 pool;
+  BatchWorker8080 *workers;
+  pthread_t *threads;
+  int started, inited = 0, i, ret = 0;
+  size_t n;
+
+  if (count == 0)
+	return 0;
+  if (options)
+	opts = *options;
+  if (opts.threads <= 0)
+  {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	opts.threads = cpus > 0 ? (int)cpus : 1;
+  }
+  if ((size_t)opts.threads > count)
+	opts.threads = (int)count;
+  if (opts.sliceCycles == 0)
+	opts.sliceCycles = DEFAULT_SLICE_CYCLES;
+  if (opts.tier == TIER_LOCKSTEP && !lockstepFits(jobs, count, &opts))
+	opts.tier = TIER_INTERPRETER;
+
+  pool.options = &opts;
+  pool.count = count;
+  pool.stub.listenFd = pool.stub.fd = -1;
+  pool.workers = opts.threads;
+  atomic_init(&pool.remaining, count);
+  pthread_mutex_init(&pool.idleLock, NULL);
+  pthread_cond_init(&pool.wake, NULL);
+  pool.pushes = 0;
+  pool.tasks = calloc(count, sizeof(BatchTask8080));
+  pool.deques = calloc(opts.threads, sizeof(WorkDeque8080));
+  workers = calloc(opts.threads, sizeof(BatchWorker8080));
+  threads = calloc(opts.threads, sizeof(pthread_t));
+  if (!pool.tasks || !pool.deques || !workers || !threads)
+  {
+	ret = -1;
+	goto out;
+  }
+
+  for (i = 0; i < opts.threads; i++, inited++)
+  {
+	pthread_mutex_init(&pool.deques[i].lock, NULL);
+	pool.deques[i].items = malloc(count * sizeof(size_t));
+	if (!pool.deques[i].items)
+	  ret = -1;
+	workers[i].pool = &pool;
+	workers[i].id = i;
+  }
+  if (ret)
+	goto out;
+  if (opts.gdbPort && opts.gdbJob < count)
+  {
+	if (OpenGdbStub8080(&pool.stub, opts.gdbPort))
+	{
+	  ret = -1;
+	  goto out;
+	}
+	pool.tasks[opts.gdbJob].stub = &pool.stub;
+  }
+
+  // deal the jobs out, in reverse so each worker pops them in order
+  for (n = count; n-- > 0;)
+  {
+	jobs[n].error = 0;
+	pool.tasks[n].job = &jobs[n];
+	pushBottom(&pool, &pool.deques[n % opts.threads], n);
+  }
+  if (opts.tier == TIER_LOCKSTEP)
+  {
+	ret = runLockstep(&pool, threads);
+	goto out;
+  }
+
+  // the calling thread is worker 0
+  for (started = 1; started < opts.threads; started++)
+	if (pthread_create(&threads[started], NULL, workerMain, &workers[started]))
+	  break;
+  workerMain(&workers[0]);
+  for (i = 1; i < started; i++)
+	pthread_join(threads[i], NULL);
+
+out:
+  CloseGdbStub8080(&pool.stub);
+  for (i = 0; i < inited; i++)
+  {
+	pthread_mutex_destroy(&pool.deques[i].lock);
+	free(pool.deques[i].items);
+  }
+  pthread_cond_destroy(&pool.wake);
+  pthread_mutex_destroy(&pool.idleLock);
+  free(pool.deques);
+  free(pool.tasks);
+  free(workers);
+  free(threads);
+  return ret;
+}
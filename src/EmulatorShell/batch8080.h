@@ -0,0 +1,86 @@
+#ifndef BATCH_8080_H
+#define BATCH_8080_H
+
+/*
+ * batch8080.h
+ * runs many independent machines from one process. each job gets
+ * its own State8080, jobs are spread over a work-stealing pool of
+ * threads and run in time slices. jobs only share the read only or
+ * copy-on-write pages of a common image.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "scheduler8080.h"
+#include "video8080.h"
+#include "flowGraph8080.h"
+
+/*
+ * execution tier used for every job of a batch
+ */
+typedef enum ExecTier8080 {
+  TIER_INTERPRETER = 0, // Run8080
+  TIER_BLOCKS, // RunBlocks8080
+  TIER_JIT, // RunJit8080, interpreter when no JIT is available
+  TIER_AOT, // RunAot8080 with the module of the rom, see aot8080.h
+  TIER_LOCKSTEP // consecutive jobs the lanes of a lockstep engine per
+                // thread, see lockstep8080.h, interpreter for batches
+                // with interrupts, video, profiles, traces or a debugger
+}ExecTier8080;
+
+typedef struct BatchOptions8080 {
+	int threads; // worker threads, 0 for one per online CPU
+	uint64_t sliceCycles; // machine states per time slice, 0 for default
+	ExecTier8080 tier;
+	int keepMemory; // keep each job's final memory in job->final
+	uint32_t profilePeriod; // profile each job, see EnableProfile8080, 0 for none
+	uint64_t interruptPeriod; // raise RST interruptRst this often, 0 for never
+	uint8_t interruptRst;
+	const char *aotDir; // where TIER_AOT looks for modules, NULL for "."
+	const VideoConfig8080 *video; // frame buffer of every job, NULL for none
+	uint64_t framePeriod; // machine states per frame, 0 for 60 Hz at 2 MHz
+	uint16_t gdbPort; // serve job gdbJob to GDB on 127.0.0.1, 0 for none
+	size_t gdbJob;
+}BatchOptions8080;
+
+/*
+ * one machine to run. IN and OUT are ignored (IN leaves A alone),
+ * the job ends on HLT or when maxCycles is reached. with an
+ * interruptPeriod a HLT only ends the job while interrupts are
+ * disabled, otherwise the clock skips ahead to the next interrupt.
+ * a debugger can attach to the gdbJob between time slices, see
+ * gdb8080.h, the job then runs in the worker serving the debugger.
+ */
+typedef struct BatchJob8080 {
+	// input
+	const Image8080 *image; // mapped into zeroed memory first, may be NULL
+	const uint8_t *rom; // copied into memory after the image, may be NULL
+	size_t romSize;
+	uint16_t loadAddress;
+	State8080 initial; // registers and flags, memory and tiers ignored
+	uint64_t maxCycles; // machine states before the job is stopped, 0 for none
+	const char *tracePath; // record an execution trace here, NULL for
+	                       // none. traced jobs don't use the JIT.
+	const char *videoPath; // stream raw frames here, see StreamVideo8080
+	const FlowGraph8080 *graph; // of the rom, TIER_BLOCKS decodes its
+	                            // blocks before the first slice, may be NULL
+	// output
+	State8080 final; // registers at the end, with keepMemory also the
+	                 // memory, release it with FreeMemory8080(), and
+	                 // with profilePeriod the profile, release it with
+	                 // DisableProfile8080()
+	StopReason8080 reason; // RUN8080_HALT or RUN8080_BUDGET
+	uint64_t cycles; // machine states run
+	uint64_t skipped; // of which skipped while halted or in idle loops
+	uint64_t frames; // frames rendered with a video config
+	uint64_t frameHash; // hash of the last frame
+	int error; // nonzero if the job could not be set up
+}BatchJob8080;
+
+int RunBatch8080(BatchJob8080 *jobs, size_t count,
+                 const BatchOptions8080 *options);
+
+#endif
@@ -0,0 +1,356 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "opcodes8080.h"
+#include "ops8080.h"
+#include "blockCache8080.h"
+#include "profile8080.h"
+#include "trace8080.h"
+#include "coverage8080.h"
+#include "debug8080.h"
+
+#define BLOCK_MAX_OPS 32 // instructions per decoded block
+#define BLOCK_SLOTS 1024 // direct mapped cache slots, power of two
+
+/*
+ * one predecoded instruction
+ */
+typedef struct DecodedOp8080 {
+	OpHandler8080 handler;
+	uint8_t lo; // immediate operands
+	uint8_t hi;
+	uint8_t cycles; // base machine states
+	uint8_t attr; // OPA_* bits
+	uint8_t length;
+	uint8_t opcode;
+	uint16_t next; // address of the following instruction
+}DecodedOp8080;
+
+/*
+ * a decoded straight-line run, ending after a branch or a stop
+ * instruction. a store to one of its pages drops it from the entry
+ * table, the slot is decoded again on the next visit.
+ */
+typedef struct DecodedBlock8080 {
+	uint16_t start;
+	uint16_t count; // 0 for an empty slot
+	uint8_t pages[2]; // the pages holding its 8080 code
+	uint32_t span; // most machine states of all but the last instruction
+	DecodedOp8080 ops[BLOCK_MAX_OPS];
+}DecodedBlock8080;
+
+typedef struct BlockCache8080 {
+	uint8_t invalidated; // a store hit cached code during this block
+	uint64_t reach[256][4]; // bit set of the pages whose blocks have code
+	                        // in each page as well
+	DecodedBlock8080 *entry[65536]; // valid block starting at each address
+	DecodedBlock8080 slots[BLOCK_SLOTS];
+}BlockCache8080;
+
+static inline DecodedBlock8080 *slotFor(BlockCache8080 *cache, uint16_t pc)
+{
+  return &cache->slots[(pc ^ (pc >> 6)) & (BLOCK_SLOTS - 1)];
+}
+
+/*
+ * make room for the code of a block in one more page
+ * @return 0 when the block already has two other pages
+ */
+static int holdPage(DecodedBlock8080 *block, uint8_t page)
+{
+  if (page == block->pages[0] || page == block->pages[1])
+	return 1;
+  if (block->pages[1] != block->pages[0])
+	return 0;
+  block->pages[1] = page;
+  return 1;
+}
+
+/*
+ * decode the block starting at pc into its slot. unconditional jumps
+ * and calls don't end a block, decoding carries on at their target
+ * as long as the code stays in two pages.
+ */
+static DecodedBlock8080 *decodeBlock(State8080 *state, BlockCache8080 *cache,
+                                     uint16_t pc)
+{
+  DecodedBlock8080 *block = slotFor(cache, pc);
+  uint16_t addr = pc;
+  uint32_t span = 0, most = 0;
+  int n;
+
+  if (block->count && cache->entry[block->start] == block)
+	cache->entry[block->start] = NULL;
+  block->pages[0] = block->pages[1] = pc >> 8;
+  for (n = 0; n < BLOCK_MAX_OPS; n++)
+  {
+	uint8_t opcode;
+	const OpcodeInfo8080 *info;
+	DecodedOp8080 *op = &block->ops[n];
+
+	// breakpoints start blocks of their own
+	if (n > 0 && state->debug && debugBit8080(state->debug->breaks, addr))
+	  break;
+	opcode = readMemory8080(state, addr);
+	info = &opcodeTable8080[opcode];
+	if (!holdPage(block, addr >> 8) ||
+		!holdPage(block, (uint16_t)(addr + info->length - 1) >> 8))
+	  break;
+	span += most;
+	op->handler = opHandlers8080[opcode];
+	// only the operand bytes, reads of device pages are seen
+	op->lo = info->length > 1 ? readMemory8080(state, addr + 1) : 0;
+	op->hi = info->length > 2 ? readMemory8080(state, addr + 2) : 0;
+	op->cycles = info->cycles;
+	op->attr = info->attr;
+	op->length = info->length;
+	op->opcode = opcode;
+	op->next = addr + info->length;
+	addr = op->next;
+	most = info->cyclesTaken > info->cycles ? info->cyclesTaken : info->cycles;
+	if (info->kind == OPK_JMP || info->kind == OPK_CALL)
+	  addr = op->lo | op->hi << 8;
+	else if (info->attr & (OPA_BRANCH | OPA_STOP))
+	{
+	  n++;
+	  break;
+	}
+  }
+
+  block->start = pc;
+  block->count = n;
+  block->span = span;
+  cache->entry[pc] = block;
+  if (block->pages[1] != block->pages[0])
+	cache->reach[block->pages[1]][block->pages[0] >> 6] |=
+	  1ULL << (block->pages[0] & 63);
+  markCode8080(state, block->pages[0], CODE_BLOCKS);
+  markCode8080(state, block->pages[1], CODE_BLOCKS);
+  return block;
+}
+
+/*
+ * find the decoded block for pc, decoding it if it isn't cached
+ * or went stale
+ */
+static inline DecodedBlock8080 *lookupBlock(State8080 *state,
+                                            BlockCache8080 *cache, uint16_t pc)
+{
+  DecodedBlock8080 *block = cache->entry[pc];
+
+  return block ? block : decodeBlock(state, cache, pc);
+}
+
+/*
+ * a store hit a page with decoded code, retire its blocks: the ones
+ * starting in the page and the ones starting in a page that reaches
+ * into it. the pages of the second kind lose all their blocks.
+ */
+void InvalidateBlockCache8080(State8080 *state, uint8_t page)
+{
+  BlockCache8080 *cache = state->blocks;
+  int n;
+
+  memset(&cache->entry[page << 8], 0, 256 * sizeof(DecodedBlock8080 *));
+  for (n = 0; n < 256; n++)
+	if (cache->reach[page][n >> 6] & (1ULL << (n & 63)))
+	  memset(&cache->entry[n << 8], 0, 256 * sizeof(DecodedBlock8080 *));
+  memset(cache->reach[page], 0, sizeof(cache->reach[page]));
+  cache->invalidated = 1;
+  state->codePages[page] &= ~CODE_BLOCKS;
+}
+
+/*
+ * end the block being replayed after the current instruction, for
+ * stores the run loop has to see before the next one
+ */
+void EndBlock8080(State8080 *state)
+{
+  if (state->blocks)
+	state->blocks->invalidated = 1;
+}
+
+/*
+ * attach a block cache to the machine
+ * @return 0 on success, -1 when out of memory
+ */
+int EnableBlockCache8080(State8080 *state)
+{
+  if (state->blocks)
+	return 0;
+  state->blocks = calloc(1, sizeof(BlockCache8080));
+  return state->blocks ? 0 : -1;
+}
+
+/*
+ * detach and free the block cache
+ */
+void DisableBlockCache8080(State8080 *state)
+{
+  int page;
+
+  if (!state->blocks)
+	return;
+  for (page = 0; page < 256; page++)
+	state->codePages[page] &= ~CODE_BLOCKS;
+  free(state->blocks);
+  state->blocks = NULL;
+}
+
+/*
+ * decode the blocks of a control flow graph ahead of the first run,
+ * so hot code doesn't pay for decoding when it is first reached.
+ * starts that share a slot keep the later block.
+ * @param graph built from the code currently in the machine's memory
+ * @return 0 on success, -1 when the cache can't be enabled
+ */
+int PreloadBlockCache8080(State8080 *state, const FlowGraph8080 *graph)
+{
+  uint32_t i;
+
+  if (EnableBlockCache8080(state))
+	return -1;
+  for (i = 0; i < graph->blockCount; i++)
+	lookupBlock(state, state->blocks, graph->blocks[i].start);
+  return 0;
+}
+
+/*
+ * Run8080 replaying predecoded blocks. stops at exactly the same
+ * instruction as Run8080 for the same budget.
+ *
+ * a block that fits in the budget whatever its branches do is
+ * replayed without budget checks: every record jumps straight to a
+ * copy of its handler body with the base cycles and attributes
+ * folded in, the way Run8080 dispatches. the pc is only stored for
+ * the instructions that read or change it, the block end or a store
+ * that may end the block. the last block of a run goes through the
+ * handler table one record at a time.
+ */
+RunResult8080 RunBlocks8080(State8080 *state, uint64_t cycle_budget)
+{
+  RunResult8080 result = { 0, RUN8080_BUDGET };
+  BlockCache8080 *cache = state->blocks;
+  Debug8080 *debug = state->debug;
+  const DecodedOp8080 *op, *end;
+  StopReason8080 reason;
+  uint64_t cycles = 0;
+  int spent;
+
+  if (!cache)
+	return Run8080(state, cycle_budget);
+
+  if (state->intPending && state->int_enable)
+	cycles += deliverInterrupt8080(state, state->intVector);
+  if (state->halted)
+  {
+	result.reason = RUN8080_HALT;
+	return result;
+  }
+  // the handlers are expanded strict, the machine may have last
+  // stepped a lazy variant
+  settleFlags8080(state);
+
+#define REPLAY_PC (OPA_BRANCH | OPA_STOP | OPA_MEMWRITE)
+#define REPLAY_STOP(kind) \
+  do { \
+	reason = stopReason8080(state, kind, &cycles); \
+	if (reason != RUN8080_RUNNING) \
+	{ \
+	  result.reason = reason; \
+	  goto done; \
+	} \
+  } while (0)
+#define REPLAY_BODY(code, length, base, kind, attr) \
+	if ((attr) & REPLAY_PC) \
+	  state->pc = op->next; \
+	spent = (base) + op8080_##code(state, op->lo, op->hi); \
+	cycles += spent; \
+	PROFILE8080_OP(state, op->next - (length), code, spent); \
+	TRACE8080_OP(state, op->next - (length), code, spent); \
+	COVER8080_OP(state, op->next - (length), attr); \
+	if ((attr) & OPA_STOP) \
+	  REPLAY_STOP(kind); \
+	if (((attr) & OPA_MEMWRITE) && cache->invalidated) \
+	  continue; \
+	if (++op == end) \
+	{ \
+	  if (!((attr) & REPLAY_PC)) \
+		state->pc = op[-1].next; \
+	  continue; \
+	} \
+	REPLAY_NEXT();
+
+#if EMU8080_COMPUTED_GOTO
+  static const void *const replay[256] = {
+#define OPCODE8080(code, ...) [code] = &&replay_##code,
+#include "opcodes8080.def"
+#undef OPCODE8080
+  };
+#define REPLAY_NEXT() goto *replay[op->opcode]
+#else
+#define REPLAY_NEXT() goto next
+#endif
+
+  while (cycles < cycle_budget)
+  {
+	DecodedBlock8080 *block;
+
+	if (debug && debugStop8080(debug, state->pc))
+	{
+	  result.reason = RUN8080_BREAK;
+	  break;
+	}
+	block = lookupBlock(state, cache, state->pc);
+	op = block->ops;
+	end = op + block->count;
+	cache->invalidated = 0;
+
+	if (cycle_budget - cycles > block->span)
+	{
+#if EMU8080_COMPUTED_GOTO
+	  REPLAY_NEXT();
+#define OPCODE8080(code, mnemonic, length, base, taken, fr, fw, kind, attr) \
+	  replay_##code: REPLAY_BODY(code, length, base, kind, attr)
+#include "opcodes8080.def"
+#undef OPCODE8080
+#else
+next:
+	  switch (op->opcode)
+	  {
+#define OPCODE8080(code, mnemonic, length, base, taken, fr, fw, kind, attr) \
+		case code: REPLAY_BODY(code, length, base, kind, attr)
+#include "opcodes8080.def"
+#undef OPCODE8080
+	  }
+#endif
+	}
+
+	for (; op < end; op++)
+	{
+	  state->pc = op->next;
+	  spent = op->cycles + op->handler(state, op->lo, op->hi);
+	  cycles += spent;
+	  PROFILE8080_OP(state, op->next - op->length, op->opcode, spent);
+	  TRACE8080_OP(state, op->next - op->length, op->opcode, spent);
+	  COVER8080_OP(state, op->next - op->length, op->attr);
+	  if (op->attr & OPA_STOP)
+		REPLAY_STOP(opcodeTable8080[op->opcode].kind);
+	  if (cycles >= cycle_budget ||
+		  ((op->attr & OPA_MEMWRITE) && cache->invalidated))
+		break;
+	}
+  }
+
+#undef REPLAY_NEXT
+#undef REPLAY_BODY
+#undef REPLAY_STOP
+#undef REPLAY_PC
+
+done:
+  result.cycles = cycles;
+  state->cycles += cycles;
+  return result;
+}
@@ -0,0 +1,26 @@
+#ifndef BLOCK_CACHE_8080_H
+#define BLOCK_CACHE_8080_H
+
+/*
+ * blockCache8080.h
+ * portable threaded code tier. straight-line runs of instructions
+ * are decoded once into arrays of {handler, operands, cycles}
+ * records, cached by start address and replayed without fetching
+ * from 8080 memory, each record jumping to an inlined copy of its
+ * handler. unconditional jumps and calls are followed while
+ * decoding, so they don't end a run. needs no executable memory.
+ */
+
+#include <stdint.h>
+
+#include "emulatorShell.h"
+#include "flowGraph8080.h"
+
+int EnableBlockCache8080(State8080 *state);
+void DisableBlockCache8080(State8080 *state);
+void InvalidateBlockCache8080(State8080 *state, uint8_t page);
+void EndBlock8080(State8080 *state);
+int PreloadBlockCache8080(State8080 *state, const FlowGraph8080 *graph);
+RunResult8080 RunBlocks8080(State8080 *state, uint64_t cycle_budget);
+
+#endif
@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "bus8080.h"
+
+/*
+ * check that a range covers whole pages
+ * @return number of pages, -1 if the range is not page aligned
+ */
+static int pageRange(uint16_t addr, size_t size)
+{
+  if ((addr & (PAGE8080_SIZE - 1)) || (size & (PAGE8080_SIZE - 1)) ||
+	  size == 0 || addr + size > 0x10000)
+	return -1;
+  return size >> PAGE8080_SHIFT;
+}
+
+/*
+ * empty bus, every page is memory and shows itself, no ports
+ */
+void InitBus8080(Bus8080 *bus)
+{
+  int n;
+
+  memset(bus, 0, sizeof(Bus8080));
+  for (n = 0; n < PAGE8080_COUNT; n++)
+	bus->home[n] = n;
+}
+
+/*
+ * put a device on a range of pages
+ * @param addr first address, page aligned
+ * @param size bytes, a multiple of the page size
+ * @param read called for every read, must not be NULL
+ * @param write called for every write, NULL to ignore writes
+ * @return 0 on success, -1 for a bad range
+ */
+int MapDevice8080(Bus8080 *bus, uint16_t addr, size_t size,
+                  DeviceRead8080 read, DeviceWrite8080 write, void *opaque)
+{
+  int first = addr >> PAGE8080_SHIFT;
+  int count = pageRange(addr, size);
+  int n;
+
+  if (count < 0 || !read)
+	return -1;
+  for (n = first; n < first + count; n++)
+  {
+	bus->devices[n].read = read;
+	bus->devices[n].write = write;
+	bus->devices[n].opaque = opaque;
+	bus->home[n] = n;
+  }
+  return 0;
+}
+
+/*
+ * make a range of pages show the memory at another address,
+ * reads and writes of either address see the same bytes. a mirror
+ * of a device page is that device, called with the address it was
+ * mapped at.
+ * @param addr first address of the mirror, page aligned
+ * @param size bytes, a multiple of the page size
+ * @param target first address of the memory shown, page aligned
+ * @return 0 on success, -1 for a bad range
+ */
+int MapMirror8080(Bus8080 *bus, uint16_t addr, size_t size, uint16_t target)
+{
+  int first = addr >> PAGE8080_SHIFT;
+  int home = target >> PAGE8080_SHIFT;
+  int count = pageRange(addr, size);
+  int n;
+
+  if (count < 0 || pageRange(target, size) < 0)
+	return -1;
+  for (n = 0; n < count; n++)
+  {
+	bus->devices[first + n] = bus->devices[home + n];
+	bus->home[first + n] = bus->home[home + n];
+  }
+  return 0;
+}
+
+/*
+ * handle IN and OUT of a port on the bus
+ * @param in handler for IN, NULL to stop Run8080 for the host
+ * @param out handler for OUT, NULL to stop Run8080 for the host
+ */
+void MapPort8080(Bus8080 *bus, uint8_t port, PortIn8080 in, PortOut8080 out,
+                 void *opaque)
+{
+  bus->ports[port].in = in;
+  bus->ports[port].out = out;
+  bus->ports[port].opaque = opaque;
+}
+
+/*
+ * connect a machine to a bus, NULL for plain memory. the bus must
+ * not change while it is attached.
+ */
+void AttachBus8080(State8080 *state, const Bus8080 *bus)
+{
+  state->bus = bus;
+  remapMemory8080(state);
+}
+
+/*
+ * the address a page shows, for mirrors the one in the page mirrored
+ */
+static inline uint16_t homeAddress(const Bus8080 *bus, uint16_t addr)
+{
+  return (bus->home[addr >> PAGE8080_SHIFT] << PAGE8080_SHIFT) |
+         (addr & (PAGE8080_SIZE - 1));
+}
+
+/*
+ * read from a page without a direct pointer, a device
+ */
+uint8_t readSlow8080(const State8080 *state, uint16_t addr)
+{
+  const Device8080 *device = &state->bus->devices[addr >> PAGE8080_SHIFT];
+
+  return device->read(device->opaque, homeAddress(state->bus, addr));
+}
+
+/*
+ * write to a page without a direct pointer. devices get the
+ * write, mirrors forward it to the page they show, shared pages
+ * are copied and ROM drops it. the store was already traced by
+ * writeMemory8080, the mirror path doesn't go through it again.
+ */
+void writeSlow8080(State8080 *state, uint16_t addr, uint8_t value)
+{
+  const Bus8080 *bus = state->bus;
+  int n = addr >> PAGE8080_SHIFT;
+  uint8_t *page;
+
+  if (bus)
+  {
+	if (bus->devices[n].read)
+	{
+	  if (bus->devices[n].write)
+		bus->devices[n].write(bus->devices[n].opaque,
+		                      homeAddress(bus, addr), value);
+	  return;
+	}
+	addr = homeAddress(bus, addr);
+	n = addr >> PAGE8080_SHIFT;
+  }
+
+  page = state->writePage[n];
+  if (!page)
+	page = writeFault8080(state, n);
+  if (!page)
+	return;
+  page[addr & (PAGE8080_SIZE - 1)] = value;
+  if (state->codePages[n])
+	invalidateCode8080(state, addr);
+}
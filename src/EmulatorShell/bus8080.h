@@ -0,0 +1,58 @@
+#ifndef BUS_8080_H
+#define BUS_8080_H
+
+/*
+ * bus8080.h
+ * memory-mapped devices, mirrored memory and I/O ports. the bus
+ * is a page table of 256 byte regions: plain RAM and ROM pages are
+ * read straight through state->readPage, device pages have no
+ * direct pointer and go through their callbacks, mirror pages show
+ * the memory of another page. IN and OUT reach the port table, ports
+ * without a handler still stop Run8080 for the host.
+ *
+ * a bus is set up once and then attached to any number of machines,
+ * forks of a machine share its bus. device state belongs to the
+ * host and is not forked.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emulatorShell.h"
+
+typedef uint8_t (*DeviceRead8080)(void *opaque, uint16_t addr);
+typedef void (*DeviceWrite8080)(void *opaque, uint16_t addr, uint8_t value);
+typedef uint8_t (*PortIn8080)(void *opaque, uint8_t port);
+typedef void (*PortOut8080)(void *opaque, uint8_t port, uint8_t value);
+
+/*
+ * memory-mapped device, callbacks get the full 16 bit address, in
+ * the pages the device was mapped at, also through a mirror
+ */
+typedef struct Device8080 {
+	DeviceRead8080 read; // NULL for pages that are not a device
+	DeviceWrite8080 write; // NULL to ignore writes
+	void *opaque;
+}Device8080;
+
+typedef struct Port8080 {
+	PortIn8080 in; // NULL to leave IN to the host
+	PortOut8080 out; // NULL to leave OUT to the host
+	void *opaque;
+}Port8080;
+
+typedef struct Bus8080 {
+	Device8080 devices[256]; // per page
+	uint8_t home[256]; // page whose memory each page shows
+	Port8080 ports[256];
+}Bus8080;
+
+void InitBus8080(Bus8080 *bus);
+int MapDevice8080(Bus8080 *bus, uint16_t addr, size_t size,
+                  DeviceRead8080 read, DeviceWrite8080 write, void *opaque);
+int MapMirror8080(Bus8080 *bus, uint16_t addr, size_t size, uint16_t target);
+void MapPort8080(Bus8080 *bus, uint8_t port, PortIn8080 in, PortOut8080 out,
+                 void *opaque);
+void AttachBus8080(State8080 *state, const Bus8080 *bus);
+
+#endif
@@ -0,0 +1,199 @@
+/*
+ * core8080.c
+ * one variant of the interpreter, see core8080.h. the Makefile
+ * compiles this file once per variant with CORE8080_FEATURES set to
+ * its CORE8080_* bits, which decide the EMU8080_* switches before
+ * any header is read. the hooks of the other features are compiled
+ * out, not skipped at run time.
+ */
+
+#ifndef CORE8080_FEATURES
+#error "build with -DCORE8080_FEATURES=<CORE8080_* bits>, see the Makefile"
+#endif
+
+// the bits of core8080.h, checked below once the header is in
+#undef EMU8080_PROFILE
+#undef EMU8080_TRACE
+#undef EMU8080_COVERAGE
+#undef EMU8080_LAZY_FLAGS
+#define EMU8080_PROFILE ((CORE8080_FEATURES & 0x01) != 0)
+#define EMU8080_TRACE ((CORE8080_FEATURES & 0x02) != 0)
+#define EMU8080_COVERAGE ((CORE8080_FEATURES & 0x04) != 0)
+#define EMU8080_LAZY_FLAGS ((CORE8080_FEATURES & 0x08) != 0)
+
+#include <stdint.h>
+
+#include "emulatorShell.h"
+#include "opcodes8080.h"
+#include "ops8080.h"
+#include "flags8080.h"
+#include "profile8080.h"
+#include "trace8080.h"
+#include "coverage8080.h"
+#include "core8080.h"
+
+_Static_assert(CORE8080_PROFILE == 0x01 && CORE8080_TRACE == 0x02 &&
+               CORE8080_COVERAGE == 0x04 && CORE8080_LAZY == 0x08,
+               "EMU8080_* switches out of step with core8080.h");
+_Static_assert(CORE8080_FEATURES < CORE8080_COUNT, "no such variant");
+
+#define CORE8080_PASTE(name, features) name##_##features
+#define CORE8080_EXPAND(name, features) CORE8080_PASTE(name, features)
+#define CORE8080_NAME(name) CORE8080_EXPAND(name, CORE8080_FEATURES)
+
+/*
+ * the machine may have last run a variant with the other flag
+ * mode. strict variants need S/Z/P written out before they start,
+ * lazy ones write them out before they return.
+ */
+static inline void enterCore(State8080 *state)
+{
+  if (!EMU8080_LAZY_FLAGS)
+	settleFlags8080(state);
+}
+
+static inline void leaveCore(State8080 *state)
+{
+  if (EMU8080_LAZY_FLAGS)
+	settleFlags8080(state);
+}
+
+/*
+ * Emulate8080Op of this variant
+ * @return machine states spent on the instruction
+ */
+int CORE8080_NAME(step8080)(State8080 *state)
+{
+  uint16_t pc = state->pc;
+  uint8_t opcode = readMemory8080(state, pc);
+  const OpcodeInfo8080 *info = &opcodeTable8080[opcode];
+  uint8_t lo = info->length > 1 ? readMemory8080(state, pc + 1) : 0;
+  uint8_t hi = info->length > 2 ? readMemory8080(state, pc + 2) : 0;
+  int extra = 0;
+
+  enterCore(state);
+  state->pc = pc + info->length;
+
+#if EMU8080_COMPUTED_GOTO
+  static const void *const dispatch[256] = {
+#define OPCODE8080(code, ...) [code] = &&do_##code,
+#include "opcodes8080.def"
+#undef OPCODE8080
+  };
+
+  goto *dispatch[opcode];
+#define OPCODE8080(code, ...) \
+  do_##code: extra = op8080_##code(state, lo, hi); goto done;
+#include "opcodes8080.def"
+#undef OPCODE8080
+done:
+#else
+  switch(opcode)
+  {
+#define OPCODE8080(code, ...) \
+	case code: extra = op8080_##code(state, lo, hi); break;
+#include "opcodes8080.def"
+#undef OPCODE8080
+  }
+#endif
+
+  PROFILE8080_OP(state, pc, opcode, info->cycles + extra);
+  TRACE8080_OP(state, pc, opcode, info->cycles + extra);
+  COVER8080_OP(state, pc, info->attr);
+  leaveCore(state);
+  return info->cycles + extra;
+}
+
+/*
+ * Run8080 of this variant
+ */
+RunResult8080 CORE8080_NAME(run8080)(State8080 *state, uint64_t cycle_budget)
+{
+  RunResult8080 result = { 0, RUN8080_BUDGET };
+  StopReason8080 reason;
+  uint64_t cycles = 0;
+  uint16_t pc;
+  uint8_t lo, hi;
+  int spent;
+
+  if (state->intPending && state->int_enable)
+	cycles += deliverInterrupt8080(state, state->intVector);
+  if (state->halted)
+  {
+	result.reason = RUN8080_HALT;
+	return result;
+  }
+  enterCore(state);
+
+  /*
+   * every opcode gets its own copy of fetch, execute and dispatch,
+   * with length, cycles and attributes folded in as constants
+   */
+#define RUN_BODY(code, length, base, kind, attr) \
+	lo = (length) > 1 ? readMemory8080(state, pc + 1) : 0; \
+	hi = (length) > 2 ? readMemory8080(state, pc + 2) : 0; \
+	state->pc = pc + (length); \
+	spent = (base) + op8080_##code(state, lo, hi); \
+	cycles += spent; \
+	PROFILE8080_OP(state, pc, code, spent); \
+	TRACE8080_OP(state, pc, code, spent); \
+	COVER8080_OP(state, pc, attr); \
+	if ((attr) & OPA_STOP) \
+	  RUN_STOP(kind); \
+	RUN_NEXT();
+#define RUN_STOP(kind) \
+  do { \
+	reason = stopReason8080(state, kind, &cycles); \
+	if (reason != RUN8080_RUNNING) \
+	{ \
+	  result.reason = reason; \
+	  goto done; \
+	} \
+  } while (0)
+
+#if EMU8080_COMPUTED_GOTO
+  static const void *const dispatch[256] = {
+#define OPCODE8080(code, ...) [code] = &&run_##code,
+#include "opcodes8080.def"
+#undef OPCODE8080
+  };
+
+#define RUN_NEXT() \
+  do { \
+	if (cycles >= cycle_budget) \
+	  goto done; \
+	pc = state->pc; \
+	goto *dispatch[readMemory8080(state, pc)]; \
+  } while (0)
+
+  RUN_NEXT();
+#define OPCODE8080(code, mnemonic, length, base, taken, fr, fw, kind, attr) \
+  run_##code: RUN_BODY(code, length, base, kind, attr)
+#include "opcodes8080.def"
+#undef OPCODE8080
+#else
+#define RUN_NEXT() continue
+
+  while (cycles < cycle_budget)
+  {
+	pc = state->pc;
+	switch(readMemory8080(state, pc))
+	{
+#define OPCODE8080(code, mnemonic, length, base, taken, fr, fw, kind, attr) \
+	  case code: RUN_BODY(code, length, base, kind, attr)
+#include "opcodes8080.def"
+#undef OPCODE8080
+	}
+  }
+#endif
+
+#undef RUN_NEXT
+#undef RUN_STOP
+#undef RUN_BODY
+
+done:
+  leaveCore(state);
+  result.cycles = cycles;
+  state->cycles += cycles;
+  return result;
+}
@@ -0,0 +1,71 @@
+#ifndef CORE_8080_H
+#define CORE_8080_H
+
+/*
+ * core8080.h
+ * the interpreter (Run8080 and Emulate8080Op) is built once for every
+ * combination of the features below, each variant with its hooks
+ * compiled in and everything else compiled out, so the plain variant
+ * has no instrumentation branches at all. a machine picks its variant
+ * once, from the hooks it has on, and keeps it until a hook is
+ * enabled or disabled. the variants are built from core8080.c, one
+ * object per entry of CORE8080_VARIANTS, see the Makefile.
+ *
+ * breakpoints need no variant, they are checked per block on the
+ * block tier (debug8080.h), and bus devices need none either, they
+ * already take the slow path through NULL page pointers.
+ */
+
+#include <stdint.h>
+
+#include "emulatorShell.h"
+
+/*
+ * features of a variant, the index into cores8080
+ */
+#define CORE8080_PROFILE  0x01 // EMU8080_PROFILE hooks, see profile8080.h
+#define CORE8080_TRACE    0x02 // EMU8080_TRACE hooks, see trace8080.h
+#define CORE8080_COVERAGE 0x04 // EMU8080_COVERAGE hooks, see coverage8080.h
+#define CORE8080_LAZY     0x08 // EMU8080_LAZY_FLAGS, see flags8080.h
+#define CORE8080_COUNT    16
+
+/*
+ * every variant with its name, CORE8080_VARIANT(features, name)
+ */
+#define CORE8080_VARIANTS \
+  CORE8080_VARIANT(0, "plain") \
+  CORE8080_VARIANT(1, "profile") \
+  CORE8080_VARIANT(2, "trace") \
+  CORE8080_VARIANT(3, "profile+trace") \
+  CORE8080_VARIANT(4, "coverage") \
+  CORE8080_VARIANT(5, "profile+coverage") \
+  CORE8080_VARIANT(6, "trace+coverage") \
+  CORE8080_VARIANT(7, "profile+trace+coverage") \
+  CORE8080_VARIANT(8, "lazy") \
+  CORE8080_VARIANT(9, "lazy+profile") \
+  CORE8080_VARIANT(10, "lazy+trace") \
+  CORE8080_VARIANT(11, "lazy+profile+trace") \
+  CORE8080_VARIANT(12, "lazy+coverage") \
+  CORE8080_VARIANT(13, "lazy+profile+coverage") \
+  CORE8080_VARIANT(14, "lazy+trace+coverage") \
+  CORE8080_VARIANT(15, "lazy+profile+trace+coverage")
+
+typedef struct Core8080 {
+	const char *name;
+	unsigned features; // CORE8080_* bits
+	RunResult8080 (*run)(State8080 *state, uint64_t cycle_budget);
+	int (*step)(State8080 *state);
+}Core8080;
+
+extern const Core8080 cores8080[CORE8080_COUNT];
+
+#define CORE8080_VARIANT(features, name) \
+  RunResult8080 run8080_##features(State8080 *state, uint64_t cycle_budget); \
+  int step8080_##features(State8080 *state);
+CORE8080_VARIANTS
+#undef CORE8080_VARIANT
+
+const Core8080 *SelectCore8080(State8080 *state, unsigned features);
+void reselectCore8080(State8080 *state);
+
+#endif
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "coverage8080.h"
+#include "core8080.h"
+
+/*
+ * attach an empty coverage map to a machine
+ * @return 0 on success, -1 when out of memory
+ */
+int EnableCoverage8080(State8080 *state)
+{
+  if (state->coverage)
+	return 0;
+  state->coverage = calloc(1, sizeof(Coverage8080));
+  if (!state->coverage)
+	return -1;
+  reselectCore8080(state);
+  return 0;
+}
+
+/*
+ * detach and free the coverage map
+ */
+void DisableCoverage8080(State8080 *state)
+{
+  free(state->coverage);
+  state->coverage = NULL;
+  reselectCore8080(state);
+}
+
+void ClearCoverage8080(Coverage8080 *coverage)
+{
+  memset(coverage->map, 0, sizeof(coverage->map));
+}
+
+/*
+ * hit count bucket bit of a counter: 1, 2, 3, 4-7, 8-15, 16-31,
+ * 32-127, 128+
+ */
+static uint8_t bucket(uint8_t hits)
+{
+  if (hits < 4)
+	return hits == 3 ? 0x04 : hits;
+  if (hits < 8)
+	return 0x08;
+  if (hits < 16)
+	return 0x10;
+  if (hits < 32)
+	return 0x20;
+  return hits < 128 ? 0x40 : 0x80;
+}
+
+/*
+ * add the buckets of a run to everything seen so far
+ * @param seen COVER8080_MAP_SIZE bytes of bucket bits, zeroed at the
+ * start of a campaign
+ * @return number of edges that hit a bucket they never hit before
+ */
+size_t MergeCoverage8080(uint8_t *seen, const Coverage8080 *coverage)
+{
+  size_t w, i, found = 0;
+
+  for (w = 0; w < COVER8080_MAP_SIZE / sizeof(uint64_t); w++)
+  {
+	uint64_t word;
+
+	// most of the map stays zero, skip it a word at a time
+	memcpy(&word, coverage->map + w * sizeof(uint64_t), sizeof(word));
+	if (!word)
+	  continue;
+	for (i = w * sizeof(uint64_t); i < (w + 1) * sizeof(uint64_t); i++)
+	{
+	  uint8_t bits = coverage->map[i] ? bucket(coverage->map[i]) : 0;
+
+	  if (bits & ~seen[i])
+	  {
+		seen[i] |= bits;
+		found++;
+	  }
+	}
+  }
+  return found;
+}
+
+/*
+ * @return number of edges hit at least once
+ */
+size_t CountCoverage8080(const uint8_t *seen)
+{
+  size_t i, count = 0;
+
+  for (i = 0; i < COVER8080_MAP_SIZE; i++)
+	count += seen[i] != 0;
+  return count;
+}
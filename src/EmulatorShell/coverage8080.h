@@ -0,0 +1,63 @@
+#ifndef COVERAGE_8080_H
+#define COVERAGE_8080_H
+
+/*
+ * coverage8080.h
+ * edge coverage for fuzzing. every executed branch instruction
+ * (jumps, calls, returns, restarts, PCHL) bumps the counter of the
+ * edge from its address to where it went, taken or not, in a 64 KiB
+ * map of hit counters, the same layout AFL and libFuzzer use. the
+ * counters of a run are folded into power of two buckets and merged
+ * into a map of everything seen so far to decide whether an input
+ * found something new.
+ *
+ * Run8080 and Emulate8080Op switch to a variant with the hooks while
+ * a map is attached (core8080.h). elsewhere the hooks only exist when
+ * built with EMU8080_COVERAGE, otherwise COVER8080_OP expands to
+ * nothing: RunBlocks8080 is hooked then, code run by the JIT is not
+ * covered.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emulatorShell.h"
+#include "opcodes8080.h"
+
+#ifndef EMU8080_COVERAGE
+#define EMU8080_COVERAGE 0
+#endif
+
+#define COVER8080_MAP_SIZE 0x10000
+
+typedef struct Coverage8080 {
+	uint8_t map[COVER8080_MAP_SIZE]; // hit counters per edge, wrapping
+}Coverage8080;
+
+/*
+ * count the edge of a branch instruction
+ * @param pc address of the branch, state->pc is where it went
+ */
+static inline void coverEdge8080(Coverage8080 *coverage,
+                                 const State8080 *state, uint16_t pc)
+{
+  coverage->map[(uint16_t)(pc * 0x9e37u) ^ state->pc]++;
+}
+
+#if EMU8080_COVERAGE
+#define COVER8080_OP(state, pc, attr) \
+  do { \
+	if (((attr) & OPA_BRANCH) && (state)->coverage) \
+	  coverEdge8080((state)->coverage, (state), (pc)); \
+  } while (0)
+#else
+#define COVER8080_OP(state, pc, attr) ((void)0)
+#endif
+
+int EnableCoverage8080(State8080 *state);
+void DisableCoverage8080(State8080 *state);
+void ClearCoverage8080(Coverage8080 *coverage);
+size_t MergeCoverage8080(uint8_t *seen, const Coverage8080 *coverage);
+size_t CountCoverage8080(const uint8_t *seen);
+
+#endif
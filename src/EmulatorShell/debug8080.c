@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emulatorShell.h"
+#include "blockCache8080.h"
+#include "bus8080.h"
+#include "debug8080.h"
+
+/*
+ * a breakpoint changed, blocks decoded across it are retired so
+ * they get split in front of it
+ */
+static void splitBlocks(State8080 *state, uint16_t addr)
+{
+  if (state->blocks)
+	InvalidateBlockCache8080(state, addr >> 8);
+}
+
+/*
+ * stores through a mirror land in the page it shows, watch that one
+ * @return the address stores to addr reach, -1 for device pages
+ */
+static int watchAddress(const State8080 *state, uint16_t addr)
+{
+  const Bus8080 *bus = state->bus;
+  int n = addr >> 8;
+
+  if (!bus)
+	return addr;
+  if (bus->devices[n].read)
+	return -1;
+  return (bus->home[n] << 8) | (addr & 0xff);
+}
+
+/*
+ * attach a debugger. the block cache is enabled, machines with
+ * points set run on it.
+ * @param tier runs the machine while no point is set
+ * @return 0 on success, -1 when out of memory
+ */
+int EnableDebug8080(State8080 *state, RunTier8080 tier)
+{
+  if (state->debug)
+	return 0;
+  if (EnableBlockCache8080(state))
+	return -1;
+  state->debug = calloc(1, sizeof(Debug8080));
+  if (!state->debug)
+	return -1;
+  state->debug->tier = tier ? tier : Run8080;
+  return 0;
+}
+
+/*
+ * drop every point and detach the debugger, the block cache stays
+ */
+void DisableDebug8080(State8080 *state)
+{
+  if (!state->debug)
+	return;
+  ClearPoints8080(state);
+  free(state->debug);
+  state->debug = NULL;
+}
+
+void SetBreakpoint8080(State8080 *state, uint16_t addr)
+{
+  Debug8080 *debug = state->debug;
+
+  if (debugBit8080(debug->breaks, addr))
+	return;
+  debug->breaks[addr >> 3] |= 1 << (addr & 7);
+  debug->breakCount++;
+  splitBlocks(state, addr);
+}
+
+void ClearBreakpoint8080(State8080 *state, uint16_t addr)
+{
+  Debug8080 *debug = state->debug;
+
+  if (!debugBit8080(debug->breaks, addr))
+	return;
+  debug->breaks[addr >> 3] &= ~(1 << (addr & 7));
+  debug->breakCount--;
+  splitBlocks(state, addr);
+}
+
+/*
+ * stop after every instruction that stores into addr
+ * @return 0 on success, -1 when addr belongs to a device
+ */
+int SetWatchpoint8080(State8080 *state, uint16_t addr)
+{
+  Debug8080 *debug = state->debug;
+  int home = watchAddress(state, addr);
+
+  if (home < 0)
+	return -1;
+  if (debugBit8080(debug->watches, home))
+	return 0;
+  debug->watches[home >> 3] |= 1 << (home & 7);
+  debug->watchCount++;
+  if (debug->watchPage[home >> 8]++ == 0)
+	state->codePages[home >> 8] |= CODE_WATCH;
+  return 0;
+}
+
+void ClearWatchpoint8080(State8080 *state, uint16_t addr)
+{
+  Debug8080 *debug = state->debug;
+  int home = watchAddress(state, addr);
+
+  if (home < 0 || !debugBit8080(debug->watches, home))
+	return;
+  debug->watches[home >> 3] &= ~(1 << (home & 7));
+  debug->watchCount--;
+  if (--debug->watchPage[home >> 8] == 0)
+	state->codePages[home >> 8] &= ~CODE_WATCH;
+}
+
+/*
+ * remove all breakpoints and watchpoints
+ */
+void ClearPoints8080(State8080 *state)
+{
+  Debug8080 *debug = state->debug;
+  int i;
+
+  for (i = 0; i < 0x10000 / 8; i++)
+  {
+	if (debug->breaks[i])
+	  splitBlocks(state, i << 3);
+	debug->breaks[i] = 0;
+	debug->watches[i] = 0;
+  }
+  for (i = 0; i < 256; i++)
+  {
+	debug->watchPage[i] = 0;
+	state->codePages[i] &= ~CODE_WATCH;
+  }
+  debug->breakCount = 0;
+  debug->watchCount = 0;
+}
+
+/*
+ * a store hit a page with watchpoints
+ */
+void WatchWrite8080(State8080 *state, uint16_t addr)
+{
+  Debug8080 *debug = state->debug;
+
+  if (!debugBit8080(debug->watches, addr))
+	return;
+  debug->hit = DEBUG8080_WATCHPOINT;
+  debug->hitAddr = addr;
+  EndBlock8080(state);
+}
+
+/*
+ * RunTier8080 of a debugged machine. a machine stopped at a
+ * breakpoint runs that instruction before the point is checked again.
+ * budgets one instruction can spend are single steps, they run on
+ * the interpreter, the translation tiers would run a whole block.
+ * @return RUN8080_BREAK when a point was hit, see state->debug->hit,
+ * otherwise like Run8080
+ */
+RunResult8080 RunDebug8080(State8080 *state, uint64_t cycle_budget)
+{
+  Debug8080 *debug = state->debug;
+  RunResult8080 step = { 0, RUN8080_BUDGET }, rest;
+
+  if (!debug)
+	return Run8080(state, cycle_budget);
+  debug->hit = DEBUG8080_NONE;
+  if (!debug->breakCount && !debug->watchCount)
+	return cycle_budget <= DEBUG8080_STEP_CYCLES ?
+	       Run8080(state, cycle_budget) : debug->tier(state, cycle_budget);
+
+  // an interrupt about to be taken leaves the breakpoint by itself
+  if (!state->halted && !(state->intPending && state->int_enable) &&
+	  debugBit8080(debug->breaks, state->pc))
+  {
+	step = Run8080(state, 1);
+	if (debug->hit)
+	  step.reason = RUN8080_BREAK;
+	if (step.reason != RUN8080_BUDGET || step.cycles >= cycle_budget)
+	  return step;
+  }
+
+  rest = RunBlocks8080(state, cycle_budget - step.cycles);
+  rest.cycles += step.cycles;
+  // the store that hit a watchpoint may have spent the budget
+  if (debug->hit)
+	rest.reason = RUN8080_BREAK;
+  return rest;
+}
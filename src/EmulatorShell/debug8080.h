@@ -0,0 +1,75 @@
+#ifndef DEBUG_8080_H
+#define DEBUG_8080_H
+
+/*
+ * debug8080.h
+ * breakpoints and write watchpoints. breakpoints are bits in a 64K
+ * bitmap indexed by address, tested once per block: while any point
+ * is set the machine runs on the block tier, and blocks are decoded
+ * so they end in front of every breakpoint. watchpoints are bits of
+ * a second bitmap, their pages carry CODE_WATCH so only stores into
+ * those pages reach the check, through the same hook that keeps the
+ * translation tiers coherent. pages replaced whole by Restore8080,
+ * LoadMemory8080 or LoadState8080 aren't stores and hit no
+ * watchpoint. with no points set RunDebug8080 hands
+ * the whole budget to the machine's own tier, single steps excepted.
+ */
+
+#include <stdint.h>
+
+#include "emulatorShell.h"
+#include "scheduler8080.h"
+
+#define DEBUG8080_STEP_CYCLES 18 // the longest instruction, XTHL
+
+/*
+ * why the machine stopped with RUN8080_BREAK
+ */
+typedef enum DebugHit8080 {
+  DEBUG8080_NONE = 0,
+  DEBUG8080_BREAKPOINT, // about to run the instruction at hitAddr
+  DEBUG8080_WATCHPOINT // the last instruction stored into hitAddr
+}DebugHit8080;
+
+typedef struct Debug8080 {
+	uint8_t breaks[0x10000 / 8]; // one bit per address
+	uint8_t watches[0x10000 / 8];
+	uint16_t watchPage[256]; // watched addresses in each page
+	uint32_t breakCount;
+	uint32_t watchCount;
+	DebugHit8080 hit;
+	uint16_t hitAddr;
+	RunTier8080 tier; // runs the machine while no point is set
+}Debug8080;
+
+int EnableDebug8080(State8080 *state, RunTier8080 tier);
+void DisableDebug8080(State8080 *state);
+void SetBreakpoint8080(State8080 *state, uint16_t addr);
+void ClearBreakpoint8080(State8080 *state, uint16_t addr);
+int SetWatchpoint8080(State8080 *state, uint16_t addr);
+void ClearWatchpoint8080(State8080 *state, uint16_t addr);
+void ClearPoints8080(State8080 *state);
+void WatchWrite8080(State8080 *state, uint16_t addr);
+RunResult8080 RunDebug8080(State8080 *state, uint64_t cycle_budget);
+
+static inline int debugBit8080(const uint8_t *bitmap, uint16_t addr)
+{
+  return (bitmap[addr >> 3] >> (addr & 7)) & 1;
+}
+
+/*
+ * block boundary check of the block tier
+ * @return 1 when the machine must stop in front of pc
+ */
+static inline int debugStop8080(Debug8080 *debug, uint16_t pc)
+{
+  if (debug->hit)
+	return 1;
+  if (!debugBit8080(debug->breaks, pc))
+	return 0;
+  debug->hit = DEBUG8080_BREAKPOINT;
+  debug->hitAddr = pc;
+  return 1;
+}
+
+#endif
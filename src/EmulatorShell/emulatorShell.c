@@ -1,323 +1,238 @@
-#include <stdlib.h>
 #include <stdint.h>
-#include <stdio.h>
+
+#include "emulatorShell.h"
+#include "opcodes8080.h"
+#include "ops8080.h"
+#include "jit8080.h"
+#include "blockCache8080.h"
+#include "bus8080.h"
+#include "profile8080.h"
+#include "trace8080.h"
+#include "coverage8080.h"
+#include "aot8080.h"
+#include "video8080.h"
+#include "debug8080.h"
+#include "flags8080.h"
+#include "core8080.h"
+
+const Core8080 cores8080[CORE8080_COUNT] = {
+#define CORE8080_VARIANT(features, name) \
+  [features] = { name, features, run8080_##features, step8080_##features },
+CORE8080_VARIANTS
+#undef CORE8080_VARIANT
+};
 
 /*
- * struct representing then 8080 flags
+ * handler table, indexed by opcode
  */
-typedef struct ConditionCodes {
-	uint8_t z:1;
-	uint8_t s:1;
-	uint8_t p:1;
-	uint8_t cy:1;
-	uint8_t ac:1;
-	uint8_t pad:3;
-}ConditionCodes;
+const OpHandler8080 opHandlers8080[256] = {
+#define OPCODE8080(code, ...) [code] = op8080_##code,
+#include "opcodes8080.def"
+#undef OPCODE8080
+};
 
 /*
- * struct representing the 8080 "state"
+ * resolve the address from a register pair
  */
-typedef struct State8080 {
-	uint8_t a; // register A
-	uint8_t b; // register B
-	uint8_t c; // register C
-	uint8_t d; // register D
-	uint8_t e; // register E
-	uint8_t h; // register H
-	uint8_t l; // register L
-	uint16_t sp; // stack pointer register
-	uint16_t pc; // program counter register
-	uint8_t *memory; // 8080 RAM, 0x0000 - 0xffff
-	struct ConditionCodes cc; // flags and stuff
-	uint8_t int_enable;
-}State8080;
+uint16_t resolveAddressInPair(uint8_t msb, uint8_t lsb)
+{
+  uint16_t ret = msb;
+  ret = (ret << 8) | lsb;
+  return ret;
+}
+
+static void invalidatePage(State8080 *state, uint8_t page)
+{
+  if ((state->codePages[page] & CODE_JIT) && state->jit)
+	InvalidateJit8080(state, page);
+  if ((state->codePages[page] & CODE_BLOCKS) && state->blocks)
+	InvalidateBlockCache8080(state, page);
+}
 
 /*
- * raise an error for an instruction
- * which has yet to be implemented
- * @param state State8080 * for current state of the 8080
- * processor
+ * drop the translations of a page and of the mirrors showing it
  */
-void UnimplementedInstruction(State8080 *state)
+static void invalidateTranslations(State8080 *state, uint8_t page)
 {
-  printf("Error: Unimplemented Instruction!\n");
-  exit(1);
+  int mirror;
+
+  invalidatePage(state, page);
+  if (!state->bus)
+	return;
+  for (mirror = 0; mirror < 256; mirror++)
+	if (mirror != page && state->bus->home[mirror] == page &&
+		state->codePages[mirror])
+	  invalidatePage(state, mirror);
 }
 
 /*
- * resolve the address from a register pair
+ * a write hit a page that an execution tier has cached code for,
+ * drop the stale translations, including those made through
+ * mirrors of the page
  */
-uint16_t resolveAddressInPair(uint8_t msb, uint8_t lsb)
+void invalidateCode8080(State8080 *state, uint16_t addr)
 {
-  uint16_t ret = msb;
-  ret = (ret << 8) | lsb;
-  return ret;
+  uint8_t page = addr >> 8;
+
+  if ((state->codePages[page] & CODE_AOT) && state->aot)
+	InvalidateAot8080(state, addr);
+  if ((state->codePages[page] & CODE_VIDEO) && state->video)
+	InvalidateVideo8080(state, addr);
+  if ((state->codePages[page] & CODE_WATCH) && state->debug)
+	WatchWrite8080(state, addr);
+  invalidateTranslations(state, page);
+}
+
+/*
+ * a whole page was replaced or loaded, not a single byte. that is
+ * no store of the machine's, watchpoints don't see it.
+ */
+void invalidateCodePage8080(State8080 *state, uint8_t page)
+{
+  if ((state->codePages[page] & CODE_AOT) && state->aot)
+	InvalidateAotPage8080(state, page);
+  if ((state->codePages[page] & CODE_VIDEO) && state->video)
+	InvalidateVideoPage8080(state, page);
+  invalidateTranslations(state, page);
+}
+
+/*
+ * an execution tier cached code from a page. a mirror page also
+ * marks the page it shows, stores only ever reach that one.
+ */
+void markCode8080(State8080 *state, uint8_t page, uint8_t bits)
+{
+  state->codePages[page] |= bits;
+  if (state->bus)
+	state->codePages[state->bus->home[page]] |= bits;
+}
+
+/*
+ * pick the interpreter variant of a machine. the hooks the machine
+ * has on (profile, trace, coverage) are added to features. without
+ * a call the first Run8080 or Emulate8080Op picks one with the flag
+ * mode of the build, like the other tiers use.
+ * @param features CORE8080_LAZY for lazy flags, or 0
+ * @return the variant, also kept in state->core
+ */
+const Core8080 *SelectCore8080(State8080 *state, unsigned features)
+{
+  features &= CORE8080_LAZY;
+  features |= state->profile ? CORE8080_PROFILE : 0;
+  features |= state->trace ? CORE8080_TRACE : 0;
+  features |= state->coverage ? CORE8080_COVERAGE : 0;
+  state->core = &cores8080[features];
+  return state->core;
+}
+
+/*
+ * a hook was enabled or disabled, a machine that already has a
+ * variant moves to the one with the new set of hooks
+ */
+void reselectCore8080(State8080 *state)
+{
+  if (state->core)
+	SelectCore8080(state, state->core->features);
+}
+
+static inline const Core8080 *coreOf(State8080 *state)
+{
+  if (state->core)
+	return state->core;
+  return SelectCore8080(state, EMU8080_LAZY_FLAGS ? CORE8080_LAZY : 0);
 }
 
 /*
  * emulate the current instruction at the program counter
  * according to the 8080 instruction set
+ * @return machine states spent on the instruction
  */
 int Emulate8080Op(State8080 *state)
 {
-  unsigned char *opcode = &state->memory[state->pc];
+  return coreOf(state)->step(state);
+}
+
+/*
+ * push the program counter and jump to a restart vector,
+ * the way the 8080 executes an interrupting RST. the machine states
+ * are left to the caller, a run loop counts them with its own.
+ * @return machine states spent on the RST
+ */
+int deliverInterrupt8080(State8080 *state, uint8_t rst)
+{
+  // the trace variants of the interpreter share this push, record
+  // it for them when the build has no store hook of its own
+  if (!EMU8080_TRACE && state->trace)
+  {
+	traceWrite8080(state->trace, state->sp - 1, state->pc >> 8);
+	traceWrite8080(state->trace, state->sp - 2, state->pc & 0xff);
+  }
+  push8080(state, state->pc);
+  state->pc = (rst & 7) << 3;
+  state->int_enable = 0;
+  state->intPending = 0;
+  state->halted = 0;
+  return opcodeTable8080[0xc7].cycles;
+}
+
+/*
+ * raise an interrupt with a RST instruction.
+ * if interrupts are disabled the interrupt is kept pending
+ * until the next EI.
+ * @param state State8080 * for current state of the 8080
+ * @param rst restart number 0 - 7
+ * @return 1 if the interrupt was taken right away
+ */
+int Interrupt8080(State8080 *state, uint8_t rst)
+{
+  if (!state->int_enable)
+  {
+	state->intPending = 1;
+	state->intVector = rst;
+	return 0;
+  }
+  state->cycles += deliverInterrupt8080(state, rst);
+  return 1;
+}
 
-  switch(*opcode)
+/*
+ * decide what an OPA_STOP instruction means for the run loop
+ * @param kind OPK_* kind of the instruction that stopped
+ * @param cycles run loop's count, gets the machine states of an
+ * interrupt delivered on EI
+ */
+StopReason8080 stopReason8080(State8080 *state, uint8_t kind,
+                              uint64_t *cycles)
+{
+  switch (kind)
   {
-	case 0x00: break;	// NOP
-	case 0x01:			// LXI B,D16
-	  state->c = opcode[1];
-	  state->b = opcode[2];
-	  state->pc += 2;
-	  break;
-	case 0x02: 			// STAX B
-	  state->memory[resolveAddressInPair (state->b, state->c)] =
-		  state->memory[state->a];
-	  break;
-	case 0x03:UnimplementedInstruction(state); break;
-	case 0x04:UnimplementedInstruction(state); break;
-	case 0x05:UnimplementedInstruction(state); break;
-	case 0x06:UnimplementedInstruction(state); break;
-	case 0x07:UnimplementedInstruction(state); break;
-	case 0x09:UnimplementedInstruction(state); break;
-	case 0x0a:UnimplementedInstruction(state); break;
-	case 0x0b:UnimplementedInstruction(state); break;
-	case 0x0c:UnimplementedInstruction(state); break;
-	case 0x0d:UnimplementedInstruction(state); break;
-	case 0x0e:UnimplementedInstruction(state); break;
-	case 0x0f:UnimplementedInstruction(state); break;
-	case 0x11:UnimplementedInstruction(state); break;
-	case 0x12:UnimplementedInstruction(state); break;
-	case 0x13:UnimplementedInstruction(state); break;
-	case 0x14:UnimplementedInstruction(state); break;
-	case 0x15:UnimplementedInstruction(state); break;
-	case 0x16:UnimplementedInstruction(state); break;
-	case 0x17:UnimplementedInstruction(state); break;
-	case 0x19:UnimplementedInstruction(state); break;
-	case 0x1a:UnimplementedInstruction(state); break;
-	case 0x1b:UnimplementedInstruction(state); break;
-	case 0x1c:UnimplementedInstruction(state); break;
-	case 0x1d:UnimplementedInstruction(state); break;
-	case 0x1e:UnimplementedInstruction(state); break;
-	case 0x1f:UnimplementedInstruction(state); break;
-	case 0x20:UnimplementedInstruction(state); break;
-	case 0x21:UnimplementedInstruction(state); break;
-	case 0x22:UnimplementedInstruction(state); break;
-	case 0x23:UnimplementedInstruction(state); break;
-	case 0x24:UnimplementedInstruction(state); break;
-	case 0x25:UnimplementedInstruction(state); break;
-	case 0x26:UnimplementedInstruction(state); break;
-	case 0x27:UnimplementedInstruction(state); break;
-	case 0x29:UnimplementedInstruction(state); break;
-	case 0x2a:UnimplementedInstruction(state); break;
-	case 0x2b:UnimplementedInstruction(state); break;
-	case 0x2c:UnimplementedInstruction(state); break;
-	case 0x2d:UnimplementedInstruction(state); break;
-	case 0x2e:UnimplementedInstruction(state); break;
-	case 0x2f:UnimplementedInstruction(state); break;
-	case 0x30:UnimplementedInstruction(state); break;
-	case 0x31:UnimplementedInstruction(state); break;
-	case 0x32:UnimplementedInstruction(state); break;
-	case 0x33:UnimplementedInstruction(state); break;
-	case 0x34:UnimplementedInstruction(state); break;
-	case 0x35:UnimplementedInstruction(state); break;
-	case 0x36:UnimplementedInstruction(state); break;
-	case 0x37:UnimplementedInstruction(state); break;
-	case 0x39:UnimplementedInstruction(state); break;
-	case 0x3a:UnimplementedInstruction(state); break;
-	case 0x3b:UnimplementedInstruction(state); break;
-	case 0x3c:UnimplementedInstruction(state); break;
-	case 0x3d:UnimplementedInstruction(state); break;
-	case 0x3e:UnimplementedInstruction(state); break;
-	case 0x3f:UnimplementedInstruction(state); break;
-	case 0x40:UnimplementedInstruction(state); break;
-	case 0x41:UnimplementedInstruction(state); break;
-	case 0x42:UnimplementedInstruction(state); break;
-	case 0x43:UnimplementedInstruction(state); break;
-	case 0x44:UnimplementedInstruction(state); break;
-	case 0x45:UnimplementedInstruction(state); break;
-	case 0x46:UnimplementedInstruction(state); break;
-	case 0x47:UnimplementedInstruction(state); break;
-	case 0x48:UnimplementedInstruction(state); break;
-	case 0x49:UnimplementedInstruction(state); break;
-	case 0x4a:UnimplementedInstruction(state); break;
-	case 0x4b:UnimplementedInstruction(state); break;
-	case 0x4c:UnimplementedInstruction(state); break;
-	case 0x4d:UnimplementedInstruction(state); break;
-	case 0x4e:UnimplementedInstruction(state); break;
-	case 0x4f:UnimplementedInstruction(state); break;
-	case 0x50:UnimplementedInstruction(state); break;
-	case 0x51:UnimplementedInstruction(state); break;
-	case 0x52:UnimplementedInstruction(state); break;
-	case 0x53:UnimplementedInstruction(state); break;
-	case 0x54:UnimplementedInstruction(state); break;
-	case 0x55:UnimplementedInstruction(state); break;
-	case 0x56:UnimplementedInstruction(state); break;
-	case 0x57:UnimplementedInstruction(state); break;
-	case 0x58:UnimplementedInstruction(state); break;
-	case 0x59:UnimplementedInstruction(state); break;
-	case 0x5a:UnimplementedInstruction(state); break;
-	case 0x5b:UnimplementedInstruction(state); break;
-	case 0x5c:UnimplementedInstruction(state); break;
-	case 0x5d:UnimplementedInstruction(state); break;
-	case 0x5e:UnimplementedInstruction(state); break;
-	case 0x5f:UnimplementedInstruction(state); break;
-	case 0x60:UnimplementedInstruction(state); break;
-	case 0x61:UnimplementedInstruction(state); break;
-	case 0x62:UnimplementedInstruction(state); break;
-	case 0x63:UnimplementedInstruction(state); break;
-	case 0x64:UnimplementedInstruction(state); break;
-	case 0x65:UnimplementedInstruction(state); break;
-	case 0x66:UnimplementedInstruction(state); break;
-	case 0x67:UnimplementedInstruction(state); break;
-	case 0x68:UnimplementedInstruction(state); break;
-	case 0x69:UnimplementedInstruction(state); break;
-	case 0x6a:UnimplementedInstruction(state); break;
-	case 0x6b:UnimplementedInstruction(state); break;
-	case 0x6c:UnimplementedInstruction(state); break;
-	case 0x6d:UnimplementedInstruction(state); break;
-	case 0x6e:UnimplementedInstruction(state); break;
-	case 0x6f:UnimplementedInstruction(state); break;
-	case 0x70:UnimplementedInstruction(state); break;
-	case 0x71:UnimplementedInstruction(state); break;
-	case 0x72:UnimplementedInstruction(state); break;
-	case 0x73:UnimplementedInstruction(state); break;
-	case 0x74:UnimplementedInstruction(state); break;
-	case 0x75:UnimplementedInstruction(state); break;
-	case 0x76:UnimplementedInstruction(state); break;
-	case 0x77:UnimplementedInstruction(state); break;
-	case 0x78:UnimplementedInstruction(state); break;
-	case 0x79:UnimplementedInstruction(state); break;
-	case 0x7a:UnimplementedInstruction(state); break;
-	case 0x7b:UnimplementedInstruction(state); break;
-	case 0x7c:UnimplementedInstruction(state); break;
-	case 0x7d:UnimplementedInstruction(state); break;
-	case 0x7e:UnimplementedInstruction(state); break;
-	case 0x7f:UnimplementedInstruction(state); break;
-	case 0x80:UnimplementedInstruction(state); break;
-	case 0x81:UnimplementedInstruction(state); break;
-	case 0x82:UnimplementedInstruction(state); break;
-	case 0x83:UnimplementedInstruction(state); break;
-	case 0x84:UnimplementedInstruction(state); break;
-	case 0x85:UnimplementedInstruction(state); break;
-	case 0x86:UnimplementedInstruction(state); break;
-	case 0x87:UnimplementedInstruction(state); break;
-	case 0x88:UnimplementedInstruction(state); break;
-	case 0x89:UnimplementedInstruction(state); break;
-	case 0x8a:UnimplementedInstruction(state); break;
-	case 0x8b:UnimplementedInstruction(state); break;
-	case 0x8c:UnimplementedInstruction(state); break;
-	case 0x8d:UnimplementedInstruction(state); break;
-	case 0x8e:UnimplementedInstruction(state); break;
-	case 0x8f:UnimplementedInstruction(state); break;
-	case 0x90:UnimplementedInstruction(state); break;
-	case 0x91:UnimplementedInstruction(state); break;
-	case 0x92:UnimplementedInstruction(state); break;
-	case 0x93:UnimplementedInstruction(state); break;
-	case 0x94:UnimplementedInstruction(state); break;
-	case 0x95:UnimplementedInstruction(state); break;
-	case 0x96:UnimplementedInstruction(state); break;
-	case 0x97:UnimplementedInstruction(state); break;
-	case 0x98:UnimplementedInstruction(state); break;
-	case 0x99:UnimplementedInstruction(state); break;
-	case 0x9a:UnimplementedInstruction(state); break;
-	case 0x9b:UnimplementedInstruction(state); break;
-	case 0x9c:UnimplementedInstruction(state); break;
-	case 0x9d:UnimplementedInstruction(state); break;
-	case 0x9e:UnimplementedInstruction(state); break;
-	case 0x9f:UnimplementedInstruction(state); break;
-	case 0xa0:UnimplementedInstruction(state); break;
-	case 0xa1:UnimplementedInstruction(state); break;
-	case 0xa2:UnimplementedInstruction(state); break;
-	case 0xa3:UnimplementedInstruction(state); break;
-	case 0xa4:UnimplementedInstruction(state); break;
-	case 0xa5:UnimplementedInstruction(state); break;
-	case 0xa6:UnimplementedInstruction(state); break;
-	case 0xa7:UnimplementedInstruction(state); break;
-	case 0xa8:UnimplementedInstruction(state); break;
-	case 0xa9:UnimplementedInstruction(state); break;
-	case 0xaa:UnimplementedInstruction(state); break;
-	case 0xab:UnimplementedInstruction(state); break;
-	case 0xac:UnimplementedInstruction(state); break;
-	case 0xad:UnimplementedInstruction(state); break;
-	case 0xae:UnimplementedInstruction(state); break;
-	case 0xaf:UnimplementedInstruction(state); break;
-	case 0xb0:UnimplementedInstruction(state); break;
-	case 0xb1:UnimplementedInstruction(state); break;
-	case 0xb2:UnimplementedInstruction(state); break;
-	case 0xb3:UnimplementedInstruction(state); break;
-	case 0xb4:UnimplementedInstruction(state); break;
-	case 0xb5:UnimplementedInstruction(state); break;
-	case 0xb6:UnimplementedInstruction(state); break;
-	case 0xb7:UnimplementedInstruction(state); break;
-	case 0xb8:UnimplementedInstruction(state); break;
-	case 0xb9:UnimplementedInstruction(state); break;
-	case 0xba:UnimplementedInstruction(state); break;
-	case 0xbb:UnimplementedInstruction(state); break;
-	case 0xbc:UnimplementedInstruction(state); break;
-	case 0xbd:UnimplementedInstruction(state); break;
-	case 0xbe:UnimplementedInstruction(state); break;
-	case 0xbf:UnimplementedInstruction(state); break;
-	case 0xc0:UnimplementedInstruction(state); break;
-	case 0xc1:UnimplementedInstruction(state); break;
-	case 0xc2:UnimplementedInstruction(state); break;
-	case 0xc3:UnimplementedInstruction(state); break;
-	case 0xc4:UnimplementedInstruction(state); break;
-	case 0xc5:UnimplementedInstruction(state); break;
-	case 0xc6:UnimplementedInstruction(state); break;
-	case 0xc7:UnimplementedInstruction(state); break;
-	case 0xc8:UnimplementedInstruction(state); break;
-	case 0xc9:UnimplementedInstruction(state); break;
-	case 0xca:UnimplementedInstruction(state); break;
-	case 0xcc:UnimplementedInstruction(state); break;
-	case 0xcd:UnimplementedInstruction(state); break;
-	case 0xce:UnimplementedInstruction(state); break;
-	case 0xcf:UnimplementedInstruction(state); break;
-	case 0xd0:UnimplementedInstruction(state); break;
-	case 0xd1:UnimplementedInstruction(state); break;
-	case 0xd2:UnimplementedInstruction(state); break;
-	case 0xd3:UnimplementedInstruction(state); break;
-	case 0xd4:UnimplementedInstruction(state); break;
-	case 0xd5:UnimplementedInstruction(state); break;
-	case 0xd6:UnimplementedInstruction(state); break;
-	case 0xd7:UnimplementedInstruction(state); break;
-	case 0xd8:UnimplementedInstruction(state); break;
-	case 0xda:UnimplementedInstruction(state); break;
-	case 0xdb:UnimplementedInstruction(state); break;
-	case 0xdc:UnimplementedInstruction(state); break;
-	case 0xde:UnimplementedInstruction(state); break;
-	case 0xdf:UnimplementedInstruction(state); break;
-	case 0xe0:UnimplementedInstruction(state); break;
-	case 0xe1:UnimplementedInstruction(state); break;
-	case 0xe2:UnimplementedInstruction(state); break;
-	case 0xe3:UnimplementedInstruction(state); break;
-	case 0xe4:UnimplementedInstruction(state); break;
-	case 0xe5:UnimplementedInstruction(state); break;
-	case 0xe6:UnimplementedInstruction(state); break;
-	case 0xe7:UnimplementedInstruction(state); break;
-	case 0xe8:UnimplementedInstruction(state); break;
-	case 0xe9:UnimplementedInstruction(state); break;
-	case 0xea:UnimplementedInstruction(state); break;
-	case 0xeb:UnimplementedInstruction(state); break;
-	case 0xec:UnimplementedInstruction(state); break;
-	case 0xee:UnimplementedInstruction(state); break;
-	case 0xef:UnimplementedInstruction(state); break;
-	case 0xf0:UnimplementedInstruction(state); break;
-	case 0xf1:UnimplementedInstruction(state); break;
-	case 0xf2:UnimplementedInstruction(state); break;
-	case 0xf3:UnimplementedInstruction(state); break;
-	case 0xf4:UnimplementedInstruction(state); break;
-	case 0xf5:UnimplementedInstruction(state); break;
-	case 0xf6:UnimplementedInstruction(state); break;
-	case 0xf7:UnimplementedInstruction(state); break;
-	case 0xf8:UnimplementedInstruction(state); break;
-	case 0xf9:UnimplementedInstruction(state); break;
-	case 0xfa:UnimplementedInstruction(state); break;
-	case 0xfb:UnimplementedInstruction(state); break;
-	case 0xfc:UnimplementedInstruction(state); break;
-	case 0xfe:UnimplementedInstruction(state); break;
-	case 0xff:UnimplementedInstruction(state); break;
+	case OPK_HLT: return RUN8080_HALT;
+	case OPK_IN:
+	  if (state->bus && state->bus->ports[state->ioPort].in)
+		return RUN8080_RUNNING;
+	  return RUN8080_IN;
+	case OPK_OUT:
+	  if (state->bus && state->bus->ports[state->ioPort].out)
+		return RUN8080_RUNNING;
+	  return RUN8080_OUT;
+	case OPK_EI:
+	  if (!state->intPending)
+		return RUN8080_RUNNING;
+	  *cycles += deliverInterrupt8080(state, state->intVector);
+	  return RUN8080_INTERRUPT;
+	default: return RUN8080_RUNNING;
   }
+}
 
-  ++state->pc;
-}
\ No newline at end of file
+/*
+ * run instructions until the cycle budget is spent or an
+ * instruction needs the host (HLT, IN, OUT, an interrupt taken
+ * on EI). the last instruction may overshoot the budget.
+ * @param state State8080 * for current state of the 8080
+ * @param cycle_budget machine states to run for
+ * @return machine states spent and the reason for stopping
+ */
+RunResult8080 Run8080(State8080 *state, uint64_t cycle_budget)
+{
+  return coreOf(state)->run(state, cycle_budget);
+}
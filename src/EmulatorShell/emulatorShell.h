@@ -0,0 +1,160 @@
+#ifndef EMULATOR_SHELL_H
+#define EMULATOR_SHELL_H
+
+#include <stdint.h>
+
+/*
+ * built with EMU8080_TRACE every store is also handed to the
+ * execution trace, see trace8080.h
+ */
+#ifndef EMU8080_TRACE
+#define EMU8080_TRACE 0
+#endif
+
+/*
+ * struct representing then 8080 flags.
+ * psw holds the flags packed like the low byte of PUSH PSW,
+ * S Z 0 AC 0 P 1 CY, see flags8080.h
+ */
+typedef struct ConditionCodes {
+	uint8_t psw; // packed flags
+	uint8_t lazy; // last ALU result while S/Z/P are pending
+	uint8_t pending; // 1 when S/Z/P in psw are stale (lazy flags)
+}ConditionCodes;
+
+/*
+ * struct representing the 8080 "state"
+ */
+typedef struct State8080 {
+	uint8_t a; // register A
+	uint8_t b; // register B
+	uint8_t c; // register C
+	uint8_t d; // register D
+	uint8_t e; // register E
+	uint8_t h; // register H
+	uint8_t l; // register L
+	uint16_t sp; // stack pointer register
+	uint16_t pc; // program counter register
+	struct ConditionCodes cc; // flags and stuff
+	uint8_t int_enable;
+	uint8_t halted; // set by HLT, cleared by an interrupt
+	uint8_t intPending; // an interrupt is waiting for EI
+	uint8_t intVector; // RST number of the pending interrupt
+	uint8_t ioPort; // port of the last IN/OUT
+	uint64_t cycles; // machine states run so far by Run8080
+	struct Jit8080 *jit; // native code tier, NULL when disabled
+	struct BlockCache8080 *blocks; // predecoded block tier, NULL when disabled
+	uint8_t codePages[256]; // CODE_* bits of tiers caching each 256 byte page
+	struct Page8080 *pages[256]; // 256 byte memory pages, see memory8080.h
+	uint8_t *readPage[256]; // data of each page, NULL for device pages
+	uint8_t *writePage[256]; // data of each private page, NULL when shared
+	const struct Bus8080 *bus; // devices, mirrors and ports, NULL for none
+	uint8_t dirtyPages[256]; // pages written since the last checkpoint
+	uint32_t checkpoint; // sequence number of the last save state
+	struct Profile8080 *profile; // execution profile, NULL when disabled
+	struct Trace8080 *trace; // execution trace being recorded, NULL when off
+	struct Coverage8080 *coverage; // edge coverage map, NULL when off
+	struct Aot8080 *aot; // compiled module of the ROM, NULL when none
+	struct Video8080 *video; // frame buffer converter, NULL when none
+	struct Debug8080 *debug; // breakpoints and watchpoints, NULL when none
+	const struct Core8080 *core; // interpreter variant, NULL until picked
+}State8080;
+
+/*
+ * codePages bits, a write to a page with any bit set
+ * invalidates the cached translations of that page.
+ * CODE_VIDEO pages hold a frame buffer, not code, CODE_WATCH pages
+ * have watchpoints.
+ */
+#define CODE_JIT    0x01
+#define CODE_BLOCKS 0x02
+#define CODE_AOT    0x04
+#define CODE_VIDEO  0x08
+#define CODE_WATCH  0x10
+
+/*
+ * why Run8080 returned
+ */
+typedef enum StopReason8080 {
+  RUN8080_RUNNING = 0, // internal, never returned
+  RUN8080_BUDGET, // the cycle budget ran out
+  RUN8080_HALT, // HLT executed, or halted on entry
+  RUN8080_IN, // IN executed, the host stores the input in A
+  RUN8080_OUT, // OUT executed, the output is in A
+  RUN8080_INTERRUPT, // EI delivered a pending interrupt
+  RUN8080_BREAK // a breakpoint or watchpoint was hit, see debug8080.h
+}StopReason8080;
+
+/*
+ * result of a Run8080 call
+ */
+typedef struct RunResult8080 {
+	uint64_t cycles; // machine states spent
+	StopReason8080 reason;
+}RunResult8080;
+
+/*
+ * opcode handler, executes one decoded instruction.
+ * the program counter already points past the instruction
+ * when the handler runs.
+ * @param state State8080 * for current state of the 8080
+ * @param lo first immediate byte (low byte of 16 bit operands)
+ * @param hi second immediate byte (high byte of 16 bit operands)
+ * @return machine states spent on top of the opcode's base cycles
+ */
+typedef int (*OpHandler8080)(State8080 *state, uint8_t lo, uint8_t hi);
+
+extern const OpHandler8080 opHandlers8080[256];
+
+uint8_t readSlow8080(const State8080 *state, uint16_t addr);
+void writeSlow8080(State8080 *state, uint16_t addr, uint8_t value);
+void invalidateCode8080(State8080 *state, uint16_t addr);
+void invalidateCodePage8080(State8080 *state, uint8_t page);
+void markCode8080(State8080 *state, uint8_t page, uint8_t bits);
+void traceWrite8080(struct Trace8080 *trace, uint16_t addr, uint8_t value);
+
+/*
+ * read a byte from 8080 memory. device pages have no direct
+ * pointer and take the slow path.
+ */
+static inline uint8_t readMemory8080(const State8080 *state, uint16_t addr)
+{
+  const uint8_t *page = state->readPage[addr >> 8];
+
+  if (!page)
+	return readSlow8080(state, addr);
+  return page[addr & 0xff];
+}
+
+/*
+ * write a byte to 8080 memory. shared pages, ROM, mirrors and
+ * devices have no write pointer and take the slow path.
+ */
+static inline void writeMemory8080(State8080 *state, uint16_t addr,
+                                   uint8_t value)
+{
+  uint8_t *page = state->writePage[addr >> 8];
+
+#if EMU8080_TRACE
+  if (state->trace)
+	traceWrite8080(state->trace, addr, value);
+#endif
+  if (!page)
+  {
+	writeSlow8080(state, addr, value);
+	return;
+  }
+  page[addr & 0xff] = value;
+  if (state->codePages[addr >> 8])
+	invalidateCode8080(state, addr);
+}
+
+uint16_t resolveAddressInPair(uint8_t msb, uint8_t lsb);
+int Emulate8080Op(State8080 *state);
+int deliverInterrupt8080(State8080 *state, uint8_t rst);
+int Interrupt8080(State8080 *state, uint8_t rst);
+StopReason8080 stopReason8080(State8080 *state, uint8_t kind,
+                              uint64_t *cycles);
+RunResult8080 Run8080(State8080 *state, uint64_t cycle_budget);
+
+#endif
@@ -0,0 +1,646 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "flags8080.h"
+#include "explore8080.h"
+
+#define PROGRESS_SECONDS 1.0 // between two progress reports
+
+/*
+ * a branch point waiting in a frontier
+ */
+typedef struct ExploreNode8080 {
+	State8080 state; // stopped after its IN
+	uint64_t memoryHash; // xor of the page hashes of state
+	uint64_t score; // EXPLORE8080_PRIORITY rank
+	uint64_t seq; // order of arrival, breaks ties
+	uint32_t depth; // inputs that led here
+	uint8_t *inputs; // those inputs, NULL at depth 0
+}ExploreNode8080;
+
+/*
+ * frontier of one worker, a binary heap in the order of the strategy
+ */
+typedef struct Frontier8080 {
+	pthread_mutex_t lock;
+	ExploreNode8080 **heap;
+	size_t count;
+	size_t capacity;
+}Frontier8080;
+
+typedef struct Explorer8080 {
+	ExploreOptions8080 options;
+	uint8_t everyInput[256]; // the alphabet when options.inputs is NULL
+	_Atomic uint64_t *visited; // state hashes, 0 marks a free slot
+	uint64_t mask; // slots - 1, a power of two minus one
+	Frontier8080 *frontiers;
+	int workers;
+	atomic_size_t pending; // nodes in the frontiers or being expanded
+	atomic_int stop;
+	atomic_int failed; // out of memory
+	atomic_int cut; // a branch point was left out at maxDepth
+	atomic_ullong seq;
+	atomic_ullong states;
+	atomic_ullong expanded;
+	atomic_ullong runs;
+	atomic_ullong duplicates;
+	atomic_ullong halts;
+	atomic_ullong stuck;
+	atomic_ullong goals;
+	atomic_uint depth;
+	pthread_mutex_t report; // found and progress run one at a time
+	double start;
+}Explorer8080;
+
+typedef struct ExploreWorker8080 {
+	Explorer8080 *explorer;
+	int id;
+	ExploreNode8080 *spare; // holds the machine of the next run
+	uint64_t pageHash[PAGE8080_COUNT]; // of the node being expanded
+	uint8_t pageHashed[PAGE8080_COUNT]; // pageHash entries filled in
+}ExploreWorker8080;
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t mix64(uint64_t x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+/*
+ * hash of the bytes a page slot shows, seeded with the slot so equal
+ * pages in different slots don't cancel out
+ * @return 0 for device pages
+ */
+static uint64_t pageHash(int n, const uint8_t *data)
+{
+  uint64_t hash = 0x8080 + n;
+  int i;
+
+  if (!data)
+	return 0;
+  for (i = 0; i < PAGE8080_SIZE; i += sizeof(uint64_t))
+  {
+	uint64_t word;
+
+	memcpy(&word, data + i, sizeof(word));
+	hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+	hash ^= hash >> 29;
+  }
+  return mix64(hash);
+}
+
+static uint64_t memoryHash(const State8080 *state)
+{
+  uint64_t hash = 0;
+  int n;
+
+  for (n = 0; n < PAGE8080_COUNT; n++)
+	hash ^= pageHash(n, state->readPage[n]);
+  return hash;
+}
+
+/*
+ * memory hash of a fork of parent. page slots still showing the
+ * parent's data were not written, only the others are rehashed.
+ */
+static uint64_t forkMemoryHash(ExploreWorker8080 *worker,
+                               const ExploreNode8080 *parent,
+                               const State8080 *child)
+{
+  uint64_t hash = parent->memoryHash;
+  int n;
+
+  for (n = 0; n < PAGE8080_COUNT; n++)
+  {
+	if (child->readPage[n] == parent->state.readPage[n])
+	  continue;
+	if (!worker->pageHashed[n])
+	{
+	  worker->pageHash[n] = pageHash(n, parent->state.readPage[n]);
+	  worker->pageHashed[n] = 1;
+	}
+	hash ^= worker->pageHash[n] ^ pageHash(n, child->readPage[n]);
+  }
+  return hash;
+}
+
+/*
+ * hash of a whole machine state, cycles and the last port left out
+ */
+static uint64_t stateHash(const State8080 *state, uint64_t memory)
+{
+  uint64_t regs = state->a | (uint64_t)state->b << 8 |
+	(uint64_t)state->c << 16 | (uint64_t)state->d << 24 |
+	(uint64_t)state->e << 32 | (uint64_t)state->h << 40 |
+	(uint64_t)state->l << 48 | (uint64_t)peekFlags8080(state) << 56;
+  uint64_t rest = state->sp | (uint64_t)state->pc << 16 |
+	(uint64_t)state->int_enable << 32 | (uint64_t)state->halted << 40 |
+	(uint64_t)state->intPending << 48 | (uint64_t)state->intVector << 56;
+
+  return mix64(mix64(regs) ^ rest) ^ memory;
+}
+
+/*
+ * add a state to the visited set, lock-free with linear probing.
+ * the set has room for maxStates plus a state per worker in flight.
+ * @return 1 for a new state, 0 for one seen before
+ */
+static int visit(Explorer8080 *explorer, uint64_t hash)
+{
+  uint64_t i;
+
+  if (!hash)
+	hash = 1;
+  for (i = hash & explorer->mask; ; i = (i + 1) & explorer->mask)
+  {
+	uint64_t seen = atomic_load(&explorer->visited[i]);
+
+	if (!seen &&
+		atomic_compare_exchange_strong(&explorer->visited[i], &seen, hash))
+	{
+	  if (atomic_fetch_add(&explorer->states, 1) + 1 >=
+		  explorer->options.maxStates)
+		atomic_store(&explorer->stop, 1);
+	  return 1;
+	}
+	// a lost race leaves the winner in seen
+	if (seen == hash)
+	  return 0;
+  }
+}
+
+static void fail(Explorer8080 *explorer)
+{
+  atomic_store(&explorer->failed, 1);
+  atomic_store(&explorer->stop, 1);
+}
+
+static void noteDepth(Explorer8080 *explorer, uint32_t depth)
+{
+  unsigned deepest = atomic_load(&explorer->depth);
+
+  while (depth > deepest &&
+		 !atomic_compare_exchange_weak(&explorer->depth, &deepest, depth))
+	;
+}
+
+/*
+ * @return 1 when a should be expanded before b
+ */
+static int before(const Explorer8080 *explorer, const ExploreNode8080 *a,
+                  const ExploreNode8080 *b)
+{
+  switch (explorer->options.strategy)
+  {
+	case EXPLORE8080_DFS:
+	  if (a->depth != b->depth)
+		return a->depth > b->depth;
+	  return a->seq > b->seq;
+	case EXPLORE8080_PRIORITY:
+	  if (a->score != b->score)
+		return a->score > b->score;
+	  return a->seq < b->seq;
+	default:
+	  if (a->depth != b->depth)
+		return a->depth < b->depth;
+	  return a->seq < b->seq;
+  }
+}
+
+/*
+ * @return 0 on success, -1 when out of memory
+ */
+static int pushNode(Explorer8080 *explorer, Frontier8080 *frontier,
+                    ExploreNode8080 *node)
+{
+  size_t i;
+
+  pthread_mutex_lock(&frontier->lock);
+  if (frontier->count == frontier->capacity)
+  {
+	size_t capacity = frontier->capacity ? frontier->capacity * 2 : 256;
+	ExploreNode8080 **heap = realloc(frontier->heap,
+	                                 capacity * sizeof(ExploreNode8080 *));
+
+	if (!heap)
+	{
+	  pthread_mutex_unlock(&frontier->lock);
+	  return -1;
+	}
+	frontier->heap = heap;
+	frontier->capacity = capacity;
+  }
+  for (i = frontier->count++;
+	   i > 0 && before(explorer, node, frontier->heap[(i - 1) / 2]);
+	   i = (i - 1) / 2)
+	frontier->heap[i] = frontier->heap[(i - 1) / 2];
+  frontier->heap[i] = node;
+  pthread_mutex_unlock(&frontier->lock);
+  return 0;
+}
+
+/*
+ * take the first node of a frontier, the owner waits for the lock,
+ * thieves give up when it is taken
+ * @return the node, NULL when there is none
+ */
+static ExploreNode8080 *popNode(Explorer8080 *explorer,
+                                Frontier8080 *frontier, int owner)
+{
+  ExploreNode8080 *top, *last;
+  size_t i = 0, child;
+
+  if (owner)
+	pthread_mutex_lock(&frontier->lock);
+  else if (pthread_mutex_trylock(&frontier->lock))
+	return NULL;
+  if (!frontier->count)
+  {
+	pthread_mutex_unlock(&frontier->lock);
+	return NULL;
+  }
+  top = frontier->heap[0];
+  last = frontier->heap[--frontier->count];
+  while ((child = 2 * i + 1) < frontier->count)
+  {
+	if (child + 1 < frontier->count &&
+		before(explorer, frontier->heap[child + 1], frontier->heap[child]))
+	  child++;
+	if (!before(explorer, frontier->heap[child], last))
+	  break;
+	frontier->heap[i] = frontier->heap[child];
+	i = child;
+  }
+  if (frontier->count)
+	frontier->heap[i] = last;
+  pthread_mutex_unlock(&frontier->lock);
+  return top;
+}
+
+static void freeNode(ExploreNode8080 *node)
+{
+  FreeMemory8080(&node->state);
+  free(node->inputs);
+  free(node);
+}
+
+/*
+ * the inputs of parent followed by value
+ * @return a malloc'd path, NULL when out of memory
+ */
+static uint8_t *extendPath(const ExploreNode8080 *parent, uint8_t value)
+{
+  uint8_t *inputs = malloc(parent->depth + 1);
+
+  if (!inputs)
+	return NULL;
+  if (parent->depth)
+	memcpy(inputs, parent->inputs, parent->depth);
+  inputs[parent->depth] = value;
+  return inputs;
+}
+
+/*
+ * run a machine to its next branch point
+ * @return RUN8080_IN at a branch point, RUN8080_HALT on HLT,
+ * RUN8080_OUT on an OUT to the goal port, RUN8080_BUDGET when it
+ * read no input for stepCycles
+ */
+static StopReason8080 runToBranch(const ExploreOptions8080 *options,
+                                  State8080 *state)
+{
+  uint64_t end = state->cycles + options->stepCycles;
+
+  while (state->cycles < end)
+  {
+	RunResult8080 result = Run8080(state, end - state->cycles);
+
+	if (result.reason == RUN8080_HALT)
+	  return RUN8080_HALT;
+	if (result.reason == RUN8080_IN &&
+		(options->inputPort < 0 || state->ioPort == options->inputPort))
+	  return RUN8080_IN;
+	if (result.reason == RUN8080_OUT && state->ioPort == options->goalPort)
+	  return RUN8080_OUT;
+  }
+  return RUN8080_BUDGET;
+}
+
+static void collect(Explorer8080 *explorer, ExploreStats8080 *stats)
+{
+  stats->states = atomic_load(&explorer->states);
+  stats->expanded = atomic_load(&explorer->expanded);
+  stats->runs = atomic_load(&explorer->runs);
+  stats->duplicates = atomic_load(&explorer->duplicates);
+  stats->halts = atomic_load(&explorer->halts);
+  stats->stuck = atomic_load(&explorer->stuck);
+  stats->goals = atomic_load(&explorer->goals);
+  stats->depth = atomic_load(&explorer->depth);
+  stats->seconds = now() - explorer->start;
+  stats->complete = 0;
+}
+
+static void reportGoal(Explorer8080 *explorer, const ExploreNode8080 *parent,
+                       uint8_t value, const State8080 *state)
+{
+  uint8_t *inputs = NULL;
+
+  if (!explorer->options.found)
+	return;
+  if (parent && !(inputs = extendPath(parent, value)))
+  {
+	fail(explorer);
+	return;
+  }
+  pthread_mutex_lock(&explorer->report);
+  explorer->options.found(state, inputs, parent ? parent->depth + 1 : 0,
+                          explorer->options.opaque);
+  pthread_mutex_unlock(&explorer->report);
+  free(inputs);
+}
+
+/*
+ * put the machine of the spare into the worker's frontier
+ * @return 0 on success, -1 when out of memory
+ */
+static int keep(ExploreWorker8080 *worker, const ExploreNode8080 *parent,
+                uint8_t value, uint32_t depth)
+{
+  Explorer8080 *explorer = worker->explorer;
+  ExploreNode8080 *node = worker->spare;
+
+  node->depth = depth;
+  node->inputs = NULL;
+  if (parent && !(node->inputs = extendPath(parent, value)))
+  {
+	fail(explorer);
+	return -1;
+  }
+  node->score = explorer->options.score ?
+	explorer->options.score(&node->state, explorer->options.opaque) : 0;
+  node->seq = atomic_fetch_add(&explorer->seq, 1);
+  atomic_fetch_add(&explorer->pending, 1);
+  if (pushNode(explorer, &explorer->frontiers[worker->id], node))
+  {
+	atomic_fetch_sub(&explorer->pending, 1);
+	free(node->inputs);
+	fail(explorer);
+	return -1;
+  }
+  worker->spare = NULL;
+  return 0;
+}
+
+/*
+ * settle the run of worker->spare, a fork of parent given value, or
+ * the initial machine when parent is NULL. a new branch point goes
+ * into the worker's frontier and takes the spare along.
+ */
+static void arrive(ExploreWorker8080 *worker, const ExploreNode8080 *parent,
+                   uint8_t value, StopReason8080 reason)
+{
+  Explorer8080 *explorer = worker->explorer;
+  ExploreNode8080 *node = worker->spare;
+  uint32_t depth = parent ? parent->depth + 1 : 0;
+
+  atomic_fetch_add(&explorer->runs, 1);
+  switch (reason)
+  {
+	case RUN8080_OUT:
+	  atomic_fetch_add(&explorer->goals, 1);
+	  reportGoal(explorer, parent, value, &node->state);
+	  break;
+	case RUN8080_BUDGET:
+	  atomic_fetch_add(&explorer->stuck, 1);
+	  break;
+	default:
+	  if (reason == RUN8080_HALT)
+		atomic_fetch_add(&explorer->halts, 1);
+	  node->memoryHash = parent ?
+		forkMemoryHash(worker, parent, &node->state) :
+		memoryHash(&node->state);
+	  if (!visit(explorer, stateHash(&node->state, node->memoryHash)))
+	  {
+		atomic_fetch_add(&explorer->duplicates, 1);
+		break;
+	  }
+	  noteDepth(explorer, depth);
+	  if (reason != RUN8080_IN)
+		break;
+	  if (explorer->options.maxDepth && depth >= explorer->options.maxDepth)
+		atomic_store(&explorer->cut, 1);
+	  else if (!keep(worker, parent, value, depth))
+		return;
+	  break;
+  }
+  FreeMemory8080(&node->state);
+}
+
+/*
+ * fork a branch point once per input and run every fork to its
+ * next stop
+ */
+static void expand(ExploreWorker8080 *worker, ExploreNode8080 *node)
+{
+  Explorer8080 *explorer = worker->explorer;
+  const uint8_t *inputs = explorer->options.inputs;
+  size_t i;
+
+  memset(worker->pageHashed, 0, sizeof(worker->pageHashed));
+  atomic_fetch_add(&explorer->expanded, 1);
+  for (i = 0; i < explorer->options.inputCount &&
+	   !atomic_load(&explorer->stop); i++)
+  {
+	if (!worker->spare && !(worker->spare = malloc(sizeof(ExploreNode8080))))
+	{
+	  fail(explorer);
+	  return;
+	}
+	Fork8080(&node->state, &worker->spare->state);
+	worker->spare->state.a = inputs[i];
+	arrive(worker, node, inputs[i],
+	       runToBranch(&explorer->options, &worker->spare->state));
+  }
+}
+
+static void *workerMain(void *arg)
+{
+  ExploreWorker8080 *worker = arg;
+  Explorer8080 *explorer = worker->explorer;
+  double lastReport = explorer->start;
+
+  while (!atomic_load(&explorer->stop) && atomic_load(&explorer->pending) > 0)
+  {
+	ExploreNode8080 *node = popNode(explorer,
+	                                &explorer->frontiers[worker->id], 1);
+	int i;
+
+	for (i = 1; !node && i < explorer->workers; i++)
+	  node = popNode(explorer,
+	                 &explorer->frontiers[(worker->id + i) % explorer->workers],
+	                 0);
+	if (node)
+	{
+	  expand(worker, node);
+	  freeNode(node);
+	  atomic_fetch_sub(&explorer->pending, 1);
+	}
+	else
+	  sched_yield();
+
+	// the first worker keeps the clock
+	if (worker->id == 0 && now() - lastReport >= PROGRESS_SECONDS)
+	{
+	  ExploreStats8080 stats;
+
+	  lastReport = now();
+	  if (explorer->options.seconds &&
+		  lastReport - explorer->start >= explorer->options.seconds)
+		atomic_store(&explorer->stop, 1);
+	  if (explorer->options.progress)
+	  {
+		collect(explorer, &stats);
+		pthread_mutex_lock(&explorer->report);
+		explorer->options.progress(&stats, explorer->options.opaque);
+		pthread_mutex_unlock(&explorer->report);
+	  }
+	}
+  }
+  return NULL;
+}
+
+/*
+ * explore the states a machine reaches through its inputs, from the
+ * first input it reads. initial stays as it is, apart from sharing
+ * its pages with the forks.
+ * @param options strategy, input alphabet and limits, NULL for
+ * defaults
+ * @param stats filled in with what was found, may be NULL
+ * @return 0 on success, also when a limit stopped the search, -1
+ * when out of memory
+ */
+int Explore8080(State8080 *initial, const ExploreOptions8080 *options,
+                ExploreStats8080 *stats)
+{
+  ExploreOptions8080 opts = { 0, EXPLORE8080_BFS, -1, NULL, 0, -1, 0, 0, 0,
+                              0, NULL, NULL, NULL, NULL };
+  Explorer8080 *explorer = calloc(1, sizeof(Explorer8080));
+  ExploreWorker8080 *workers = NULL;
+  pthread_t *threads = NULL;
+  uint64_t slots = 1024;
+  int started = 0, inited = 0, i, ret = 0;
+
+  if (!explorer)
+	return -1;
+  if (options)
+	opts = *options;
+  if (opts.threads <= 0)
+  {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	opts.threads = cpus > 0 ? (int)cpus : 1;
+  }
+  if (!opts.stepCycles)
+	opts.stepCycles = EXPLORE8080_CYCLES;
+  if (!opts.maxStates)
+	opts.maxStates = EXPLORE8080_STATES;
+  if (!opts.inputs || !opts.inputCount)
+  {
+	for (i = 0; i < 256; i++)
+	  explorer->everyInput[i] = i;
+	opts.inputs = explorer->everyInput;
+	opts.inputCount = 256;
+  }
+  // at most half full, every worker may add one state past the limit
+  while (slots < 2 * (opts.maxStates + opts.threads))
+	slots *= 2;
+
+  explorer->options = opts;
+  explorer->mask = slots - 1;
+  explorer->workers = opts.threads;
+  explorer->start = now();
+  atomic_init(&explorer->pending, 0);
+  atomic_init(&explorer->stop, 0);
+  atomic_init(&explorer->failed, 0);
+  atomic_init(&explorer->cut, 0);
+  pthread_mutex_init(&explorer->report, NULL);
+  explorer->visited = calloc(slots, sizeof(uint64_t));
+  explorer->frontiers = calloc(opts.threads, sizeof(Frontier8080));
+  workers = calloc(opts.threads, sizeof(ExploreWorker8080));
+  threads = calloc(opts.threads, sizeof(pthread_t));
+  if (!explorer->visited || !explorer->frontiers || !workers || !threads)
+  {
+	ret = -1;
+	goto out;
+  }
+  for (i = 0; i < opts.threads; i++, inited++)
+  {
+	pthread_mutex_init(&explorer->frontiers[i].lock, NULL);
+	workers[i].explorer = explorer;
+	workers[i].id = i;
+  }
+
+  // the initial machine runs to its first branch point
+  workers[0].spare = malloc(sizeof(ExploreNode8080));
+  if (!workers[0].spare)
+  {
+	ret = -1;
+	goto out;
+  }
+  Fork8080(initial, &workers[0].spare->state);
+  arrive(&workers[0], NULL, 0, runToBranch(&opts, &workers[0].spare->state));
+
+  // the calling thread is worker 0
+  for (started = 1; started < opts.threads; started++)
+	if (pthread_create(&threads[started], NULL, workerMain, &workers[started]))
+	  break;
+  workerMain(&workers[0]);
+  for (i = 1; i < started; i++)
+	pthread_join(threads[i], NULL);
+  if (atomic_load(&explorer->failed))
+	ret = -1;
+
+out:
+  if (stats)
+  {
+	collect(explorer, stats);
+	stats->complete = !ret && !atomic_load(&explorer->stop) &&
+	  !atomic_load(&explorer->cut) && !atomic_load(&explorer->pending);
+  }
+  for (i = 0; i < inited; i++)
+  {
+	Frontier8080 *frontier = &explorer->frontiers[i];
+
+	while (frontier->count)
+	  freeNode(frontier->heap[--frontier->count]);
+	pthread_mutex_destroy(&frontier->lock);
+	free(frontier->heap);
+	free(workers[i].spare);
+  }
+  pthread_mutex_destroy(&explorer->report);
+  free((void *)explorer->visited);
+  free(explorer->frontiers);
+  free(workers);
+  free(threads);
+  free(explorer);
+  return ret;
+}
@@ -0,0 +1,82 @@
+#ifndef EXPLORE_8080_H
+#define EXPLORE_8080_H
+
+/*
+ * explore8080.h
+ * searches the states a program reaches through its inputs. a
+ * machine runs until it reads an unmapped input port (RUN8080_IN),
+ * which is a branch point: it is forked once per value of the input
+ * alphabet, each fork gets its value in A and runs on to the next
+ * branch point. a state seen before ends its path, so every distinct
+ * state is expanded once.
+ *
+ * states are told apart by a 64 bit hash of the registers, flags and
+ * memory. the memory hash is the xor of one hash per page slot and
+ * follows the writes: a fork rehashes only the pages its stores
+ * copied away from its parent (memory8080.h), the rest of the hash
+ * comes with the parent. cycles and device state are not part of a
+ * state, two states with the same hash count as one.
+ *
+ * the visited states are a lock-free open addressing set of hashes.
+ * the frontier is spread over a pool of workers, one heap each in
+ * the order of the strategy, idle workers steal from the others. a
+ * frontier node holds a whole machine, sharing its unwritten pages
+ * with its relatives, bound breadth first searches with maxStates.
+ * machines run on the interpreter, interrupts are not raised.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emulatorShell.h"
+
+#define EXPLORE8080_CYCLES 1000000 // default machine states per step
+#define EXPLORE8080_STATES (1 << 20) // default limit of distinct states
+
+typedef enum ExploreStrategy8080 {
+  EXPLORE8080_BFS = 0, // fewest inputs first
+  EXPLORE8080_DFS, // most inputs first
+  EXPLORE8080_PRIORITY // highest score first
+}ExploreStrategy8080;
+
+typedef struct ExploreStats8080 {
+	uint64_t states; // distinct states seen
+	uint64_t expanded; // branch points forked
+	uint64_t runs; // forks run to their next stop
+	uint64_t duplicates; // runs that stopped in a state seen before
+	uint64_t halts; // runs that ended on HLT
+	uint64_t stuck; // runs that read no input for stepCycles
+	uint64_t goals; // runs that wrote to the goal port
+	uint32_t depth; // most inputs along a path
+	double seconds;
+	int complete; // every reachable state was expanded, no limit was hit
+}ExploreStats8080;
+
+typedef struct ExploreOptions8080 {
+	int threads; // workers, 0 for one per online CPU
+	ExploreStrategy8080 strategy;
+	int inputPort; // IN from this port branches, -1 for every port,
+	               // the other ports leave A alone
+	const uint8_t *inputs; // values of the input alphabet, NULL for 0-255
+	size_t inputCount;
+	int goalPort; // OUT to this port ends a path as found, -1 for none
+	uint64_t stepCycles; // machine states between two branch points
+	                     // before a path is stuck, 0 for EXPLORE8080_CYCLES
+	uint64_t maxStates; // distinct states before the search stops,
+	                    // 0 for EXPLORE8080_STATES
+	uint32_t maxDepth; // inputs along a path, 0 for no limit
+	double seconds; // stop after this long, 0 for no limit
+	// EXPLORE8080_PRIORITY rank of a branch point, higher goes first
+	uint64_t (*score)(const State8080 *state, void *opaque);
+	// a path reached the goal port, called one at a time
+	void (*found)(const State8080 *state, const uint8_t *inputs,
+	              uint32_t depth, void *opaque);
+	// about once a second from one of the workers
+	void (*progress)(const ExploreStats8080 *stats, void *opaque);
+	void *opaque;
+}ExploreOptions8080;
+
+int Explore8080(State8080 *initial, const ExploreOptions8080 *options,
+                ExploreStats8080 *stats);
+
+#endif
@@ -0,0 +1,18 @@
+#include <stdint.h>
+
+#include "flags8080.h"
+
+/*
+ * S, Z and P flag bits for every possible result byte
+ */
+#define PARITY8(v) (!(((v) ^ (v) >> 1 ^ (v) >> 2 ^ (v) >> 3 ^ \
+                       (v) >> 4 ^ (v) >> 5 ^ (v) >> 6 ^ (v) >> 7) & 1))
+#define SZP8(v) (((v) & FLAG_S) | ((v) == 0 ? FLAG_Z : 0) | \
+                 (PARITY8(v) ? FLAG_P : 0))
+#define SZP_4(n) SZP8(n), SZP8(n + 1), SZP8(n + 2), SZP8(n + 3)
+#define SZP_16(n) SZP_4(n), SZP_4(n + 4), SZP_4(n + 8), SZP_4(n + 12)
+#define SZP_64(n) SZP_16(n), SZP_16(n + 16), SZP_16(n + 32), SZP_16(n + 48)
+
+const uint8_t szpTable8080[256] = {
+  SZP_64(0), SZP_64(64), SZP_64(128), SZP_64(192)
+};
@@ -0,0 +1,119 @@
+#ifndef FLAGS_8080_H
+#define FLAGS_8080_H
+
+/*
+ * flags8080.h
+ * flag engine of the 8080. the flags live packed in cc.psw exactly
+ * as PUSH PSW stores them, S Z 0 AC 0 P 1 CY, and S/Z/P come from a
+ * 256 entry lookup table instead of being computed per instruction.
+ *
+ * built with EMU8080_LAZY_FLAGS the S/Z/P bits are not written by
+ * the ALU at all, the last result is kept in cc.lazy and the bits
+ * are only materialized when a condition, PUSH PSW or an outside
+ * reader asks for them. CY and AC are always kept up to date.
+ */
+
+#include <stdint.h>
+
+#include "emulatorShell.h"
+#include "opcodes8080.h"
+
+#ifndef EMU8080_LAZY_FLAGS
+#define EMU8080_LAZY_FLAGS 0
+#endif
+
+/*
+ * bit 1 of the PSW always reads as 1, bits 3 and 5 as 0
+ */
+#define FLAGS_FIXED   0x02
+#define FLAGS_DEFINED (FLAGS_ALL | FLAGS_FIXED)
+
+extern const uint8_t szpTable8080[256];
+
+/*
+ * store new flags, S/Z/P taken from result, everything else from
+ * other which must have the S/Z/P bits clear
+ */
+static inline void storeFlagsSZP(State8080 *state, uint8_t result,
+                                 uint8_t other)
+{
+#if EMU8080_LAZY_FLAGS
+  state->cc.psw = other | FLAGS_FIXED;
+  state->cc.lazy = result;
+  state->cc.pending = 1;
+#else
+  state->cc.psw = szpTable8080[result] | other | FLAGS_FIXED;
+  state->cc.pending = 0;
+#endif
+}
+
+/*
+ * write pending S/Z/P into the PSW. builds without lazy flags still
+ * meet them, a machine may have last run a lazy variant of the
+ * interpreter, see core8080.h
+ */
+static inline void settleFlags8080(State8080 *state)
+{
+  if (state->cc.pending)
+  {
+	state->cc.psw |= szpTable8080[state->cc.lazy];
+	state->cc.pending = 0;
+  }
+}
+
+/*
+ * get the up to date PSW flags byte, materializing lazy S/Z/P
+ */
+static inline uint8_t readFlags8080(State8080 *state)
+{
+#if EMU8080_LAZY_FLAGS
+  settleFlags8080(state);
+#endif
+  return state->cc.psw | FLAGS_FIXED;
+}
+
+/*
+ * get the PSW flags byte without touching the state,
+ * for readers outside of the core
+ */
+static inline uint8_t peekFlags8080(const State8080 *state)
+{
+  if (state->cc.pending)
+	return state->cc.psw | szpTable8080[state->cc.lazy] | FLAGS_FIXED;
+  return state->cc.psw | FLAGS_FIXED;
+}
+
+/*
+ * replace all flags with a PSW byte, as POP PSW does
+ */
+static inline void writeFlags8080(State8080 *state, uint8_t psw)
+{
+  state->cc.psw = (psw & FLAGS_ALL) | FLAGS_FIXED;
+  state->cc.pending = 0;
+}
+
+static inline uint8_t getCarry8080(const State8080 *state)
+{
+  return state->cc.psw & FLAG_CY;
+}
+
+static inline void setCarry8080(State8080 *state, uint8_t cy)
+{
+  state->cc.psw = (state->cc.psw & ~FLAG_CY) | cy;
+}
+
+/*
+ * evaluate one of the eight branch conditions,
+ * NZ, Z, NC, C, PO, PE, P, M in opcode order.
+ * carry conditions never need lazy flags materialized.
+ */
+static inline int condition8080(State8080 *state, int cond)
+{
+  static const uint8_t condFlag[4] = { FLAG_Z, FLAG_CY, FLAG_P, FLAG_S };
+  uint8_t flag = condFlag[cond >> 1];
+  uint8_t psw = flag == FLAG_CY ? state->cc.psw : readFlags8080(state);
+
+  return ((psw & flag) != 0) == (cond & 1);
+}
+
+#endif
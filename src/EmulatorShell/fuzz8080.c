@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "bus8080.h"
+#include "coverage8080.h"
+#include "fuzz8080.h"
+
+static uint8_t readInput(void *opaque, uint8_t port)
+{
+  FuzzTarget8080 *target = opaque;
+
+  (void)port;
+  if (target->inputPos >= target->inputSize)
+	return 0;
+  return target->input[target->inputPos++];
+}
+
+/*
+ * load a program into a pristine machine and fork the machine that
+ * runs the inputs from it
+ * @param program bytes loaded at options->loadAddress
+ * @return the target, NULL when out of memory
+ */
+FuzzTarget8080 *CreateFuzzTarget8080(const uint8_t *program, size_t size,
+                                     const FuzzOptions8080 *options)
+{
+  FuzzTarget8080 *target = calloc(1, sizeof(FuzzTarget8080));
+  size_t room;
+
+  if (!target)
+	return NULL;
+  target->options = *options;
+  if (!target->options.maxCycles)
+	target->options.maxCycles = FUZZ8080_CYCLES;
+  room = 0x10000 - target->options.inputAddress;
+  if (target->options.inputMax > room)
+	target->options.inputMax = room;
+
+  InitBus8080(&target->bus);
+  if (options->inputPort >= 0)
+	MapPort8080(&target->bus, options->inputPort, readInput, NULL, target);
+
+  InitMemory8080(&target->pristine);
+  AttachBus8080(&target->pristine, &target->bus);
+  LoadMemory8080(&target->pristine, options->loadAddress, program, size);
+  target->pristine.pc = options->loadAddress;
+  Fork8080(&target->pristine, &target->machine);
+  if (EnableCoverage8080(&target->machine))
+  {
+	DestroyFuzzTarget8080(target);
+	return NULL;
+  }
+  return target;
+}
+
+void DestroyFuzzTarget8080(FuzzTarget8080 *target)
+{
+  if (!target)
+	return;
+  DisableCoverage8080(&target->machine);
+  FreeMemory8080(&target->machine);
+  FreeMemory8080(&target->pristine);
+  free(target);
+}
+
+/*
+ * run one input on a machine rolled back to the pristine one. the
+ * coverage map of target->machine holds the edges of this run only.
+ * @return how the run ended
+ */
+FuzzResult8080 RunFuzzInput8080(FuzzTarget8080 *target, const uint8_t *data,
+                                size_t size)
+{
+  State8080 *machine = &target->machine;
+  const FuzzOptions8080 *options = &target->options;
+  uint64_t end;
+  size_t copy = size < options->inputMax ? size : options->inputMax;
+
+  Restore8080(machine, &target->pristine);
+  if (machine->coverage)
+	ClearCoverage8080(machine->coverage);
+  target->input = data;
+  target->inputSize = size;
+  target->inputPos = 0;
+  target->execs++;
+
+  if (copy)
+	LoadMemory8080(machine, options->inputAddress, data, copy);
+  machine->h = options->inputAddress >> 8;
+  machine->l = options->inputAddress & 0xff;
+  machine->b = copy >> 8;
+  machine->c = copy & 0xff;
+
+  end = machine->cycles + options->maxCycles;
+  while (machine->cycles < end)
+  {
+	RunResult8080 result = Run8080(machine, end - machine->cycles);
+
+	if (result.reason == RUN8080_HALT)
+	  return FUZZ8080_HALT;
+	if (result.reason == RUN8080_OUT && machine->ioPort == options->crashPort)
+	{
+	  target->crashValue = machine->a;
+	  return FUZZ8080_CRASH;
+	}
+  }
+  return FUZZ8080_TIMEOUT;
+}
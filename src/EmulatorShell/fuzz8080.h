@@ -0,0 +1,62 @@
+#ifndef FUZZ_8080_H
+#define FUZZ_8080_H
+
+/*
+ * fuzz8080.h
+ * in-process fuzz target for 8080 programs. the program is loaded
+ * once into a pristine machine, each input runs on a fork of it that
+ * is rolled back with Restore8080, so an exec costs the pages the
+ * previous input touched instead of a process and a full memory
+ * load. the input is copied into memory, with its address in HL and
+ * its length in BC, and can also be read byte by byte from an input
+ * port (0 past the end). a run ends on HLT, when the cycle budget
+ * runs out, or on an OUT to the crash port, which is how a guest
+ * reports a failed check.
+ *
+ * inputs run on the interpreter, on its variant with the edge
+ * coverage hooks (core8080.h).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emulatorShell.h"
+#include "bus8080.h"
+#include "coverage8080.h"
+
+#define FUZZ8080_CYCLES 1000000 // default machine states per input
+
+typedef struct FuzzOptions8080 {
+	uint16_t loadAddress; // where the program goes, execution starts there
+	uint16_t inputAddress; // where each input is copied
+	size_t inputMax; // bytes of input copied to memory, 0 for none
+	int inputPort; // IN from this port reads the input, -1 for none
+	int crashPort; // OUT to this port is a crash, -1 for none
+	uint64_t maxCycles; // machine states per input, 0 for FUZZ8080_CYCLES
+}FuzzOptions8080;
+
+typedef enum FuzzResult8080 {
+  FUZZ8080_HALT = 0, // the program halted
+  FUZZ8080_TIMEOUT, // the cycle budget ran out
+  FUZZ8080_CRASH // OUT to the crash port
+}FuzzResult8080;
+
+typedef struct FuzzTarget8080 {
+	FuzzOptions8080 options;
+	State8080 pristine; // the program before any input
+	State8080 machine; // rolled back to pristine for every input
+	Bus8080 bus;
+	const uint8_t *input; // input of the current run
+	size_t inputSize;
+	size_t inputPos; // next byte for the input port
+	uint8_t crashValue; // A of the last crash
+	uint64_t execs;
+}FuzzTarget8080;
+
+FuzzTarget8080 *CreateFuzzTarget8080(const uint8_t *program, size_t size,
+                                     const FuzzOptions8080 *options);
+void DestroyFuzzTarget8080(FuzzTarget8080 *target);
+FuzzResult8080 RunFuzzInput8080(FuzzTarget8080 *target, const uint8_t *data,
+                                size_t size);
+
+#endif
@@ -0,0 +1,555 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "emulatorShell.h"
+#include "flags8080.h"
+#include "debug8080.h"
+#include "gdb8080.h"
+
+#define GDB_REGISTERS 13 // z80 layout, 16 bits each
+#define GDB_POLL_CYCLES 200000 // machine states between interrupt polls
+#define GDB_SIGINT 2
+#define GDB_SIGTRAP 5
+
+static const char hexDigits[] = "0123456789abcdef";
+
+static int hexValue(char c)
+{
+  if (c >= '0' && c <= '9')
+	return c - '0';
+  if (c >= 'a' && c <= 'f')
+	return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+	return c - 'A' + 10;
+  return -1;
+}
+
+/*
+ * parse a hex number, *end is left at the first other character
+ */
+static unsigned long parseHex(const char *text, const char **end)
+{
+  unsigned long value = 0;
+  int digit;
+
+  while ((digit = hexValue(*text)) >= 0)
+  {
+	value = value << 4 | digit;
+	text++;
+  }
+  *end = text;
+  return value;
+}
+
+static char *putByte(char *out, uint8_t value)
+{
+  *out++ = hexDigits[value >> 4];
+  *out++ = hexDigits[value & 15];
+  return out;
+}
+
+/*
+ * drop the client, the machine keeps running without points
+ */
+static void detach(GdbStub8080 *stub, State8080 *state)
+{
+  ClearPoints8080(state);
+  close(stub->fd);
+  stub->fd = -1;
+  stub->noAck = 0;
+  stub->inPos = stub->inLength = 0;
+}
+
+/*
+ * @param wait block until a byte arrives, otherwise only take what
+ * is already there
+ * @return the next byte from the client, -1 when there is none yet,
+ * -2 when the client is gone
+ */
+static int readByte(GdbStub8080 *stub, int wait)
+{
+  ssize_t got;
+
+  if (stub->inPos == stub->inLength)
+  {
+	struct pollfd pfd = { stub->fd, POLLIN, 0 };
+
+	if (!wait && poll(&pfd, 1, 0) <= 0)
+	  return -1;
+	do
+	  got = recv(stub->fd, stub->in, sizeof(stub->in), 0);
+	while (got < 0 && errno == EINTR);
+	if (got <= 0)
+	  return -2;
+	stub->inPos = 0;
+	stub->inLength = got;
+  }
+  return (uint8_t)stub->in[stub->inPos++];
+}
+
+static int sendAll(GdbStub8080 *stub, const char *data, size_t length)
+{
+  while (length > 0)
+  {
+	ssize_t sent = send(stub->fd, data, length, MSG_NOSIGNAL);
+
+	if (sent < 0 && errno == EINTR)
+	  continue;
+	if (sent <= 0)
+	  return -1;
+	data += sent;
+	length -= sent;
+  }
+  return 0;
+}
+
+/*
+ * frame the reply buffer as $data#checksum and send it
+ */
+static int sendReply(GdbStub8080 *stub)
+{
+  char frame[GDB8080_PACKET_SIZE + 4];
+  size_t length = strlen(stub->reply), i;
+  uint8_t sum = 0;
+
+  frame[0] = '$';
+  for (i = 0; i < length; i++)
+	sum += (uint8_t)(frame[i + 1] = stub->reply[i]);
+  frame[length + 1] = '#';
+  putByte(frame + length + 2, sum);
+  return sendAll(stub, frame, length + 4);
+}
+
+static int sendPacket(GdbStub8080 *stub, const char *data)
+{
+  snprintf(stub->reply, sizeof(stub->reply), "%s", data);
+  return sendReply(stub);
+}
+
+/*
+ * receive the next packet into stub->packet. acknowledgments from
+ * the client are consumed, a NAK resends the last reply.
+ * @return 0 on success, -1 when the client is gone
+ */
+static int readPacket(GdbStub8080 *stub)
+{
+  for (;;)
+  {
+	size_t length = 0;
+	uint8_t sum = 0;
+	int c, hi, lo;
+
+	c = readByte(stub, 1);
+	if (c == '-' && sendReply(stub))
+	  return -1;
+	if (c == -2)
+	  return -1;
+	if (c != '$')
+	  continue;
+	while ((c = readByte(stub, 1)) >= 0 && c != '#')
+	{
+	  if (length < sizeof(stub->packet) - 1)
+		stub->packet[length++] = c;
+	  sum += c;
+	}
+	if (c < 0 || (hi = readByte(stub, 1)) < 0 || (lo = readByte(stub, 1)) < 0)
+	  return -1;
+	stub->packet[length] = 0;
+	if (stub->noAck)
+	  return 0;
+	if (hexValue(hi) << 4 == (sum & 0xf0) && hexValue(lo) == (sum & 15))
+	  return sendAll(stub, "+", 1);
+	if (sendAll(stub, "-", 1))
+	  return -1;
+  }
+}
+
+/*
+ * 16 bit register values in z80 order
+ */
+static void getRegisters(State8080 *state, uint16_t *regs)
+{
+  memset(regs, 0, GDB_REGISTERS * sizeof(uint16_t));
+  regs[0] = state->a << 8 | peekFlags8080(state);
+  regs[1] = state->b << 8 | state->c;
+  regs[2] = state->d << 8 | state->e;
+  regs[3] = state->h << 8 | state->l;
+  regs[4] = state->sp;
+  regs[5] = state->pc;
+}
+
+static void setRegister(State8080 *state, int n, uint16_t value)
+{
+  switch (n)
+  {
+	case 0: state->a = value >> 8; writeFlags8080(state, value); break;
+	case 1: state->b = value >> 8; state->c = value; break;
+	case 2: state->d = value >> 8; state->e = value; break;
+	case 3: state->h = value >> 8; state->l = value; break;
+	case 4: state->sp = value; break;
+	case 5: state->pc = value; state->halted = 0; break;
+	default: break;
+  }
+}
+
+/*
+ * registers go over the wire in target byte order, little endian
+ */
+static uint16_t parseRegister(const char *text, const char **end)
+{
+  uint16_t value = 0;
+  int i;
+
+  for (i = 0; i < 2 && hexValue(text[0]) >= 0 && hexValue(text[1]) >= 0;
+	   i++, text += 2)
+	value |= (hexValue(text[0]) << 4 | hexValue(text[1])) << (i * 8);
+  *end = text;
+  return value;
+}
+
+static void replyRegisters(GdbStub8080 *stub, State8080 *state)
+{
+  uint16_t regs[GDB_REGISTERS];
+  char *out = stub->reply;
+  int i;
+
+  getRegisters(state, regs);
+  for (i = 0; i < GDB_REGISTERS; i++)
+  {
+	out = putByte(out, regs[i]);
+	out = putByte(out, regs[i] >> 8);
+  }
+  *out = 0;
+}
+
+static void writeRegisters(GdbStub8080 *stub, State8080 *state)
+{
+  const char *text = stub->packet + 1;
+  int n;
+
+  for (n = 0; n < GDB_REGISTERS && *text; n++)
+	setRegister(state, n, parseRegister(text, &text));
+  strcpy(stub->reply, "OK");
+}
+
+/*
+ * m addr,length. device pages aren't read, reading them could have
+ * side effects.
+ */
+static void readMemory(GdbStub8080 *stub, State8080 *state)
+{
+  const char *text;
+  uint16_t addr = parseHex(stub->packet + 1, &text);
+  unsigned long length = *text == ',' ? parseHex(text + 1, &text) : 0;
+  char *out = stub->reply;
+
+  if (length > (sizeof(stub->reply) - 1) / 2)
+	length = (sizeof(stub->reply) - 1) / 2;
+  for (; length > 0; length--, addr++)
+  {
+	const uint8_t *page = state->readPage[addr >> 8];
+
+	if (!page)
+	  break;
+	out = putByte(out, page[addr & 0xff]);
+  }
+  *out = 0;
+  if (out == stub->reply)
+	strcpy(stub->reply, "E0e");
+}
+
+/*
+ * M addr,length:bytes, stored like the 8080 would so the execution
+ * tiers see the change. ROM keeps its contents.
+ */
+static void writeMemory(GdbStub8080 *stub, State8080 *state)
+{
+  const char *text;
+  uint16_t addr = parseHex(stub->packet + 1, &text);
+  unsigned long length = *text == ',' ? parseHex(text + 1, &text) : 0;
+
+  if (*text++ != ':')
+  {
+	strcpy(stub->reply, "E01");
+	return;
+  }
+  for (; length > 0 && hexValue(text[0]) >= 0 && hexValue(text[1]) >= 0;
+	   length--, addr++, text += 2)
+	writeMemory8080(state, addr, hexValue(text[0]) << 4 | hexValue(text[1]));
+  strcpy(stub->reply, "OK");
+}
+
+/*
+ * Z/z type,addr,kind. kind is the length of a watchpoint.
+ */
+static void changePoint(GdbStub8080 *stub, State8080 *state)
+{
+  const char *text = stub->packet + 2;
+  int set = stub->packet[0] == 'Z';
+  int type = hexValue(stub->packet[1]);
+  uint16_t addr;
+  unsigned long length;
+
+  if (*text != ',')
+  {
+	strcpy(stub->reply, "E01");
+	return;
+  }
+  addr = parseHex(text + 1, &text);
+  length = *text == ',' ? parseHex(text + 1, &text) : 1;
+  strcpy(stub->reply, "OK");
+  if (type == 0 || type == 1)
+  {
+	if (set)
+	  SetBreakpoint8080(state, addr);
+	else
+	  ClearBreakpoint8080(state, addr);
+  }
+  else if (type == 2)
+  {
+	if (length > 0x10000)
+	  length = 0x10000;
+	for (; length > 0; length--, addr++)
+	  if (!set)
+		ClearWatchpoint8080(state, addr);
+	  else if (SetWatchpoint8080(state, addr))
+		strcpy(stub->reply, "E01");
+  }
+  else
+	stub->reply[0] = 0;
+}
+
+static void query(GdbStub8080 *stub)
+{
+  const char *packet = stub->packet;
+
+  if (!strncmp(packet, "qSupported", 10))
+	snprintf(stub->reply, sizeof(stub->reply),
+	         "PacketSize=%x;QStartNoAckMode+", GDB8080_PACKET_SIZE);
+  else if (!strcmp(packet, "qAttached"))
+	strcpy(stub->reply, "1");
+  else if (!strcmp(packet, "qC"))
+	strcpy(stub->reply, "QC1");
+  else if (!strcmp(packet, "qfThreadInfo"))
+	strcpy(stub->reply, "m1");
+  else if (!strcmp(packet, "qsThreadInfo"))
+	strcpy(stub->reply, "l");
+  else
+	stub->reply[0] = 0;
+}
+
+static int sendStop(GdbStub8080 *stub, const State8080 *state, int signal)
+{
+  const Debug8080 *debug = state->debug;
+
+  if (signal == GDB_SIGTRAP && debug->hit == DEBUG8080_WATCHPOINT)
+	snprintf(stub->reply, sizeof(stub->reply), "T%02xwatch:%04x;", signal,
+	         debug->hitAddr);
+  else
+	snprintf(stub->reply, sizeof(stub->reply), "S%02x", signal);
+  return sendReply(stub);
+}
+
+/*
+ * run the machine until a point is hit, the client interrupts or a
+ * single step is done
+ * @param signal set to the signal to report the stop with
+ * @return RUN8080_RUNNING, or why the machine ended
+ */
+static StopReason8080 resume(GdbStub8080 *stub, State8080 *state,
+                             GdbRun8080 run, void *opaque, int step,
+                             int *signal)
+{
+  *signal = GDB_SIGTRAP;
+  for (;;)
+  {
+	StopReason8080 end = run(state, opaque, step ? 1 : GDB_POLL_CYCLES);
+	int c;
+
+	if (end != RUN8080_RUNNING || step || state->debug->hit)
+	  return end;
+	while ((c = readByte(stub, 0)) >= 0 && c != 0x03)
+	  ;
+	if (c == 0x03)
+	{
+	  *signal = GDB_SIGINT;
+	  return RUN8080_RUNNING;
+	}
+	if (c == -2)
+	{
+	  *signal = -1;
+	  return RUN8080_RUNNING;
+	}
+  }
+}
+
+/*
+ * listen for a debugger on 127.0.0.1
+ * @return 0 on success, -1 when the port can't be opened
+ */
+int OpenGdbStub8080(GdbStub8080 *stub, uint16_t port)
+{
+  struct sockaddr_in addr;
+  int one = 1;
+
+  memset(stub, 0, sizeof(GdbStub8080));
+  stub->fd = -1;
+  stub->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  if (stub->listenFd < 0)
+	return -1;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  setsockopt(stub->listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (bind(stub->listenFd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	  listen(stub->listenFd, 1) ||
+	  fcntl(stub->listenFd, F_SETFL, O_NONBLOCK))
+  {
+	close(stub->listenFd);
+	stub->listenFd = -1;
+	return -1;
+  }
+  return 0;
+}
+
+void CloseGdbStub8080(GdbStub8080 *stub)
+{
+  if (stub->fd >= 0)
+	close(stub->fd);
+  if (stub->listenFd >= 0)
+	close(stub->listenFd);
+  stub->fd = stub->listenFd = -1;
+}
+
+/*
+ * take a waiting connection, never blocks
+ * @return 1 when a client is attached
+ */
+int PollGdbStub8080(GdbStub8080 *stub)
+{
+  int one = 1;
+
+  if (stub->fd >= 0)
+	return 1;
+  if (stub->listenFd < 0)
+	return 0;
+  stub->fd = accept(stub->listenFd, NULL, NULL);
+  if (stub->fd < 0)
+	return 0;
+  fcntl(stub->fd, F_SETFL, 0);
+  setsockopt(stub->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  stub->noAck = 0;
+  stub->inPos = stub->inLength = 0;
+  stub->reply[0] = 0;
+  return 1;
+}
+
+/*
+ * serve the attached client until it detaches or the machine ends.
+ * the machine is stopped while this waits for packets.
+ * @param state machine with a debugger, see EnableDebug8080
+ * @param run runs the machine, for continue and step
+ * @return RUN8080_RUNNING when the client detached and the machine
+ * goes on, otherwise why it ended, RUN8080_BUDGET when it was killed
+ */
+StopReason8080 ServeGdb8080(GdbStub8080 *stub, State8080 *state,
+                            GdbRun8080 run, void *opaque)
+{
+  int signal = GDB_SIGTRAP;
+
+  while (readPacket(stub) == 0)
+  {
+	const char *packet = stub->packet, *text;
+	StopReason8080 end;
+
+	stub->reply[0] = 0;
+	switch (packet[0])
+	{
+	  case '?':
+		if (sendStop(stub, state, signal))
+		  goto gone;
+		continue;
+	  case 'g': replyRegisters(stub, state); break;
+	  case 'G': writeRegisters(stub, state); break;
+	  case 'p':
+	  {
+		uint16_t regs[GDB_REGISTERS];
+		unsigned long n = parseHex(packet + 1, &text);
+
+		getRegisters(state, regs);
+		if (n < GDB_REGISTERS)
+		{
+		  putByte(putByte(stub->reply, regs[n]), regs[n] >> 8);
+		  stub->reply[4] = 0;
+		}
+		else
+		  strcpy(stub->reply, "E01");
+		break;
+	  }
+	  case 'P':
+	  {
+		unsigned long n = parseHex(packet + 1, &text);
+
+		if (*text == '=')
+		  setRegister(state, n, parseRegister(text + 1, &text));
+		strcpy(stub->reply, "OK");
+		break;
+	  }
+	  case 'm': readMemory(stub, state); break;
+	  case 'M': writeMemory(stub, state); break;
+	  case 'Z':
+	  case 'z': changePoint(stub, state); break;
+	  case 'c':
+	  case 's':
+		if (packet[1])
+		  setRegister(state, 5, parseHex(packet + 1, &text));
+		end = resume(stub, state, run, opaque, packet[0] == 's', &signal);
+		if (end != RUN8080_RUNNING)
+		{
+		  sendPacket(stub, "W00");
+		  detach(stub, state);
+		  return end;
+		}
+		if (signal < 0 || sendStop(stub, state, signal))
+		  goto gone;
+		continue;
+	  case 'q': query(stub); break;
+	  case 'Q':
+		if (!strcmp(packet, "QStartNoAckMode"))
+		{
+		  strcpy(stub->reply, "OK");
+		  if (sendReply(stub))
+			goto gone;
+		  stub->noAck = 1;
+		  continue;
+		}
+		break;
+	  case 'H':
+	  case 'T': strcpy(stub->reply, "OK"); break;
+	  case 'D':
+		sendPacket(stub, "OK");
+		goto gone;
+	  case 'k':
+		detach(stub, state);
+		return RUN8080_BUDGET;
+	  default: break;
+	}
+	if (sendReply(stub))
+	  break;
+  }
+
+gone:
+  detach(stub, state);
+  return RUN8080_RUNNING;
+}
@@ -0,0 +1,48 @@
+#ifndef GDB_8080_H
+#define GDB_8080_H
+
+/*
+ * gdb8080.h
+ * GDB remote serial protocol stub on a localhost TCP port. the
+ * machine is stopped while a client is attached and runs in chunks
+ * on continue, between chunks the socket is polled for an interrupt
+ * (Ctrl-C). registers are laid out like GDB's z80 target, AF BC DE
+ * HL SP PC, then IX IY AF' BC' DE' HL' IR which read as 0. software
+ * and hardware breakpoints (Z0, Z1) and write watchpoints (Z2) map
+ * to debug8080.h, read and access watchpoints are not supported.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emulatorShell.h"
+
+#define GDB8080_PACKET_SIZE 4096
+
+/*
+ * runs the debugged machine on RunDebug8080 for up to cycle_budget
+ * machine states
+ * @return RUN8080_RUNNING while the machine can go on, otherwise why
+ * it ended (RUN8080_HALT or RUN8080_BUDGET)
+ */
+typedef StopReason8080 (*GdbRun8080)(State8080 *state, void *opaque,
+                                     uint64_t cycle_budget);
+
+typedef struct GdbStub8080 {
+	int listenFd;
+	int fd; // attached client, -1 for none
+	int noAck; // the client switched acknowledgments off
+	char in[256]; // bytes received, not parsed yet
+	size_t inPos;
+	size_t inLength;
+	char packet[GDB8080_PACKET_SIZE]; // last packet received
+	char reply[GDB8080_PACKET_SIZE]; // last packet sent, for resends
+}GdbStub8080;
+
+int OpenGdbStub8080(GdbStub8080 *stub, uint16_t port);
+void CloseGdbStub8080(GdbStub8080 *stub);
+int PollGdbStub8080(GdbStub8080 *stub);
+StopReason8080 ServeGdb8080(GdbStub8080 *stub, State8080 *state,
+                            GdbRun8080 run, void *opaque);
+
+#endif
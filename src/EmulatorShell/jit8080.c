@@ -0,0 +1,1211 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "opcodes8080.h"
+#include "flags8080.h"
+#include "jit8080.h"
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define JIT8080_NATIVE 1
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define JIT8080_NATIVE 0
+#endif
+
+#define JIT_CACHE_SIZE (4 << 20) // bytes of executable code cache
+#define JIT_HOT_THRESHOLD 16 // block entries before translating
+#define JIT_MAX_BLOCK 64 // instructions per block
+#define JIT_MAX_BLOCKS 8192 // translations before the cache is flushed
+#define JIT_MAX_INSN_BYTES 320 // worst case native bytes per instruction
+#define JIT_MAX_BLOCK_BYTES (JIT_MAX_BLOCK * JIT_MAX_INSN_BYTES + 128)
+
+/*
+ * a translated block runs, and goes on into the translated blocks
+ * that follow it until the budget is spent
+ * @return machine states spent
+ */
+typedef uint64_t (*JitCode8080)(State8080 *state, uint64_t budget);
+
+/*
+ * a translation and the pages its 8080 code came from
+ */
+typedef struct JitBlock8080 {
+	uint16_t start; // 8080 address of the first instruction
+	uint8_t pages[2]; // first and last page of the 8080 code
+	uint8_t dead; // invalidated, waiting for the next flush
+	struct JitBlock8080 *pageNext[2]; // next block in pageBlocks[pages[i]]
+}JitBlock8080;
+
+typedef struct Jit8080 {
+	uint8_t exitRequested; // set on invalidation, polled by native code
+	uint8_t *cache; // code cache, executable except while translating
+	size_t used; // bytes of cache in use
+	size_t pageSize; // host page size, the unit of protection changes
+	int blockCount;
+	JitCode8080 code[65536]; // translation starting at each address
+	uint8_t hits[65536]; // block entries seen while not translated
+	JitBlock8080 *pageBlocks[256]; // blocks with code in each page
+	JitBlock8080 blocks[JIT_MAX_BLOCKS];
+}Jit8080;
+
+#if JIT8080_NATIVE
+
+/*
+ * run the interpreter up to and including the next branch
+ * @param reason set to the stop reason if the block hit one
+ * @return machine states spent
+ */
+static uint64_t interpretBlock(State8080 *state, StopReason8080 *reason)
+{
+  uint64_t cycles = 0;
+  int n;
+
+  for (n = 0; n < JIT_MAX_BLOCK; n++)
+  {
+	const OpcodeInfo8080 *info =
+	  &opcodeTable8080[readMemory8080(state, state->pc)];
+	uint8_t attr = info->attr;
+
+	cycles += Emulate8080Op(state);
+	if (attr & OPA_STOP)
+	{
+	  *reason = stopReason8080(state, info->kind, &cycles);
+	  if (*reason != RUN8080_RUNNING)
+		break;
+	}
+	if (attr & OPA_BRANCH)
+	  break;
+  }
+  return cycles;
+}
+
+/*
+ * byte offsets of B, C, D, E, H, L, (M), A in State8080
+ */
+static const int32_t regOffset[8] = {
+  offsetof(State8080, b), offsetof(State8080, c),
+  offsetof(State8080, d), offsetof(State8080, e),
+  offsetof(State8080, h), offsetof(State8080, l),
+  -1, offsetof(State8080, a)
+};
+
+#define REG_M_INDEX 6
+
+static uint8_t *emit8(uint8_t *p, uint8_t v)
+{
+  *p = v;
+  return p + 1;
+}
+
+static uint8_t *emit16(uint8_t *p, uint16_t v)
+{
+  memcpy(p, &v, 2);
+  return p + 2;
+}
+
+static uint8_t *emit32(uint8_t *p, uint32_t v)
+{
+  memcpy(p, &v, 4);
+  return p + 4;
+}
+
+static uint8_t *emit64(uint8_t *p, uint64_t v)
+{
+  memcpy(p, &v, 8);
+  return p + 8;
+}
+
+static uint8_t *emitBytes(uint8_t *p, const uint8_t *bytes, size_t n)
+{
+  memcpy(p, bytes, n);
+  return p + n;
+}
+
+/*
+ * a forward jcc or jmp with a 32 bit displacement
+ * @param patch set to the displacement, for jumpHere
+ */
+static uint8_t *emitJump(uint8_t *p, uint8_t jcc, uint8_t **patch)
+{
+  if (jcc == 0xeb)
+	p = emit8(p, 0xe9);
+  else
+  {
+	p = emit8(p, 0x0f);
+	p = emit8(p, jcc + 0x10); // jz 74 -> 0f 84 ...
+  }
+  *patch = p;
+  return emit32(p, 0);
+}
+
+/*
+ * point a jump from emitJump at p
+ */
+static void jumpHere(uint8_t *patch, uint8_t *p)
+{
+  uint32_t rel = p - (patch + 4);
+
+  memcpy(patch, &rel, 4);
+}
+
+/*
+ * push rbx; push r12; push r13; push r14; push r15
+ * mov rbx, rdi         rbx = state
+ * mov r14, rsi         r14 = budget
+ * xor r12d, r12d       r12 = machine states spent
+ * mov r13, &exitRequested
+ * mov r15, jit->code   where chained blocks are looked up
+ * five pushes keep the stack aligned for calls
+ */
+#define PROLOGUE_BYTES 38
+
+static uint8_t *emitPrologue(uint8_t *p, Jit8080 *jit)
+{
+  static const uint8_t prologue[] = {
+	0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57,
+	0x48, 0x89, 0xfb,
+	0x49, 0x89, 0xf6,
+	0x45, 0x31, 0xe4
+  };
+
+  p = emitBytes(p, prologue, sizeof(prologue));
+  p = emit8(p, 0x49);
+  p = emit8(p, 0xbd);
+  p = emit64(p, (uint64_t)(uintptr_t)&jit->exitRequested);
+  p = emit8(p, 0x49);
+  p = emit8(p, 0xbf);
+  return emit64(p, (uint64_t)(uintptr_t)jit->code);
+}
+
+/*
+ * add r12, cycles
+ */
+static uint8_t *emitAddCycles(uint8_t *p, uint32_t cycles)
+{
+  p = emit8(p, 0x49);
+  p = emit8(p, 0x81);
+  p = emit8(p, 0xc4);
+  return emit32(p, cycles);
+}
+
+/*
+ * mov rax, r12; pop r15; pop r14; pop r13; pop r12; pop rbx; ret
+ */
+static uint8_t *emitEpilogue(uint8_t *p)
+{
+  static const uint8_t epilogue[] = {
+	0x4c, 0x89, 0xe0,
+	0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5b, 0xc3
+  };
+
+  return emitBytes(p, epilogue, sizeof(epilogue));
+}
+
+/*
+ * the end of a block: while budget is left and the block at the new
+ * pc is translated, jump past its prologue instead of returning
+ * add r12, cycles; cmp r12, r14; jae exit
+ * movzx eax, word [rbx + pc]; mov rax, [r15 + rax * 8]
+ * test rax, rax; jz exit; add rax, PROLOGUE_BYTES; jmp rax
+ * exit: <epilogue>
+ */
+static uint8_t *emitChain(uint8_t *p, uint32_t cycles)
+{
+  static const uint8_t lookup[] = {
+	0x49, 0x8b, 0x04, 0xc7,
+	0x48, 0x85, 0xc0
+  };
+  static const uint8_t enter[] = {
+	0x48, 0x83, 0xc0, PROLOGUE_BYTES,
+	0xff, 0xe0
+  };
+  uint8_t *spent, *untranslated;
+
+  p = emitAddCycles(p, cycles);
+  p = emit8(p, 0x4d);
+  p = emit8(p, 0x39);
+  p = emit8(p, 0xf4);
+  p = emitJump(p, 0x73, &spent);
+  p = emit8(p, 0x0f);
+  p = emit8(p, 0xb7);
+  p = emit8(p, 0x83);
+  p = emit32(p, offsetof(State8080, pc));
+  p = emitBytes(p, lookup, sizeof(lookup));
+  p = emitJump(p, 0x74, &untranslated);
+  p = emitBytes(p, enter, sizeof(enter));
+  jumpHere(spent, p);
+  jumpHere(untranslated, p);
+  return emitEpilogue(p);
+}
+
+/*
+ * mov word [rbx + pc], value
+ */
+static uint8_t *emitSetPC(uint8_t *p, uint16_t value)
+{
+  p = emit8(p, 0x66);
+  p = emit8(p, 0xc7);
+  p = emit8(p, 0x83);
+  p = emit32(p, offsetof(State8080, pc));
+  return emit16(p, value);
+}
+
+/*
+ * mov byte [rbx + offset], value
+ */
+static uint8_t *emitStoreImm8(uint8_t *p, int32_t offset, uint8_t value)
+{
+  p = emit8(p, 0xc6);
+  p = emit8(p, 0x83);
+  p = emit32(p, offset);
+  return emit8(p, value);
+}
+
+/*
+ * mov al, [rbx + src]; mov [rbx + dst], al
+ */
+static uint8_t *emitMoveReg(uint8_t *p, int32_t dst, int32_t src)
+{
+  p = emit8(p, 0x8a);
+  p = emit8(p, 0x83);
+  p = emit32(p, src);
+  p = emit8(p, 0x88);
+  p = emit8(p, 0x83);
+  return emit32(p, dst);
+}
+
+/*
+ * mov rdi, rbx; mov esi, lo; mov edx, hi; mov rax, handler; call rax
+ * mov eax, eax; add r12, rax
+ */
+static uint8_t *emitCallHandler(uint8_t *p, OpHandler8080 handler,
+                                uint8_t lo, uint8_t hi)
+{
+  static const uint8_t callAdd[] = {
+	0xff, 0xd0, 0x89, 0xc0, 0x49, 0x01, 0xc4
+  };
+
+  p = emit8(p, 0x48);
+  p = emit8(p, 0x89);
+  p = emit8(p, 0xdf);
+  p = emit8(p, 0xbe);
+  p = emit32(p, lo);
+  p = emit8(p, 0xba);
+  p = emit32(p, hi);
+  p = emit8(p, 0x48);
+  p = emit8(p, 0xb8);
+  p = emit64(p, (uint64_t)(uintptr_t)handler);
+  return emitBytes(p, callAdd, sizeof(callAdd));
+}
+
+/*
+ * cmp byte [r13], 0; je skip; add r12, cycles; <epilogue>; skip:
+ * leaves the block when a store invalidated translated code
+ */
+static uint8_t *emitExitCheck(uint8_t *p, uint32_t cycles)
+{
+  static const uint8_t check[] = { 0x41, 0x80, 0x7d, 0x00, 0x00 };
+  uint8_t *skip;
+
+  p = emitBytes(p, check, sizeof(check));
+  p = emitJump(p, 0x74, &skip);
+  p = emitAddCycles(p, cycles);
+  p = emitEpilogue(p);
+  jumpHere(skip, p);
+  return p;
+}
+
+/*
+ * x86 byte registers in the ModRM reg field
+ */
+#define X86_AL 0
+#define X86_CL 1
+#define X86_DL 2
+#define X86_AH 4
+#define X86_CH 5
+#define X86_DH 6
+
+#define PSW_OFFSET ((int32_t)offsetof(State8080, cc.psw))
+#define A_OFFSET ((int32_t)offsetof(State8080, a))
+
+/*
+ * <op> [rbx + offset], with reg in the ModRM reg field, a register
+ * or an opcode extension
+ */
+static uint8_t *emitMem(uint8_t *p, uint8_t op, int reg, int32_t offset)
+{
+  p = emit8(p, op);
+  p = emit8(p, 0x83 | reg << 3);
+  return emit32(p, offset);
+}
+
+/*
+ * x86 ALU operation numbers of ADD, ADC, SUB, SBB, ANA, XRA, ORA, CMP
+ */
+static const uint8_t x86Alu[8] = { 0, 2, 5, 3, 4, 6, 1, 7 };
+
+/*
+ * an 8080 ALU operation on A with a register or an immediate.
+ * lahf leaves S Z 0 AC 0 P 1 CY in ah, the 8080 PSW layout, only AC
+ * of the subtractions and the logical operations needs fixing up.
+ * src is the 8080 register index, -1 for the immediate lo, M for
+ * an operand emitLoad left in dl.
+ */
+static uint8_t *emitAlu(uint8_t *p, int group, int src, uint8_t lo)
+{
+  static const uint8_t carryIn[] = { 0xd0, 0xe9 }; // shr cl, 1
+  static const uint8_t andAc[] = {
+	0x80, 0xe4, 0xef, // and ah, ~AC
+	0xd0, 0xe1, // shl cl, 1
+	0x80, 0xe1, 0x10, // and cl, AC
+	0x08, 0xcc // or ah, cl
+  };
+  static const uint8_t flipAc[] = { 0x80, 0xf4, 0x10 }; // xor ah, AC
+  static const uint8_t logicAc[] = { 0x80, 0xe4, 0xc6 }; // and ah, S|Z|P|1
+
+  if (group == 1 || group == 3) // ADC, SBB: CY into CF
+  {
+	p = emitMem(p, 0x8a, X86_CL, PSW_OFFSET);
+	p = emitBytes(p, carryIn, sizeof(carryIn));
+  }
+  p = emitMem(p, 0x8a, X86_AL, A_OFFSET);
+  if (group == 4) // ANA: AC is bit 3 of A | operand
+  {
+	p = emit8(p, 0x88);
+	p = emit8(p, 0xc1); // mov cl, al
+	if (src < 0)
+	{
+	  p = emit8(p, 0x80);
+	  p = emit8(p, 0xc9);
+	  p = emit8(p, lo); // or cl, lo
+	}
+	else if (src == REG_M_INDEX)
+	{
+	  p = emit8(p, 0x08);
+	  p = emit8(p, 0xd1); // or cl, dl
+	}
+	else
+	  p = emitMem(p, 0x0a, X86_CL, regOffset[src]);
+  }
+  if (src < 0)
+  {
+	p = emit8(p, x86Alu[group] << 3 | 0x04);
+	p = emit8(p, lo);
+  }
+  else if (src == REG_M_INDEX)
+  {
+	p = emit8(p, x86Alu[group] << 3 | 0x02);
+	p = emit8(p, 0xc2); // <op> al, dl
+  }
+  else
+	p = emitMem(p, x86Alu[group] << 3 | 0x02, X86_AL, regOffset[src]);
+  p = emit8(p, 0x9f); // lahf
+
+  if (group == 2 || group == 3 || group == 7)
+	p = emitBytes(p, flipAc, sizeof(flipAc));
+  else if (group == 4)
+	p = emitBytes(p, andAc, sizeof(andAc));
+  else if (group == 5 || group == 6)
+	p = emitBytes(p, logicAc, sizeof(logicAc));
+  if (group != 7)
+	p = emitMem(p, 0x88, X86_AL, A_OFFSET);
+  return emitMem(p, 0x88, X86_AH, PSW_OFFSET);
+}
+
+/*
+ * INR or DCR of a register, CY kept from the PSW. M works on the
+ * byte emitLoad left in al.
+ */
+static uint8_t *emitIncDec(uint8_t *p, int dec, int reg)
+{
+  static const uint8_t keepCarry[] = {
+	0x9f, // lahf
+	0x80, 0xe4, 0xfe // and ah, ~CY
+  };
+  static const uint8_t mergeCarry[] = {
+	0x80, 0xe1, 0x01, // and cl, CY
+	0x08, 0xcc // or ah, cl
+  };
+  static const uint8_t flipAc[] = { 0x80, 0xf4, 0x10 }; // xor ah, AC
+
+  if (reg == REG_M_INDEX)
+  {
+	p = emit8(p, 0xfe);
+	p = emit8(p, 0xc0 | dec << 3); // inc/dec al
+  }
+  else
+	p = emitMem(p, 0xfe, dec, regOffset[reg]);
+  p = emitBytes(p, keepCarry, sizeof(keepCarry));
+  p = emitMem(p, 0x8a, X86_CL, PSW_OFFSET);
+  p = emitBytes(p, mergeCarry, sizeof(mergeCarry));
+  if (dec)
+	p = emitBytes(p, flipAc, sizeof(flipAc));
+  return emitMem(p, 0x88, X86_AH, PSW_OFFSET);
+}
+
+/*
+ * RLC, RRC, RAL or RAR: CY goes through CF, then back in with
+ * adc cl, cl on the PSW shifted right by one
+ */
+static uint8_t *emitRotate(uint8_t *p, uint8_t opcode)
+{
+  static const uint8_t carryIn[] = { 0xd0, 0xe9 }; // shr cl, 1
+  static const uint8_t carryOut[] = { 0x10, 0xc9 }; // adc cl, cl
+
+  p = emitMem(p, 0x8a, X86_CL, PSW_OFFSET);
+  p = emitBytes(p, carryIn, sizeof(carryIn));
+  p = emitMem(p, 0x8a, X86_AL, A_OFFSET);
+  p = emit8(p, 0xd0);
+  p = emit8(p, 0xc0 | (opcode >> 3) << 3); // rol, ror, rcl, rcr al, 1
+  p = emitBytes(p, carryOut, sizeof(carryOut));
+  p = emitMem(p, 0x88, X86_AL, A_OFFSET);
+  return emitMem(p, 0x88, X86_CL, PSW_OFFSET);
+}
+
+/*
+ * INX or DCX of a register pair, a carry chain over its two bytes
+ */
+static uint8_t *emitPairStep(uint8_t *p, int dec, int pair)
+{
+  if (pair == 3) // SP: inc/dec word [rbx + sp]
+  {
+	p = emit8(p, 0x66);
+	return emitMem(p, 0xff, dec, offsetof(State8080, sp));
+  }
+  p = emitMem(p, 0x80, dec ? 5 : 0, regOffset[pair * 2 + 1]); // add/sub lo, 1
+  p = emit8(p, 1);
+  p = emitMem(p, 0x80, dec ? 3 : 2, regOffset[pair * 2]); // adc/sbb hi, 0
+  return emit8(p, 0);
+}
+
+/*
+ * Jcc: pc is the next instruction, or the target when the flag
+ * test of the condition passes
+ */
+static uint8_t *emitBranch(uint8_t *p, int cond, uint16_t next,
+                           uint16_t target)
+{
+  static const uint8_t condFlag[4] = { FLAG_Z, FLAG_CY, FLAG_P, FLAG_S };
+
+  p = emitSetPC(p, next);
+  p = emitMem(p, 0xf6, 0, PSW_OFFSET); // test byte [rbx + psw], flag
+  p = emit8(p, condFlag[cond >> 1]);
+  p = emit8(p, cond & 1 ? 0x74 : 0x75); // jz/jnz over the taken store
+  p = emit8(p, 9);
+  return emitSetPC(p, target);
+}
+
+/*
+ * byte offsets of the page tables the memory accesses go through
+ */
+#define READ_PAGE_OFFSET ((int32_t)offsetof(State8080, readPage))
+#define WRITE_PAGE_OFFSET ((int32_t)offsetof(State8080, writePage))
+#define CODE_PAGES_OFFSET ((int32_t)offsetof(State8080, codePages))
+#define SP_OFFSET ((int32_t)offsetof(State8080, sp))
+#define PC_OFFSET ((int32_t)offsetof(State8080, pc))
+
+/*
+ * the stores of native code that leave the fast path
+ */
+static void jitWrite(State8080 *state, uint32_t addr, uint32_t value)
+{
+  writeMemory8080(state, addr, value);
+}
+
+/*
+ * ecx = the address in a register pair
+ * movzx ecx, byte [rbx + lo]; mov ch, [rbx + hi]
+ */
+static uint8_t *emitAddrPair(uint8_t *p, int32_t hiOffset, int32_t loOffset)
+{
+  p = emit8(p, 0x0f);
+  p = emitMem(p, 0xb6, X86_CL, loOffset);
+  return emitMem(p, 0x8a, X86_CH, hiOffset);
+}
+
+/*
+ * ecx = addr, mov ecx, addr
+ */
+static uint8_t *emitAddrImm(uint8_t *p, uint16_t addr)
+{
+  p = emit8(p, 0xb9);
+  return emit32(p, addr);
+}
+
+/*
+ * ecx = sp + delta, wrapping at 64K
+ * movzx ecx, word [rbx + sp]; add cx, delta
+ */
+static uint8_t *emitAddrSP(uint8_t *p, int8_t delta)
+{
+  p = emit8(p, 0x0f);
+  p = emitMem(p, 0xb7, X86_CL, SP_OFFSET);
+  if (!delta)
+	return p;
+  p = emit8(p, 0x66);
+  p = emit8(p, 0x83);
+  p = emit8(p, 0xc1);
+  return emit8(p, delta);
+}
+
+/*
+ * al = the byte at ecx, readMemory8080 inline: the page of
+ * readPage, or readSlow8080 for a device page
+ */
+static uint8_t *emitLoad(uint8_t *p)
+{
+  static const uint8_t page[] = {
+	0x89, 0xca, // mov edx, ecx
+	0xc1, 0xea, 0x08, // shr edx, 8
+	0x48, 0x8b, 0x84, 0xd3 // mov rax, [rbx + rdx * 8 + readPage]
+  };
+  static const uint8_t fast[] = {
+	0x0f, 0xb6, 0xc9, // movzx ecx, cl
+	0x8a, 0x04, 0x08 // mov al, [rax + rcx]
+  };
+  static const uint8_t slow[] = {
+	0x48, 0x89, 0xdf, // mov rdi, rbx
+	0x89, 0xce, // mov esi, ecx
+	0x48, 0xb8 // mov rax, readSlow8080
+  };
+  uint8_t *toSlow, *done;
+
+  p = emitBytes(p, page, sizeof(page));
+  p = emit32(p, READ_PAGE_OFFSET);
+  p = emit8(p, 0x48);
+  p = emit8(p, 0x85);
+  p = emit8(p, 0xc0); // test rax, rax
+  p = emitJump(p, 0x74, &toSlow);
+  p = emitBytes(p, fast, sizeof(fast));
+  p = emitJump(p, 0xeb, &done);
+  jumpHere(toSlow, p);
+  p = emitBytes(p, slow, sizeof(slow));
+  p = emit64(p, (uint64_t)(uintptr_t)readSlow8080);
+  p = emit8(p, 0xff);
+  p = emit8(p, 0xd0); // call rax
+  jumpHere(done, p);
+  return p;
+}
+
+/*
+ * store dl at ecx, writeMemory8080 inline: straight into the page
+ * of writePage unless a tier caches code from it, through jitWrite
+ * otherwise. traced builds always call jitWrite, it sees every
+ * store.
+ * @param next pc for the slow path, the handlers run with it
+ */
+static uint8_t *emitStore(uint8_t *p, uint16_t next)
+{
+  static const uint8_t page[] = {
+	0x89, 0xc8, // mov eax, ecx
+	0xc1, 0xe8, 0x08, // shr eax, 8
+	0x4c, 0x8b, 0x84, 0xc3 // mov r8, [rbx + rax * 8 + writePage]
+  };
+  static const uint8_t fast[] = {
+	0x0f, 0xb6, 0xc9, // movzx ecx, cl
+	0x41, 0x88, 0x14, 0x08 // mov [r8 + rcx], dl
+  };
+  static const uint8_t slow[] = {
+	0x48, 0x89, 0xdf, // mov rdi, rbx
+	0x89, 0xce, // mov esi, ecx
+	0x0f, 0xb6, 0xd2, // movzx edx, dl
+	0x48, 0xb8 // mov rax, jitWrite
+  };
+  uint8_t *shared = NULL, *code = NULL, *done = NULL;
+
+  if (!EMU8080_TRACE)
+  {
+	p = emitBytes(p, page, sizeof(page));
+	p = emit32(p, WRITE_PAGE_OFFSET);
+	p = emit8(p, 0x4d);
+	p = emit8(p, 0x85);
+	p = emit8(p, 0xc0); // test r8, r8
+	p = emitJump(p, 0x74, &shared);
+	p = emit8(p, 0x80);
+	p = emit8(p, 0xbc);
+	p = emit8(p, 0x03);
+	p = emit32(p, CODE_PAGES_OFFSET);
+	p = emit8(p, 0x00); // cmp byte [rbx + rax + codePages], 0
+	p = emitJump(p, 0x75, &code);
+	p = emitBytes(p, fast, sizeof(fast));
+	p = emitJump(p, 0xeb, &done);
+	jumpHere(shared, p);
+	jumpHere(code, p);
+  }
+  p = emitSetPC(p, next);
+  p = emitBytes(p, slow, sizeof(slow));
+  p = emit64(p, (uint64_t)(uintptr_t)jitWrite);
+  p = emit8(p, 0xff);
+  p = emit8(p, 0xd0); // call rax
+  if (done)
+	jumpHere(done, p);
+  return p;
+}
+
+/*
+ * edx = a register, movzx edx, byte [rbx + offset]
+ */
+static uint8_t *emitValueReg(uint8_t *p, int32_t offset)
+{
+  p = emit8(p, 0x0f);
+  return emitMem(p, 0xb6, X86_DL, offset);
+}
+
+/*
+ * edx = value, mov edx, value
+ */
+static uint8_t *emitValueImm(uint8_t *p, uint8_t value)
+{
+  p = emit8(p, 0xba);
+  return emit32(p, value);
+}
+
+/*
+ * PUSH of a register pair, or of pc for CALL and RST when hi is
+ * negative. PUSH PSW sets the fixed bit of the flag byte.
+ */
+static uint8_t *emitPush(uint8_t *p, int32_t hi, int32_t lo, uint16_t value,
+                         uint16_t next)
+{
+  p = emit8(p, 0x66);
+  p = emitMem(p, 0x83, 5, SP_OFFSET); // sub word [rbx + sp], 2
+  p = emit8(p, 2);
+  p = emitAddrSP(p, 1);
+  p = hi < 0 ? emitValueImm(p, value >> 8) : emitValueReg(p, hi);
+  p = emitStore(p, next);
+  p = emitAddrSP(p, 0);
+  p = hi < 0 ? emitValueImm(p, value & 0xff) : emitValueReg(p, lo);
+  if (lo == PSW_OFFSET)
+  {
+	p = emit8(p, 0x80);
+	p = emit8(p, 0xca);
+	p = emit8(p, FLAGS_FIXED); // or dl, FLAGS_FIXED
+  }
+  return emitStore(p, next);
+}
+
+/*
+ * POP into two bytes of State8080, a register pair or pc.
+ * POP PSW keeps the defined flag bits, like writeFlags8080.
+ */
+static uint8_t *emitPop(uint8_t *p, int32_t hi, int32_t lo)
+{
+  static const uint8_t flags[] = {
+	0x24, FLAGS_ALL, // and al, FLAGS_ALL
+	0x0c, FLAGS_FIXED // or al, FLAGS_FIXED
+  };
+
+  p = emitAddrSP(p, 0);
+  p = emitLoad(p);
+  if (lo == PSW_OFFSET)
+  {
+	p = emitBytes(p, flags, sizeof(flags));
+	p = emitStoreImm8(p, offsetof(State8080, cc.pending), 0);
+  }
+  p = emitMem(p, 0x88, X86_AL, lo);
+  p = emitAddrSP(p, 1);
+  p = emitLoad(p);
+  p = emitMem(p, 0x88, X86_AL, hi);
+  p = emit8(p, 0x66);
+  p = emitMem(p, 0x83, 0, SP_OFFSET); // add word [rbx + sp], 2
+  return emit8(p, 2);
+}
+
+/*
+ * test the flag of a condition, jump to skip when it fails
+ */
+static uint8_t *emitCondition(uint8_t *p, int cond, uint8_t **skip)
+{
+  static const uint8_t condFlag[4] = { FLAG_Z, FLAG_CY, FLAG_P, FLAG_S };
+
+  p = emitMem(p, 0xf6, 0, PSW_OFFSET); // test byte [rbx + psw], flag
+  p = emit8(p, condFlag[cond >> 1]);
+  return emitJump(p, cond & 1 ? 0x74 : 0x75, skip);
+}
+
+/*
+ * DAD rp: HL += rp, CY from the carry out of bit 15
+ */
+static uint8_t *emitDad(uint8_t *p, int pair)
+{
+  static const uint8_t add[] = {
+	0x66, 0x01, 0xd1, // add cx, dx
+	0x0f, 0x92, 0xc0 // setc al
+  };
+
+  p = emitAddrPair(p, regOffset[4], regOffset[5]);
+  p = emit8(p, 0x0f);
+  if (pair == 3) // movzx edx, word [rbx + sp]
+	p = emitMem(p, 0xb7, X86_DL, SP_OFFSET);
+  else
+  {
+	p = emitMem(p, 0xb6, X86_DL, regOffset[pair * 2 + 1]);
+	p = emitMem(p, 0x8a, X86_DH, regOffset[pair * 2]);
+  }
+  p = emitBytes(p, add, sizeof(add));
+  p = emitMem(p, 0x88, X86_CL, regOffset[5]);
+  p = emitMem(p, 0x88, X86_CH, regOffset[4]);
+  p = emitMem(p, 0x80, 4, PSW_OFFSET); // and byte [rbx + psw], ~CY
+  p = emit8(p, (uint8_t)~FLAG_CY);
+  return emitMem(p, 0x08, X86_AL, PSW_OFFSET); // or [rbx + psw], al
+}
+
+/*
+ * an instruction that reads or writes memory or the stack, as
+ * native code
+ * @return the advanced output pointer, or NULL if the instruction
+ * must go through its handler
+ */
+static uint8_t *emitMemoryOp(uint8_t *p, uint8_t opcode, uint8_t lo,
+                             uint8_t hi, uint16_t next)
+{
+  int32_t h = regOffset[4], l = regOffset[5];
+  int dst = (opcode >> 3) & 7;
+  int src = opcode & 7;
+  uint16_t addr = resolveAddressInPair(hi, lo);
+  uint8_t *skip;
+
+  if ((opcode & 0xc7) == 0x46 && opcode != 0x76) // MOV r,M
+  {
+	p = emitAddrPair(p, h, l);
+	p = emitLoad(p);
+	return emitMem(p, 0x88, X86_AL, regOffset[dst]);
+  }
+  if ((opcode & 0xf8) == 0x70 && opcode != 0x76) // MOV M,r
+  {
+	p = emitAddrPair(p, h, l);
+	p = emitValueReg(p, regOffset[src]);
+	return emitStore(p, next);
+  }
+  if (opcode == 0x36) // MVI M,D8
+  {
+	p = emitAddrPair(p, h, l);
+	p = emitValueImm(p, lo);
+	return emitStore(p, next);
+  }
+  if ((opcode & 0xc7) == 0x86) // ALU M
+  {
+	p = emitAddrPair(p, h, l);
+	p = emitLoad(p);
+	p = emit8(p, 0x88);
+	p = emit8(p, 0xc2); // mov dl, al
+	return emitAlu(p, dst, REG_M_INDEX, 0);
+  }
+  if (opcode == 0x34 || opcode == 0x35) // INR/DCR M
+  {
+	p = emitAddrPair(p, h, l);
+	p = emitLoad(p);
+	p = emitIncDec(p, opcode & 1, REG_M_INDEX);
+	p = emit8(p, 0x89);
+	p = emit8(p, 0xc2); // mov edx, eax
+	p = emitAddrPair(p, h, l);
+	return emitStore(p, next);
+  }
+  if (opcode == 0x3a || (opcode & 0xef) == 0x0a) // LDA, LDAX B/D
+  {
+	p = opcode == 0x3a ? emitAddrImm(p, addr) :
+	    emitAddrPair(p, regOffset[dst & 6], regOffset[(dst & 6) + 1]);
+	p = emitLoad(p);
+	return emitMem(p, 0x88, X86_AL, A_OFFSET);
+  }
+  if (opcode == 0x32 || (opcode & 0xef) == 0x02) // STA, STAX B/D
+  {
+	p = opcode == 0x32 ? emitAddrImm(p, addr) :
+	    emitAddrPair(p, regOffset[dst & 6], regOffset[(dst & 6) + 1]);
+	p = emitValueReg(p, A_OFFSET);
+	return emitStore(p, next);
+  }
+  if (opcode == 0x2a) // LHLD
+  {
+	p = emitAddrImm(p, addr);
+	p = emitLoad(p);
+	p = emitMem(p, 0x88, X86_AL, l);
+	p = emitAddrImm(p, addr + 1);
+	p = emitLoad(p);
+	return emitMem(p, 0x88, X86_AL, h);
+  }
+  if (opcode == 0x22) // SHLD
+  {
+	p = emitAddrImm(p, addr);
+	p = emitValueReg(p, l);
+	p = emitStore(p, next);
+	p = emitAddrImm(p, addr + 1);
+	p = emitValueReg(p, h);
+	return emitStore(p, next);
+  }
+  if ((opcode & 0xcf) == 0xc5 && (opcode != 0xf5 || !EMU8080_LAZY_FLAGS))
+	return opcode == 0xf5 ? emitPush(p, A_OFFSET, PSW_OFFSET, 0, next) :
+	       emitPush(p, regOffset[dst], regOffset[dst + 1], 0, next);
+  if ((opcode & 0xcf) == 0xc1) // POP
+	return opcode == 0xf1 ? emitPop(p, A_OFFSET, PSW_OFFSET) :
+	       emitPop(p, regOffset[dst], regOffset[dst + 1]);
+  if ((opcode & 0xcf) == 0xcd) // CALL and its aliases
+  {
+	p = emitPush(p, -1, -1, next, next);
+	return emitSetPC(p, addr);
+  }
+  if ((opcode & 0xc7) == 0xc7) // RST
+  {
+	p = emitPush(p, -1, -1, next, next);
+	return emitSetPC(p, opcode & 0x38);
+  }
+  if (opcode == 0xc9 || opcode == 0xd9) // RET
+	return emitPop(p, PC_OFFSET + 1, PC_OFFSET);
+  if ((opcode & 0xc7) == 0xc4 || (opcode & 0xc7) == 0xc0) // Ccc, Rcc
+  {
+	p = emitSetPC(p, next);
+	p = emitCondition(p, dst, &skip);
+	if (opcode & 4)
+	{
+	  p = emitPush(p, -1, -1, next, next);
+	  p = emitSetPC(p, addr);
+	}
+	else
+	  p = emitPop(p, PC_OFFSET + 1, PC_OFFSET);
+	p = emit8(p, 0x49);
+	p = emit8(p, 0x83);
+	p = emit8(p, 0xc4);
+	p = emit8(p, opcodeTable8080[opcode].cyclesTaken -
+	             opcodeTable8080[opcode].cycles); // add r12, taken states
+	jumpHere(skip, p);
+	return p;
+  }
+  return NULL;
+}
+
+/*
+ * emit an instruction as native code. branches store their own pc.
+ * @return the advanced output pointer, or NULL if the instruction
+ * must go through its handler
+ */
+static uint8_t *emitInline(uint8_t *p, uint8_t opcode, uint8_t lo, uint8_t hi,
+                           uint16_t next)
+{
+  int dst = (opcode >> 3) & 7;
+  int src = opcode & 7;
+
+  if ((opcode & 0xc7) == 0x00) // NOP and its aliases
+	return p;
+  if ((opcode & 0xc0) == 0x80 && src != REG_M_INDEX) // ALU r
+	return emitAlu(p, dst, src, 0);
+  if ((opcode & 0xc7) == 0xc6) // ALU D8
+	return emitAlu(p, dst, -1, lo);
+  if ((opcode & 0xc6) == 0x04 && dst != REG_M_INDEX) // INR/DCR r
+	return emitIncDec(p, opcode & 1, dst);
+  if ((opcode & 0xc7) == 0x03) // INX/DCX rp
+	return emitPairStep(p, (opcode >> 3) & 1, opcode >> 4);
+  if ((opcode & 0xe7) == 0x07) // RLC, RRC, RAL, RAR
+	return emitRotate(p, opcode);
+  if (opcode == 0x2f) // CMA
+	return emitMem(p, 0xf6, 2, A_OFFSET);
+  if (opcode == 0x37 || opcode == 0x3f) // STC, CMC: or/xor psw, CY
+  {
+	p = emitMem(p, 0x80, opcode == 0x37 ? 1 : 6, PSW_OFFSET);
+	return emit8(p, FLAG_CY);
+  }
+  if ((opcode & 0xc7) == 0xc2) // Jcc
+	return emitBranch(p, dst, next, resolveAddressInPair(hi, lo));
+  if (opcode == 0xc3 || opcode == 0xcb) // JMP
+	return emitSetPC(p, resolveAddressInPair(hi, lo));
+  if ((opcode & 0xc0) == 0x40 && opcode != 0x76 &&
+	  dst != REG_M_INDEX && src != REG_M_INDEX) // MOV r,r
+	return dst == src ? p : emitMoveReg(p, regOffset[dst], regOffset[src]);
+  if ((opcode & 0xc7) == 0x06 && dst != REG_M_INDEX) // MVI r,D8
+	return emitStoreImm8(p, regOffset[dst], lo);
+  if (opcode == 0x31) // LXI SP,D16
+  {
+	p = emit8(p, 0x66);
+	p = emit8(p, 0xc7);
+	p = emit8(p, 0x83);
+	p = emit32(p, offsetof(State8080, sp));
+	return emit16(p, resolveAddressInPair(hi, lo));
+  }
+  if ((opcode & 0xcf) == 0x01) // LXI B/D/H,D16
+  {
+	p = emitStoreImm8(p, regOffset[dst & 6], hi);
+	return emitStoreImm8(p, regOffset[(dst & 6) + 1], lo);
+  }
+  if (opcode == 0xe9 || opcode == 0xf9) // PCHL, SPHL
+  {
+	p = emitAddrPair(p, regOffset[4], regOffset[5]);
+	p = emit8(p, 0x66);
+	return emitMem(p, 0x89, X86_CL, opcode == 0xe9 ? PC_OFFSET : SP_OFFSET);
+  }
+  if (opcode == 0xeb) // XCHG, D/E and H/L as words
+  {
+	p = emit8(p, 0x66);
+	p = emitMem(p, 0x8b, X86_AL, regOffset[2]);
+	p = emit8(p, 0x66);
+	p = emitMem(p, 0x8b, X86_CL, regOffset[4]);
+	p = emit8(p, 0x66);
+	p = emitMem(p, 0x89, X86_AL, regOffset[4]);
+	p = emit8(p, 0x66);
+	return emitMem(p, 0x89, X86_CL, regOffset[2]);
+  }
+  if ((opcode & 0xcf) == 0x09) // DAD rp
+	return emitDad(p, opcode >> 4);
+  return emitMemoryOp(p, opcode, lo, hi, next);
+}
+
+/*
+ * drop every translation and start over with an empty cache
+ */
+static void flushJit(State8080 *state, Jit8080 *jit)
+{
+  int page;
+
+  memset(jit->code, 0, sizeof(jit->code));
+  memset(jit->hits, 0, sizeof(jit->hits));
+  memset(jit->pageBlocks, 0, sizeof(jit->pageBlocks));
+  jit->used = 0;
+  jit->blockCount = 0;
+  for (page = 0; page < 256; page++)
+	state->codePages[page] &= ~CODE_JIT;
+}
+
+/*
+ * switch the part of the cache a translation goes to between
+ * writable and executable, it is never both
+ * @return 0 on success, -1 if the protection can't be changed
+ */
+static int protectCache(Jit8080 *jit, uint8_t *code, int prot)
+{
+  uint8_t *first = (uint8_t *)((uintptr_t)code & ~(jit->pageSize - 1));
+
+  return mprotect(first, code + JIT_MAX_BLOCK_BYTES - first, prot) ? -1 : 0;
+}
+
+/*
+ * translate the basic block at start.
+ * blocks end after a branch, before an instruction that needs
+ * the run loop (HLT, IN, OUT, EI) or after JIT_MAX_BLOCK instructions.
+ * @return the native code, NULL if nothing could be translated
+ */
+static JitCode8080 translate(State8080 *state, Jit8080 *jit, uint16_t start)
+{
+  JitBlock8080 *block;
+  uint8_t *code, *p;
+  uint32_t cycles = 0;
+  uint16_t pc = start;
+  int n, branched = 0, i;
+
+  if (jit->blockCount == JIT_MAX_BLOCKS ||
+	  jit->used + JIT_MAX_BLOCK_BYTES > JIT_CACHE_SIZE)
+	flushJit(state, jit);
+
+  code = jit->cache + jit->used;
+  if (protectCache(jit, code, PROT_READ | PROT_WRITE))
+	return NULL;
+  p = emitPrologue(code, jit);
+
+  for (n = 0; n < JIT_MAX_BLOCK && !branched; n++)
+  {
+	uint8_t opcode = readMemory8080(state, pc);
+	const OpcodeInfo8080 *info = &opcodeTable8080[opcode];
+	uint8_t lo = info->length > 1 ? readMemory8080(state, pc + 1) : 0;
+	uint8_t hi = info->length > 2 ? readMemory8080(state, pc + 2) : 0;
+	uint16_t next = pc + info->length;
+	uint8_t *inlined;
+
+	if (info->attr & OPA_STOP)
+	  break;
+
+	cycles += info->cycles;
+	inlined = emitInline(p, opcode, lo, hi, next);
+	if (inlined)
+	  p = inlined;
+	else
+	{
+	  p = emitSetPC(p, next);
+	  p = emitCallHandler(p, opHandlers8080[opcode], lo, hi);
+	}
+	if (info->attr & OPA_MEMWRITE)
+	  p = emitExitCheck(p, cycles);
+	branched = info->attr & OPA_BRANCH;
+	pc = next;
+  }
+
+  if (!branched)
+	p = emitSetPC(p, pc);
+  p = emitChain(p, cycles);
+  if (protectCache(jit, code, PROT_READ | PROT_EXEC) || n == 0)
+	return NULL;
+  jit->used += p - code;
+
+  block = &jit->blocks[jit->blockCount++];
+  block->start = start;
+  block->pages[0] = start >> 8;
+  block->pages[1] = (uint16_t)(pc - 1) >> 8;
+  block->dead = 0;
+  for (i = 0; i < 2; i++)
+  {
+	if (i == 1 && block->pages[1] == block->pages[0])
+	{
+	  block->pageNext[1] = NULL;
+	  break;
+	}
+	block->pageNext[i] = jit->pageBlocks[block->pages[i]];
+	jit->pageBlocks[block->pages[i]] = block;
+	markCode8080(state, block->pages[i], CODE_JIT);
+  }
+
+  jit->code[start] = (JitCode8080)(void *)code;
+  return jit->code[start];
+}
+
+/*
+ * a store hit a page holding translated code, drop every block
+ * built from it and make running native code return
+ */
+void InvalidateJit8080(State8080 *state, uint8_t page)
+{
+  Jit8080 *jit = state->jit;
+  JitBlock8080 *block = jit->pageBlocks[page];
+
+  while (block)
+  {
+	int slot = block->pages[0] == page ? 0 : 1;
+
+	if (!block->dead)
+	{
+	  block->dead = 1;
+	  jit->code[block->start] = NULL;
+	  jit->hits[block->start] = 0;
+	}
+	block = block->pageNext[slot];
+  }
+  jit->pageBlocks[page] = NULL;
+  state->codePages[page] &= ~CODE_JIT;
+  jit->exitRequested = 1;
+}
+
+/*
+ * attach a native code tier to the machine
+ * @return 0 on success, -1 if executable memory isn't available
+ */
+int EnableJit8080(State8080 *state)
+{
+  Jit8080 *jit;
+
+  if (state->jit)
+	return 0;
+  jit = calloc(1, sizeof(Jit8080));
+  if (!jit)
+	return -1;
+  jit->pageSize = sysconf(_SC_PAGESIZE);
+  jit->cache = mmap(NULL, JIT_CACHE_SIZE, PROT_READ | PROT_EXEC,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (jit->cache == MAP_FAILED)
+  {
+	free(jit);
+	return -1;
+  }
+  state->jit = jit;
+  return 0;
+}
+
+/*
+ * detach and free the native code tier
+ */
+void DisableJit8080(State8080 *state)
+{
+  Jit8080 *jit = state->jit;
+  int page;
+
+  if (!jit)
+	return;
+  for (page = 0; page < 256; page++)
+	state->codePages[page] &= ~CODE_JIT;
+  munmap(jit->cache, JIT_CACHE_SIZE);
+  free(jit);
+  state->jit = NULL;
+}
+
+/*
+ * Run8080 with hot blocks executed as native code. a block always
+ * runs to its end, so the budget may be overshot by one block.
+ * native code goes on into the next translated block by itself,
+ * the loop only sees blocks that still have to be interpreted.
+ */
+RunResult8080 RunJit8080(State8080 *state, uint64_t cycle_budget)
+{
+  RunResult8080 result = { 0, RUN8080_BUDGET };
+  StopReason8080 reason = RUN8080_RUNNING;
+  Jit8080 *jit = state->jit;
+  uint64_t cycles = 0;
+
+  if (!jit)
+	return Run8080(state, cycle_budget);
+
+  if (state->intPending && state->int_enable)
+	cycles += deliverInterrupt8080(state, state->intVector);
+  if (state->halted)
+  {
+	result.reason = RUN8080_HALT;
+	return result;
+  }
+
+  while (cycles < cycle_budget)
+  {
+	uint16_t pc = state->pc;
+	JitCode8080 code = jit->code[pc];
+
+	if (!code && ++jit->hits[pc] >= JIT_HOT_THRESHOLD)
+	{
+	  code = translate(state, jit, pc);
+	  if (!code)
+		jit->hits[pc] = 0;
+	}
+	if (code)
+	{
+	  // native code writes whole flag bytes
+	  settleFlags8080(state);
+	  jit->exitRequested = 0;
+	  cycles += code(state, cycle_budget - cycles);
+	  continue;
+	}
+
+	cycles += interpretBlock(state, &reason);
+	if (reason != RUN8080_RUNNING)
+	{
+	  result.reason = reason;
+	  break;
+	}
+  }
+
+  result.cycles = cycles;
+  state->cycles += cycles;
+  return result;
+}
+
+#else
+
+void InvalidateJit8080(State8080 *state, uint8_t page)
+{
+  state->codePages[page] &= ~CODE_JIT;
+}
+
+int EnableJit8080(State8080 *state)
+{
+  (void)state;
+  return -1;
+}
+
+void DisableJit8080(State8080 *state)
+{
+  (void)state;
+}
+
+/*
+ * no native tier on this host, interpret block by block
+ */
+RunResult8080 RunJit8080(State8080 *state, uint64_t cycle_budget)
+{
+  return Run8080(state, cycle_budget);
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef JIT_8080_H
+#define JIT_8080_H
+
+/*
+ * jit8080.h
+ * optional native code tier. basic blocks that run often are
+ * translated to x86-64 in a code cache that is writable only while
+ * a block is being translated, everything else goes through the
+ * interpreter. almost every instruction becomes native code, memory
+ * and stack accesses go straight to the pages of readPage and
+ * writePage and fall back to the C paths for devices, shared pages
+ * and pages holding cached code. a block goes on into the next
+ * translated block without returning to the run loop. on other
+ * hosts, or when the cache can't be mapped, EnableJit8080 fails and
+ * RunJit8080 just interprets.
+ */
+
+#include <stdint.h>
+
+#include "emulatorShell.h"
+
+int EnableJit8080(State8080 *state);
+void DisableJit8080(State8080 *state);
+void InvalidateJit8080(State8080 *state, uint8_t page);
+RunResult8080 RunJit8080(State8080 *state, uint64_t cycle_budget);
+
+#endif
@@ -0,0 +1,1410 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "opcodes8080.h"
+#include "flags8080.h"
+#include "lockstep8080.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LOCKSTEP_AVX2 1
+#include <immintrin.h>
+#else
+#define LOCKSTEP_AVX2 0
+#endif
+
+#define LANE_WIDTH 32 // bytes per AVX2 vector
+#define RUN_MAX_OPS 32 // instructions of a straight-line run
+#define RUN_END (OPA_BRANCH | OPA_STOP) // ends a run
+#define SIMD_SHARE 4 // smaller groups than 1 lane in 4 go a lane at a time
+
+/*
+ * lockstep register index of B, C, D, E, H, L, (M), A
+ */
+#define REG_M_INDEX 6
+
+static inline uint8_t *laneReg(const Lockstep8080 *engine, int reg)
+{
+  return engine->regs[reg];
+}
+
+/*
+ * allocate a zeroed, SIMD aligned array
+ */
+static void *laneArray(size_t padded, size_t size)
+{
+  void *p = aligned_alloc(LANE_WIDTH, padded * size);
+
+  if (p)
+	memset(p, 0, padded * size);
+  return p;
+}
+
+/*
+ * create an engine for a number of machines, all lanes start zeroed
+ * @return the engine, NULL when out of memory
+ */
+Lockstep8080 *CreateLockstep8080(size_t lanes)
+{
+  Lockstep8080 *engine = calloc(1, sizeof(Lockstep8080));
+  size_t padded = (lanes + LANE_WIDTH - 1) / LANE_WIDTH * LANE_WIDTH;
+
+  if (!engine)
+	return NULL;
+  engine->lanes = lanes;
+  engine->padded = padded;
+  engine->a = laneArray(padded, 1);
+  engine->b = laneArray(padded, 1);
+  engine->c = laneArray(padded, 1);
+  engine->d = laneArray(padded, 1);
+  engine->e = laneArray(padded, 1);
+  engine->h = laneArray(padded, 1);
+  engine->l = laneArray(padded, 1);
+  engine->psw = laneArray(padded, 1);
+  engine->pc = laneArray(padded, sizeof(uint16_t));
+  engine->sp = laneArray(padded, sizeof(uint16_t));
+  engine->int_enable = laneArray(padded, 1);
+  engine->halted = laneArray(padded, 1);
+  engine->active = laneArray(padded, 1);
+  engine->group = laneArray(padded, 1);
+  engine->members = laneArray(padded, sizeof(size_t));
+  engine->waiting = laneArray(padded, sizeof(size_t));
+  engine->cycles = laneArray(padded, sizeof(uint64_t));
+  engine->end = laneArray(padded, sizeof(uint64_t));
+  engine->limit = laneArray(padded, sizeof(uint64_t));
+  engine->machine = laneArray(padded, sizeof(State8080 *));
+  if (!engine->a || !engine->b || !engine->c || !engine->d || !engine->e ||
+	  !engine->h || !engine->l || !engine->psw || !engine->pc ||
+	  !engine->sp || !engine->int_enable || !engine->halted ||
+	  !engine->active || !engine->group || !engine->members ||
+	  !engine->waiting || !engine->cycles ||
+	  !engine->end || !engine->limit || !engine->machine)
+  {
+	DestroyLockstep8080(engine);
+	return NULL;
+  }
+  memset(engine->limit, 0xff, padded * sizeof(uint64_t));
+  engine->regs[0] = engine->b;
+  engine->regs[1] = engine->c;
+  engine->regs[2] = engine->d;
+  engine->regs[3] = engine->e;
+  engine->regs[4] = engine->h;
+  engine->regs[5] = engine->l;
+  engine->regs[7] = engine->a;
+  return engine;
+}
+
+void DestroyLockstep8080(Lockstep8080 *engine)
+{
+  if (!engine)
+	return;
+  free(engine->a);
+  free(engine->b);
+  free(engine->c);
+  free(engine->d);
+  free(engine->e);
+  free(engine->h);
+  free(engine->l);
+  free(engine->psw);
+  free(engine->pc);
+  free(engine->sp);
+  free(engine->int_enable);
+  free(engine->halted);
+  free(engine->active);
+  free(engine->group);
+  free(engine->members);
+  free(engine->waiting);
+  free(engine->cycles);
+  free(engine->end);
+  free(engine->limit);
+  free(engine->machine);
+  free(engine);
+}
+
+/*
+ * copy a machine into a lane. the lane keeps using the memory of
+ * the machine, and steps through it when it runs alone.
+ */
+void LoadLane8080(Lockstep8080 *engine, size_t lane, State8080 *state)
+{
+  engine->a[lane] = state->a;
+  engine->b[lane] = state->b;
+  engine->c[lane] = state->c;
+  engine->d[lane] = state->d;
+  engine->e[lane] = state->e;
+  engine->h[lane] = state->h;
+  engine->l[lane] = state->l;
+  engine->psw[lane] = peekFlags8080(state);
+  engine->pc[lane] = state->pc;
+  engine->sp[lane] = state->sp;
+  engine->int_enable[lane] = state->int_enable;
+  engine->halted[lane] = state->halted;
+  engine->cycles[lane] = state->cycles;
+  engine->machine[lane] = state;
+}
+
+/*
+ * copy the registers of a lane back out into a machine
+ */
+void StoreLane8080(const Lockstep8080 *engine, size_t lane, State8080 *state)
+{
+  state->a = engine->a[lane];
+  state->b = engine->b[lane];
+  state->c = engine->c[lane];
+  state->d = engine->d[lane];
+  state->e = engine->e[lane];
+  state->h = engine->h[lane];
+  state->l = engine->l[lane];
+  writeFlags8080(state, engine->psw[lane]);
+  state->pc = engine->pc[lane];
+  state->sp = engine->sp[lane];
+  state->int_enable = engine->int_enable[lane];
+  state->halted = engine->halted[lane];
+  state->cycles = engine->cycles[lane];
+}
+
+/*
+ * retire a lane that halted or used up its budget
+ */
+static inline void checkLane(Lockstep8080 *engine, size_t lane)
+{
+  if (engine->halted[lane] || engine->cycles[lane] >= engine->end[lane])
+	engine->active[lane] = 0;
+}
+
+/*
+ * run one instruction of a single lane through the interpreter of
+ * its machine. IN and OUT only reach ports on the bus of the machine.
+ */
+static void emulateLane(Lockstep8080 *engine, size_t lane)
+{
+  State8080 *machine = engine->machine[lane];
+
+  StoreLane8080(engine, lane, machine);
+  engine->cycles[lane] += Emulate8080Op(machine);
+  engine->a[lane] = machine->a;
+  engine->b[lane] = machine->b;
+  engine->c[lane] = machine->c;
+  engine->d[lane] = machine->d;
+  engine->e[lane] = machine->e;
+  engine->h[lane] = machine->h;
+  engine->l[lane] = machine->l;
+  engine->psw[lane] = peekFlags8080(machine);
+  engine->pc[lane] = machine->pc;
+  engine->sp[lane] = machine->sp;
+  engine->int_enable[lane] = machine->int_enable;
+  engine->halted[lane] = machine->halted;
+  engine->emulatedSteps++;
+}
+
+/*
+ * resolveAddressInPair, inline for the lane loops
+ */
+static inline uint16_t laneWord(uint8_t msb, uint8_t lsb)
+{
+  return (uint16_t)msb << 8 | lsb;
+}
+
+/*
+ * the single lane kernel works on the lane arrays in place, only
+ * memory goes through the machine
+ */
+static inline uint16_t laneHL(const Lockstep8080 *engine, size_t lane)
+{
+  return laneWord(engine->h[lane], engine->l[lane]);
+}
+
+static inline uint8_t laneGet(Lockstep8080 *engine, size_t lane, int reg)
+{
+  if (reg == REG_M_INDEX)
+	return readMemory8080(engine->machine[lane], laneHL(engine, lane));
+  return engine->regs[reg][lane];
+}
+
+static inline void laneSet(Lockstep8080 *engine, size_t lane, int reg,
+                           uint8_t value)
+{
+  if (reg == REG_M_INDEX)
+	writeMemory8080(engine->machine[lane], laneHL(engine, lane), value);
+  else
+	engine->regs[reg][lane] = value;
+}
+
+/*
+ * BC, DE, HL or SP in opcode order
+ */
+static inline uint16_t lanePair(const Lockstep8080 *engine, size_t lane,
+                                int pair)
+{
+  if (pair == 3)
+	return engine->sp[lane];
+  return laneWord(engine->regs[pair * 2][lane],
+                  engine->regs[pair * 2 + 1][lane]);
+}
+
+static inline void laneSetPair(Lockstep8080 *engine, size_t lane, int pair,
+                               uint16_t value)
+{
+  if (pair == 3)
+	engine->sp[lane] = value;
+  else
+  {
+	engine->regs[pair * 2][lane] = value >> 8;
+	engine->regs[pair * 2 + 1][lane] = value & 0xff;
+  }
+}
+
+static inline void lanePush(Lockstep8080 *engine, size_t lane, uint16_t value)
+{
+  State8080 *machine = engine->machine[lane];
+  uint16_t sp = engine->sp[lane] - 2;
+
+  writeMemory8080(machine, sp + 1, value >> 8);
+  writeMemory8080(machine, sp, value & 0xff);
+  engine->sp[lane] = sp;
+}
+
+static inline uint16_t lanePop(Lockstep8080 *engine, size_t lane)
+{
+  const State8080 *machine = engine->machine[lane];
+  uint16_t sp = engine->sp[lane];
+
+  const uint8_t *bytes = machine->readPage[sp >> 8];
+
+  engine->sp[lane] = sp + 2;
+  // both bytes on one page in memory
+  if (bytes && (sp & 0xff) != 0xff)
+	return laneWord(bytes[(sp & 0xff) + 1], bytes[sp & 0xff]);
+  return laneWord(readMemory8080(machine, sp + 1),
+                  readMemory8080(machine, sp));
+}
+
+static inline int laneCondition(uint8_t psw, int cond)
+{
+  static const uint8_t condFlag[4] = { FLAG_Z, FLAG_CY, FLAG_P, FLAG_S };
+
+  return ((psw & condFlag[cond >> 1]) != 0) == (cond & 1);
+}
+
+/*
+ * ADD, ADC, SUB, SBB, ANA, XRA, ORA or CMP of a lane
+ */
+static void laneAlu(Lockstep8080 *engine, size_t lane, int op, uint8_t value)
+{
+  uint8_t a = engine->a[lane];
+  uint8_t carry = (op == 1 || op == 3) ? engine->psw[lane] & FLAG_CY : 0;
+  uint8_t other = 0;
+  uint16_t res;
+
+  switch (op)
+  {
+	case 0: case 1: // ADD ADC
+	  res = a + value + carry;
+	  other = ((a ^ value ^ res) & FLAG_AC) | (res >> 8);
+	  break;
+	case 2: case 3: case 7: // SUB SBB CMP
+	  res = a - value - carry;
+	  other = (~(a ^ value ^ res) & FLAG_AC) | ((res >> 8) & FLAG_CY);
+	  break;
+	case 4: // ANA
+	  res = a & value;
+	  other = ((a | value) & 0x08) << 1;
+	  break;
+	case 5: // XRA
+	  res = a ^ value;
+	  break;
+	default: // ORA
+	  res = a | value;
+	  break;
+  }
+  engine->psw[lane] = szpTable8080[res & 0xff] | other | FLAGS_FIXED;
+  if (op != 7)
+	engine->a[lane] = res & 0xff;
+}
+
+/*
+ * run a decoded instruction of a single lane in place
+ * @return machine states spent, 0 for HLT, IN, OUT, EI and DI, which
+ * need the machine and are left to emulateLane
+ */
+static int laneExecute(Lockstep8080 *engine, size_t lane, uint8_t opcode,
+                       uint8_t lo, uint8_t hi)
+{
+  State8080 *machine = engine->machine[lane];
+  const OpcodeInfo8080 *info = &opcodeTable8080[opcode];
+  uint8_t *psw = &engine->psw[lane];
+  uint8_t *a = &engine->a[lane];
+  int dst = (opcode >> 3) & 7;
+  int src = opcode & 7;
+  int pair = (opcode >> 4) & 3;
+  uint16_t addr = laneWord(hi, lo);
+  uint8_t value, cy;
+  uint32_t sum;
+
+  if ((info->attr & OPA_STOP) || info->kind == OPK_DI)
+	return 0;
+  engine->pc[lane] += info->length;
+
+  switch (info->kind)
+  {
+	case OPK_JCC:
+	  if (laneCondition(*psw, dst))
+		engine->pc[lane] = addr;
+	  return info->cycles;
+	case OPK_JMP:
+	  engine->pc[lane] = addr;
+	  return info->cycles;
+	case OPK_CCC:
+	  if (!laneCondition(*psw, dst))
+		return info->cycles;
+	  lanePush(engine, lane, engine->pc[lane]);
+	  engine->pc[lane] = addr;
+	  return info->cyclesTaken;
+	case OPK_CALL:
+	  lanePush(engine, lane, engine->pc[lane]);
+	  engine->pc[lane] = addr;
+	  return info->cycles;
+	case OPK_RCC:
+	  if (!laneCondition(*psw, dst))
+		return info->cycles;
+	  engine->pc[lane] = lanePop(engine, lane);
+	  return info->cyclesTaken;
+	case OPK_RET:
+	  engine->pc[lane] = lanePop(engine, lane);
+	  return info->cycles;
+	case OPK_RST:
+	  lanePush(engine, lane, engine->pc[lane]);
+	  engine->pc[lane] = dst << 3;
+	  return info->cycles;
+	case OPK_PCHL:
+	  engine->pc[lane] = laneHL(engine, lane);
+	  return info->cycles;
+	default:
+	  break;
+  }
+
+  if ((opcode & 0xc0) == 0x40) // MOV
+	laneSet(engine, lane, dst, laneGet(engine, lane, src));
+  else if ((opcode & 0xc0) == 0x80) // ALU r
+	laneAlu(engine, lane, dst, laneGet(engine, lane, src));
+  else if ((opcode & 0xc7) == 0xc6) // ALU immediate
+	laneAlu(engine, lane, dst, lo);
+  else if ((opcode & 0xc7) == 0x06) // MVI
+	laneSet(engine, lane, dst, lo);
+  else if ((opcode & 0xc6) == 0x04) // INR DCR
+  {
+	value = laneGet(engine, lane, dst) + ((opcode & 1) ? -1 : 1);
+	laneSet(engine, lane, dst, value);
+	if (opcode & 1)
+	  cy = (value & 0x0f) != 0x0f ? FLAG_AC : 0;
+	else
+	  cy = (value & 0x0f) == 0 ? FLAG_AC : 0;
+	*psw = szpTable8080[value] | cy | (*psw & FLAG_CY) | FLAGS_FIXED;
+  }
+  else if ((opcode & 0xcf) == 0x01) // LXI
+	laneSetPair(engine, lane, pair, addr);
+  else if ((opcode & 0xcf) == 0x03) // INX
+	laneSetPair(engine, lane, pair, lanePair(engine, lane, pair) + 1);
+  else if ((opcode & 0xcf) == 0x0b) // DCX
+	laneSetPair(engine, lane, pair, lanePair(engine, lane, pair) - 1);
+  else if ((opcode & 0xcf) == 0x09) // DAD
+  {
+	sum = laneHL(engine, lane) + lanePair(engine, lane, pair);
+	laneSetPair(engine, lane, 2, sum);
+	*psw = (*psw & ~FLAG_CY) | ((sum >> 16) & 1);
+  }
+  else if ((opcode & 0xcf) == 0xc5) // PUSH
+	lanePush(engine, lane, pair == 3 ? laneWord(*a, *psw) :
+	                       lanePair(engine, lane, pair));
+  else if ((opcode & 0xcf) == 0xc1) // POP
+  {
+	addr = lanePop(engine, lane);
+	if (pair == 3)
+	{
+	  *a = addr >> 8;
+	  *psw = (addr & FLAGS_ALL) | FLAGS_FIXED;
+	}
+	else
+	  laneSetPair(engine, lane, pair, addr);
+  }
+  else
+	switch (opcode)
+	{
+	  case 0x02: case 0x12: // STAX
+		writeMemory8080(machine, lanePair(engine, lane, pair), *a);
+		break;
+	  case 0x0a: case 0x1a: // LDAX
+		*a = readMemory8080(machine, lanePair(engine, lane, pair));
+		break;
+	  case 0x22: // SHLD
+		writeMemory8080(machine, addr, engine->l[lane]);
+		writeMemory8080(machine, addr + 1, engine->h[lane]);
+		break;
+	  case 0x2a: // LHLD
+		engine->l[lane] = readMemory8080(machine, addr);
+		engine->h[lane] = readMemory8080(machine, addr + 1);
+		break;
+	  case 0x32: // STA
+		writeMemory8080(machine, addr, *a);
+		break;
+	  case 0x3a: // LDA
+		*a = readMemory8080(machine, addr);
+		break;
+	  case 0x07: // RLC
+		cy = *a >> 7;
+		*a = (*a << 1) | cy;
+		*psw = (*psw & ~FLAG_CY) | cy;
+		break;
+	  case 0x0f: // RRC
+		cy = *a & 1;
+		*a = (*a >> 1) | (cy << 7);
+		*psw = (*psw & ~FLAG_CY) | cy;
+		break;
+	  case 0x17: // RAL
+		cy = *psw & FLAG_CY;
+		*psw = (*psw & ~FLAG_CY) | (*a >> 7);
+		*a = (*a << 1) | cy;
+		break;
+	  case 0x1f: // RAR
+		cy = *psw & FLAG_CY;
+		*psw = (*psw & ~FLAG_CY) | (*a & 1);
+		*a = (*a >> 1) | (cy << 7);
+		break;
+	  case 0x27: // DAA
+		value = 0;
+		cy = *psw & FLAG_CY;
+		if ((*psw & FLAG_AC) || (*a & 0x0f) > 9)
+		  value += 0x06;
+		if (cy || (*a >> 4) > 9 || ((*a >> 4) >= 9 && (*a & 0x0f) > 9))
+		{
+		  value += 0x60;
+		  cy = FLAG_CY;
+		}
+		laneAlu(engine, lane, 0, value);
+		*psw |= cy;
+		break;
+	  case 0x2f: // CMA
+		*a = ~*a;
+		break;
+	  case 0x37: // STC
+		*psw |= FLAG_CY;
+		break;
+	  case 0x3f: // CMC
+		*psw ^= FLAG_CY;
+		break;
+	  case 0xe3: // XTHL
+		addr = lanePop(engine, lane);
+		lanePush(engine, lane, laneHL(engine, lane));
+		laneSetPair(engine, lane, 2, addr);
+		break;
+	  case 0xeb: // XCHG
+		addr = laneHL(engine, lane);
+		laneSetPair(engine, lane, 2, lanePair(engine, lane, 1));
+		laneSetPair(engine, lane, 1, addr);
+		break;
+	  case 0xf9: // SPHL
+		engine->sp[lane] = laneHL(engine, lane);
+		break;
+	  default: // NOP and its aliases
+		break;
+	}
+  return info->cycles;
+}
+
+/*
+ * run one instruction of a lane that isn't in the lockstep group
+ * @return OPA_* bits of the instruction
+ */
+static uint8_t stepLane(Lockstep8080 *engine, size_t lane)
+{
+  const State8080 *machine = engine->machine[lane];
+  uint16_t pc = engine->pc[lane];
+  uint8_t opcode = readMemory8080(machine, pc);
+  uint8_t length = opcodeTable8080[opcode].length;
+  int cycles = laneExecute(engine, lane, opcode,
+                           length > 1 ? readMemory8080(machine, pc + 1) : 0,
+                           length > 2 ? readMemory8080(machine, pc + 2) : 0);
+
+  if (cycles)
+	engine->cycles[lane] += cycles;
+  else
+	emulateLane(engine, lane);
+  engine->scalarSteps++;
+  checkLane(engine, lane);
+  return opcodeTable8080[opcode].attr;
+}
+
+/*
+ * step a lane on its own up to the end of its straight-line run
+ */
+static void runLane(Lockstep8080 *engine, size_t lane)
+{
+  int n;
+
+  for (n = 0; n < RUN_MAX_OPS && engine->active[lane]; n++)
+	if (stepLane(engine, lane) & RUN_END)
+	  break;
+}
+
+/*
+ * instructions the SIMD kernels handle, registers and flags only
+ */
+static int simdSupported(uint8_t opcode)
+{
+  int dst = (opcode >> 3) & 7;
+  int src = opcode & 7;
+
+  if ((opcode & 0xc7) == 0x00) // NOP and aliases
+	return 1;
+  if ((opcode & 0xc0) == 0x40) // MOV r,r
+	return opcode != 0x76 && dst != REG_M_INDEX && src != REG_M_INDEX;
+  if ((opcode & 0xc0) == 0x80) // ALU r
+	return src != REG_M_INDEX;
+  if ((opcode & 0xc7) == 0xc6) // ALU immediate
+	return 1;
+  if ((opcode & 0xc6) == 0x04 || (opcode & 0xc7) == 0x06) // INR, DCR, MVI
+	return dst != REG_M_INDEX;
+  if ((opcode & 0xcf) == 0x01 || (opcode & 0xc7) == 0x03) // LXI, INX, DCX
+	return (opcode >> 4) != 3;
+  if ((opcode & 0xe7) == 0x07) // RLC, RRC, RAL, RAR
+	return 1;
+  return opcode == 0x2f || opcode == 0x37 || opcode == 0x3f || // CMA STC CMC
+         opcode == 0xeb; // XCHG
+}
+
+#if LOCKSTEP_AVX2
+
+/*
+ * S, Z and P flag bits of 32 result bytes
+ */
+__attribute__((target("avx2")))
+static __m256i simdSZP(__m256i res)
+{
+  const __m256i nibbleParity = _mm256_setr_epi8(
+	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
+	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0);
+  const __m256i low = _mm256_set1_epi8(0x0f);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i odd = _mm256_xor_si256(
+	_mm256_shuffle_epi8(nibbleParity, _mm256_and_si256(res, low)),
+	_mm256_shuffle_epi8(nibbleParity,
+	                    _mm256_and_si256(_mm256_srli_epi16(res, 4), low)));
+  __m256i s = _mm256_and_si256(res, _mm256_set1_epi8((char)FLAG_S));
+  __m256i z = _mm256_and_si256(_mm256_cmpeq_epi8(res, zero),
+                               _mm256_set1_epi8(FLAG_Z));
+  __m256i p = _mm256_and_si256(_mm256_cmpeq_epi8(odd, zero),
+                               _mm256_set1_epi8(FLAG_P));
+
+  return _mm256_or_si256(_mm256_or_si256(s, z),
+                         _mm256_or_si256(p, _mm256_set1_epi8(FLAGS_FIXED)));
+}
+
+/*
+ * execute a supported instruction for every lane of the group
+ */
+__attribute__((target("avx2")))
+static void simdExecute(Lockstep8080 *engine, uint8_t opcode, uint8_t lo,
+                        uint8_t hi)
+{
+  const __m256i one = _mm256_set1_epi8(1);
+  const __m256i flagAC = _mm256_set1_epi8(FLAG_AC);
+  const __m256i flagCY = _mm256_set1_epi8(FLAG_CY);
+  int dst = (opcode >> 3) & 7;
+  int src = opcode & 7;
+  int alu = (opcode & 0xc0) == 0x80 || (opcode & 0xc7) == 0xc6;
+  uint8_t *dstReg = laneReg(engine, dst);
+  uint8_t *srcReg = laneReg(engine, src);
+  size_t i;
+
+  for (i = 0; i < engine->padded; i += LANE_WIDTH)
+  {
+	__m256i mask = _mm256_load_si256((const __m256i *)(engine->group + i));
+	__m256i a, psw, v, res, flags, cy, ac;
+
+	if (_mm256_testz_si256(mask, mask))
+	  continue;
+	a = _mm256_load_si256((const __m256i *)(engine->a + i));
+	psw = _mm256_load_si256((const __m256i *)(engine->psw + i));
+
+	if (alu)
+	{
+	  int aluOp = dst;
+
+	  v = (opcode & 0xc0) == 0x80 ?
+		_mm256_load_si256((const __m256i *)(srcReg + i)) :
+		_mm256_set1_epi8((char)lo);
+	  cy = (aluOp == 1 || aluOp == 3) ? _mm256_and_si256(psw, flagCY) :
+		_mm256_setzero_si256();
+
+	  switch (aluOp)
+	  {
+		case 0: case 1: // ADD ADC
+		  res = _mm256_add_epi8(_mm256_add_epi8(a, v), cy);
+		  // carry out of bit 7: (a & v) | ((a | v) & ~res)
+		  cy = _mm256_or_si256(_mm256_and_si256(a, v),
+		                       _mm256_andnot_si256(res, _mm256_or_si256(a, v)));
+		  cy = _mm256_and_si256(_mm256_srli_epi16(cy, 7), flagCY);
+		  ac = _mm256_and_si256(_mm256_xor_si256(_mm256_xor_si256(a, v), res),
+		                        flagAC);
+		  break;
+		case 2: case 3: case 7: // SUB SBB CMP
+		  res = _mm256_sub_epi8(_mm256_sub_epi8(a, v), cy);
+		  // borrow out of bit 7: (~a & v) | ((~a | v) & res)
+		  cy = _mm256_or_si256(_mm256_andnot_si256(a, v),
+		                       _mm256_and_si256(res,
+		                         _mm256_or_si256(_mm256_xor_si256(a,
+		                           _mm256_set1_epi8(-1)), v)));
+		  cy = _mm256_and_si256(_mm256_srli_epi16(cy, 7), flagCY);
+		  ac = _mm256_andnot_si256(
+		         _mm256_xor_si256(_mm256_xor_si256(a, v), res), flagAC);
+		  break;
+		case 4: // ANA
+		  res = _mm256_and_si256(a, v);
+		  ac = _mm256_and_si256(_mm256_slli_epi16(_mm256_or_si256(a, v), 1),
+		                        flagAC);
+		  cy = _mm256_setzero_si256();
+		  break;
+		case 5: // XRA
+		  res = _mm256_xor_si256(a, v);
+		  ac = cy = _mm256_setzero_si256();
+		  break;
+		default: // ORA
+		  res = _mm256_or_si256(a, v);
+		  ac = cy = _mm256_setzero_si256();
+		  break;
+	  }
+	  flags = _mm256_or_si256(simdSZP(res), _mm256_or_si256(ac, cy));
+	  psw = _mm256_blendv_epi8(psw, flags, mask);
+	  if (aluOp != 7)
+		a = _mm256_blendv_epi8(a, res, mask);
+	  _mm256_store_si256((__m256i *)(engine->a + i), a);
+	  _mm256_store_si256((__m256i *)(engine->psw + i), psw);
+	}
+	else if ((opcode & 0xc0) == 0x40 || (opcode & 0xc7) == 0x06) // MOV MVI
+	{
+	  __m256i old = _mm256_load_si256((const __m256i *)(dstReg + i));
+
+	  v = (opcode & 0xc0) == 0x40 ?
+		_mm256_load_si256((const __m256i *)(srcReg + i)) :
+		_mm256_set1_epi8((char)lo);
+	  _mm256_store_si256((__m256i *)(dstReg + i),
+	                     _mm256_blendv_epi8(old, v, mask));
+	}
+	else if ((opcode & 0xc6) == 0x04) // INR DCR
+	{
+	  __m256i old = _mm256_load_si256((const __m256i *)(dstReg + i));
+	  __m256i nibble;
+
+	  if (opcode & 1)
+	  {
+		res = _mm256_sub_epi8(old, one);
+		nibble = _mm256_cmpeq_epi8(_mm256_and_si256(res, _mm256_set1_epi8(0x0f)),
+		                           _mm256_set1_epi8(0x0f));
+		ac = _mm256_andnot_si256(nibble, flagAC);
+	  }
+	  else
+	  {
+		res = _mm256_add_epi8(old, one);
+		nibble = _mm256_cmpeq_epi8(_mm256_and_si256(res, _mm256_set1_epi8(0x0f)),
+		                           _mm256_setzero_si256());
+		ac = _mm256_and_si256(nibble, flagAC);
+	  }
+	  flags = _mm256_or_si256(simdSZP(res),
+	                          _mm256_or_si256(ac, _mm256_and_si256(psw, flagCY)));
+	  _mm256_store_si256((__m256i *)(dstReg + i),
+	                     _mm256_blendv_epi8(old, res, mask));
+	  _mm256_store_si256((__m256i *)(engine->psw + i),
+	                     _mm256_blendv_epi8(psw, flags, mask));
+	}
+	else if ((opcode & 0xcf) == 0x01 || (opcode & 0xc7) == 0x03) // LXI INX DCX
+	{
+	  int pair = (opcode >> 4) & 3;
+	  uint8_t *hiReg = laneReg(engine, pair * 2);
+	  uint8_t *loReg = laneReg(engine, pair * 2 + 1);
+	  __m256i hiOld = _mm256_load_si256((const __m256i *)(hiReg + i));
+	  __m256i loOld = _mm256_load_si256((const __m256i *)(loReg + i));
+	  __m256i hiNew, loNew;
+
+	  if ((opcode & 0xcf) == 0x01)
+	  {
+		hiNew = _mm256_set1_epi8((char)hi);
+		loNew = _mm256_set1_epi8((char)lo);
+	  }
+	  else if (opcode & 8) // DCX, a borrow where the low byte was 0
+	  {
+		loNew = _mm256_sub_epi8(loOld, one);
+		hiNew = _mm256_add_epi8(hiOld, _mm256_cmpeq_epi8(loOld,
+		                          _mm256_setzero_si256()));
+	  }
+	  else // INX, a carry where the low byte became 0
+	  {
+		loNew = _mm256_add_epi8(loOld, one);
+		hiNew = _mm256_sub_epi8(hiOld, _mm256_cmpeq_epi8(loNew,
+		                          _mm256_setzero_si256()));
+	  }
+	  _mm256_store_si256((__m256i *)(hiReg + i),
+	                     _mm256_blendv_epi8(hiOld, hiNew, mask));
+	  _mm256_store_si256((__m256i *)(loReg + i),
+	                     _mm256_blendv_epi8(loOld, loNew, mask));
+	}
+	else if ((opcode & 0xe7) == 0x07) // RLC RRC RAL RAR
+	{
+	  // bytes shifted as words, the bit crossing into the neighbour
+	  // byte masked off
+	  __m256i left = _mm256_and_si256(_mm256_slli_epi16(a, 1),
+	                                  _mm256_set1_epi8((char)0xfe));
+	  __m256i right = _mm256_and_si256(_mm256_srli_epi16(a, 1),
+	                                   _mm256_set1_epi8(0x7f));
+	  __m256i bit7 = _mm256_and_si256(_mm256_srli_epi16(a, 7), one);
+	  __m256i bit0 = _mm256_and_si256(a, one);
+	  __m256i carry = _mm256_and_si256(psw, flagCY);
+
+	  switch (opcode)
+	  {
+		case 0x07: res = _mm256_or_si256(left, bit7); cy = bit7; break;
+		case 0x0f:
+		  res = _mm256_or_si256(right, _mm256_slli_epi16(bit0, 7));
+		  cy = bit0;
+		  break;
+		case 0x17: res = _mm256_or_si256(left, carry); cy = bit7; break;
+		default:
+		  res = _mm256_or_si256(right, _mm256_slli_epi16(carry, 7));
+		  cy = bit0;
+		  break;
+	  }
+	  flags = _mm256_or_si256(_mm256_andnot_si256(flagCY, psw), cy);
+	  _mm256_store_si256((__m256i *)(engine->a + i),
+	                     _mm256_blendv_epi8(a, res, mask));
+	  _mm256_store_si256((__m256i *)(engine->psw + i),
+	                     _mm256_blendv_epi8(psw, flags, mask));
+	}
+	else if (opcode == 0xeb) // XCHG
+	{
+	  uint8_t *x[2] = { engine->d, engine->e };
+	  uint8_t *y[2] = { engine->h, engine->l };
+	  int r;
+
+	  for (r = 0; r < 2; r++)
+	  {
+		__m256i dx = _mm256_load_si256((const __m256i *)(x[r] + i));
+		__m256i hy = _mm256_load_si256((const __m256i *)(y[r] + i));
+
+		_mm256_store_si256((__m256i *)(x[r] + i),
+		                   _mm256_blendv_epi8(dx, hy, mask));
+		_mm256_store_si256((__m256i *)(y[r] + i),
+		                   _mm256_blendv_epi8(hy, dx, mask));
+	  }
+	}
+	else if (opcode == 0x2f) // CMA
+	  _mm256_store_si256((__m256i *)(engine->a + i),
+	                     _mm256_xor_si256(a, mask));
+	else if (opcode == 0x37) // STC
+	  _mm256_store_si256((__m256i *)(engine->psw + i),
+	                     _mm256_or_si256(psw, _mm256_and_si256(mask, flagCY)));
+	else if (opcode == 0x3f) // CMC
+	  _mm256_store_si256((__m256i *)(engine->psw + i),
+	                     _mm256_xor_si256(psw, _mm256_and_si256(mask, flagCY)));
+  }
+}
+
+static int haveAvx2(void)
+{
+  static int cached = -1;
+
+  if (cached < 0)
+	cached = __builtin_cpu_supports("avx2") ? 1 : 0;
+  return cached;
+}
+
+#else
+
+static void simdExecute(Lockstep8080 *engine, uint8_t opcode, uint8_t lo,
+                        uint8_t hi)
+{
+  (void)engine;
+  (void)opcode;
+  (void)lo;
+  (void)hi;
+}
+
+static int haveAvx2(void)
+{
+  return 0;
+}
+
+#endif
+
+/*
+ * one decoded instruction of a straight-line run
+ */
+typedef struct LaneOp8080 {
+	uint16_t pc;
+	uint8_t opcode;
+	uint8_t lo;
+	uint8_t hi;
+	uint8_t simd; // registers and flags only, see simdSupported
+	uint16_t next; // pc after it, the target of JMP, CALL and RST
+}LaneOp8080;
+
+/*
+ * the instructions from a pc up to a branch that may go different
+ * ways in different lanes. JMP, CALL and RST go the same way in all
+ * of them, the run goes on at their target.
+ */
+typedef struct LaneRun8080 {
+	LaneOp8080 ops[RUN_MAX_OPS];
+	int count;
+	uint8_t code[RUN_MAX_OPS * 3]; // the bytes of ops, in order
+	uint16_t start[RUN_MAX_OPS]; // pieces of straight code in code
+	uint8_t length[RUN_MAX_OPS];
+	int pieces;
+	uint64_t pages[4]; // bit set for every page holding code
+	uint32_t span; // most states before the last instruction starts
+	uint16_t next; // pc after the run
+}LaneRun8080;
+
+/*
+ * decode the run of a machine at pc
+ */
+static void decodeRun(const State8080 *machine, uint16_t pc, LaneRun8080 *run)
+{
+  const OpcodeInfo8080 *info;
+  uint8_t *code = run->code;
+  uint32_t most = 0;
+  int piece;
+
+  run->count = 0;
+  run->span = 0;
+  run->pieces = 1;
+  run->start[0] = pc;
+  run->length[0] = 0;
+  while (run->count < RUN_MAX_OPS)
+  {
+	LaneOp8080 *op = &run->ops[run->count++];
+	int follow;
+
+	op->pc = pc;
+	op->opcode = *code++ = readMemory8080(machine, pc);
+	info = &opcodeTable8080[op->opcode];
+	op->lo = info->length > 1 ? *code++ = readMemory8080(machine, pc + 1) : 0;
+	op->hi = info->length > 2 ? *code++ = readMemory8080(machine, pc + 2) : 0;
+	op->simd = simdSupported(op->opcode);
+	run->length[run->pieces - 1] += info->length;
+	run->span += most;
+	most = info->cyclesTaken > info->cycles ? info->cyclesTaken : info->cycles;
+
+	follow = info->kind == OPK_JMP || info->kind == OPK_CALL ||
+	  info->kind == OPK_RST;
+	if (!follow)
+	  op->next = pc + info->length;
+	else if (info->kind == OPK_RST)
+	  op->next = op->opcode & 0x38;
+	else
+	  op->next = laneWord(op->hi, op->lo);
+	pc = op->next;
+	if ((!follow && (info->attr & RUN_END)) || info->kind == OPK_DI)
+	  break;
+	if (follow && run->count < RUN_MAX_OPS)
+	{
+	  run->start[run->pieces] = pc;
+	  run->length[run->pieces++] = 0;
+	}
+  }
+  run->next = pc;
+
+  // a piece is at most RUN_MAX_OPS * 3 bytes, on one or two pages
+  memset(run->pages, 0, sizeof(run->pages));
+  for (piece = 0; piece < run->pieces; piece++)
+  {
+	uint8_t first = run->start[piece] >> 8;
+	uint8_t last = (uint16_t)(run->start[piece] + run->length[piece] - 1) >> 8;
+
+	run->pages[first >> 6] |= 1ull << (first & 63);
+	run->pages[last >> 6] |= 1ull << (last & 63);
+  }
+}
+
+/*
+ * whether a lane has the leader's code for the run, without reading
+ * it when both share its pages, as forks of one machine do
+ * @return 2 when they share the pages, 1 when only the code is the
+ * same, 0 when it isn't
+ */
+static int sameCode(const State8080 *machine, const State8080 *leader,
+                    const LaneRun8080 *run)
+{
+  const uint8_t *code = run->code;
+  int piece, i, ret = 2;
+
+  for (piece = 0; piece < run->pieces; code += run->length[piece++])
+  {
+	uint16_t pc = run->start[piece];
+	uint8_t first = pc >> 8;
+	uint8_t last = (uint16_t)(pc + run->length[piece] - 1) >> 8;
+
+	if (leader->readPage[first] && leader->readPage[last] &&
+		machine->readPage[first] == leader->readPage[first] &&
+		machine->readPage[last] == leader->readPage[last])
+	  continue;
+	for (i = 0; i < run->length[piece]; i++)
+	  if (readMemory8080(machine, pc + i) != code[i])
+		return 0;
+	ret = 1;
+  }
+  return ret;
+}
+
+/*
+ * the lanes of a lockstep group and the code of the run they step
+ * through together
+ */
+typedef struct LaneGroup8080 {
+	const size_t *lanes;
+	size_t count;
+	const uint64_t *pages; // of the run's code
+	int stored; // a lane stored into them, the run ends
+	int emulated; // a lane went through emulateLane, the group ends
+	uint32_t cycles; // states not charged to the lanes yet
+	uint64_t left; // states every lane has left at least
+	// pages every lane shares with the leader, since none of them
+	// stored into one, runs on them need no sameCode
+	uint64_t shared[4];
+}LaneGroup8080;
+
+static inline void groupSpend(LaneGroup8080 *group, uint32_t states)
+{
+  group->left = group->left > states ? group->left - states : 0;
+}
+
+/*
+ * a store of a lane of the group, which ends the run when it may
+ * have changed the code decoded for it
+ */
+static inline void groupStore(Lockstep8080 *engine, LaneGroup8080 *group,
+                              size_t lane, uint16_t addr, uint8_t value)
+{
+  uint8_t page = addr >> 8;
+
+  writeMemory8080(engine->machine[lane], addr, value);
+  group->shared[page >> 6] &= ~(1ull << (page & 63));
+  if (group->pages[page >> 6] >> (page & 63) & 1)
+	group->stored = 1;
+}
+
+static inline void groupPush(Lockstep8080 *engine, LaneGroup8080 *group,
+                             size_t lane, uint16_t value)
+{
+  State8080 *machine = engine->machine[lane];
+  uint16_t sp = engine->sp[lane] - 2;
+  uint8_t page = sp >> 8;
+  uint8_t *bytes = machine->writePage[page];
+
+  engine->sp[lane] = sp;
+  // both bytes on one page of plain memory, as writeMemory8080 would
+  // store them. the lane writes the page in place, it shares it with
+  // no other lane.
+  if (bytes && (sp & 0xff) != 0xff && !machine->codePages[page] &&
+	  !EMU8080_TRACE)
+  {
+	bytes[sp & 0xff] = value & 0xff;
+	bytes[(sp & 0xff) + 1] = value >> 8;
+	if (group->pages[page >> 6] >> (page & 63) & 1)
+	  group->stored = 1;
+	return;
+  }
+  groupStore(engine, group, lane, sp + 1, value >> 8);
+  groupStore(engine, group, lane, sp, value & 0xff);
+}
+
+/*
+ * run a decoded instruction for every lane of the group. memory,
+ * stack, branch and register pair instructions loop over the lanes
+ * with the instruction decoded once, the rest go through laneExecute
+ * lane by lane. the states of the instruction go to group->cycles,
+ * to charge at the end of the run, those that differ between lanes
+ * are charged right away.
+ * @param setPC set when the instruction left pc set in every lane
+ */
+static void groupExecute(Lockstep8080 *engine, LaneGroup8080 *group,
+                        const LaneOp8080 *op, int *setPC)
+{
+  const OpcodeInfo8080 *info = &opcodeTable8080[op->opcode];
+  uint8_t opcode = op->opcode;
+  int dst = (opcode >> 3) & 7;
+  int src = opcode & 7;
+  int pair = (opcode >> 4) & 3;
+  int extra = info->cyclesTaken - info->cycles;
+  uint16_t addr = laneWord(op->hi, op->lo);
+  uint16_t next = op->pc + info->length;
+  const size_t *lanes = group->lanes;
+  size_t k, count = group->count;
+  uint32_t sum;
+
+  *setPC = (info->attr & OPA_BRANCH) != 0;
+  engine->scalarSteps += count;
+  groupSpend(group, info->cyclesTaken > info->cycles ?
+             info->cyclesTaken : info->cycles);
+  switch (info->kind)
+  {
+	case OPK_JMP:
+	  for (k = 0; k < count; k++)
+		engine->pc[lanes[k]] = addr;
+	  group->cycles += info->cycles;
+	  return;
+	case OPK_JCC:
+	  for (k = 0; k < count; k++)
+		engine->pc[lanes[k]] =
+		  laneCondition(engine->psw[lanes[k]], dst) ? addr : next;
+	  group->cycles += info->cycles;
+	  return;
+	case OPK_CALL:
+	case OPK_RST:
+	  for (k = 0; k < count; k++)
+	  {
+		groupPush(engine, group, lanes[k], next);
+		engine->pc[lanes[k]] = info->kind == OPK_RST ? dst << 3 : addr;
+	  }
+	  group->cycles += info->cycles;
+	  return;
+	case OPK_CCC:
+	  for (k = 0; k < count; k++)
+	  {
+		size_t lane = lanes[k];
+
+		engine->pc[lane] = next;
+		if (!laneCondition(engine->psw[lane], dst))
+		  continue;
+		groupPush(engine, group, lane, next);
+		engine->pc[lane] = addr;
+		engine->cycles[lane] += extra;
+	  }
+	  group->cycles += info->cycles;
+	  return;
+	case OPK_RET:
+	  for (k = 0; k < count; k++)
+		engine->pc[lanes[k]] = lanePop(engine, lanes[k]);
+	  group->cycles += info->cycles;
+	  return;
+	case OPK_RCC:
+	  for (k = 0; k < count; k++)
+	  {
+		size_t lane = lanes[k];
+
+		engine->pc[lane] = next;
+		if (!laneCondition(engine->psw[lane], dst))
+		  continue;
+		engine->pc[lane] = lanePop(engine, lane);
+		engine->cycles[lane] += extra;
+	  }
+	  group->cycles += info->cycles;
+	  return;
+	case OPK_PCHL:
+	  for (k = 0; k < count; k++)
+		engine->pc[lanes[k]] = laneHL(engine, lanes[k]);
+	  group->cycles += info->cycles;
+	  return;
+	default:
+	  break;
+  }
+
+  if ((opcode & 0xc7) == 0x46 && opcode != 0x76) // MOV r,M
+	for (k = 0; k < count; k++)
+	  engine->regs[dst][lanes[k]] =
+		readMemory8080(engine->machine[lanes[k]], laneHL(engine, lanes[k]));
+  else if ((opcode & 0xf8) == 0x70 && opcode != 0x76) // MOV M,r
+	for (k = 0; k < count; k++)
+	  groupStore(engine, group, lanes[k], laneHL(engine, lanes[k]),
+	             engine->regs[src][lanes[k]]);
+  else if (opcode == 0x36) // MVI M
+	for (k = 0; k < count; k++)
+	  groupStore(engine, group, lanes[k], laneHL(engine, lanes[k]), op->lo);
+  else if ((opcode & 0xc7) == 0x86) // ALU M
+	for (k = 0; k < count; k++)
+	  laneAlu(engine, lanes[k], dst,
+	          readMemory8080(engine->machine[lanes[k]],
+	                         laneHL(engine, lanes[k])));
+  else if (opcode == 0x3a) // LDA
+	for (k = 0; k < count; k++)
+	  engine->a[lanes[k]] = readMemory8080(engine->machine[lanes[k]], addr);
+  else if (opcode == 0x32) // STA
+	for (k = 0; k < count; k++)
+	  groupStore(engine, group, lanes[k], addr, engine->a[lanes[k]]);
+  else if ((opcode & 0xef) == 0x0a) // LDAX
+	for (k = 0; k < count; k++)
+	  engine->a[lanes[k]] = readMemory8080(engine->machine[lanes[k]],
+	                                       lanePair(engine, lanes[k], pair));
+  else if ((opcode & 0xef) == 0x02) // STAX
+	for (k = 0; k < count; k++)
+	  groupStore(engine, group, lanes[k], lanePair(engine, lanes[k], pair),
+	             engine->a[lanes[k]]);
+  else if (opcode == 0x2a) // LHLD
+	for (k = 0; k < count; k++)
+	{
+	  const State8080 *machine = engine->machine[lanes[k]];
+
+	  engine->l[lanes[k]] = readMemory8080(machine, addr);
+	  engine->h[lanes[k]] = readMemory8080(machine, addr + 1);
+	}
+  else if (opcode == 0x22) // SHLD
+	for (k = 0; k < count; k++)
+	{
+	  groupStore(engine, group, lanes[k], addr, engine->l[lanes[k]]);
+	  groupStore(engine, group, lanes[k], addr + 1, engine->h[lanes[k]]);
+	}
+  else if ((opcode & 0xcf) == 0xc5) // PUSH
+	for (k = 0; k < count; k++)
+	  groupPush(engine, group, lanes[k], pair == 3 ?
+	            laneWord(engine->a[lanes[k]], engine->psw[lanes[k]]) :
+	            lanePair(engine, lanes[k], pair));
+  else if ((opcode & 0xcf) == 0xc1) // POP
+	for (k = 0; k < count; k++)
+	{
+	  uint16_t value = lanePop(engine, lanes[k]);
+
+	  if (pair != 3)
+		laneSetPair(engine, lanes[k], pair, value);
+	  else
+	  {
+		engine->a[lanes[k]] = value >> 8;
+		engine->psw[lanes[k]] = (value & FLAGS_ALL) | FLAGS_FIXED;
+	  }
+	}
+  else if (op->simd) // a small group, see stepGroup
+	for (k = 0; k < count; k++)
+	  laneExecute(engine, lanes[k], opcode, op->lo, op->hi);
+  else if ((opcode & 0xc7) == 0x03) // INX DCX SP, the others are SIMD
+	for (k = 0; k < count; k++)
+	  laneSetPair(engine, lanes[k], pair, lanePair(engine, lanes[k], pair) +
+	              (opcode & 8 ? -1 : 1));
+  else if ((opcode & 0xcf) == 0x01) // LXI
+	for (k = 0; k < count; k++)
+	  laneSetPair(engine, lanes[k], pair, addr);
+  else if ((opcode & 0xcf) == 0x09) // DAD
+	for (k = 0; k < count; k++)
+	{
+	  sum = laneHL(engine, lanes[k]) + lanePair(engine, lanes[k], pair);
+	  laneSetPair(engine, lanes[k], 2, sum);
+	  engine->psw[lanes[k]] = (engine->psw[lanes[k]] & ~FLAG_CY) |
+	                          ((sum >> 16) & 1);
+	}
+  else
+  {
+	for (k = 0; k < count; k++)
+	{
+	  size_t lane = lanes[k];
+	  int cycles;
+
+	  engine->cycles[lane] += group->cycles;
+	  engine->pc[lane] = op->pc;
+	  cycles = laneExecute(engine, lane, opcode, op->lo, op->hi);
+	  if (cycles)
+		engine->cycles[lane] += cycles;
+	  else
+	  {
+		emulateLane(engine, lane);
+		group->emulated = 1;
+	  }
+	}
+	// the host may have written anywhere
+	memset(group->shared, 0, sizeof(group->shared));
+	group->cycles = 0;
+	*setPC = 1;
+	return;
+  }
+  group->cycles += info->cycles;
+}
+
+/*
+ * run the group through the run, up to a store into its code, and
+ * decode the run the leader goes on with. the states of the runs are
+ * charged to the lanes when the group breaks up.
+ * @param following the leader's next run
+ * @return 1 when every lane of the group goes on with it
+ */
+static int executeRun(Lockstep8080 *engine, LaneGroup8080 *group,
+                      const LaneRun8080 *run, int wide,
+                      LaneRun8080 *following)
+{
+  const State8080 *lead = engine->machine[group->lanes[0]];
+  uint16_t next = run->next, pc;
+  uint64_t check = 0;
+  size_t k;
+  int i, setPC = 0, together, shares = 1;
+
+  group->stored = 0;
+  for (i = 0; i < run->count; i++)
+  {
+	const LaneOp8080 *op = &run->ops[i];
+
+	if (op->simd && wide)
+	{
+	  simdExecute(engine, op->opcode, op->lo, op->hi);
+	  group->cycles += opcodeTable8080[op->opcode].cycles;
+	  groupSpend(group, opcodeTable8080[op->opcode].cycles);
+	  engine->simdSteps++;
+	  setPC = 0;
+	}
+	else
+	  groupExecute(engine, group, op, &setPC);
+	if (group->stored)
+	{
+	  // the rest of the run may have changed, decode it again
+	  next = op->next;
+	  break;
+	}
+  }
+
+  pc = setPC ? engine->pc[group->lanes[0]] : next;
+  decodeRun(lead, pc, following);
+  together = !group->emulated && group->left > following->span;
+  if (!setPC)
+	for (k = 0; k < group->count; k++)
+	  engine->pc[group->lanes[k]] = next;
+  else
+	for (k = 0; together && k < group->count; k++)
+	  together = engine->pc[group->lanes[k]] == pc;
+
+  for (i = 0; i < 4; i++)
+	check |= following->pages[i] & ~group->shared[i];
+  for (k = 0; together && check && k < group->count; k++)
+  {
+	int same = sameCode(engine->machine[group->lanes[k]], lead, following);
+
+	together = same != 0;
+	shares &= same == 2;
+  }
+
+  if (!together)
+  {
+	for (k = 0; k < group->count; k++)
+	{
+	  size_t lane = group->lanes[k];
+
+	  engine->cycles[lane] += group->cycles;
+	  checkLane(engine, lane);
+	}
+	group->cycles = 0;
+	return 0;
+  }
+  if (shares)
+	for (i = 0; i < 4; i++)
+	  group->shared[i] |= following->pages[i];
+  return 1;
+}
+
+/*
+ * step the first waiting lane, and the waiting lanes joining it,
+ * through runs from its pc for as long as they stay together. lanes
+ * at the same address with the same code and with budget left for
+ * the whole run join. a leader without that budget steps alone.
+ * @param waiting lanes in engine->waiting
+ * @return lanes left waiting, the others are taken out
+ */
+static size_t stepGroup(Lockstep8080 *engine, size_t waiting, int simd)
+{
+  size_t leader = engine->waiting[0];
+  const State8080 *lead = engine->machine[leader];
+  LaneRun8080 runs[2];
+  LaneGroup8080 group;
+  size_t lane, k, left = 0;
+  uint16_t pc = engine->pc[leader];
+  int shares = 1, cur = 0;
+
+  decodeRun(lead, pc, &runs[0]);
+  if (engine->end[leader] - engine->cycles[leader] <= runs[0].span)
+  {
+	runLane(engine, leader);
+	memmove(engine->waiting, engine->waiting + 1,
+	        (waiting - 1) * sizeof(size_t));
+	return waiting - 1;
+  }
+
+  memset(&group, 0, sizeof(group));
+  group.lanes = engine->members;
+  group.left = UINT64_MAX;
+  for (k = 0; k < waiting; k++)
+  {
+	uint64_t budget;
+	int same = 0;
+
+	lane = engine->waiting[k];
+	budget = engine->end[lane] - engine->cycles[lane];
+	if (engine->pc[lane] == pc && budget > runs[0].span &&
+		(same = sameCode(engine->machine[lane], lead, &runs[0])))
+	{
+	  shares &= same == 2;
+	  engine->members[group.count++] = lane;
+	  if (budget < group.left)
+		group.left = budget;
+	}
+	else
+	  engine->waiting[left++] = lane;
+  }
+  if (shares)
+	for (k = 0; k < 4; k++)
+	  group.shared[k] = runs[0].pages[k];
+  // the kernels go over every lane, a small group is cheaper a lane
+  // at a time
+  simd = simd && group.count * SIMD_SHARE >= engine->lanes;
+  if (simd)
+  {
+	memset(engine->group, 0, engine->padded);
+	for (k = 0; k < group.count; k++)
+	  engine->group[group.lanes[k]] = 0xff;
+  }
+
+  for (;; cur ^= 1)
+  {
+	group.pages = runs[cur].pages;
+	if (!executeRun(engine, &group, &runs[cur], simd, &runs[cur ^ 1]))
+	  return left;
+  }
+}
+
+/*
+ * advance every running lane by at least a run. the first lane
+ * still waiting leads a group, until none is left.
+ * @return 1 if any lane ran
+ */
+static int stepLockstep(Lockstep8080 *engine)
+{
+  size_t lane, waiting = 0;
+  int simd = haveAvx2();
+
+  for (lane = 0; lane < engine->lanes; lane++)
+	if (engine->active[lane])
+	  engine->waiting[waiting++] = lane;
+  if (!waiting)
+	return 0;
+  while (waiting)
+	waiting = stepGroup(engine, waiting, simd);
+  return 1;
+}
+
+/*
+ * run every lane for a number of machine states, or until it halts
+ * or reaches its limit
+ * @return number of lanes that are not halted
+ */
+size_t RunLockstep8080(Lockstep8080 *engine, uint64_t cycle_budget)
+{
+  size_t lane, running = 0;
+
+  for (lane = 0; lane < engine->lanes; lane++)
+  {
+	engine->end[lane] = engine->cycles[lane] + cycle_budget;
+	if (engine->end[lane] > engine->limit[lane] ||
+		engine->end[lane] < engine->cycles[lane])
+	  engine->end[lane] = engine->limit[lane];
+	engine->active[lane] = 1;
+	checkLane(engine, lane);
+  }
+
+  while (stepLockstep(engine))
+	;
+
+  for (lane = 0; lane < engine->lanes; lane++)
+	running += !engine->halted[lane];
+  return running;
+}
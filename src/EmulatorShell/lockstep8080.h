@@ -0,0 +1,52 @@
+#ifndef LOCKSTEP_8080_H
+#define LOCKSTEP_8080_H
+
+/*
+ * lockstep8080.h
+ * steps many machines together. registers are stored structure of
+ * arrays, all A registers together, all B registers together and so
+ * on. lanes sitting at the same address with the same code form a
+ * group and run the straight-line code from there together up to
+ * the next branch: register and ALU instructions with AVX2 where the
+ * host has it, memory and stack instructions in loops over the
+ * group with the instruction decoded once. lanes whose control flow
+ * diverged form groups of their own until they meet again. only
+ * HLT, IN, OUT, EI and DI go through Emulate8080Op of the lane's
+ * machine.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emulatorShell.h"
+
+typedef struct Lockstep8080 {
+	size_t lanes; // machines in the engine
+	size_t padded; // lanes rounded up to the SIMD width
+	uint8_t *a, *b, *c, *d, *e, *h, *l; // registers, one array each
+	uint8_t *regs[8]; // B, C, D, E, H, L, NULL for (M), A in opcode order
+	uint8_t *psw; // packed flags
+	uint16_t *pc;
+	uint16_t *sp;
+	uint8_t *int_enable;
+	uint8_t *halted;
+	uint8_t *active; // lane runs in the current RunLockstep8080 call
+	uint8_t *group; // 0xff for lanes in the current lockstep group
+	size_t *members; // the lanes of the current group, in order
+	size_t *waiting; // lanes yet to run in the current step
+	uint64_t *cycles; // machine states run by each lane
+	uint64_t *end; // cycle count at which each lane stops
+	uint64_t *limit; // cycle count no run takes a lane past, none at first
+	State8080 **machine; // machine each lane was loaded from, owns its memory
+	uint64_t simdSteps; // group steps executed with SIMD kernels
+	uint64_t scalarSteps; // single lane instructions
+	uint64_t emulatedSteps; // of which went through Emulate8080Op
+}Lockstep8080;
+
+Lockstep8080 *CreateLockstep8080(size_t lanes);
+void DestroyLockstep8080(Lockstep8080 *engine);
+void LoadLane8080(Lockstep8080 *engine, size_t lane, State8080 *state);
+void StoreLane8080(const Lockstep8080 *engine, size_t lane, State8080 *state);
+size_t RunLockstep8080(Lockstep8080 *engine, uint64_t cycle_budget);
+
+#endif
@@ -0,0 +1,403 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "bus8080.h"
+
+/*
+ * page every machine starts with, copied on the first write
+ */
+static Page8080 zeroPage8080 = { 1, PAGE_STATIC, { 0 } };
+
+static inline void holdPage(Page8080 *page)
+{
+  if (!(page->flags & PAGE_STATIC))
+	atomic_fetch_add(&page->refs, 1);
+}
+
+static void dropPage(Page8080 *page)
+{
+  if (!page || (page->flags & PAGE_STATIC))
+	return;
+  if (atomic_fetch_sub(&page->refs, 1) == 1)
+	free(page);
+}
+
+static Page8080 *newPage(uint8_t flags)
+{
+  Page8080 *page = malloc(sizeof(Page8080));
+
+  if (!page)
+	return NULL;
+  atomic_init(&page->refs, 1);
+  page->flags = flags;
+  return page;
+}
+
+/*
+ * direct read pointer of a page slot, NULL for devices
+ */
+static uint8_t *viewPage(const State8080 *state, int n)
+{
+  const Bus8080 *bus = state->bus;
+
+  if (!bus)
+	return state->pages[n]->data;
+  if (bus->devices[n].read)
+	return NULL;
+  return state->pages[bus->home[n]]->data;
+}
+
+/*
+ * refresh the read pointers of a page slot and its mirrors
+ */
+static void updateView(State8080 *state, int n)
+{
+  int m;
+
+  if (!state->bus)
+  {
+	state->readPage[n] = state->pages[n]->data;
+	return;
+  }
+  for (m = 0; m < PAGE8080_COUNT; m++)
+	if (state->bus->home[m] == n)
+	  state->readPage[m] = viewPage(state, m);
+}
+
+/*
+ * rebuild all page pointers after the bus changed, write access
+ * is granted again on the next write
+ */
+void remapMemory8080(State8080 *state)
+{
+  int n;
+
+  for (n = 0; n < PAGE8080_COUNT; n++)
+  {
+	state->readPage[n] = viewPage(state, n);
+	state->writePage[n] = NULL;
+  }
+}
+
+/*
+ * point a page slot of a machine at a page, the machine
+ * takes over the reference. shared pages are mapped without
+ * write access.
+ */
+static void setPage(State8080 *state, int n, Page8080 *page)
+{
+  Page8080 *old = state->pages[n];
+
+  state->pages[n] = page;
+  state->writePage[n] = NULL;
+  updateView(state, n);
+  dropPage(old);
+  if (old != page)
+	state->dirtyPages[n] = 1;
+  if (old && old != page && state->codePages[n])
+	invalidateCodePage8080(state, n);
+}
+
+/*
+ * first write to a memory page that isn't writable yet. copies
+ * the page unless this machine holds the only reference.
+ * @param n page slot, not a device or mirror
+ * @return data to write to, NULL for ROM
+ */
+uint8_t *writeFault8080(State8080 *state, int n)
+{
+  Page8080 *page = state->pages[n];
+  Page8080 *copy;
+
+  if (page->flags & PAGE_ROM)
+	return NULL;
+  state->dirtyPages[n] = 1;
+  if (!(page->flags & PAGE_STATIC) && atomic_load(&page->refs) == 1)
+	return state->writePage[n] = page->data;
+
+  copy = newPage(0);
+  if (!copy)
+  {
+	printf("Error: out of memory copying page %02x!\n", n);
+	exit(1);
+  }
+  memcpy(copy->data, page->data, PAGE8080_SIZE);
+  state->pages[n] = copy;
+  updateView(state, n);
+  dropPage(page);
+  return state->writePage[n] = copy->data;
+}
+
+/*
+ * start a new dirty page interval. write access is revoked so the
+ * first write to each page after the checkpoint marks it again.
+ */
+void CheckpointMemory8080(State8080 *state)
+{
+  int n;
+
+  for (n = 0; n < PAGE8080_COUNT; n++)
+  {
+	state->dirtyPages[n] = 0;
+	state->writePage[n] = NULL;
+  }
+}
+
+/*
+ * replace the contents of a whole memory page
+ * @param n page slot, not a device or mirror
+ * @param data 256 bytes, NULL for the zero page
+ */
+void storePage8080(State8080 *state, int n, const uint8_t *data)
+{
+  uint8_t *page;
+
+  if (!data)
+  {
+	setPage(state, n, &zeroPage8080);
+	return;
+  }
+  page = state->writePage[n] ? state->writePage[n] : writeFault8080(state, n);
+  if (!page)
+	return;
+  memcpy(page, data, PAGE8080_SIZE);
+  if (state->codePages[n])
+	invalidateCodePage8080(state, n);
+}
+
+/*
+ * map the zero page at every address
+ * @param state machine without memory
+ */
+void InitMemory8080(State8080 *state)
+{
+  int n;
+
+  for (n = 0; n < PAGE8080_COUNT; n++)
+	state->pages[n] = &zeroPage8080;
+  remapMemory8080(state);
+}
+
+/*
+ * release the pages of a machine
+ */
+void FreeMemory8080(State8080 *state)
+{
+  int n;
+
+  for (n = 0; n < PAGE8080_COUNT; n++)
+  {
+	dropPage(state->pages[n]);
+	state->pages[n] = NULL;
+	state->readPage[n] = NULL;
+	state->writePage[n] = NULL;
+  }
+}
+
+/*
+ * store bytes into the memory of one machine like the 8080 would,
+ * the address wraps. ROM keeps its contents.
+ */
+void LoadMemory8080(State8080 *state, uint16_t addr, const uint8_t *data,
+                    size_t size)
+{
+  while (size > 0)
+  {
+	int n = addr >> PAGE8080_SHIFT;
+	size_t offset = addr & (PAGE8080_SIZE - 1);
+	size_t chunk = PAGE8080_SIZE - offset;
+	size_t i;
+
+	if (chunk > size)
+	  chunk = size;
+	if (!state->writePage[n] && viewPage(state, n) == state->pages[n]->data)
+	  writeFault8080(state, n);
+	if (state->writePage[n])
+	{
+	  memcpy(state->writePage[n] + offset, data, chunk);
+	  if (state->codePages[n])
+		invalidateCodePage8080(state, n);
+	}
+	else
+	  for (i = 0; i < chunk; i++)
+		writeMemory8080(state, addr + i, data[i]);
+	addr += chunk;
+	data += chunk;
+	size -= chunk;
+  }
+}
+
+/*
+ * build an image from a buffer. pages the buffer only partly
+ * covers are zero filled.
+ * @param data bytes of the image
+ * @param size number of bytes, at most 64 KiB
+ * @param addr load address, the image wraps at 0xffff
+ * @param rom nonzero for read only pages, otherwise the pages are
+ * copied on write by each machine
+ * @return the image, NULL when out of memory
+ */
+Image8080 *CreateImage8080(const uint8_t *data, size_t size, uint16_t addr,
+                           int rom)
+{
+  Image8080 *image = calloc(1, sizeof(Image8080));
+
+  if (!image)
+	return NULL;
+  if (size > 0x10000)
+	size = 0x10000;
+  while (size > 0)
+  {
+	int n = addr >> PAGE8080_SHIFT;
+	size_t offset = addr & (PAGE8080_SIZE - 1);
+	size_t chunk = PAGE8080_SIZE - offset;
+
+	if (chunk > size)
+	  chunk = size;
+	if (!image->pages[n])
+	{
+	  image->pages[n] = newPage(rom ? PAGE_ROM : 0);
+	  if (!image->pages[n])
+	  {
+		ReleaseImage8080(image);
+		return NULL;
+	  }
+	  memset(image->pages[n]->data, 0, PAGE8080_SIZE);
+	}
+	memcpy(image->pages[n]->data + offset, data, chunk);
+	addr += chunk;
+	data += chunk;
+	size -= chunk;
+  }
+  return image;
+}
+
+/*
+ * drop the image's references, machines it is mapped into
+ * keep their pages
+ */
+void ReleaseImage8080(Image8080 *image)
+{
+  int n;
+
+  if (!image)
+	return;
+  for (n = 0; n < PAGE8080_COUNT; n++)
+	dropPage(image->pages[n]);
+  free(image);
+}
+
+/*
+ * map the pages of an image into a machine, replacing what was there
+ */
+void MapImage8080(State8080 *state, const Image8080 *image)
+{
+  int n;
+
+  for (n = 0; n < PAGE8080_COUNT; n++)
+	if (image->pages[n] && state->pages[n] != image->pages[n])
+	{
+	  holdPage(image->pages[n]);
+	  setPage(state, n, image->pages[n]);
+	}
+}
+
+/*
+ * copy everything but memory and execution tiers
+ */
+static void copyRegisters(State8080 *dst, const State8080 *src)
+{
+  dst->a = src->a;
+  dst->b = src->b;
+  dst->c = src->c;
+  dst->d = src->d;
+  dst->e = src->e;
+  dst->h = src->h;
+  dst->l = src->l;
+  dst->sp = src->sp;
+  dst->pc = src->pc;
+  dst->cc = src->cc;
+  dst->int_enable = src->int_enable;
+  dst->halted = src->halted;
+  dst->intPending = src->intPending;
+  dst->intVector = src->intVector;
+  dst->ioPort = src->ioPort;
+  dst->cycles = src->cycles;
+}
+
+/*
+ * make child a copy of parent sharing all of its pages. both
+ * machines copy a page on their next write to it. a snapshot is
+ * a fork that is kept around and never run.
+ * @param parent machine to copy
+ * @param child machine without memory, gets no execution tiers
+ */
+void Fork8080(State8080 *parent, State8080 *child)
+{
+  int n;
+
+  memset(child, 0, sizeof(State8080));
+  copyRegisters(child, parent);
+  child->bus = parent->bus;
+  for (n = 0; n < PAGE8080_COUNT; n++)
+  {
+	holdPage(parent->pages[n]);
+	child->pages[n] = parent->pages[n];
+	child->readPage[n] = parent->readPage[n];
+	parent->writePage[n] = NULL;
+  }
+}
+
+/*
+ * roll a machine back to a snapshot. only pages that differ from
+ * the snapshot change hands, execution tiers are kept and lose
+ * the translations of those pages.
+ */
+void Restore8080(State8080 *state, State8080 *snapshot)
+{
+  int n;
+
+  copyRegisters(state, snapshot);
+  for (n = 0; n < PAGE8080_COUNT; n++)
+	if (state->pages[n] != snapshot->pages[n])
+	{
+	  holdPage(snapshot->pages[n]);
+	  snapshot->writePage[n] = NULL;
+	  setPage(state, n, snapshot->pages[n]);
+	}
+}
+
+/*
+ * checksum of the memory a machine sees, cheap enough to compare
+ * two machines after every block. device pages aren't read, reading
+ * them could have side effects.
+ * @return the same value for the same RAM and ROM contents
+ */
+uint64_t MemoryHash8080(const State8080 *state)
+{
+  uint64_t hash = 0x8080;
+  int n, i;
+
+  for (n = 0; n < PAGE8080_COUNT; n++)
+  {
+	const uint8_t *data = state->readPage[n];
+
+	if (!data)
+	  continue;
+	hash = (hash ^ n) * 0x9e3779b97f4a7c15ULL;
+	for (i = 0; i < PAGE8080_SIZE; i += sizeof(uint64_t))
+	{
+	  uint64_t word;
+
+	  memcpy(&word, data + i, sizeof(word));
+	  hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+	  hash ^= hash >> 29;
+	}
+  }
+  return hash;
+}
@@ -0,0 +1,62 @@
+#ifndef MEMORY_8080_H
+#define MEMORY_8080_H
+
+/*
+ * memory8080.h
+ * paged copy-on-write memory. the 64 KiB address space is 256
+ * reference counted pages of 256 bytes. forking a machine shares
+ * all of its pages, a page is copied on the first write to it, so
+ * forks and snapshot restores cost the pages touched, not 64 KiB.
+ * images (ROMs, program loads) are built once and mapped into any
+ * number of machines, ROM pages stay shared and ignore writes.
+ * state->dirtyPages marks the pages written since the last
+ * CheckpointMemory8080, for incremental save states.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "emulatorShell.h"
+
+#define PAGE8080_SHIFT 8
+#define PAGE8080_SIZE  (1 << PAGE8080_SHIFT)
+#define PAGE8080_COUNT 256
+
+/*
+ * Page8080 flags
+ */
+#define PAGE_ROM    0x01 // read only, writes are dropped
+#define PAGE_STATIC 0x02 // the shared zero page, never freed
+
+typedef struct Page8080 {
+	atomic_uint refs; // machines and images mapping the page
+	uint8_t flags;
+	uint8_t data[PAGE8080_SIZE];
+}Page8080;
+
+/*
+ * a memory image that can be mapped into many machines
+ */
+typedef struct Image8080 {
+	Page8080 *pages[PAGE8080_COUNT]; // NULL outside the image
+}Image8080;
+
+uint8_t *writeFault8080(State8080 *state, int n);
+void remapMemory8080(State8080 *state);
+void storePage8080(State8080 *state, int n, const uint8_t *data);
+
+void InitMemory8080(State8080 *state);
+void FreeMemory8080(State8080 *state);
+void CheckpointMemory8080(State8080 *state);
+void LoadMemory8080(State8080 *state, uint16_t addr, const uint8_t *data,
+                    size_t size);
+Image8080 *CreateImage8080(const uint8_t *data, size_t size, uint16_t addr,
+                           int rom);
+void ReleaseImage8080(Image8080 *image);
+void MapImage8080(State8080 *state, const Image8080 *image);
+void Fork8080(State8080 *parent, State8080 *child);
+void Restore8080(State8080 *state, State8080 *snapshot);
+uint64_t MemoryHash8080(const State8080 *state);
+
+#endif
@@ -0,0 +1,574 @@
+#ifndef OPS_8080_H
+#define OPS_8080_H
+
+/*
+ * ops8080.h
+ * instruction semantics of the 8080, one static inline handler
+ * per opcode named op8080_0xNN. the handlers are expanded into
+ * the dispatch loops of the interpreter and the block tier and
+ * referenced through opHandlers8080[] by everything that needs a
+ * function pointer.
+ */
+
+#include "emulatorShell.h"
+#include "opcodes8080.h"
+#include "flags8080.h"
+#include "bus8080.h"
+
+#define OP8080_UNUSED __attribute__((unused))
+
+/*
+ * the loops expanding the handlers dispatch with computed goto on
+ * compilers that support labels as values, a plain switch everywhere
+ * else
+ */
+#if defined(__GNUC__) && !defined(EMU8080_NO_COMPUTED_GOTO)
+#define EMU8080_COMPUTED_GOTO 1
+#else
+#define EMU8080_COMPUTED_GOTO 0
+#endif
+
+#define OPHANDLER8080(code) \
+  static inline int op8080_##code(State8080 *state OP8080_UNUSED, \
+                                  uint8_t lo OP8080_UNUSED, \
+                                  uint8_t hi OP8080_UNUSED)
+
+/*
+ * extra machine states of a taken conditional CALL/RET
+ */
+#define COND_TAKEN_CYCLES 6
+
+static inline uint16_t getHL(const State8080 *state)
+{
+  return resolveAddressInPair(state->h, state->l);
+}
+
+static inline void push8080(State8080 *state, uint16_t value)
+{
+  state->sp -= 2;
+  writeMemory8080(state, state->sp + 1, value >> 8);
+  writeMemory8080(state, state->sp, value & 0xff);
+}
+
+static inline uint16_t pop8080(State8080 *state)
+{
+  uint16_t value = resolveAddressInPair(readMemory8080(state, state->sp + 1),
+                                        readMemory8080(state, state->sp));
+  state->sp += 2;
+  return value;
+}
+
+/*
+ * ALU helpers, all operate on the accumulator
+ */
+static inline uint8_t aluAdd(State8080 *state, uint8_t value, uint8_t carry)
+{
+  uint16_t res = state->a + value + carry;
+  storeFlagsSZP(state, res & 0xff,
+                ((state->a ^ value ^ res) & FLAG_AC) | (res >> 8));
+  return res & 0xff;
+}
+
+static inline uint8_t aluSub(State8080 *state, uint8_t value, uint8_t borrow)
+{
+  // AC is the carry out of bit 3 of A + ~value + !borrow
+  uint16_t res = state->a - value - borrow;
+  storeFlagsSZP(state, res & 0xff,
+                (~(state->a ^ value ^ res) & FLAG_AC) | ((res >> 8) & FLAG_CY));
+  return res & 0xff;
+}
+
+static inline void aluAnd(State8080 *state, uint8_t value)
+{
+  uint8_t ac = ((state->a | value) & 0x08) << 1;
+  state->a &= value;
+  storeFlagsSZP(state, state->a, ac);
+}
+
+static inline void aluXor(State8080 *state, uint8_t value)
+{
+  state->a ^= value;
+  storeFlagsSZP(state, state->a, 0);
+}
+
+static inline void aluOr(State8080 *state, uint8_t value)
+{
+  state->a |= value;
+  storeFlagsSZP(state, state->a, 0);
+}
+
+static inline uint8_t aluInr(State8080 *state, uint8_t value)
+{
+  value++;
+  storeFlagsSZP(state, value, getCarry8080(state) |
+                ((value & 0x0f) == 0 ? FLAG_AC : 0));
+  return value;
+}
+
+static inline uint8_t aluDcr(State8080 *state, uint8_t value)
+{
+  value--;
+  storeFlagsSZP(state, value, getCarry8080(state) |
+                ((value & 0x0f) != 0x0f ? FLAG_AC : 0));
+  return value;
+}
+
+static inline void aluDad(State8080 *state, uint16_t value)
+{
+  uint32_t res = getHL(state) + value;
+  state->h = (res >> 8) & 0xff;
+  state->l = res & 0xff;
+  setCarry8080(state, (res >> 16) & 1);
+}
+
+static inline void aluDaa(State8080 *state)
+{
+  uint8_t correction = 0;
+  uint8_t cy = getCarry8080(state);
+  uint8_t lsb = state->a & 0x0f;
+  uint8_t msb = state->a >> 4;
+
+  if ((state->cc.psw & FLAG_AC) || lsb > 9)
+	correction += 0x06;
+  if (cy || msb > 9 || (msb >= 9 && lsb > 9))
+  {
+	correction += 0x60;
+	cy = FLAG_CY;
+  }
+  state->a = aluAdd(state, correction, 0);
+  state->cc.psw |= cy;
+}
+
+/*
+ * handler families, one macro per instruction group
+ */
+#define MOV_RR(code, dst, src) \
+  OPHANDLER8080(code) { state->dst = state->src; return 0; }
+#define MOV_RM(code, dst) \
+  OPHANDLER8080(code) \
+  { state->dst = readMemory8080(state, getHL(state)); return 0; }
+#define MOV_MR(code, src) \
+  OPHANDLER8080(code) \
+  { writeMemory8080(state, getHL(state), state->src); return 0; }
+
+#define MVI_R(code, dst) \
+  OPHANDLER8080(code) { state->dst = lo; return 0; }
+#define INR_R(code, reg) \
+  OPHANDLER8080(code) { state->reg = aluInr(state, state->reg); return 0; }
+#define DCR_R(code, reg) \
+  OPHANDLER8080(code) { state->reg = aluDcr(state, state->reg); return 0; }
+
+#define LXI_RP(code, hreg, lreg) \
+  OPHANDLER8080(code) { state->hreg = hi; state->lreg = lo; return 0; }
+#define INX_RP(code, hreg, lreg) \
+  OPHANDLER8080(code) \
+  { \
+	uint16_t v = resolveAddressInPair(state->hreg, state->lreg) + 1; \
+	state->hreg = v >> 8; state->lreg = v & 0xff; return 0; \
+  }
+#define DCX_RP(code, hreg, lreg) \
+  OPHANDLER8080(code) \
+  { \
+	uint16_t v = resolveAddressInPair(state->hreg, state->lreg) - 1; \
+	state->hreg = v >> 8; state->lreg = v & 0xff; return 0; \
+  }
+#define DAD_RP(code, hreg, lreg) \
+  OPHANDLER8080(code) \
+  { aluDad(state, resolveAddressInPair(state->hreg, state->lreg)); return 0; }
+#define PUSH_RP(code, hreg, lreg) \
+  OPHANDLER8080(code) \
+  { push8080(state, resolveAddressInPair(state->hreg, state->lreg)); return 0; }
+#define POP_RP(code, hreg, lreg) \
+  OPHANDLER8080(code) \
+  { \
+	uint16_t v = pop8080(state); \
+	state->hreg = v >> 8; state->lreg = v & 0xff; return 0; \
+  }
+
+#define ADD_X(code, operand) \
+  OPHANDLER8080(code) { state->a = aluAdd(state, operand, 0); return 0; }
+#define ADC_X(code, operand) \
+  OPHANDLER8080(code) \
+  { state->a = aluAdd(state, operand, getCarry8080(state)); return 0; }
+#define SUB_X(code, operand) \
+  OPHANDLER8080(code) { state->a = aluSub(state, operand, 0); return 0; }
+#define SBB_X(code, operand) \
+  OPHANDLER8080(code) \
+  { state->a = aluSub(state, operand, getCarry8080(state)); return 0; }
+#define ANA_X(code, operand) \
+  OPHANDLER8080(code) { aluAnd(state, operand); return 0; }
+#define XRA_X(code, operand) \
+  OPHANDLER8080(code) { aluXor(state, operand); return 0; }
+#define ORA_X(code, operand) \
+  OPHANDLER8080(code) { aluOr(state, operand); return 0; }
+#define CMP_X(code, operand) \
+  OPHANDLER8080(code) { aluSub(state, operand, 0); return 0; }
+
+#define JCC(code, cond) \
+  OPHANDLER8080(code) \
+  { \
+	if (condition8080(state, cond)) \
+	  state->pc = resolveAddressInPair(hi, lo); \
+	return 0; \
+  }
+#define CCC(code, cond) \
+  OPHANDLER8080(code) \
+  { \
+	if (!condition8080(state, cond)) \
+	  return 0; \
+	push8080(state, state->pc); \
+	state->pc = resolveAddressInPair(hi, lo); \
+	return COND_TAKEN_CYCLES; \
+  }
+#define RCC(code, cond) \
+  OPHANDLER8080(code) \
+  { \
+	if (!condition8080(state, cond)) \
+	  return 0; \
+	state->pc = pop8080(state); \
+	return COND_TAKEN_CYCLES; \
+  }
+#define RST_N(code, n) \
+  OPHANDLER8080(code) \
+  { push8080(state, state->pc); state->pc = (n) << 3; return 0; }
+
+#define NOP_X(code) \
+  OPHANDLER8080(code) { return 0; }
+#define JMP_X(code) \
+  OPHANDLER8080(code) { state->pc = resolveAddressInPair(hi, lo); return 0; }
+#define CALL_X(code) \
+  OPHANDLER8080(code) \
+  { \
+	push8080(state, state->pc); \
+	state->pc = resolveAddressInPair(hi, lo); \
+	return 0; \
+  }
+#define RET_X(code) \
+  OPHANDLER8080(code) { state->pc = pop8080(state); return 0; }
+
+#define REG_M readMemory8080(state, getHL(state))
+
+/*
+ * 0x00 - 0x3f
+ */
+NOP_X(0x00)
+LXI_RP(0x01, b, c)
+OPHANDLER8080(0x02)	// STAX B
+{
+  writeMemory8080(state, resolveAddressInPair(state->b, state->c), state->a);
+  return 0;
+}
+INX_RP(0x03, b, c)
+INR_R(0x04, b)
+DCR_R(0x05, b)
+MVI_R(0x06, b)
+OPHANDLER8080(0x07)	// RLC
+{
+  uint8_t cy = state->a >> 7;
+  state->a = (state->a << 1) | cy;
+  setCarry8080(state, cy);
+  return 0;
+}
+NOP_X(0x08)
+DAD_RP(0x09, b, c)
+OPHANDLER8080(0x0a)	// LDAX B
+{
+  state->a = readMemory8080(state, resolveAddressInPair(state->b, state->c));
+  return 0;
+}
+DCX_RP(0x0b, b, c)
+INR_R(0x0c, c)
+DCR_R(0x0d, c)
+MVI_R(0x0e, c)
+OPHANDLER8080(0x0f)	// RRC
+{
+  uint8_t cy = state->a & 1;
+  state->a = (state->a >> 1) | (cy << 7);
+  setCarry8080(state, cy);
+  return 0;
+}
+
+NOP_X(0x10)
+LXI_RP(0x11, d, e)
+OPHANDLER8080(0x12)	// STAX D
+{
+  writeMemory8080(state, resolveAddressInPair(state->d, state->e), state->a);
+  return 0;
+}
+INX_RP(0x13, d, e)
+INR_R(0x14, d)
+DCR_R(0x15, d)
+MVI_R(0x16, d)
+OPHANDLER8080(0x17)	// RAL
+{
+  uint8_t cy = getCarry8080(state);
+  setCarry8080(state, state->a >> 7);
+  state->a = (state->a << 1) | cy;
+  return 0;
+}
+NOP_X(0x18)
+DAD_RP(0x19, d, e)
+OPHANDLER8080(0x1a)	// LDAX D
+{
+  state->a = readMemory8080(state, resolveAddressInPair(state->d, state->e));
+  return 0;
+}
+DCX_RP(0x1b, d, e)
+INR_R(0x1c, e)
+DCR_R(0x1d, e)
+MVI_R(0x1e, e)
+OPHANDLER8080(0x1f)	// RAR
+{
+  uint8_t cy = getCarry8080(state);
+  setCarry8080(state, state->a & 1);
+  state->a = (state->a >> 1) | (cy << 7);
+  return 0;
+}
+
+NOP_X(0x20)
+LXI_RP(0x21, h, l)
+OPHANDLER8080(0x22)	// SHLD adr
+{
+  uint16_t addr = resolveAddressInPair(hi, lo);
+  writeMemory8080(state, addr, state->l);
+  writeMemory8080(state, addr + 1, state->h);
+  return 0;
+}
+INX_RP(0x23, h, l)
+INR_R(0x24, h)
+DCR_R(0x25, h)
+MVI_R(0x26, h)
+OPHANDLER8080(0x27)	// DAA
+{
+  aluDaa(state);
+  return 0;
+}
+NOP_X(0x28)
+DAD_RP(0x29, h, l)
+OPHANDLER8080(0x2a)	// LHLD adr
+{
+  uint16_t addr = resolveAddressInPair(hi, lo);
+  state->l = readMemory8080(state, addr);
+  state->h = readMemory8080(state, addr + 1);
+  return 0;
+}
+DCX_RP(0x2b, h, l)
+INR_R(0x2c, l)
+DCR_R(0x2d, l)
+MVI_R(0x2e, l)
+OPHANDLER8080(0x2f)	// CMA
+{
+  state->a = ~state->a;
+  return 0;
+}
+
+NOP_X(0x30)
+OPHANDLER8080(0x31)	// LXI SP,D16
+{
+  state->sp = resolveAddressInPair(hi, lo);
+  return 0;
+}
+OPHANDLER8080(0x32)	// STA adr
+{
+  writeMemory8080(state, resolveAddressInPair(hi, lo), state->a);
+  return 0;
+}
+OPHANDLER8080(0x33)	// INX SP
+{
+  state->sp++;
+  return 0;
+}
+OPHANDLER8080(0x34)	// INR M
+{
+  uint16_t addr = getHL(state);
+  writeMemory8080(state, addr, aluInr(state, readMemory8080(state, addr)));
+  return 0;
+}
+OPHANDLER8080(0x35)	// DCR M
+{
+  uint16_t addr = getHL(state);
+  writeMemory8080(state, addr, aluDcr(state, readMemory8080(state, addr)));
+  return 0;
+}
+OPHANDLER8080(0x36)	// MVI M,D8
+{
+  writeMemory8080(state, getHL(state), lo);
+  return 0;
+}
+OPHANDLER8080(0x37)	// STC
+{
+  state->cc.psw |= FLAG_CY;
+  return 0;
+}
+NOP_X(0x38)
+OPHANDLER8080(0x39)	// DAD SP
+{
+  aluDad(state, state->sp);
+  return 0;
+}
+OPHANDLER8080(0x3a)	// LDA adr
+{
+  state->a = readMemory8080(state, resolveAddressInPair(hi, lo));
+  return 0;
+}
+OPHANDLER8080(0x3b)	// DCX SP
+{
+  state->sp--;
+  return 0;
+}
+INR_R(0x3c, a)
+DCR_R(0x3d, a)
+MVI_R(0x3e, a)
+OPHANDLER8080(0x3f)	// CMC
+{
+  state->cc.psw ^= FLAG_CY;
+  return 0;
+}
+
+/*
+ * 0x40 - 0x7f, MOV and HLT
+ */
+MOV_RR(0x40, b, b) MOV_RR(0x41, b, c) MOV_RR(0x42, b, d) MOV_RR(0x43, b, e)
+MOV_RR(0x44, b, h) MOV_RR(0x45, b, l) MOV_RM(0x46, b)    MOV_RR(0x47, b, a)
+MOV_RR(0x48, c, b) MOV_RR(0x49, c, c) MOV_RR(0x4a, c, d) MOV_RR(0x4b, c, e)
+MOV_RR(0x4c, c, h) MOV_RR(0x4d, c, l) MOV_RM(0x4e, c)    MOV_RR(0x4f, c, a)
+MOV_RR(0x50, d, b) MOV_RR(0x51, d, c) MOV_RR(0x52, d, d) MOV_RR(0x53, d, e)
+MOV_RR(0x54, d, h) MOV_RR(0x55, d, l) MOV_RM(0x56, d)    MOV_RR(0x57, d, a)
+MOV_RR(0x58, e, b) MOV_RR(0x59, e, c) MOV_RR(0x5a, e, d) MOV_RR(0x5b, e, e)
+MOV_RR(0x5c, e, h) MOV_RR(0x5d, e, l) MOV_RM(0x5e, e)    MOV_RR(0x5f, e, a)
+MOV_RR(0x60, h, b) MOV_RR(0x61, h, c) MOV_RR(0x62, h, d) MOV_RR(0x63, h, e)
+MOV_RR(0x64, h, h) MOV_RR(0x65, h, l) MOV_RM(0x66, h)    MOV_RR(0x67, h, a)
+MOV_RR(0x68, l, b) MOV_RR(0x69, l, c) MOV_RR(0x6a, l, d) MOV_RR(0x6b, l, e)
+MOV_RR(0x6c, l, h) MOV_RR(0x6d, l, l) MOV_RM(0x6e, l)    MOV_RR(0x6f, l, a)
+MOV_MR(0x70, b)    MOV_MR(0x71, c)    MOV_MR(0x72, d)    MOV_MR(0x73, e)
+MOV_MR(0x74, h)    MOV_MR(0x75, l)                       MOV_MR(0x77, a)
+MOV_RR(0x78, a, b) MOV_RR(0x79, a, c) MOV_RR(0x7a, a, d) MOV_RR(0x7b, a, e)
+MOV_RR(0x7c, a, h) MOV_RR(0x7d, a, l) MOV_RM(0x7e, a)    MOV_RR(0x7f, a, a)
+
+OPHANDLER8080(0x76)	// HLT
+{
+  state->halted = 1;
+  return 0;
+}
+
+/*
+ * 0x80 - 0xbf, register/memory ALU operations
+ */
+ADD_X(0x80, state->b) ADD_X(0x81, state->c) ADD_X(0x82, state->d)
+ADD_X(0x83, state->e) ADD_X(0x84, state->h) ADD_X(0x85, state->l)
+ADD_X(0x86, REG_M)    ADD_X(0x87, state->a)
+ADC_X(0x88, state->b) ADC_X(0x89, state->c) ADC_X(0x8a, state->d)
+ADC_X(0x8b, state->e) ADC_X(0x8c, state->h) ADC_X(0x8d, state->l)
+ADC_X(0x8e, REG_M)    ADC_X(0x8f, state->a)
+SUB_X(0x90, state->b) SUB_X(0x91, state->c) SUB_X(0x92, state->d)
+SUB_X(0x93, state->e) SUB_X(0x94, state->h) SUB_X(0x95, state->l)
+SUB_X(0x96, REG_M)    SUB_X(0x97, state->a)
+SBB_X(0x98, state->b) SBB_X(0x99, state->c) SBB_X(0x9a, state->d)
+SBB_X(0x9b, state->e) SBB_X(0x9c, state->h) SBB_X(0x9d, state->l)
+SBB_X(0x9e, REG_M)    SBB_X(0x9f, state->a)
+ANA_X(0xa0, state->b) ANA_X(0xa1, state->c) ANA_X(0xa2, state->d)
+ANA_X(0xa3, state->e) ANA_X(0xa4, state->h) ANA_X(0xa5, state->l)
+ANA_X(0xa6, REG_M)    ANA_X(0xa7, state->a)
+XRA_X(0xa8, state->b) XRA_X(0xa9, state->c) XRA_X(0xaa, state->d)
+XRA_X(0xab, state->e) XRA_X(0xac, state->h) XRA_X(0xad, state->l)
+XRA_X(0xae, REG_M)    XRA_X(0xaf, state->a)
+ORA_X(0xb0, state->b) ORA_X(0xb1, state->c) ORA_X(0xb2, state->d)
+ORA_X(0xb3, state->e) ORA_X(0xb4, state->h) ORA_X(0xb5, state->l)
+ORA_X(0xb6, REG_M)    ORA_X(0xb7, state->a)
+CMP_X(0xb8, state->b) CMP_X(0xb9, state->c) CMP_X(0xba, state->d)
+CMP_X(0xbb, state->e) CMP_X(0xbc, state->h) CMP_X(0xbd, state->l)
+CMP_X(0xbe, REG_M)    CMP_X(0xbf, state->a)
+
+/*
+ * 0xc0 - 0xff, control flow, stack, immediates and I/O
+ */
+RCC(0xc0, 0) POP_RP(0xc1, b, c) JCC(0xc2, 0) JMP_X(0xc3)
+CCC(0xc4, 0) PUSH_RP(0xc5, b, c) ADD_X(0xc6, lo) RST_N(0xc7, 0)
+RCC(0xc8, 1) RET_X(0xc9) JCC(0xca, 1) JMP_X(0xcb)
+CCC(0xcc, 1) CALL_X(0xcd) ADC_X(0xce, lo) RST_N(0xcf, 1)
+
+RCC(0xd0, 2) POP_RP(0xd1, d, e) JCC(0xd2, 2)
+OPHANDLER8080(0xd3)	// OUT D8, a bus port or the host when Run8080 stops
+{
+  state->ioPort = lo;
+  if (state->bus && state->bus->ports[lo].out)
+	state->bus->ports[lo].out(state->bus->ports[lo].opaque, lo, state->a);
+  return 0;
+}
+CCC(0xd4, 2) PUSH_RP(0xd5, d, e) SUB_X(0xd6, lo) RST_N(0xd7, 2)
+RCC(0xd8, 3) RET_X(0xd9) JCC(0xda, 3)
+OPHANDLER8080(0xdb)	// IN D8, a bus port or the host when Run8080 stops
+{
+  state->ioPort = lo;
+  if (state->bus && state->bus->ports[lo].in)
+	state->a = state->bus->ports[lo].in(state->bus->ports[lo].opaque, lo);
+  return 0;
+}
+CCC(0xdc, 3) CALL_X(0xdd) SBB_X(0xde, lo) RST_N(0xdf, 3)
+
+RCC(0xe0, 4) POP_RP(0xe1, h, l) JCC(0xe2, 4)
+OPHANDLER8080(0xe3)	// XTHL
+{
+  uint8_t l = readMemory8080(state, state->sp);
+  uint8_t h = readMemory8080(state, state->sp + 1);
+  writeMemory8080(state, state->sp, state->l);
+  writeMemory8080(state, state->sp + 1, state->h);
+  state->l = l;
+  state->h = h;
+  return 0;
+}
+CCC(0xe4, 4) PUSH_RP(0xe5, h, l) ANA_X(0xe6, lo) RST_N(0xe7, 4)
+RCC(0xe8, 5)
+OPHANDLER8080(0xe9)	// PCHL
+{
+  state->pc = getHL(state);
+  return 0;
+}
+JCC(0xea, 5)
+OPHANDLER8080(0xeb)	// XCHG
+{
+  uint8_t h = state->h, l = state->l;
+  state->h = state->d;
+  state->l = state->e;
+  state->d = h;
+  state->e = l;
+  return 0;
+}
+CCC(0xec, 5) CALL_X(0xed) XRA_X(0xee, lo) RST_N(0xef, 5)
+
+RCC(0xf0, 6)
+OPHANDLER8080(0xf1)	// POP PSW
+{
+  uint16_t v = pop8080(state);
+  state->a = v >> 8;
+  writeFlags8080(state, v & 0xff);
+  return 0;
+}
+JCC(0xf2, 6)
+OPHANDLER8080(0xf3)	// DI
+{
+  state->int_enable = 0;
+  return 0;
+}
+CCC(0xf4, 6)
+OPHANDLER8080(0xf5)	// PUSH PSW
+{
+  push8080(state, resolveAddressInPair(state->a, readFlags8080(state)));
+  return 0;
+}
+ORA_X(0xf6, lo) RST_N(0xf7, 6)
+RCC(0xf8, 7)
+OPHANDLER8080(0xf9)	// SPHL
+{
+  state->sp = getHL(state);
+  return 0;
+}
+JCC(0xfa, 7)
+OPHANDLER8080(0xfb)	// EI
+{
+  state->int_enable = 1;
+  return 0;
+}
+CCC(0xfc, 7) CALL_X(0xfd) CMP_X(0xfe, lo) RST_N(0xff, 7)
+
+#endif
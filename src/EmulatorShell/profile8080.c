@@ -0,0 +1,273 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "opcodes8080.h"
+#include "flowGraph8080.h"
+#include "profile8080.h"
+#include "core8080.h"
+
+#define LINE_MAX_LENGTH 32 // one disassembled instruction
+
+/*
+ * a call was taken, open a frame for the subroutine
+ */
+static void enterCall(Profile8080 *profile, uint16_t target, uint16_t ret)
+{
+  ProfileFrame8080 *frame;
+
+  if (profile->depth == PROFILE8080_FRAMES)
+  {
+	memmove(profile->frames, profile->frames + 1,
+	        (PROFILE8080_FRAMES - 1) * sizeof(ProfileFrame8080));
+	profile->depth--;
+  }
+  frame = &profile->frames[profile->depth++];
+  frame->target = target;
+  frame->ret = ret;
+  frame->entry = profile->clock;
+  profile->calls[target]++;
+}
+
+/*
+ * a return was taken, close the frame it returns from. frames above
+ * it were left without a RET (stack games) and are closed too. a RET
+ * that matches no frame is a computed jump and is ignored.
+ * recursive subroutines are charged once per level.
+ */
+static void leaveCall(Profile8080 *profile, uint16_t ret)
+{
+  uint32_t i = profile->depth;
+
+  while (i > 0 && profile->frames[i - 1].ret != ret)
+	i--;
+  if (i == 0)
+	return;
+  while (profile->depth >= i)
+  {
+	const ProfileFrame8080 *frame = &profile->frames[--profile->depth];
+
+	profile->callCycles[frame->target] += profile->clock - frame->entry;
+  }
+}
+
+/*
+ * follow calls and returns on the shadow stack
+ */
+void profileBranch8080(Profile8080 *profile, const State8080 *state,
+                       uint16_t pc, uint8_t opcode)
+{
+  const OpcodeInfo8080 *info = &opcodeTable8080[opcode];
+  uint16_t next = pc + info->length;
+
+  switch (info->kind)
+  {
+	case OPK_CALL:
+	case OPK_RST:
+	  enterCall(profile, state->pc, next);
+	  break;
+	case OPK_CCC:
+	  if (state->pc != next)
+		enterCall(profile, state->pc, next);
+	  break;
+	case OPK_RET:
+	  leaveCall(profile, state->pc);
+	  break;
+	case OPK_RCC:
+	  if (state->pc != next)
+		leaveCall(profile, state->pc);
+	  break;
+	default:
+	  break;
+  }
+}
+
+/*
+ * attach a profile to the machine
+ * @param period record one instruction in period, 0 or 1 for all
+ * @return 0 on success, -1 when out of memory
+ */
+int EnableProfile8080(State8080 *state, uint32_t period)
+{
+  if (state->profile)
+	return 0;
+  state->profile = calloc(1, sizeof(Profile8080));
+  if (!state->profile)
+	return -1;
+  state->profile->period = period ? period : 1;
+  state->profile->countdown = state->profile->period;
+  reselectCore8080(state);
+  return 0;
+}
+
+/*
+ * detach and free the profile
+ */
+void DisableProfile8080(State8080 *state)
+{
+  free(state->profile);
+  state->profile = NULL;
+  reselectCore8080(state);
+}
+
+/*
+ * indices of the largest nonzero keys, largest first
+ * @return number of indices found, at most max
+ */
+static int topEntries(const uint64_t *keys, uint32_t n, uint32_t *top, int max)
+{
+  int count = 0, k;
+  uint32_t i;
+
+  for (i = 0; i < n; i++)
+  {
+	if (!keys[i] || (count == max && keys[i] <= keys[top[count - 1]]))
+	  continue;
+	k = count < max ? count++ : count - 1;
+	while (k > 0 && keys[top[k - 1]] < keys[i])
+	{
+	  top[k] = top[k - 1];
+	  k--;
+	}
+	top[k] = i;
+  }
+  return count;
+}
+
+/*
+ * disassemble the instruction at addr the way the disassembler
+ * prints it, bytes outside the image read as 0
+ */
+static void formatOp(char *line, const uint8_t *image, uint16_t origin,
+                     size_t size, uint16_t addr)
+{
+  uint8_t bytes[3];
+  const OpcodeInfo8080 *info;
+  int i;
+
+  for (i = 0; i < 3; i++)
+  {
+	uint16_t offset = addr + i - origin;
+
+	bytes[i] = image && offset < size ? image[offset] : 0;
+  }
+  if (!image || (uint16_t)(addr - origin) >= size)
+  {
+	line[0] = '\0';
+	return;
+  }
+  info = &opcodeTable8080[bytes[0]];
+  switch (info->length)
+  {
+	case 2:
+	  snprintf(line, LINE_MAX_LENGTH, "%s#%02x", info->mnemonic, bytes[1]);
+	  break;
+	case 3:
+	  snprintf(line, LINE_MAX_LENGTH, "%s#%04x", info->mnemonic,
+	           bytes[2] << 8 | bytes[1]);
+	  break;
+	default:
+	  snprintf(line, LINE_MAX_LENGTH, "%s", info->mnemonic);
+	  break;
+  }
+}
+
+static double percent(uint64_t part, uint64_t total)
+{
+  return total ? 100.0 * part / total : 0.0;
+}
+
+/*
+ * print the hottest addresses, opcodes, subroutines and blocks
+ * @param image code the profile ran, to disassemble hot addresses,
+ * may be NULL
+ * @param origin address of image[0]
+ * @param size bytes in the image
+ * @param graph flow graph of the image for the block report, may be NULL
+ * @param top lines per table
+ */
+void ReportProfile8080(FILE *file, const Profile8080 *profile,
+                       const uint8_t *image, uint16_t origin, size_t size,
+                       const FlowGraph8080 *graph, int top)
+{
+  uint32_t *order = malloc((top > 0 ? top : 1) * sizeof(uint32_t));
+  uint64_t sampled = 0;
+  char line[LINE_MAX_LENGTH];
+  int i, n;
+
+  if (!order)
+	return;
+  for (i = 0; i < 256; i++)
+	sampled += profile->opcodeCycles[i];
+  fprintf(file, "profile: %llu instructions, %llu states, ",
+          (unsigned long long)profile->instructions,
+          (unsigned long long)profile->clock);
+  if (profile->period > 1)
+	fprintf(file, "1 in %u sampled\n", profile->period);
+  else
+	fprintf(file, "every instruction\n");
+
+  fprintf(file, "\nhottest addresses\n"
+                "      states      %%       hits  addr  instruction\n");
+  n = topEntries(profile->cycles, 0x10000, order, top);
+  for (i = 0; i < n; i++)
+  {
+	formatOp(line, image, origin, size, order[i]);
+	fprintf(file, "%12llu %5.1f%% %10llu  %04x  %s\n",
+	        (unsigned long long)profile->cycles[order[i]],
+	        percent(profile->cycles[order[i]], sampled),
+	        (unsigned long long)profile->hits[order[i]], order[i], line);
+  }
+
+  fprintf(file, "\nhottest opcodes\n"
+                "      states      %%       hits  op  mnemonic\n");
+  n = topEntries(profile->opcodeCycles, 256, order, top);
+  for (i = 0; i < n; i++)
+	fprintf(file, "%12llu %5.1f%% %10llu  %02x  %s\n",
+	        (unsigned long long)profile->opcodeCycles[order[i]],
+	        percent(profile->opcodeCycles[order[i]], sampled),
+	        (unsigned long long)profile->opcodeHits[order[i]], order[i],
+	        opcodeTable8080[order[i]].mnemonic);
+
+  fprintf(file, "\nhottest subroutines, inclusive\n"
+                "      states      %%      calls  addr\n");
+  n = topEntries(profile->callCycles, 0x10000, order, top);
+  for (i = 0; i < n; i++)
+	fprintf(file, "%12llu %5.1f%% %10llu  %04x\n",
+	        (unsigned long long)profile->callCycles[order[i]],
+	        percent(profile->callCycles[order[i]], profile->clock),
+	        (unsigned long long)profile->calls[order[i]], order[i]);
+
+  if (graph && graph->blockCount)
+  {
+	uint64_t *blockCycles = calloc(graph->blockCount, sizeof(uint64_t));
+	uint64_t *blockHits = calloc(graph->blockCount, sizeof(uint64_t));
+	uint32_t b, k;
+
+	for (b = 0; blockCycles && blockHits && b < graph->blockCount; b++)
+	  for (k = 0; k < graph->blocks[b].length; k++)
+	  {
+		uint16_t addr = graph->blocks[b].start + k;
+
+		blockCycles[b] += profile->cycles[addr];
+		blockHits[b] += profile->hits[addr];
+	  }
+	if (blockCycles && blockHits)
+	{
+	  fprintf(file, "\nhottest blocks\n"
+	                "      states      %%       hits  block  instructions\n");
+	  n = topEntries(blockCycles, graph->blockCount, order, top);
+	  for (i = 0; i < n; i++)
+		fprintf(file, "%12llu %5.1f%% %10llu  %04x   %u\n",
+		        (unsigned long long)blockCycles[order[i]],
+		        percent(blockCycles[order[i]], sampled),
+		        (unsigned long long)blockHits[order[i]],
+		        graph->blocks[order[i]].start, graph->blocks[order[i]].count);
+	}
+	free(blockHits);
+	free(blockCycles);
+  }
+  free(order);
+}
@@ -0,0 +1,93 @@
+#ifndef PROFILE_8080_H
+#define PROFILE_8080_H
+
+/*
+ * profile8080.h
+ * execution profiler. counts hits and machine states per address and
+ * per opcode in flat 64K/256 entry arrays, and follows CALL/RST and
+ * RET pairs on a shadow stack to charge subroutines their inclusive
+ * machine states. the report joins the counters with the
+ * disassembly of the profiled image.
+ *
+ * Run8080 and Emulate8080Op switch to a variant with the hooks while
+ * a profile is attached (core8080.h). elsewhere the hooks only exist
+ * when built with EMU8080_PROFILE, otherwise PROFILE8080_OP expands to
+ * nothing: RunBlocks8080 is hooked then, code run by the JIT is not
+ * counted.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "emulatorShell.h"
+#include "opcodes8080.h"
+#include "flowGraph8080.h"
+
+#ifndef EMU8080_PROFILE
+#define EMU8080_PROFILE 0
+#endif
+
+#define PROFILE8080_FRAMES 256 // shadow stack depth, deeper calls drop the oldest
+
+typedef struct ProfileFrame8080 {
+	uint16_t target; // subroutine entered
+	uint16_t ret; // return address pushed by the call
+	uint64_t entry; // clock when it was entered
+}ProfileFrame8080;
+
+typedef struct Profile8080 {
+	uint32_t period; // one instruction in period is recorded, 1 for all
+	uint32_t countdown; // instructions until the next sample
+	uint64_t clock; // machine states of every instruction seen
+	uint64_t instructions; // instructions seen
+	uint64_t hits[0x10000]; // sampled instructions per address
+	uint64_t cycles[0x10000]; // sampled machine states per address
+	uint64_t opcodeHits[256];
+	uint64_t opcodeCycles[256];
+	uint64_t calls[0x10000]; // calls per subroutine entry, never sampled
+	uint64_t callCycles[0x10000]; // inclusive machine states per subroutine
+	uint32_t depth;
+	ProfileFrame8080 frames[PROFILE8080_FRAMES];
+}Profile8080;
+
+void profileBranch8080(Profile8080 *profile, const State8080 *state,
+                       uint16_t pc, uint8_t opcode);
+
+/*
+ * count one executed instruction
+ * @param pc address of the instruction, state->pc is past it
+ * @param cycles machine states it took
+ */
+static inline void profileOp8080(Profile8080 *profile, const State8080 *state,
+                                 uint16_t pc, uint8_t opcode, int cycles)
+{
+  profile->clock += cycles;
+  profile->instructions++;
+  if (opcodeTable8080[opcode].attr & OPA_BRANCH)
+	profileBranch8080(profile, state, pc, opcode);
+  if (--profile->countdown)
+	return;
+  profile->countdown = profile->period;
+  profile->hits[pc]++;
+  profile->cycles[pc] += cycles;
+  profile->opcodeHits[opcode]++;
+  profile->opcodeCycles[opcode] += cycles;
+}
+
+#if EMU8080_PROFILE
+#define PROFILE8080_OP(state, pc, opcode, cycles) \
+  do { \
+	if ((state)->profile) \
+	  profileOp8080((state)->profile, (state), (pc), (opcode), (cycles)); \
+  } while (0)
+#else
+#define PROFILE8080_OP(state, pc, opcode, cycles) ((void)0)
+#endif
+
+int EnableProfile8080(State8080 *state, uint32_t period);
+void DisableProfile8080(State8080 *state);
+void ReportProfile8080(FILE *file, const Profile8080 *profile,
+                       const uint8_t *image, uint16_t origin, size_t size,
+                       const FlowGraph8080 *graph, int top);
+
+#endif
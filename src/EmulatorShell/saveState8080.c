@@ -0,0 +1,367 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "flags8080.h"
+#include "memory8080.h"
+#include "bus8080.h"
+#include "saveState8080.h"
+
+#define SAVE_MAGIC "8080SAVE"
+#define SAVE_MAGIC_LENGTH 8
+#define SAVE_HEADER_SIZE 28
+#define SAVE_REGISTERS_SIZE 26
+
+/*
+ * growable output buffer
+ */
+typedef struct SaveBuffer8080 {
+	uint8_t *data;
+	size_t length;
+	size_t capacity;
+	int error;
+}SaveBuffer8080;
+
+static uint8_t *reserve(SaveBuffer8080 *buf, size_t size)
+{
+  uint8_t *p;
+
+  if (buf->error)
+	return NULL;
+  if (buf->length + size > buf->capacity)
+  {
+	size_t capacity = buf->capacity ? buf->capacity : 4096;
+	uint8_t *data;
+
+	while (capacity < buf->length + size)
+	  capacity *= 2;
+	data = realloc(buf->data, capacity);
+	if (!data)
+	{
+	  buf->error = 1;
+	  return NULL;
+	}
+	buf->data = data;
+	buf->capacity = capacity;
+  }
+  p = buf->data + buf->length;
+  buf->length += size;
+  return p;
+}
+
+static void put8(SaveBuffer8080 *buf, uint8_t value)
+{
+  uint8_t *p = reserve(buf, 1);
+
+  if (p)
+	p[0] = value;
+}
+
+static void put16(SaveBuffer8080 *buf, uint16_t value)
+{
+  put8(buf, value & 0xff);
+  put8(buf, value >> 8);
+}
+
+static void put32(SaveBuffer8080 *buf, uint32_t value)
+{
+  put16(buf, value & 0xffff);
+  put16(buf, value >> 16);
+}
+
+static void put64(SaveBuffer8080 *buf, uint64_t value)
+{
+  put32(buf, value & 0xffffffff);
+  put32(buf, value >> 32);
+}
+
+static void putBytes(SaveBuffer8080 *buf, const uint8_t *data, size_t size)
+{
+  uint8_t *p = reserve(buf, size);
+
+  if (p)
+	memcpy(p, data, size);
+}
+
+static void set16(uint8_t *p, uint16_t value)
+{
+  p[0] = value & 0xff;
+  p[1] = value >> 8;
+}
+
+static void set32(uint8_t *p, uint32_t value)
+{
+  set16(p, value & 0xffff);
+  set16(p + 2, value >> 16);
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+  return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static uint64_t get64(const uint8_t *p)
+{
+  return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+static uint32_t fnv1a(const uint8_t *data, size_t size)
+{
+  uint32_t hash = 2166136261u;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+	hash = (hash ^ data[i]) * 16777619u;
+  return hash;
+}
+
+/*
+ * pages that belong in a save state: RAM that this slot owns,
+ * not devices, mirrors or ROM
+ */
+static int savedPage(const State8080 *state, int n)
+{
+  const Bus8080 *bus = state->bus;
+
+  if (bus && (bus->devices[n].read || bus->home[n] != n))
+	return 0;
+  return !(state->pages[n]->flags & PAGE_ROM);
+}
+
+static int zeroPage(const uint8_t *data)
+{
+  int i;
+
+  for (i = 0; i < PAGE8080_SIZE; i++)
+	if (data[i])
+	  return 0;
+  return 1;
+}
+
+/*
+ * write a save state and start a new dirty page interval
+ * @param file output, the record is written with one fwrite
+ * @param state machine to save
+ * @param type SAVE8080_FULL, or SAVE8080_DELTA for the pages written
+ * since the previous save state
+ * @param devices hooks of the attached devices, may be NULL
+ * @param deviceCount number of hooks
+ * @return 0 on success, -1 on failure, the checkpoint is kept then
+ */
+int SaveState8080(FILE *file, State8080 *state, int type,
+                  const DeviceState8080 *devices, size_t deviceCount)
+{
+  SaveBuffer8080 buf = { NULL, 0, 0, 0 };
+  uint32_t sequence = state->checkpoint + 1;
+  size_t countAt, i;
+  uint16_t pages = 0;
+  int n, ret = -1;
+
+  // header, length and checksum are filled in at the end
+  putBytes(&buf, (const uint8_t *)SAVE_MAGIC, SAVE_MAGIC_LENGTH);
+  put16(&buf, SAVE8080_VERSION);
+  put8(&buf, type);
+  put8(&buf, 0);
+  put32(&buf, state->checkpoint);
+  put32(&buf, sequence);
+  put32(&buf, 0);
+  put32(&buf, 0);
+
+  put8(&buf, state->a);
+  put8(&buf, state->b);
+  put8(&buf, state->c);
+  put8(&buf, state->d);
+  put8(&buf, state->e);
+  put8(&buf, state->h);
+  put8(&buf, state->l);
+  put8(&buf, peekFlags8080(state));
+  put16(&buf, state->sp);
+  put16(&buf, state->pc);
+  put8(&buf, state->int_enable);
+  put8(&buf, state->halted);
+  put8(&buf, state->intPending);
+  put8(&buf, state->intVector);
+  put8(&buf, state->ioPort);
+  put8(&buf, 0);
+  put64(&buf, state->cycles);
+
+  countAt = buf.length;
+  put16(&buf, 0);
+  for (n = 0; n < PAGE8080_COUNT; n++)
+  {
+	const uint8_t *data = state->pages[n]->data;
+
+	if (!savedPage(state, n))
+	  continue;
+	if (type == SAVE8080_DELTA ? !state->dirtyPages[n] : zeroPage(data))
+	  continue;
+	put8(&buf, n);
+	putBytes(&buf, data, PAGE8080_SIZE);
+	pages++;
+  }
+
+  put16(&buf, deviceCount);
+  for (i = 0; i < deviceCount; i++)
+  {
+	size_t size = devices[i].save(devices[i].opaque, NULL, 0);
+	uint8_t *p;
+
+	put32(&buf, devices[i].id);
+	put32(&buf, size);
+	p = reserve(&buf, size);
+	if (p && devices[i].save(devices[i].opaque, p, size) != size)
+	  buf.error = 1;
+  }
+
+  if (buf.error)
+	goto out;
+  set16(buf.data + countAt, pages);
+  set32(buf.data + 20, buf.length - SAVE_HEADER_SIZE);
+  set32(buf.data + 24, fnv1a(buf.data + SAVE_HEADER_SIZE,
+                             buf.length - SAVE_HEADER_SIZE));
+  if (fwrite(buf.data, 1, buf.length, file) != buf.length)
+	goto out;
+
+  CheckpointMemory8080(state);
+  state->checkpoint = sequence;
+  ret = 0;
+
+out:
+  free(buf.data);
+  return ret;
+}
+
+/*
+ * read one save state record and apply it. the record, including
+ * the device states, is checked completely before the machine is
+ * touched. a device load failing after that leaves the machine
+ * partly applied and its checkpoint where it was, so no delta
+ * follows it.
+ * @param file input positioned at a record
+ * @param state machine with memory, and the same bus and ROM images
+ * as the machine that was saved. a delta must follow the last save
+ * state loaded into or written from this machine.
+ * @param devices hooks of the attached devices, may be NULL
+ * @param deviceCount number of hooks
+ * @return 0 on success, -1 for I/O errors, bad records, unknown
+ * devices or a delta out of sequence
+ */
+int LoadState8080(FILE *file, State8080 *state,
+                  const DeviceState8080 *devices, size_t deviceCount)
+{
+  uint8_t header[SAVE_HEADER_SIZE];
+  uint8_t *body = NULL;
+  const uint8_t *p, *end, *pagesAt;
+  uint32_t length, base, sequence;
+  uint16_t pages, count, k;
+  int type, n, ret = -1;
+  size_t i;
+
+  if (fread(header, 1, SAVE_HEADER_SIZE, file) != SAVE_HEADER_SIZE ||
+	  memcmp(header, SAVE_MAGIC, SAVE_MAGIC_LENGTH) ||
+	  get16(header + 8) != SAVE8080_VERSION)
+	return -1;
+  type = header[10];
+  base = get32(header + 12);
+  sequence = get32(header + 16);
+  length = get32(header + 20);
+  if ((type != SAVE8080_FULL && type != SAVE8080_DELTA) ||
+	  (type == SAVE8080_DELTA && base != state->checkpoint) ||
+	  length < SAVE_REGISTERS_SIZE + 4)
+	return -1;
+
+  body = malloc(length);
+  if (!body || fread(body, 1, length, file) != length ||
+	  fnv1a(body, length) != get32(header + 24))
+	goto out;
+
+  // check the layout and the devices before applying anything
+  end = body + length;
+  p = body + SAVE_REGISTERS_SIZE;
+  pages = get16(p);
+  pagesAt = p + 2;
+  if ((size_t)pages * (1 + PAGE8080_SIZE) + 2 > (size_t)(end - pagesAt))
+	goto out;
+  p = pagesAt + (size_t)pages * (1 + PAGE8080_SIZE);
+  for (k = 0; k < pages; k++)
+	if (!savedPage(state, pagesAt[k * (1 + PAGE8080_SIZE)]))
+	  goto out;
+  count = get16(p);
+  p += 2;
+  for (k = 0; k < count; k++)
+  {
+	uint32_t size;
+
+	if (p + 8 > end)
+	  goto out;
+	size = get32(p + 4);
+	if (size > (size_t)(end - p - 8))
+	  goto out;
+	for (i = 0; i < deviceCount && devices[i].id != get32(p); i++)
+	  ;
+	if (i == deviceCount)
+	  goto out;
+	if (devices[i].check &&
+		devices[i].check(devices[i].opaque, p + 8, size))
+	  goto out;
+	p += 8 + size;
+  }
+  if (p != end)
+	goto out;
+
+  p = body;
+  state->a = p[0];
+  state->b = p[1];
+  state->c = p[2];
+  state->d = p[3];
+  state->e = p[4];
+  state->h = p[5];
+  state->l = p[6];
+  writeFlags8080(state, p[7]);
+  state->sp = get16(p + 8);
+  state->pc = get16(p + 10);
+  state->int_enable = p[12];
+  state->halted = p[13];
+  state->intPending = p[14];
+  state->intVector = p[15];
+  state->ioPort = p[16];
+  state->cycles = get64(p + 18);
+
+  if (type == SAVE8080_FULL)
+	for (n = 0; n < PAGE8080_COUNT; n++)
+	  if (savedPage(state, n))
+		storePage8080(state, n, NULL);
+  for (k = 0; k < pages; k++)
+  {
+	const uint8_t *record = pagesAt + k * (1 + PAGE8080_SIZE);
+
+	storePage8080(state, record[0], record + 1);
+  }
+
+  p = pagesAt + (size_t)pages * (1 + PAGE8080_SIZE) + 2;
+  for (k = 0; k < count; k++)
+  {
+	uint32_t size = get32(p + 4);
+
+	for (i = 0; devices[i].id != get32(p); i++)
+	  ;
+	if (devices[i].load(devices[i].opaque, p + 8, size))
+	  goto out;
+	p += 8 + size;
+  }
+
+  CheckpointMemory8080(state);
+  state->checkpoint = sequence;
+  ret = 0;
+
+out:
+  free(body);
+  return ret;
+}
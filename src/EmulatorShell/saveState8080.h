@@ -0,0 +1,56 @@
+#ifndef SAVE_STATE_8080_H
+#define SAVE_STATE_8080_H
+
+/*
+ * saveState8080.h
+ * versioned binary save states. a full save state holds the
+ * registers, flags and every RAM page that isn't all zeros; a delta
+ * only holds the pages dirtied since the previous save state of the
+ * same machine. each record is checked with its sequence numbers and
+ * a checksum, so a chain of deltas can't be applied out of order.
+ * ROM pages are never saved, the host maps the same images before
+ * loading. all fields are little endian, the same machine always
+ * produces the same bytes.
+ *
+ * record layout:
+ *   header   "8080SAVE", u16 version, u8 type, u8 0,
+ *            u32 base, u32 sequence, u32 body length, u32 FNV-1a of body
+ *   body     a b c d e h l psw, u16 sp, u16 pc, int_enable halted
+ *            intPending intVector ioPort, u8 0, u64 cycles,
+ *            u16 page count, pages as u8 index + 256 bytes,
+ *            u16 device count, devices as u32 id + u32 length + bytes
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "emulatorShell.h"
+
+#define SAVE8080_VERSION 1
+
+#define SAVE8080_FULL  0
+#define SAVE8080_DELTA 1
+
+/*
+ * host hooks for the state of an attached device
+ */
+typedef struct DeviceState8080 {
+	uint32_t id; // tags the device's record, unique per save state
+	// write the state into buf if size is big enough
+	// @return bytes of state
+	size_t (*save)(void *opaque, uint8_t *buf, size_t size);
+	// check a saved state before anything is loaded, NULL to accept any
+	// @return 0 when load will take it
+	int (*check)(void *opaque, const uint8_t *buf, size_t size);
+	// @return 0 on success
+	int (*load)(void *opaque, const uint8_t *buf, size_t size);
+	void *opaque;
+}DeviceState8080;
+
+int SaveState8080(FILE *file, State8080 *state, int type,
+                  const DeviceState8080 *devices, size_t deviceCount);
+int LoadState8080(FILE *file, State8080 *state,
+                  const DeviceState8080 *devices, size_t deviceCount);
+
+#endif
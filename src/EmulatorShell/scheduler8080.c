@@ -0,0 +1,346 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emulatorShell.h"
+#include "opcodes8080.h"
+#include "flags8080.h"
+#include "scheduler8080.h"
+
+#define IDLE_MAX_OPS 8 // longest loop body checked for idling
+#define IDLE_MARGIN 256 // room before a deadline needed to check a loop
+#define IDLE_PROBE_CYCLES 4096 // run this long before the first check
+
+static int before(const Event8080 *a, const Event8080 *b)
+{
+  return a->when < b->when || (a->when == b->when && a->id < b->id);
+}
+
+static void siftUp(Scheduler8080 *scheduler, size_t i)
+{
+  Event8080 event = scheduler->heap[i];
+
+  while (i > 0 && before(&event, &scheduler->heap[(i - 1) / 2]))
+  {
+	scheduler->heap[i] = scheduler->heap[(i - 1) / 2];
+	i = (i - 1) / 2;
+  }
+  scheduler->heap[i] = event;
+}
+
+static void siftDown(Scheduler8080 *scheduler, size_t i)
+{
+  Event8080 event = scheduler->heap[i];
+
+  for (;;)
+  {
+	size_t child = 2 * i + 1;
+
+	if (child >= scheduler->count)
+	  break;
+	if (child + 1 < scheduler->count &&
+		before(&scheduler->heap[child + 1], &scheduler->heap[child]))
+	  child++;
+	if (!before(&scheduler->heap[child], &event))
+	  break;
+	scheduler->heap[i] = scheduler->heap[child];
+	i = child;
+  }
+  scheduler->heap[i] = event;
+}
+
+/*
+ * take out the event at heap index i
+ */
+static void removeAt(Scheduler8080 *scheduler, size_t i)
+{
+  scheduler->heap[i] = scheduler->heap[--scheduler->count];
+  if (i < scheduler->count)
+  {
+	siftDown(scheduler, i);
+	siftUp(scheduler, i);
+  }
+}
+
+static int pushEvent(Scheduler8080 *scheduler, const Event8080 *event)
+{
+  if (scheduler->count == scheduler->capacity)
+  {
+	size_t capacity = scheduler->capacity ? scheduler->capacity * 2 : 16;
+	Event8080 *heap = realloc(scheduler->heap, capacity * sizeof(Event8080));
+
+	if (!heap)
+	  return -1;
+	scheduler->heap = heap;
+	scheduler->capacity = capacity;
+  }
+  scheduler->heap[scheduler->count++] = *event;
+  siftUp(scheduler, scheduler->count - 1);
+  return 0;
+}
+
+void InitScheduler8080(Scheduler8080 *scheduler)
+{
+  scheduler->heap = NULL;
+  scheduler->count = 0;
+  scheduler->capacity = 0;
+  scheduler->nextId = 1;
+  scheduler->skipped = 0;
+  scheduler->spun = 0;
+  scheduler->skipIdle = 1;
+}
+
+void FreeScheduler8080(Scheduler8080 *scheduler)
+{
+  free(scheduler->heap);
+  InitScheduler8080(scheduler);
+}
+
+/*
+ * add a timed event
+ * @param when deadline on the state->cycles clock
+ * @param period fire again every period machine states, 0 for once
+ * @param flags EVENT8080_WAKE when the handler may raise an interrupt,
+ * only those events wake a halted CPU
+ * @return id of the event for CancelEvent8080, 0 when out of memory
+ */
+uint32_t ScheduleEvent8080(Scheduler8080 *scheduler, uint64_t when,
+                           uint64_t period, uint32_t flags,
+                           EventHandler8080 handler, void *opaque)
+{
+  Event8080 event = { when, period, scheduler->nextId, flags, handler,
+                      opaque };
+
+  if (pushEvent(scheduler, &event))
+	return 0;
+  if (++scheduler->nextId == 0)
+	scheduler->nextId = 1;
+  return event.id;
+}
+
+/*
+ * drop an event before it fires
+ * @return 0 on success, -1 if there is no such event
+ */
+int CancelEvent8080(Scheduler8080 *scheduler, uint32_t id)
+{
+  size_t i;
+
+  for (i = 0; i < scheduler->count; i++)
+	if (scheduler->heap[i].id == id)
+	{
+	  removeAt(scheduler, i);
+	  return 0;
+	}
+  return -1;
+}
+
+/*
+ * event handler raising RST n, n passed as the opaque pointer
+ * with (void *)(uintptr_t)n
+ */
+void RaiseInterrupt8080(State8080 *state, void *opaque, uint64_t when)
+{
+  (void)when;
+  Interrupt8080(state, (uintptr_t)opaque & 7);
+}
+
+/*
+ * run every event whose deadline has passed, in deadline order.
+ * periodic events are put back before their handler runs, so a
+ * handler may cancel itself.
+ * @return number of events fired
+ */
+static int fireEvents(State8080 *state, Scheduler8080 *scheduler)
+{
+  int fired = 0;
+
+  while (scheduler->count && scheduler->heap[0].when <= state->cycles)
+  {
+	Event8080 event = scheduler->heap[0];
+	uint64_t when = event.when;
+
+	removeAt(scheduler, 0);
+	if (event.period)
+	{
+	  event.when += event.period;
+	  pushEvent(scheduler, &event);
+	}
+	event.handler(state, event.opaque, when);
+	fired++;
+  }
+  return fired;
+}
+
+/*
+ * @return 1 when a scheduled event may wake a halted CPU
+ */
+static int canWake(const Scheduler8080 *scheduler)
+{
+  size_t i;
+
+  for (i = 0; i < scheduler->count; i++)
+	if (scheduler->heap[i].flags & EVENT8080_WAKE)
+	  return 1;
+  return 0;
+}
+
+/*
+ * RAM pages hold still between events, device pages may not
+ */
+static int stillPage(const State8080 *state, uint16_t addr)
+{
+  return state->readPage[addr >> 8] != NULL;
+}
+
+/*
+ * check that an instruction can be part of an idle loop: no stores,
+ * no I/O, no stack or interrupt changes, reads only from RAM at
+ * addresses known from the registers
+ */
+static int idleOp(const State8080 *state, uint16_t pc)
+{
+  const OpcodeInfo8080 *info;
+  uint8_t opcode;
+  uint16_t addr;
+
+  if (!stillPage(state, pc) || !stillPage(state, pc + 2))
+	return 0;
+  opcode = readMemory8080(state, pc);
+  info = &opcodeTable8080[opcode];
+  if ((info->attr & (OPA_MEMWRITE | OPA_STOP)) ||
+	  (info->kind != OPK_NONE && info->kind != OPK_JMP &&
+	   info->kind != OPK_JCC))
+	return 0;
+  if (!(info->attr & OPA_MEMREAD))
+	return 1;
+
+  switch (opcode)
+  {
+	case 0x0a: addr = (state->b << 8) | state->c; break; // LDAX B
+	case 0x1a: addr = (state->d << 8) | state->e; break; // LDAX D
+	case 0x3a: // LDA
+	case 0x2a: // LHLD
+	  addr = readMemory8080(state, pc + 1) | (readMemory8080(state, pc + 2) << 8);
+	  if (opcode == 0x2a && !stillPage(state, addr + 1))
+		return 0;
+	  break;
+	default:
+	  // MOV r,M and ALU M, anything else reading memory is stack work
+	  if ((opcode & 0xc7) != 0x46 && (opcode & 0xc7) != 0x86)
+		return 0;
+	  addr = (state->h << 8) | state->l;
+	  break;
+  }
+  return stillPage(state, addr);
+}
+
+/*
+ * run one pass of the loop the CPU is in, if it looks like an idle
+ * loop. the instructions run for real, so nothing is lost when it
+ * turns out not to be one.
+ * @return machine states of the pass when it came back to the same
+ * pc with every register unchanged, 0 otherwise
+ */
+static uint64_t idleLoop(State8080 *state)
+{
+  const uint16_t start = state->pc;
+  const uint8_t regs[7] = { state->a, state->b, state->c, state->d,
+                            state->e, state->h, state->l };
+  const uint8_t psw = peekFlags8080(state);
+  const uint16_t sp = state->sp;
+  const uint64_t before = state->cycles;
+  int n;
+
+  for (n = 0; n < IDLE_MAX_OPS; n++)
+  {
+	if (!idleOp(state, state->pc))
+	  return 0;
+	state->cycles += Emulate8080Op(state);
+	if (state->pc == start)
+	  break;
+  }
+  if (state->pc != start || state->sp != sp || peekFlags8080(state) != psw ||
+	  state->a != regs[0] || state->b != regs[1] || state->c != regs[2] ||
+	  state->d != regs[3] || state->e != regs[4] || state->h != regs[5] ||
+	  state->l != regs[6])
+	return 0;
+  return state->cycles - before;
+}
+
+/*
+ * run the machine with a tier, stopping at each event deadline to
+ * fire the events that are due. time the CPU spends halted or in an
+ * idle loop is skipped up to the next deadline. idle loops are
+ * looked for after IDLE_PROBE_CYCLES, then at doubling intervals,
+ * and not at all while the machine is traced.
+ * @param run tier to execute with, Run8080 when NULL
+ * @param cycle_budget machine states to run for, halted time included
+ * @return machine states spent, RUN8080_BUDGET when the budget ran
+ * out, RUN8080_HALT when the CPU is halted and no interrupt can wake
+ * it (interrupts disabled or no EVENT8080_WAKE event), RUN8080_IN or
+ * RUN8080_OUT when the host has to serve a port, RUN8080_BREAK when
+ * a debugged machine hit a point
+ */
+RunResult8080 RunScheduled8080(State8080 *state, Scheduler8080 *scheduler,
+                               RunTier8080 run, uint64_t cycle_budget)
+{
+  RunResult8080 result = { 0, RUN8080_BUDGET };
+  uint64_t start = state->cycles, end = start + cycle_budget;
+  uint64_t probe = IDLE_PROBE_CYCLES;
+  int skipIdle = scheduler->skipIdle && !state->trace;
+
+  if (!run)
+	run = Run8080;
+  while (state->cycles < end)
+  {
+	uint64_t deadline = end, stop, pass;
+	RunResult8080 step;
+
+	if (fireEvents(state, scheduler))
+	  probe = IDLE_PROBE_CYCLES;
+	if (scheduler->count && scheduler->heap[0].when < deadline)
+	  deadline = scheduler->heap[0].when;
+
+	if (state->halted)
+	{
+	  if (!state->int_enable || !canWake(scheduler))
+	  {
+		result.reason = RUN8080_HALT;
+		break;
+	  }
+	  scheduler->skipped += deadline - state->cycles;
+	  state->cycles = deadline;
+	  continue;
+	}
+
+	stop = deadline;
+	if (skipIdle && deadline - state->cycles > probe)
+	  stop = state->cycles + probe;
+	step = run(state, stop - state->cycles);
+	if (step.reason == RUN8080_IN || step.reason == RUN8080_OUT ||
+		step.reason == RUN8080_BREAK)
+	{
+	  result.reason = step.reason;
+	  break;
+	}
+	if (!skipIdle || state->halted || state->cycles >= deadline ||
+		deadline - state->cycles <= IDLE_MARGIN)
+	  continue;
+
+	// whole passes up to the deadline, the rest runs normally
+	pass = idleLoop(state);
+	if (pass && deadline > state->cycles)
+	{
+	  uint64_t spin = (deadline - state->cycles) / pass * pass;
+
+	  state->cycles += spin;
+	  scheduler->spun += spin;
+	}
+	else
+	  probe *= 2;
+  }
+  fireEvents(state, scheduler);
+
+  result.cycles = state->cycles - start;
+  return result;
+}
@@ -0,0 +1,72 @@
+#ifndef SCHEDULER_8080_H
+#define SCHEDULER_8080_H
+
+/*
+ * scheduler8080.h
+ * timed events on the machine's cycle clock (state->cycles). events
+ * sit in a min-heap ordered by deadline, the CPU runs uninterrupted
+ * up to the earliest deadline, so nothing is checked per
+ * instruction. events fire once the instruction that crosses their
+ * deadline is done, at most one instruction late. while the CPU is
+ * halted the clock jumps straight to the next deadline.
+ *
+ * idle loops are skipped the same way: a short loop that stores
+ * nothing, does no I/O, only reads RAM and leaves every register as
+ * it found it after one pass will spin the same way until an event
+ * changes something, so the clock is moved ahead by whole passes up
+ * to the next deadline. the machine ends up exactly where running
+ * the loop would have left it.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emulatorShell.h"
+
+/*
+ * runs an event, usually raising an interrupt with Interrupt8080
+ * @param when the deadline the event was scheduled for
+ */
+typedef void (*EventHandler8080)(State8080 *state, void *opaque,
+                                  uint64_t when);
+
+/*
+ * one of Run8080, RunBlocks8080, RunJit8080, RunAot8080 or RunDebug8080
+ */
+typedef RunResult8080 (*RunTier8080)(State8080 *state, uint64_t cycle_budget);
+
+/*
+ * Event8080 flags
+ */
+#define EVENT8080_WAKE 0x01 // the handler may raise an interrupt
+
+typedef struct Event8080 {
+	uint64_t when; // deadline in machine states
+	uint64_t period; // rescheduled this much later after firing, 0 for once
+	uint32_t id; // ties fire in the order they were scheduled
+	uint32_t flags; // EVENT8080_* bits
+	EventHandler8080 handler;
+	void *opaque;
+}Event8080;
+
+typedef struct Scheduler8080 {
+	Event8080 *heap;
+	size_t count;
+	size_t capacity;
+	uint32_t nextId;
+	uint64_t skipped; // machine states fast-forwarded while halted
+	uint64_t spun; // machine states fast-forwarded in idle loops
+	int skipIdle; // look for idle loops, set by InitScheduler8080
+}Scheduler8080;
+
+void InitScheduler8080(Scheduler8080 *scheduler);
+void FreeScheduler8080(Scheduler8080 *scheduler);
+uint32_t ScheduleEvent8080(Scheduler8080 *scheduler, uint64_t when,
+                           uint64_t period, uint32_t flags,
+                           EventHandler8080 handler, void *opaque);
+int CancelEvent8080(Scheduler8080 *scheduler, uint32_t id);
+void RaiseInterrupt8080(State8080 *state, void *opaque, uint64_t when);
+RunResult8080 RunScheduled8080(State8080 *state, Scheduler8080 *scheduler,
+                               RunTier8080 run, uint64_t cycle_budget);
+
+#endif
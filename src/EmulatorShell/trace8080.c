@@ -0,0 +1,900 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "emulatorShell.h"
+#include "flags8080.h"
+#include "core8080.h"
+#include "opcodes8080.h"
+#include "memory8080.h"
+#include "trace8080.h"
+
+#define TRACE_MAGIC "8080TRCE"
+#define TRACE_MAGIC_LENGTH 8
+#define TRACE_HEADER_SIZE 16
+#define CHUNK_HEADER_SIZE 28
+#define TRACE_SLOTS 8 // blocks in flight between run loop and writer
+#define TRACE_SLOT_SIZE (1 << 17) // raw bytes per block
+#define WRITER_IDLE_NS 100000 // writer sleep while the ring is empty
+#define KEYFRAME_REGISTERS 22
+#define KEYFRAME_SIZE (KEYFRAME_REGISTERS + 0x10000)
+#define RECORD_MAX (18 + TRACE8080_WRITES * 3) // longest encoded record
+#define PACKED_MAX(n) ((n) + (n) / 128 + 16) // packed size of incompressible data
+
+/*
+ * chunk types
+ */
+#define CHUNK_RECORDS  1
+#define CHUNK_KEYFRAME 2
+
+/*
+ * first byte of a record, which optional fields follow the opcode.
+ * the second byte has one bit per changed register, A B C D E H L F.
+ */
+#define REC_SP      0x01 // u16 new SP
+#define REC_RESYNC  0x02 // u16 pc before the opcode, it didn't follow the last one
+#define REC_BRANCH  0x04 // u16 next pc, it isn't pc + length
+#define REC_CYCLES  0x08 // u8 machine states, not the opcode's base cycles
+#define REC_IRQ     0x10 // u8 interrupt state, see irqByte
+#define REC_WRITES_SHIFT 5 // stores in the top 3 bits
+#define REC_WRITES_MORE  7 // u8 store count follows
+
+/*
+ * block compression, a byte oriented LZ77. a token below 0x80 is
+ * followed by token + 1 literals, otherwise it is a match of
+ * (token & 0x7f) + LZ_MIN_MATCH bytes at a u16 distance back.
+ */
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_MATCH (0x7f + LZ_MIN_MATCH)
+#define LZ_MAX_LITERALS 0x80
+#define LZ_HASH_BITS 12
+
+/*
+ * one block passed from the run loop to the writer
+ */
+typedef struct TraceSlot8080 {
+	uint8_t type; // CHUNK_* type
+	uint32_t length; // raw bytes
+	uint32_t count; // instructions
+	uint64_t first; // index of the first instruction
+	uint8_t data[TRACE_SLOT_SIZE];
+}TraceSlot8080;
+
+typedef struct Trace8080 {
+	FILE *file;
+	uint32_t keyInterval;
+	uint64_t instructions;
+	uint64_t cycles; // machine states up to the last record
+	int forceKey; // stores were dropped, write a keyframe next
+	// what the next record is encoded against
+	uint8_t regs[8];
+	uint16_t sp;
+	uint16_t expectPc;
+	uint8_t irq;
+	// stores of the instruction being run
+	uint32_t writeCount;
+	uint16_t writeAddr[TRACE8080_WRITES];
+	uint8_t writeValue[TRACE8080_WRITES];
+	// single producer single consumer ring. the run loop fills
+	// slots[produced % TRACE_SLOTS] and publishes it, the writer
+	// drains up to published and hands slots back through consumed.
+	TraceSlot8080 *slot; // slot being filled, NULL for none
+	uint32_t produced;
+	atomic_uint published;
+	atomic_uint consumed;
+	atomic_int stopping;
+	atomic_int error;
+	pthread_t writer;
+	uint8_t *packed; // writer's compression buffer
+	TraceSlot8080 slots[TRACE_SLOTS];
+}Trace8080;
+
+typedef struct TraceKey8080 {
+	uint64_t index;
+	long offset;
+}TraceKey8080;
+
+struct TraceReader8080 {
+	FILE *file;
+	uint64_t length; // instructions in the trace
+	long end; // offset after the last whole chunk
+	TraceKey8080 *keys;
+	size_t keyCount;
+	uint8_t *raw;
+	uint8_t *packed;
+	size_t rawLength;
+	size_t pos; // next record in raw
+	uint32_t left; // records left in raw
+	uint64_t index; // next instruction
+	int positioned;
+	// decoder state, mirrors the encoder's baseline
+	uint8_t regs[8];
+	uint16_t sp;
+	uint16_t pc;
+	uint8_t irq;
+};
+
+typedef struct ChunkHeader8080 {
+	uint8_t type;
+	uint32_t rawLength;
+	uint32_t packedLength;
+	uint32_t count;
+	uint64_t first;
+	uint32_t hash;
+}ChunkHeader8080;
+
+static uint8_t *put16(uint8_t *p, uint16_t value)
+{
+  p[0] = value & 0xff;
+  p[1] = value >> 8;
+  return p + 2;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t value)
+{
+  return put16(put16(p, value & 0xffff), value >> 16);
+}
+
+static uint8_t *put64(uint8_t *p, uint64_t value)
+{
+  return put32(put32(p, value & 0xffffffff), value >> 32);
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+  return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static uint64_t get64(const uint8_t *p)
+{
+  return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+static uint32_t fnv1a(const uint8_t *data, size_t size)
+{
+  uint32_t hash = 2166136261u;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+	hash = (hash ^ data[i]) * 16777619u;
+  return hash;
+}
+
+static size_t packLiterals(const uint8_t *src, size_t from, size_t to,
+                           uint8_t *dst, size_t out)
+{
+  while (from < to)
+  {
+	size_t n = to - from > LZ_MAX_LITERALS ? LZ_MAX_LITERALS : to - from;
+
+	dst[out++] = n - 1;
+	memcpy(dst + out, src + from, n);
+	out += n;
+	from += n;
+  }
+  return out;
+}
+
+/*
+ * compress a block
+ * @param dst room for PACKED_MAX(length) bytes
+ * @return packed length
+ */
+static size_t packBlock(const uint8_t *src, size_t length, uint8_t *dst)
+{
+  uint32_t table[1 << LZ_HASH_BITS]; // last position + 1 per hash
+  size_t pos = 0, literal = 0, out = 0;
+
+  memset(table, 0, sizeof(table));
+  while (pos + LZ_MIN_MATCH <= length)
+  {
+	uint32_t word, hash;
+	size_t from, n;
+
+	memcpy(&word, src + pos, sizeof(word));
+	hash = (word * 2654435761u) >> (32 - LZ_HASH_BITS);
+	from = table[hash];
+	table[hash] = pos + 1;
+	if (!from || pos - (from - 1) > 0xffff ||
+		memcmp(src + from - 1, src + pos, LZ_MIN_MATCH))
+	{
+	  pos++;
+	  continue;
+	}
+	from--;
+	n = LZ_MIN_MATCH;
+	while (n < LZ_MAX_MATCH && pos + n < length && src[from + n] == src[pos + n])
+	  n++;
+	out = packLiterals(src, literal, pos, dst, out);
+	dst[out++] = 0x80 | (n - LZ_MIN_MATCH);
+	dst[out++] = (pos - from) & 0xff;
+	dst[out++] = (pos - from) >> 8;
+	pos += n;
+	literal = pos;
+  }
+  return packLiterals(src, literal, length, dst, out);
+}
+
+/*
+ * decompress a block
+ * @return 0 when it unpacks to exactly size bytes, -1 otherwise
+ */
+static int unpackBlock(const uint8_t *src, size_t length, uint8_t *dst,
+                       size_t size)
+{
+  size_t in = 0, out = 0;
+
+  while (in < length)
+  {
+	uint8_t token = src[in++];
+	size_t n;
+
+	if (token < 0x80)
+	{
+	  n = token + 1;
+	  if (n > length - in || n > size - out)
+		return -1;
+	  memcpy(dst + out, src + in, n);
+	  in += n;
+	  out += n;
+	}
+	else
+	{
+	  size_t distance;
+
+	  n = (token & 0x7f) + LZ_MIN_MATCH;
+	  if (length - in < 2)
+		return -1;
+	  distance = get16(src + in);
+	  in += 2;
+	  if (!distance || distance > out || n > size - out)
+		return -1;
+	  for (; n > 0; n--, out++)
+		dst[out] = dst[out - distance];
+	}
+  }
+  return out == size ? 0 : -1;
+}
+
+static uint8_t irqByte(const State8080 *state)
+{
+  return (state->int_enable & 1) | (state->halted & 1) << 1 |
+         (state->intPending & 1) << 2 | (state->intVector & 7) << 3;
+}
+
+/*
+ * wait for a free slot in the ring
+ */
+static TraceSlot8080 *acquireSlot(Trace8080 *trace, uint8_t type)
+{
+  TraceSlot8080 *slot;
+
+  while (trace->produced -
+		 atomic_load_explicit(&trace->consumed, memory_order_acquire) >=
+		 TRACE_SLOTS)
+	sched_yield();
+  slot = &trace->slots[trace->produced % TRACE_SLOTS];
+  slot->type = type;
+  slot->length = 0;
+  slot->count = 0;
+  slot->first = trace->instructions;
+  return slot;
+}
+
+static void publishSlot(Trace8080 *trace)
+{
+  trace->produced++;
+  atomic_store_explicit(&trace->published, trace->produced,
+                        memory_order_release);
+  trace->slot = NULL;
+}
+
+/*
+ * queue a keyframe of the machine as it is before the next
+ * instruction, and make it the baseline of the following records
+ */
+static void writeKey(Trace8080 *trace, const State8080 *state)
+{
+  TraceSlot8080 *slot;
+  uint8_t *p;
+  int n;
+
+  if (trace->slot && trace->slot->count)
+	publishSlot(trace);
+  slot = trace->slot ? trace->slot : acquireSlot(trace, CHUNK_KEYFRAME);
+  slot->type = CHUNK_KEYFRAME;
+  slot->first = trace->instructions;
+
+  trace->regs[0] = state->a;
+  trace->regs[1] = state->b;
+  trace->regs[2] = state->c;
+  trace->regs[3] = state->d;
+  trace->regs[4] = state->e;
+  trace->regs[5] = state->h;
+  trace->regs[6] = state->l;
+  trace->regs[7] = peekFlags8080(state);
+  trace->sp = state->sp;
+  trace->expectPc = state->pc;
+  trace->irq = irqByte(state);
+  trace->writeCount = 0;
+  trace->forceKey = 0;
+
+  p = slot->data;
+  memcpy(p, trace->regs, sizeof(trace->regs));
+  p += sizeof(trace->regs);
+  p = put16(p, state->sp);
+  p = put16(p, state->pc);
+  *p++ = trace->irq;
+  *p++ = state->ioPort;
+  p = put64(p, trace->cycles);
+  // device pages have no data to copy and read as 0
+  for (n = 0; n < PAGE8080_COUNT; n++, p += PAGE8080_SIZE)
+	if (state->readPage[n])
+	  memcpy(p, state->readPage[n], PAGE8080_SIZE);
+	else
+	  memset(p, 0, PAGE8080_SIZE);
+  slot->length = p - slot->data;
+  publishSlot(trace);
+}
+
+/*
+ * record a store of the instruction being run
+ */
+void traceWrite8080(struct Trace8080 *trace, uint16_t addr, uint8_t value)
+{
+  if (trace->writeCount == TRACE8080_WRITES)
+  {
+	trace->forceKey = 1;
+	return;
+  }
+  trace->writeAddr[trace->writeCount] = addr;
+  trace->writeValue[trace->writeCount++] = value;
+}
+
+/*
+ * record one executed instruction
+ * @param pc address of the instruction, state->pc is past it
+ * @param cycles machine states it took
+ */
+void traceOp8080(State8080 *state, uint16_t pc, uint8_t opcode, int cycles)
+{
+  Trace8080 *trace = state->trace;
+  const OpcodeInfo8080 *info = &opcodeTable8080[opcode];
+  uint8_t regs[8] = { state->a, state->b, state->c, state->d, state->e,
+                      state->h, state->l, peekFlags8080(state) };
+  uint8_t irq = irqByte(state), mask = 0, misc = 0;
+  uint8_t *head, *p;
+  uint32_t i;
+
+  if (!trace->slot || trace->slot->length + RECORD_MAX > TRACE_SLOT_SIZE)
+  {
+	if (trace->slot)
+	  publishSlot(trace);
+	trace->slot = acquireSlot(trace, CHUNK_RECORDS);
+  }
+
+  head = trace->slot->data + trace->slot->length;
+  p = head + 2;
+  if (pc != trace->expectPc)
+  {
+	misc |= REC_RESYNC;
+	p = put16(p, pc);
+  }
+  *p++ = opcode;
+  for (i = 0; i < 8; i++)
+	if (regs[i] != trace->regs[i])
+	{
+	  mask |= 1 << i;
+	  *p++ = regs[i];
+	  trace->regs[i] = regs[i];
+	}
+  if (state->sp != trace->sp)
+  {
+	misc |= REC_SP;
+	p = put16(p, state->sp);
+	trace->sp = state->sp;
+  }
+  if (state->pc != (uint16_t)(pc + info->length))
+  {
+	misc |= REC_BRANCH;
+	p = put16(p, state->pc);
+  }
+  if (cycles != info->cycles)
+  {
+	misc |= REC_CYCLES;
+	*p++ = cycles;
+  }
+  if (irq != trace->irq)
+  {
+	misc |= REC_IRQ;
+	*p++ = irq;
+	trace->irq = irq;
+  }
+  if (trace->writeCount < REC_WRITES_MORE)
+	misc |= trace->writeCount << REC_WRITES_SHIFT;
+  else
+  {
+	misc |= REC_WRITES_MORE << REC_WRITES_SHIFT;
+	*p++ = trace->writeCount;
+  }
+  for (i = 0; i < trace->writeCount; i++)
+  {
+	p = put16(p, trace->writeAddr[i]);
+	*p++ = trace->writeValue[i];
+  }
+  head[0] = misc;
+  head[1] = mask;
+
+  trace->slot->length = p - trace->slot->data;
+  trace->slot->count++;
+  trace->writeCount = 0;
+  trace->expectPc = state->pc;
+  trace->cycles += cycles;
+  trace->instructions++;
+  if (trace->forceKey || trace->instructions % trace->keyInterval == 0)
+	writeKey(trace, state);
+}
+
+/*
+ * compress a block and append it to the trace file
+ * @return 0 on success, -1 on a write error
+ */
+static int writeChunk(Trace8080 *trace, const TraceSlot8080 *slot)
+{
+  uint8_t header[CHUNK_HEADER_SIZE] = { 0 };
+  size_t packed = packBlock(slot->data, slot->length, trace->packed);
+  uint8_t *p = header + 4;
+
+  header[0] = slot->type;
+  p = put32(p, slot->length);
+  p = put32(p, packed);
+  p = put32(p, slot->count);
+  p = put64(p, slot->first);
+  put32(p, fnv1a(slot->data, slot->length));
+  if (fwrite(header, 1, CHUNK_HEADER_SIZE, trace->file) != CHUNK_HEADER_SIZE ||
+	  fwrite(trace->packed, 1, packed, trace->file) != packed)
+	return -1;
+  return 0;
+}
+
+/*
+ * writer thread, drains the ring until the trace is disabled
+ */
+static void *writerMain(void *arg)
+{
+  Trace8080 *trace = arg;
+  struct timespec idle = { 0, WRITER_IDLE_NS };
+  uint32_t consumed = 0;
+
+  for (;;)
+  {
+	uint32_t published = atomic_load_explicit(&trace->published,
+	                                          memory_order_acquire);
+
+	if (consumed == published)
+	{
+	  // stopping is set after the last publish, look again before leaving
+	  if (atomic_load(&trace->stopping) &&
+		  consumed == atomic_load(&trace->published))
+		break;
+	  nanosleep(&idle, NULL);
+	  continue;
+	}
+	// after a write error keep draining so the run loop never blocks
+	if (!atomic_load(&trace->error) &&
+		writeChunk(trace, &trace->slots[consumed % TRACE_SLOTS]))
+	  atomic_store(&trace->error, 1);
+	atomic_store_explicit(&trace->consumed, ++consumed, memory_order_release);
+  }
+  return NULL;
+}
+
+/*
+ * start recording a trace of the machine
+ * @param path trace file, truncated
+ * @param keyInterval instructions between keyframes, 0 for the default
+ * @return 0 on success, -1 when the file or writer can't be set up
+ * or the machine is already traced
+ */
+int EnableTrace8080(State8080 *state, const char *path, uint32_t keyInterval)
+{
+  uint8_t header[TRACE_HEADER_SIZE] = { 0 };
+  Trace8080 *trace;
+
+  if (state->trace)
+	return -1;
+  trace = calloc(1, sizeof(Trace8080));
+  if (!trace)
+	return -1;
+  trace->packed = malloc(PACKED_MAX(TRACE_SLOT_SIZE));
+  trace->file = fopen(path, "wb");
+  trace->keyInterval = keyInterval ? keyInterval : TRACE8080_KEY_INTERVAL;
+  trace->cycles = state->cycles;
+  atomic_init(&trace->published, 0);
+  atomic_init(&trace->consumed, 0);
+  atomic_init(&trace->stopping, 0);
+  atomic_init(&trace->error, 0);
+
+  memcpy(header, TRACE_MAGIC, TRACE_MAGIC_LENGTH);
+  put16(header + 8, TRACE8080_VERSION);
+  put32(header + 12, trace->keyInterval);
+  if (!trace->packed || !trace->file ||
+	  fwrite(header, 1, TRACE_HEADER_SIZE, trace->file) != TRACE_HEADER_SIZE)
+	goto fail;
+
+  writeKey(trace, state);
+  if (pthread_create(&trace->writer, NULL, writerMain, trace))
+	goto fail;
+  state->trace = trace;
+  reselectCore8080(state);
+  return 0;
+
+fail:
+  if (trace->file)
+	fclose(trace->file);
+  free(trace->packed);
+  free(trace);
+  return -1;
+}
+
+/*
+ * stop recording, write out everything still queued and close the
+ * trace file
+ * @return 0 on success, -1 if any part of the trace failed to write
+ */
+int DisableTrace8080(State8080 *state)
+{
+  Trace8080 *trace = state->trace;
+  int ret;
+
+  if (!trace)
+	return 0;
+  if (trace->slot && trace->slot->count)
+	publishSlot(trace);
+  atomic_store(&trace->stopping, 1);
+  pthread_join(trace->writer, NULL);
+  ret = atomic_load(&trace->error) ? -1 : 0;
+  if (fclose(trace->file))
+	ret = -1;
+  free(trace->packed);
+  free(trace);
+  state->trace = NULL;
+  reselectCore8080(state);
+  return ret;
+}
+
+static int readChunkHeader(FILE *file, ChunkHeader8080 *chunk)
+{
+  uint8_t header[CHUNK_HEADER_SIZE];
+
+  if (fread(header, 1, CHUNK_HEADER_SIZE, file) != CHUNK_HEADER_SIZE)
+	return -1;
+  chunk->type = header[0];
+  chunk->rawLength = get32(header + 4);
+  chunk->packedLength = get32(header + 8);
+  chunk->count = get32(header + 12);
+  chunk->first = get64(header + 16);
+  chunk->hash = get32(header + 24);
+  if ((chunk->type != CHUNK_RECORDS && chunk->type != CHUNK_KEYFRAME) ||
+	  chunk->rawLength > TRACE_SLOT_SIZE ||
+	  chunk->packedLength > PACKED_MAX(TRACE_SLOT_SIZE))
+	return -1;
+  return 0;
+}
+
+/*
+ * open a trace for replay. the chunks are scanned for keyframes, a
+ * trace cut short by a crash is read up to its last whole chunk.
+ * @return the reader, NULL if the file is missing or isn't a trace
+ */
+TraceReader8080 *OpenTrace8080(const char *path)
+{
+  TraceReader8080 *reader = calloc(1, sizeof(TraceReader8080));
+  uint8_t header[TRACE_HEADER_SIZE];
+  ChunkHeader8080 chunk;
+  size_t capacity = 0;
+  long size, offset;
+
+  if (!reader)
+	return NULL;
+  reader->file = fopen(path, "rb");
+  reader->raw = malloc(TRACE_SLOT_SIZE);
+  reader->packed = malloc(PACKED_MAX(TRACE_SLOT_SIZE));
+  if (!reader->file || !reader->raw || !reader->packed ||
+	  fseek(reader->file, 0, SEEK_END) || (size = ftell(reader->file)) < 0 ||
+	  fseek(reader->file, 0, SEEK_SET) ||
+	  fread(header, 1, TRACE_HEADER_SIZE, reader->file) != TRACE_HEADER_SIZE ||
+	  memcmp(header, TRACE_MAGIC, TRACE_MAGIC_LENGTH) ||
+	  get16(header + 8) != TRACE8080_VERSION)
+	goto fail;
+
+  offset = TRACE_HEADER_SIZE;
+  while (!readChunkHeader(reader->file, &chunk) &&
+		 chunk.packedLength <= size - offset - CHUNK_HEADER_SIZE)
+  {
+	if (chunk.type == CHUNK_KEYFRAME)
+	{
+	  if (reader->keyCount == capacity)
+	  {
+		TraceKey8080 *keys;
+
+		capacity = capacity ? capacity * 2 : 64;
+		keys = realloc(reader->keys, capacity * sizeof(TraceKey8080));
+		if (!keys)
+		  goto fail;
+		reader->keys = keys;
+	  }
+	  reader->keys[reader->keyCount].index = chunk.first;
+	  reader->keys[reader->keyCount++].offset = offset;
+	}
+	else
+	  reader->length = chunk.first + chunk.count;
+	offset += CHUNK_HEADER_SIZE + chunk.packedLength;
+	if (fseek(reader->file, offset, SEEK_SET))
+	  break;
+  }
+  reader->end = offset;
+  if (!reader->keyCount || reader->keys[0].index != 0)
+	goto fail;
+  return reader;
+
+fail:
+  CloseTrace8080(reader);
+  return NULL;
+}
+
+void CloseTrace8080(TraceReader8080 *reader)
+{
+  if (!reader)
+	return;
+  if (reader->file)
+	fclose(reader->file);
+  free(reader->keys);
+  free(reader->packed);
+  free(reader->raw);
+  free(reader);
+}
+
+/*
+ * @return instructions recorded in the trace
+ */
+uint64_t TraceLength8080(const TraceReader8080 *reader)
+{
+  return reader->length;
+}
+
+/*
+ * load a keyframe into the machine and the decoder
+ */
+static int applyKey(TraceReader8080 *reader, State8080 *state)
+{
+  const uint8_t *p = reader->raw;
+
+  if (reader->rawLength != KEYFRAME_SIZE)
+	return -1;
+  memcpy(reader->regs, p, sizeof(reader->regs));
+  reader->sp = get16(p + 8);
+  reader->pc = get16(p + 10);
+  reader->irq = p[12];
+  state->ioPort = p[13];
+  state->cycles = get64(p + 14);
+  LoadMemory8080(state, 0, p + KEYFRAME_REGISTERS, 0x10000);
+  return 0;
+}
+
+/*
+ * copy the decoder's registers into the machine
+ */
+static void applyRegisters(const TraceReader8080 *reader, State8080 *state)
+{
+  state->a = reader->regs[0];
+  state->b = reader->regs[1];
+  state->c = reader->regs[2];
+  state->d = reader->regs[3];
+  state->e = reader->regs[4];
+  state->h = reader->regs[5];
+  state->l = reader->regs[6];
+  writeFlags8080(state, reader->regs[7]);
+  state->sp = reader->sp;
+  state->pc = reader->pc;
+  state->int_enable = reader->irq & 1;
+  state->halted = (reader->irq >> 1) & 1;
+  state->intPending = (reader->irq >> 2) & 1;
+  state->intVector = (reader->irq >> 3) & 7;
+}
+
+/*
+ * read the chunk at the file position, keyframes are applied
+ * @return 0 on success, 1 at the end of the trace, -1 on errors
+ */
+static int loadChunk(TraceReader8080 *reader, State8080 *state)
+{
+  ChunkHeader8080 chunk;
+
+  if (ftell(reader->file) >= reader->end)
+	return 1;
+  if (readChunkHeader(reader->file, &chunk))
+	return -1;
+  if (fread(reader->packed, 1, chunk.packedLength, reader->file) !=
+		chunk.packedLength ||
+	  unpackBlock(reader->packed, chunk.packedLength, reader->raw,
+	              chunk.rawLength) ||
+	  fnv1a(reader->raw, chunk.rawLength) != chunk.hash ||
+	  chunk.first != reader->index)
+	return -1;
+  reader->rawLength = chunk.rawLength;
+  reader->pos = 0;
+  reader->left = 0;
+  if (chunk.type == CHUNK_KEYFRAME)
+  {
+	if (applyKey(reader, state))
+	  return -1;
+	applyRegisters(reader, state);
+	return 0;
+  }
+  reader->left = chunk.count;
+  return 0;
+}
+
+/*
+ * decode the next record into the machine
+ * @return 0 on success, -1 for a damaged record
+ */
+static int decodeRecord(TraceReader8080 *reader, State8080 *state,
+                        TraceEvent8080 *event)
+{
+  const uint8_t *p = reader->raw + reader->pos;
+  const uint8_t *end = reader->raw + reader->rawLength;
+  const OpcodeInfo8080 *info;
+  uint8_t misc, mask, count;
+  uint16_t pc, next;
+  int i;
+
+#define NEED(n) \
+  do { \
+	if (end - p < (n)) \
+	  return -1; \
+  } while (0)
+
+  NEED(3);
+  misc = *p++;
+  mask = *p++;
+  pc = reader->pc;
+  if (misc & REC_RESYNC)
+  {
+	NEED(3);
+	pc = get16(p);
+	p += 2;
+  }
+  event->opcode = *p++;
+  info = &opcodeTable8080[event->opcode];
+  for (i = 0; i < 8; i++)
+	if (mask & (1 << i))
+	{
+	  NEED(1);
+	  reader->regs[i] = *p++;
+	}
+  if (misc & REC_SP)
+  {
+	NEED(2);
+	reader->sp = get16(p);
+	p += 2;
+  }
+  next = pc + info->length;
+  if (misc & REC_BRANCH)
+  {
+	NEED(2);
+	next = get16(p);
+	p += 2;
+  }
+  event->cycles = info->cycles;
+  if (misc & REC_CYCLES)
+  {
+	NEED(1);
+	event->cycles = *p++;
+  }
+  if (misc & REC_IRQ)
+  {
+	NEED(1);
+	reader->irq = *p++;
+  }
+  count = misc >> REC_WRITES_SHIFT;
+  if (count == REC_WRITES_MORE)
+  {
+	NEED(1);
+	count = *p++;
+  }
+  if (count > TRACE8080_WRITES)
+	return -1;
+  NEED(count * 3);
+  for (i = 0; i < count; i++, p += 3)
+  {
+	event->writeAddr[i] = get16(p);
+	event->writeValue[i] = p[2];
+  }
+#undef NEED
+
+  event->index = reader->index;
+  event->pc = pc;
+  event->writeCount = count;
+  reader->pc = next;
+  reader->pos = p - reader->raw;
+  reader->left--;
+  reader->index++;
+
+  applyRegisters(reader, state);
+  state->cycles += event->cycles;
+  for (i = 0; i < count; i++)
+	writeMemory8080(state, event->writeAddr[i], event->writeValue[i]);
+  return 0;
+}
+
+/*
+ * replay the next instruction of the trace into the machine
+ * @param state machine with memory, see InitMemory8080
+ * @param event filled with the instruction, may be NULL
+ * @return 1 for an instruction, 0 at the end of the trace, -1 on errors
+ */
+int NextTrace8080(TraceReader8080 *reader, State8080 *state,
+                  TraceEvent8080 *event)
+{
+  TraceEvent8080 scratch;
+  int ret;
+
+  if (!reader->positioned && SeekTrace8080(reader, state, 0))
+	return -1;
+  while (reader->left == 0)
+	if ((ret = loadChunk(reader, state)))
+	  return ret > 0 ? 0 : -1;
+  return decodeRecord(reader, state, event ? event : &scratch) ? -1 : 1;
+}
+
+/*
+ * put the machine in the state it had after index instructions,
+ * replaying from the keyframe before it
+ * @param state machine with memory, see InitMemory8080
+ * @return 0 on success, -1 if index is past the end or the trace
+ * is damaged
+ */
+int SeekTrace8080(TraceReader8080 *reader, State8080 *state, uint64_t index)
+{
+  size_t lo = 0, hi = reader->keyCount;
+
+  if (index > reader->length)
+	return -1;
+  // last keyframe at or before index
+  while (hi - lo > 1)
+  {
+	size_t mid = lo + (hi - lo) / 2;
+
+	if (reader->keys[mid].index <= index)
+	  lo = mid;
+	else
+	  hi = mid;
+  }
+  if (!reader->positioned || reader->index > index ||
+	  reader->index < reader->keys[lo].index)
+  {
+	reader->positioned = 0;
+	reader->index = reader->keys[lo].index;
+	reader->left = 0;
+	if (fseek(reader->file, reader->keys[lo].offset, SEEK_SET) ||
+		loadChunk(reader, state))
+	  return -1;
+	reader->positioned = 1;
+  }
+  while (reader->index < index)
+	if (NextTrace8080(reader, state, NULL) != 1)
+	  return -1;
+  return 0;
+}
@@ -0,0 +1,74 @@
+#ifndef TRACE_8080_H
+#define TRACE_8080_H
+
+/*
+ * trace8080.h
+ * binary execution trace. every instruction is recorded as its pc
+ * (only when it isn't where the last one went), opcode, the
+ * registers it changed and the bytes it stored. records are packed
+ * into blocks that the run loop hands to a writer thread through a
+ * lock-free ring, the writer compresses them and appends them to the
+ * trace file. a keyframe with all registers and memory is written
+ * at the start and every keyInterval instructions, so a reader can
+ * seek to any instruction by replaying from the keyframe before it.
+ *
+ * file layout, little endian:
+ *   header  "8080TRCE", u16 version, u16 0, u32 keyInterval
+ *   chunks  u8 type, u8[3] 0, u32 raw length, u32 packed length,
+ *           u32 instructions, u64 first instruction, u32 FNV-1a of
+ *           the raw data, then the packed data
+ *
+ * Run8080 and Emulate8080Op switch to a variant with the hooks while
+ * a trace is recorded (core8080.h), RunBlocks8080 is only traced when
+ * built with EMU8080_TRACE, code run by the JIT isn't. stores that
+ * bypass writeMemory8080 (LoadMemory8080, images) only show up at the
+ * next keyframe.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "emulatorShell.h"
+
+#define TRACE8080_VERSION 1
+#define TRACE8080_KEY_INTERVAL (1u << 20) // default instructions between keyframes
+#define TRACE8080_WRITES 32 // stores kept per record, more force a keyframe
+
+#if EMU8080_TRACE
+#define TRACE8080_OP(state, pc, opcode, cycles) \
+  do { \
+	if ((state)->trace) \
+	  traceOp8080((state), (pc), (opcode), (cycles)); \
+  } while (0)
+#else
+#define TRACE8080_OP(state, pc, opcode, cycles) ((void)0)
+#endif
+
+/*
+ * one replayed instruction
+ */
+typedef struct TraceEvent8080 {
+	uint64_t index; // instructions before this one
+	uint16_t pc;
+	uint8_t opcode;
+	uint8_t cycles;
+	uint8_t writeCount;
+	uint16_t writeAddr[TRACE8080_WRITES];
+	uint8_t writeValue[TRACE8080_WRITES];
+}TraceEvent8080;
+
+typedef struct TraceReader8080 TraceReader8080;
+
+void traceOp8080(State8080 *state, uint16_t pc, uint8_t opcode, int cycles);
+
+int EnableTrace8080(State8080 *state, const char *path, uint32_t keyInterval);
+int DisableTrace8080(State8080 *state);
+
+TraceReader8080 *OpenTrace8080(const char *path);
+void CloseTrace8080(TraceReader8080 *reader);
+uint64_t TraceLength8080(const TraceReader8080 *reader);
+int SeekTrace8080(TraceReader8080 *reader, State8080 *state, uint64_t index);
+int NextTrace8080(TraceReader8080 *reader, State8080 *state,
+                  TraceEvent8080 *event);
+
+#endif
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "opcodes8080.h"
+#include "flags8080.h"
+#include "memory8080.h"
+#include "validate8080.h"
+
+/*
+ * find the first byte that differs between the machines
+ * @param pages 1 for each page to look at
+ * @return 1 if one was found
+ */
+static int compareMemory(const State8080 *reference,
+                         const State8080 *candidate, const uint8_t *pages,
+                         Divergence8080 *divergence)
+{
+  int n, i;
+
+  for (n = 0; n < PAGE8080_COUNT; n++)
+  {
+	const uint8_t *ref = reference->readPage[n];
+	const uint8_t *cand = candidate->readPage[n];
+
+	// shared pages and device pages need no look
+	if (!pages[n] || reference->pages[n] == candidate->pages[n] ||
+		!ref || !cand || !memcmp(ref, cand, PAGE8080_SIZE))
+	  continue;
+	for (i = 0; ref[i] == cand[i]; i++)
+	  ;
+	divergence->addr = (n << PAGE8080_SHIFT) | i;
+	divergence->referenceByte = ref[i];
+	divergence->candidateByte = cand[i];
+	return 1;
+  }
+  return 0;
+}
+
+/*
+ * @return DIFF_* bits of the registers that differ
+ */
+static int compareRegisters(const State8080 *reference,
+                            const State8080 *candidate)
+{
+  int what = 0;
+
+  if (reference->a != candidate->a || reference->b != candidate->b ||
+	  reference->c != candidate->c || reference->d != candidate->d ||
+	  reference->e != candidate->e || reference->h != candidate->h ||
+	  reference->l != candidate->l)
+	what |= DIFF_REGS;
+  if (peekFlags8080(reference) != peekFlags8080(candidate))
+	what |= DIFF_FLAGS;
+  if (reference->sp != candidate->sp)
+	what |= DIFF_SP;
+  if (reference->pc != candidate->pc)
+	what |= DIFF_PC;
+  if (reference->cycles != candidate->cycles)
+	what |= DIFF_CYCLES;
+  if (reference->halted != candidate->halted ||
+	  reference->int_enable != candidate->int_enable)
+	what |= DIFF_HALT;
+  return what;
+}
+
+/*
+ * start a new comparison interval on a machine
+ * @param written collects the pages marked dirty before it
+ */
+static void checkpoint(State8080 *state, uint8_t *written)
+{
+  int n;
+
+  for (n = 0; n < PAGE8080_COUNT; n++)
+	written[n] |= state->dirtyPages[n];
+  CheckpointMemory8080(state);
+}
+
+/*
+ * mark the pages written before and during validation dirty again,
+ * save state deltas since the last real checkpoint still need them
+ */
+static void restoreDirty(State8080 *state, const uint8_t *written)
+{
+  int n;
+
+  for (n = 0; n < PAGE8080_COUNT; n++)
+	state->dirtyPages[n] |= written[n];
+}
+
+/*
+ * the comparison loop of Validate8080
+ * @param written pages each machine wrote, reference then candidate
+ */
+static int compareRun(State8080 *reference, State8080 *candidate,
+                      RunTier8080 run, uint64_t cycle_budget,
+                      Divergence8080 *divergence,
+                      uint8_t written[2][PAGE8080_COUNT])
+{
+  uint64_t end = candidate->cycles + cycle_budget, instructions = 0;
+  uint8_t pages[PAGE8080_COUNT];
+  int n;
+
+  checkpoint(reference, written[0]);
+  checkpoint(candidate, written[1]);
+
+  while (candidate->cycles < end && !candidate->halted)
+  {
+	divergence->instructions = instructions;
+	divergence->cycles = candidate->cycles;
+	divergence->pc = candidate->pc;
+
+	// IN and OUT leave A alone on both sides, just carry on
+	run(candidate, 1);
+	while (reference->cycles < candidate->cycles && !reference->halted)
+	{
+	  memmove(divergence->trail, divergence->trail + 1,
+	          (VALIDATE8080_TRAIL - 1) * sizeof(uint16_t));
+	  divergence->trail[VALIDATE8080_TRAIL - 1] = reference->pc;
+	  if (divergence->trailCount < VALIDATE8080_TRAIL)
+		divergence->trailCount++;
+	  reference->cycles += Emulate8080Op(reference);
+	  instructions++;
+	}
+
+	divergence->what = compareRegisters(reference, candidate);
+	for (n = 0; n < PAGE8080_COUNT; n++)
+	  pages[n] = reference->dirtyPages[n] | candidate->dirtyPages[n];
+	if (compareMemory(reference, candidate, pages, divergence))
+	  divergence->what |= DIFF_MEMORY;
+	if (divergence->what)
+	  return 1;
+	checkpoint(reference, written[0]);
+	checkpoint(candidate, written[1]);
+  }
+
+  // stores that went around the dirty marks
+  divergence->instructions = instructions;
+  divergence->cycles = candidate->cycles;
+  divergence->pc = candidate->pc;
+  if (!reference->halted && candidate->halted)
+	divergence->what |= DIFF_HALT;
+  if (MemoryHash8080(reference) != MemoryHash8080(candidate))
+  {
+	memset(pages, 1, sizeof(pages));
+	if (compareMemory(reference, candidate, pages, divergence))
+	  divergence->what |= DIFF_MEMORY;
+  }
+  return divergence->what != 0;
+}
+
+/*
+ * run a tier against the reference interpreter
+ * @param reference machine stepped with Emulate8080Op
+ * @param candidate machine run with the tier, same registers and
+ * memory as the reference, tiers already enabled
+ * @param run tier under test
+ * @param cycle_budget machine states to run, the run also ends when
+ * both machines halt
+ * @param divergence filled in when they disagree
+ * @return 0 when they agreed all along, 1 when they diverged
+ */
+int Validate8080(State8080 *reference, State8080 *candidate, RunTier8080 run,
+                 uint64_t cycle_budget, Divergence8080 *divergence)
+{
+  uint8_t written[2][PAGE8080_COUNT];
+  int diverged;
+
+  memset(divergence, 0, sizeof(Divergence8080));
+  memset(written, 0, sizeof(written));
+  diverged = compareRun(reference, candidate, run, cycle_budget, divergence,
+                        written);
+  restoreDirty(reference, written[0]);
+  restoreDirty(candidate, written[1]);
+  return diverged;
+}
+
+/*
+ * print an instruction the way the disassembler does
+ */
+static void printOp(FILE *file, const State8080 *state, uint16_t pc)
+{
+  uint8_t opcode = readMemory8080(state, pc);
+  const OpcodeInfo8080 *info = &opcodeTable8080[opcode];
+
+  fprintf(file, "%04x %s", pc, info->mnemonic);
+  if (info->length == 2)
+	fprintf(file, "#%02x", readMemory8080(state, pc + 1));
+  else if (info->length == 3)
+	fprintf(file, "#%04x", readMemory8080(state, pc + 1) |
+	                       readMemory8080(state, pc + 2) << 8);
+}
+
+static void printField(FILE *file, const char *name, unsigned reference,
+                       unsigned candidate, int digits)
+{
+  fprintf(file, "  %c %-10s %0*x %0*x\n", reference != candidate ? '*' : ' ',
+          name, digits, reference, digits, candidate);
+}
+
+/*
+ * describe a divergence: the instructions leading up to it, the
+ * registers of both machines with the differing ones marked, and
+ * the first differing memory byte
+ */
+void ReportDivergence8080(FILE *file, const State8080 *reference,
+                          const State8080 *candidate,
+                          const Divergence8080 *divergence)
+{
+  int i, first = VALIDATE8080_TRAIL - divergence->trailCount;
+
+  fprintf(file, "diverged in the block at %04x, after %llu instructions "
+          "and %llu cycles\n", divergence->pc,
+          (unsigned long long)divergence->instructions,
+          (unsigned long long)divergence->cycles);
+  for (i = first; i < VALIDATE8080_TRAIL; i++)
+  {
+	fprintf(file, "  %s ", i == VALIDATE8080_TRAIL - 1 ? ">" : " ");
+	printOp(file, reference, divergence->trail[i]);
+	fprintf(file, "\n");
+  }
+
+  fprintf(file, "    %-10s %-4s %s\n", "", "ref", "tier");
+  printField(file, "a", reference->a, candidate->a, 2);
+  printField(file, "b", reference->b, candidate->b, 2);
+  printField(file, "c", reference->c, candidate->c, 2);
+  printField(file, "d", reference->d, candidate->d, 2);
+  printField(file, "e", reference->e, candidate->e, 2);
+  printField(file, "h", reference->h, candidate->h, 2);
+  printField(file, "l", reference->l, candidate->l, 2);
+  printField(file, "psw", peekFlags8080(reference), peekFlags8080(candidate),
+             2);
+  printField(file, "sp", reference->sp, candidate->sp, 4);
+  printField(file, "pc", reference->pc, candidate->pc, 4);
+  printField(file, "halted", reference->halted, candidate->halted, 2);
+  printField(file, "int_enable", reference->int_enable,
+             candidate->int_enable, 2);
+  fprintf(file, "  %c %-10s %llu %llu\n",
+          reference->cycles != candidate->cycles ? '*' : ' ', "cycles",
+          (unsigned long long)reference->cycles,
+          (unsigned long long)candidate->cycles);
+  if (divergence->what & DIFF_MEMORY)
+	fprintf(file, "  * [%04x]     %02x %02x\n", divergence->addr,
+	        divergence->referenceByte, divergence->candidateByte);
+}
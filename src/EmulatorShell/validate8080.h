@@ -0,0 +1,63 @@
+#ifndef VALIDATE_8080_H
+#define VALIDATE_8080_H
+
+/*
+ * validate8080.h
+ * differential validation of an execution tier. a reference machine
+ * single steps through Emulate8080Op while a candidate machine runs
+ * the tier under test one block at a time (the tier is called with a
+ * budget of one machine state, Run8080 and RunBlocks8080 then run one
+ * instruction, RunJit8080 one translated block). after every block
+ * the reference catches up to the candidate's clock and the two are
+ * compared: registers, flags, clock, and every memory page either of
+ * them wrote since the last comparison. at the end the whole memory
+ * is compared through MemoryHash8080.
+ *
+ * both machines should start as forks of one machine, pages neither
+ * writes stay shared and cost nothing to compare. the comparisons
+ * checkpoint memory (CheckpointMemory8080) as they go, the dirty page
+ * marks are put back afterwards, so a delta save state taken later
+ * still holds every page written since the last real checkpoint.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "emulatorShell.h"
+#include "scheduler8080.h"
+
+#define VALIDATE8080_TRAIL 16 // reference instructions kept for the report
+
+/*
+ * Divergence8080 what bits
+ */
+#define DIFF_REGS   0x01 // A B C D E H L
+#define DIFF_FLAGS  0x02
+#define DIFF_SP     0x04
+#define DIFF_PC     0x08
+#define DIFF_CYCLES 0x10 // the reference couldn't stop on the candidate's clock
+#define DIFF_HALT   0x20 // halted or int_enable
+#define DIFF_MEMORY 0x40
+
+/*
+ * first point where the engines disagreed
+ */
+typedef struct Divergence8080 {
+	int what; // DIFF_* bits
+	uint64_t instructions; // reference instructions before the block
+	uint64_t cycles; // clock at the start of the block
+	uint16_t pc; // address the block started at
+	uint16_t trail[VALIDATE8080_TRAIL]; // last reference pcs, oldest first
+	int trailCount;
+	uint16_t addr; // first differing byte with DIFF_MEMORY
+	uint8_t referenceByte;
+	uint8_t candidateByte;
+}Divergence8080;
+
+int Validate8080(State8080 *reference, State8080 *candidate, RunTier8080 run,
+                 uint64_t cycle_budget, Divergence8080 *divergence);
+void ReportDivergence8080(FILE *file, const State8080 *reference,
+                          const State8080 *candidate,
+                          const Divergence8080 *divergence);
+
+#endif
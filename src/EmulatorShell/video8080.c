@@ -0,0 +1,544 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "video8080.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VIDEO_SIMD 1
+#include <immintrin.h>
+#else
+#define VIDEO_SIMD 0
+#endif
+
+#define FNV64_OFFSET 0xcbf29ce484222325ULL
+#define FNV64_PRIME 0x100000001b3ULL
+#define REPEAT8 0x0101010101010101ULL // a byte in all 8 bytes of a word
+#define SHORT_RUN 4 // rotated runs of fewer bytes skip the SIMD kernels
+
+static size_t pixelSize(const Video8080 *video)
+{
+  return video->config.format == VIDEO8080_GRAY ? 1 : 4;
+}
+
+static uint32_t pixel32(const uint8_t *rgba)
+{
+  uint32_t value;
+
+  memcpy(&value, rgba, sizeof(value));
+  return value;
+}
+
+static void expandScalar(const Video8080 *video, const uint8_t *src,
+                         size_t count, uint8_t *dst)
+{
+  size_t i;
+
+  // constant sizes, so the copies are inlined
+  if (video->config.format == VIDEO8080_GRAY)
+	for (i = 0; i < count; i++, dst += 8)
+	  memcpy(dst, video->lut[src[i]], 8);
+  else
+	for (i = 0; i < count; i++, dst += 32)
+	  memcpy(dst, video->lut[src[i]], 32);
+}
+
+#if VIDEO_SIMD
+
+__attribute__((target("sse2")))
+static void expandSse2(const Video8080 *video, const uint8_t *src,
+                       size_t count, uint8_t *dst)
+{
+  size_t i = 0;
+
+  if (video->config.format == VIDEO8080_GRAY)
+  {
+	const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+	                                   1, 2, 4, 8, 16, 32, 64, -128);
+	const __m128i on = _mm_set1_epi8((char)video->config.on[0]);
+	const __m128i off = _mm_set1_epi8((char)video->config.off[0]);
+
+	for (; i + 2 <= count; i += 2, dst += 16)
+	{
+	  __m128i v = _mm_set_epi64x((long long)(src[i + 1] * REPEAT8),
+	                             (long long)(src[i] * REPEAT8));
+	  __m128i set = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+
+	  _mm_storeu_si128((__m128i *)dst,
+	                   _mm_or_si128(_mm_and_si128(set, on),
+	                                _mm_andnot_si128(set, off)));
+	}
+  }
+  else
+  {
+	const __m128i low = _mm_setr_epi32(1, 2, 4, 8);
+	const __m128i high = _mm_setr_epi32(16, 32, 64, 128);
+	const __m128i on = _mm_set1_epi32(pixel32(video->config.on));
+	const __m128i off = _mm_set1_epi32(pixel32(video->config.off));
+
+	for (; i < count; i++, dst += 32)
+	{
+	  __m128i v = _mm_set1_epi32(src[i]);
+	  __m128i set = _mm_cmpeq_epi32(_mm_and_si128(v, low), low);
+
+	  _mm_storeu_si128((__m128i *)dst,
+	                   _mm_or_si128(_mm_and_si128(set, on),
+	                                _mm_andnot_si128(set, off)));
+	  set = _mm_cmpeq_epi32(_mm_and_si128(v, high), high);
+	  _mm_storeu_si128((__m128i *)(dst + 16),
+	                   _mm_or_si128(_mm_and_si128(set, on),
+	                                _mm_andnot_si128(set, off)));
+	}
+  }
+  expandScalar(video, src + i, count - i, dst);
+}
+
+__attribute__((target("avx2")))
+static void expandAvx2(const Video8080 *video, const uint8_t *src,
+                       size_t count, uint8_t *dst)
+{
+  size_t i = 0;
+
+  if (video->config.format == VIDEO8080_GRAY)
+  {
+	const __m256i bits = _mm256_set1_epi64x(0x8040201008040201LL);
+	const __m256i on = _mm256_set1_epi8((char)video->config.on[0]);
+	const __m256i off = _mm256_set1_epi8((char)video->config.off[0]);
+
+	for (; i + 4 <= count; i += 4, dst += 32)
+	{
+	  __m256i v = _mm256_set_epi64x((long long)(src[i + 3] * REPEAT8),
+	                                (long long)(src[i + 2] * REPEAT8),
+	                                (long long)(src[i + 1] * REPEAT8),
+	                                (long long)(src[i] * REPEAT8));
+	  __m256i set = _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits);
+
+	  _mm256_storeu_si256((__m256i *)dst,
+	                      _mm256_blendv_epi8(off, on, set));
+	}
+  }
+  else
+  {
+	const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	const __m256i on = _mm256_set1_epi32(pixel32(video->config.on));
+	const __m256i off = _mm256_set1_epi32(pixel32(video->config.off));
+
+	for (; i < count; i++, dst += 32)
+	{
+	  __m256i v = _mm256_set1_epi32(src[i]);
+	  __m256i set = _mm256_cmpeq_epi32(_mm256_and_si256(v, bits), bits);
+
+	  _mm256_storeu_si256((__m256i *)dst,
+	                      _mm256_blendv_epi8(off, on, set));
+	}
+  }
+  expandScalar(video, src + i, count - i, dst);
+}
+
+#endif
+
+/*
+ * pick the conversion kernel
+ * @return 0 on success, -1 if the host lacks the one asked for
+ */
+static int pickKernel(Video8080 *video, VideoKernel8080 kernel)
+{
+#if VIDEO_SIMD
+  int avx2 = __builtin_cpu_supports("avx2");
+  int sse2 = __builtin_cpu_supports("sse2");
+
+  if (kernel == VIDEO8080_KERNEL_AUTO)
+	kernel = avx2 ? VIDEO8080_KERNEL_AVX2 :
+	  sse2 ? VIDEO8080_KERNEL_SSE2 : VIDEO8080_KERNEL_SCALAR;
+  if (kernel == VIDEO8080_KERNEL_AVX2 && avx2)
+  {
+	video->expand = expandAvx2;
+	video->kernelName = "avx2";
+	return 0;
+  }
+  if (kernel == VIDEO8080_KERNEL_SSE2 && sse2)
+  {
+	video->expand = expandSse2;
+	video->kernelName = "sse2";
+	return 0;
+  }
+#else
+  if (kernel == VIDEO8080_KERNEL_AUTO)
+	kernel = VIDEO8080_KERNEL_SCALAR;
+#endif
+  if (kernel != VIDEO8080_KERNEL_SCALAR)
+	return -1;
+  video->expand = expandScalar;
+  video->kernelName = "scalar";
+  return 0;
+}
+
+static void fillLut(Video8080 *video)
+{
+  size_t bytes = pixelSize(video);
+  int value, bit;
+
+  for (value = 0; value < 256; value++)
+	for (bit = 0; bit < 8; bit++)
+	  memcpy(video->lut[value] + bit * bytes,
+	         (value >> bit) & 1 ? video->config.on : video->config.off,
+	         bytes);
+}
+
+/*
+ * pages holding part of the frame buffer
+ */
+static void markFrameBuffer(State8080 *state, const Video8080 *video)
+{
+  uint32_t end = video->config.base +
+	(uint32_t)video->stride * video->config.height;
+  uint32_t page;
+
+  for (page = video->config.base >> 8; page <= (end - 1) >> 8; page++)
+	markCode8080(state, page, CODE_VIDEO);
+}
+
+static void freeVideo(Video8080 *video)
+{
+  free(video->pixels);
+  free(video->dirty);
+  free(video->lineHash);
+  free(video->rotated);
+  free(video->lines);
+  free(video);
+}
+
+/*
+ * convert a frame buffer in the machine's memory from now on
+ * @param config frame buffer layout and output, copied
+ * @return 0 on success, -1 when the layout doesn't fit in memory,
+ * the kernel isn't available or out of memory
+ */
+int EnableVideo8080(State8080 *state, const VideoConfig8080 *config)
+{
+  Video8080 *video;
+  uint16_t stride = config->width / 8;
+  int rotated = config->rotate == VIDEO8080_ROTATE_CCW;
+
+  if (state->video)
+	return 0;
+  if (!config->width || config->width % 8 || !config->height ||
+	  (rotated && config->height % 8) ||
+	  config->base + (uint32_t)stride * config->height > 0x10000)
+	return -1;
+
+  video = calloc(1, sizeof(Video8080));
+  if (!video)
+	return -1;
+  video->config = *config;
+  video->stride = stride;
+  video->frameWidth = rotated ? config->height : config->width;
+  video->frameHeight = rotated ? config->width : config->height;
+  video->pitch = video->frameWidth * pixelSize(video);
+  video->frameSize = video->pitch * video->frameHeight;
+  video->pixels = malloc(video->frameSize);
+  video->dirty = malloc(config->height);
+  video->lineHash = calloc(config->height, sizeof(uint64_t));
+  video->lines = malloc(8 * stride);
+  video->rotated = rotated ? malloc(config->width * (config->height / 8)) :
+	NULL;
+  if (!video->pixels || !video->dirty || !video->lineHash || !video->lines ||
+	  (rotated && !video->rotated) ||
+	  pickKernel(video, config->kernel))
+  {
+	freeVideo(video);
+	return -1;
+  }
+  fillLut(video);
+  memset(video->dirty, 1, config->height);
+  video->anyDirty = 1;
+  markFrameBuffer(state, video);
+  state->video = video;
+  return 0;
+}
+
+void DisableVideo8080(State8080 *state)
+{
+  Video8080 *video = state->video;
+  int page;
+
+  if (!video)
+	return;
+  for (page = 0; page < 256; page++)
+	state->codePages[page] &= ~CODE_VIDEO;
+  if (video->stream && video->piped)
+	pclose(video->stream);
+  else if (video->stream && video->stream != stdout)
+	fclose(video->stream);
+  freeVideo(video);
+  state->video = NULL;
+}
+
+/*
+ * a store hit a frame buffer page
+ */
+void InvalidateVideo8080(State8080 *state, uint16_t addr)
+{
+  Video8080 *video = state->video;
+  uint16_t offset = addr - video->config.base;
+
+  if (offset < (uint32_t)video->stride * video->config.height)
+  {
+	video->dirty[offset / video->stride] = 1;
+	video->anyDirty = 1;
+  }
+}
+
+/*
+ * a frame buffer page was replaced, by Restore8080 or LoadMemory8080
+ */
+void InvalidateVideoPage8080(State8080 *state, uint8_t page)
+{
+  Video8080 *video = state->video;
+  uint32_t start = (uint32_t)page << 8, end = start + 0x100;
+  uint32_t base = video->config.base;
+  uint32_t line, last;
+
+  if (end <= base)
+	return;
+  line = start > base ? (start - base) / video->stride : 0;
+  last = (end - base - 1) / video->stride;
+  for (; line <= last && line < video->config.height; line++)
+	video->dirty[line] = 1;
+  video->anyDirty = 1;
+}
+
+/*
+ * the bytes of a memory line, straight from the page when it is
+ * one plain page
+ */
+static const uint8_t *lineBytes(const State8080 *state,
+                                const Video8080 *video, int line,
+                                uint8_t *buffer)
+{
+  uint16_t addr = video->config.base + line * video->stride;
+  const uint8_t *page = state->readPage[addr >> 8];
+  int i;
+
+  if (page && (addr & 0xff) + video->stride <= 0x100)
+	return page + (addr & 0xff);
+  for (i = 0; i < video->stride; i++)
+	buffer[i] = readMemory8080(state, addr + i);
+  return buffer;
+}
+
+/*
+ * FNV-1a over 8 byte words, then the bytes left
+ */
+static uint64_t hashBytes(const uint8_t *data, size_t size)
+{
+  uint64_t hash = FNV64_OFFSET, word;
+  size_t i;
+
+  for (i = 0; i + 8 <= size; i += 8)
+  {
+	memcpy(&word, data + i, sizeof(word));
+	hash = (hash ^ word) * FNV64_PRIME;
+  }
+  for (; i < size; i++)
+	hash = (hash ^ data[i]) * FNV64_PRIME;
+  return hash;
+}
+
+/*
+ * transpose an 8x8 bit matrix, byte i bit j becomes byte j bit i
+ */
+static uint64_t transpose8x8(uint64_t x)
+{
+  uint64_t t;
+
+  t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+  x ^= t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+  x ^= t ^ (t << 14);
+  t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+  x ^= t ^ (t << 28);
+  return x;
+}
+
+static int renderLines(const State8080 *state, Video8080 *video)
+{
+  int line, converted = 0;
+
+  for (line = 0; line < video->config.height; line++)
+	if (video->dirty[line])
+	{
+	  const uint8_t *src = lineBytes(state, video, line, video->lines);
+
+	  video->lineHash[line] = hashBytes(src, video->stride);
+	  video->expand(video, src, video->stride,
+	                video->pixels + line * video->pitch);
+	  converted++;
+	}
+  return converted;
+}
+
+/*
+ * expand a run of transposed groups into every frame row. short runs
+ * cost more to set up in a kernel than to copy from the table.
+ */
+static void expandRun(const Video8080 *video, int first, int count)
+{
+  int groups = video->config.height / 8, row, i;
+  const uint8_t *src = video->rotated + first;
+  size_t pitch = video->pitch;
+
+  if (count >= SHORT_RUN)
+  {
+	uint8_t *dst = video->pixels + first * 8 * pixelSize(video);
+
+	for (row = 0; row < video->config.width; row++, src += groups,
+		 dst += pitch)
+	  video->expand(video, src, count, dst);
+  }
+  else if (video->config.format == VIDEO8080_GRAY)
+  {
+	uint8_t *dst = video->pixels + first * 8;
+
+	for (row = 0; row < video->config.width; row++, src += groups,
+		 dst += pitch)
+	  for (i = 0; i < count; i++)
+		memcpy(dst + i * 8, video->lut[src[i]], 8);
+  }
+  else
+  {
+	uint8_t *dst = video->pixels + first * 32;
+
+	for (row = 0; row < video->config.width; row++, src += groups,
+		 dst += pitch)
+	  for (i = 0; i < count; i++)
+		memcpy(dst + i * 32, video->lut[src[i]], 32);
+  }
+}
+
+/*
+ * rotated boards: transpose each dirty group of 8 memory lines into
+ * a byte per frame row, then expand each run of dirty groups into
+ * every row
+ */
+static int renderRotated(const State8080 *state, Video8080 *video)
+{
+  uint8_t *rotated = video->rotated;
+  int groups = video->config.height / 8, width = video->config.width;
+  int stride = video->stride;
+  int group, first = -1, converted = 0;
+
+  for (group = 0; group <= groups; group++)
+  {
+	const uint8_t *src[8];
+	int i, x;
+
+	for (i = 0; group < groups && i < 8 && !video->dirty[group * 8 + i];
+		 i++)
+	  ;
+	if (group == groups || i == 8)
+	{
+	  if (first >= 0)
+		expandRun(video, first, group - first);
+	  first = -1;
+	  continue;
+	}
+	if (first < 0)
+	  first = group;
+
+	for (i = 0; i < 8; i++)
+	{
+	  src[i] = lineBytes(state, video, group * 8 + i,
+	                     video->lines + i * stride);
+	  if (video->dirty[group * 8 + i])
+	  {
+		video->lineHash[group * 8 + i] = hashBytes(src[i], stride);
+		converted++;
+	  }
+	}
+	for (x = 0; x < stride; x++)
+	{
+	  uint64_t matrix = 0;
+	  uint8_t *dst = rotated + (width - 1 - x * 8) * groups + group;
+
+	  for (i = 0; i < 8; i++)
+		matrix |= (uint64_t)src[i][x] << (i * 8);
+	  matrix = transpose8x8(matrix);
+	  for (i = 0; i < 8; i++, dst -= groups, matrix >>= 8)
+		*dst = matrix;
+	}
+  }
+  return converted;
+}
+
+/*
+ * convert the memory lines written since the last frame, update the
+ * frame hash and stream the frame
+ * @return memory lines converted, -1 when streaming failed
+ */
+int RenderFrame8080(State8080 *state)
+{
+  Video8080 *video = state->video;
+  uint64_t hash = FNV64_OFFSET;
+  int converted = 0, line;
+
+  if (!video)
+	return 0;
+  if (video->anyDirty)
+  {
+	converted = video->rotated ? renderRotated(state, video) :
+	  renderLines(state, video);
+	memset(video->dirty, 0, video->config.height);
+	video->anyDirty = 0;
+  }
+  for (line = 0; line < video->config.height; line++)
+	hash = (hash ^ video->lineHash[line]) * FNV64_PRIME;
+  video->hash = hash;
+  video->frames++;
+  video->linesConverted += converted;
+
+  if (video->stream &&
+	  fwrite(video->pixels, 1, video->frameSize, video->stream) !=
+	  video->frameSize)
+  {
+	video->error = 1;
+	return -1;
+  }
+  return converted;
+}
+
+/*
+ * write every frame rendered from now on, raw
+ * @param path file, "-" for stdout or "|command" for a pipe
+ * @return 0 on success, -1 when it can't be opened
+ */
+int StreamVideo8080(State8080 *state, const char *path)
+{
+  Video8080 *video = state->video;
+  FILE *stream;
+  int piped = path[0] == '|';
+
+  if (!video || video->stream)
+	return -1;
+  if (!strcmp(path, "-"))
+	stream = stdout;
+  else
+	stream = piped ? popen(path + 1, "w") : fopen(path, "wb");
+  if (!stream)
+	return -1;
+  video->stream = stream;
+  video->piped = piped;
+  return 0;
+}
+
+/*
+ * scheduler event rendering a frame, see ScheduleEvent8080
+ */
+void RenderFrameEvent8080(State8080 *state, void *opaque, uint64_t when)
+{
+  (void)opaque;
+  (void)when;
+  RenderFrame8080(state);
+}
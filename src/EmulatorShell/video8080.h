@@ -0,0 +1,96 @@
+#ifndef VIDEO_8080_H
+#define VIDEO_8080_H
+
+/*
+ * video8080.h
+ * headless video for 1 bit per pixel frame buffers in 8080 memory,
+ * like the 256x224 one arcade boards keep at 0x2400. bit 0 of a byte
+ * is its leftmost pixel. the frame buffer pages carry CODE_VIDEO, so
+ * stores into them mark the memory lines they hit, and a frame only
+ * converts the lines written since the last one. conversion expands
+ * bytes into RGBA or grayscale pixels with SSE2 or AVX2 where the
+ * host has them. rotated boards are converted 8 lines at a time, an
+ * 8x8 bit transpose turns them into the same byte expansion.
+ *
+ * every frame gets a 64 bit hash of the frame buffer bytes, not of
+ * the pixels, so it doesn't depend on format or colours. frames can
+ * be streamed raw to a file or a pipe.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "emulatorShell.h"
+
+typedef enum VideoFormat8080 {
+  VIDEO8080_RGBA = 0, // 4 bytes per pixel, R G B A
+  VIDEO8080_GRAY // 1 byte per pixel
+}VideoFormat8080;
+
+typedef enum VideoRotate8080 {
+  VIDEO8080_ROTATE_NONE = 0,
+  VIDEO8080_ROTATE_CCW // memory lines become columns, left to right,
+                       // their first pixel at the bottom
+}VideoRotate8080;
+
+typedef enum VideoKernel8080 {
+  VIDEO8080_KERNEL_AUTO = 0, // widest the host has
+  VIDEO8080_KERNEL_SCALAR,
+  VIDEO8080_KERNEL_SSE2,
+  VIDEO8080_KERNEL_AVX2
+}VideoKernel8080;
+
+typedef struct VideoConfig8080 {
+	uint16_t base; // address of the first frame buffer byte
+	uint16_t width; // pixels per memory line, a multiple of 8
+	uint16_t height; // memory lines, a multiple of 8 when rotated
+	VideoRotate8080 rotate;
+	VideoFormat8080 format;
+	uint8_t on[4]; // RGBA of set bits, VIDEO8080_GRAY uses on[0]
+	uint8_t off[4]; // RGBA of clear bits
+	VideoKernel8080 kernel;
+}VideoConfig8080;
+
+struct Video8080;
+
+/*
+ * expands bytes into 8 pixels each
+ */
+typedef void (*VideoKernelFn8080)(const struct Video8080 *video,
+                                  const uint8_t *src, size_t count,
+                                  uint8_t *dst);
+
+typedef struct Video8080 {
+	VideoConfig8080 config;
+	uint16_t stride; // bytes per memory line
+	uint16_t frameWidth; // pixels per row of the frame, after rotation
+	uint16_t frameHeight;
+	size_t pitch; // bytes per row of the frame
+	size_t frameSize;
+	uint8_t *pixels; // the last frame
+	uint8_t *dirty; // memory lines written since the last frame
+	uint8_t *rotated; // rotated boards: frame rows of 8 line groups
+	uint8_t *lines; // 8 memory lines copied out of split or device pages
+	int anyDirty;
+	uint64_t *lineHash; // hash of each memory line
+	uint64_t hash; // of the last frame
+	uint64_t frames; // frames rendered
+	uint64_t linesConverted; // memory lines turned into pixels
+	uint8_t lut[256][32]; // 8 pixels of every byte, for the scalar kernel
+	VideoKernelFn8080 expand;
+	const char *kernelName;
+	FILE *stream; // raw frames go here, NULL for none
+	int piped; // stream was opened with popen
+	int error; // a frame failed to stream
+}Video8080;
+
+int EnableVideo8080(State8080 *state, const VideoConfig8080 *config);
+void DisableVideo8080(State8080 *state);
+void InvalidateVideo8080(State8080 *state, uint16_t addr);
+void InvalidateVideoPage8080(State8080 *state, uint8_t page);
+int RenderFrame8080(State8080 *state);
+int StreamVideo8080(State8080 *state, const char *path);
+void RenderFrameEvent8080(State8080 *state, void *opaque, uint64_t when);
+
+#endif
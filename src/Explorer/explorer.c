@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "explore8080.h"
+#include "file8080.h"
+
+static int scoreAddress = -1; // -P, byte that ranks branch points
+
+/*
+ * parse an input alphabet like 0,1,0x30-0x39
+ * @return number of values, 0 on a syntax error
+ */
+static size_t parseValues(const char *text, uint8_t *values)
+{
+  uint8_t seen[256] = { 0 };
+  size_t count = 0;
+  char *end;
+
+  while (*text)
+  {
+	unsigned long first = strtoul(text, &end, 0), last = first, v;
+
+	if (end == text)
+	  return 0;
+	text = end;
+	if (*text == '-')
+	{
+	  last = strtoul(++text, &end, 0);
+	  if (end == text)
+		return 0;
+	  text = end;
+	}
+	if (first > last || last > 0xff || (*text && *text++ != ','))
+	  return 0;
+	for (v = first; v <= last; v++)
+	  if (!seen[v])
+	  {
+		seen[v] = 1;
+		values[count++] = v;
+	  }
+  }
+  return count;
+}
+
+static uint64_t scoreByte(const State8080 *state, void *opaque)
+{
+  (void)opaque;
+  return readMemory8080(state, scoreAddress);
+}
+
+static void printGoal(const State8080 *state, const uint8_t *inputs,
+                      uint32_t depth, void *opaque)
+{
+  uint32_t i;
+
+  (void)opaque;
+  printf("goal, A=%02x pc=%04x after %u inputs:", state->a, state->pc,
+         depth);
+  for (i = 0; i < depth; i++)
+	printf(" %02x", inputs[i]);
+  printf("\n");
+  fflush(stdout);
+}
+
+static void printProgress(const ExploreStats8080 *stats, void *opaque)
+{
+  (void)opaque;
+  fprintf(stderr, "#%llu states %llu duplicates %llu depth %u goals %llu "
+          "states/s %.0f\n", (unsigned long long)stats->runs,
+          (unsigned long long)stats->states,
+          (unsigned long long)stats->duplicates, stats->depth,
+          (unsigned long long)stats->goals,
+          stats->seconds > 0 ? stats->states / stats->seconds : 0.0);
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-o load address] [-i input port] [-v input values]\n"
+          "       [-x goal port] [-s bfs|dfs|prio] [-P score address]\n"
+          "       [-c cycles per step] [-n max states] [-d max depth]\n"
+          "       [-t seconds] [-j threads] rom\n"
+          "       explores the states a program reaches through its\n"
+          "       inputs, -v lists the values tried at every IN, like\n"
+          "       0,1,0x30-0x39, prio expands the highest byte at -P\n"
+          "       first. paths to an OUT to the goal port are printed\n",
+          name);
+}
+
+int main(int argc, char **argv)
+{
+  ExploreOptions8080 options = { 0, EXPLORE8080_BFS, -1, NULL, 0, -1, 0, 0, 0,
+                                 0, NULL, printGoal, printProgress, NULL };
+  ExploreStats8080 stats;
+  State8080 initial;
+  uint16_t loadAddress = 0;
+  uint8_t values[256];
+  size_t size;
+  uint8_t *rom;
+  int opt, ret = 0;
+
+  while ((opt = getopt(argc, argv, "o:i:v:x:s:P:c:n:d:t:j:")) != -1)
+  {
+	switch (opt)
+	{
+	  case 'o': loadAddress = strtoul(optarg, NULL, 0); break;
+	  case 'i': options.inputPort = strtol(optarg, NULL, 0) & 0xff; break;
+	  case 'v':
+		options.inputs = values;
+		options.inputCount = parseValues(optarg, values);
+		if (!options.inputCount)
+		{
+		  usage(argv[0]);
+		  return 1;
+		}
+		break;
+	  case 'x': options.goalPort = strtol(optarg, NULL, 0) & 0xff; break;
+	  case 's':
+		if (!strcmp(optarg, "dfs"))
+		  options.strategy = EXPLORE8080_DFS;
+		else if (!strcmp(optarg, "prio"))
+		  options.strategy = EXPLORE8080_PRIORITY;
+		else
+		  options.strategy = EXPLORE8080_BFS;
+		break;
+	  case 'P': scoreAddress = strtoul(optarg, NULL, 0) & 0xffff; break;
+	  case 'c': options.stepCycles = strtoull(optarg, NULL, 0); break;
+	  case 'n': options.maxStates = strtoull(optarg, NULL, 0); break;
+	  case 'd': options.maxDepth = strtoul(optarg, NULL, 0); break;
+	  case 't': options.seconds = strtod(optarg, NULL); break;
+	  case 'j': options.threads = atoi(optarg); break;
+	  default:
+		usage(argv[0]);
+		return 1;
+	}
+  }
+  if (optind + 1 != argc ||
+	  (options.strategy == EXPLORE8080_PRIORITY && scoreAddress < 0))
+  {
+	usage(argv[0]);
+	return 1;
+  }
+  if (scoreAddress >= 0)
+	options.score = scoreByte;
+
+  rom = ReadFile8080(argv[optind], &size);
+  if (!rom)
+  {
+	printf("failed to open %s!\n", argv[optind]);
+	return 1;
+  }
+  memset(&initial, 0, sizeof(State8080));
+  InitMemory8080(&initial);
+  LoadMemory8080(&initial, loadAddress, rom, size);
+  initial.pc = loadAddress;
+  free(rom);
+
+  if (Explore8080(&initial, &options, &stats))
+  {
+	printf("out of memory!\n");
+	ret = 1;
+  }
+  printf("states %llu expanded %llu runs %llu duplicates %llu halts %llu "
+         "stuck %llu goals %llu depth %u states/s %.0f, %s\n",
+         (unsigned long long)stats.states,
+         (unsigned long long)stats.expanded, (unsigned long long)stats.runs,
+         (unsigned long long)stats.duplicates,
+         (unsigned long long)stats.halts, (unsigned long long)stats.stuck,
+         (unsigned long long)stats.goals, stats.depth,
+         stats.seconds > 0 ? stats.states / stats.seconds : 0.0,
+         stats.complete ? "complete" : "stopped at a limit");
+
+  FreeMemory8080(&initial);
+  return ret;
+}
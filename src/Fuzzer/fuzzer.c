@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "emulatorShell.h"
+#include "coverage8080.h"
+#include "fuzz8080.h"
+#include "file8080.h"
+
+#define DEFAULT_MAX_LENGTH 256 // longest input the mutator makes
+#define MAX_STACKED 8 // mutations applied to one input at most
+
+/*
+ * inputs that found new coverage
+ */
+typedef struct Corpus {
+	uint8_t **data;
+	size_t *size;
+	size_t count;
+	size_t capacity;
+}Corpus;
+
+static uint64_t rngState = 0x8080;
+
+static uint64_t nextRandom(void)
+{
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 7;
+  rngState ^= rngState << 17;
+  return rngState;
+}
+
+static size_t randomBelow(size_t n)
+{
+  return n ? nextRandom() % n : 0;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int writeFile(const char *path, const uint8_t *data, size_t size)
+{
+  FILE *fHandle = fopen(path, "wb");
+  int ret;
+
+  if (!fHandle)
+	return -1;
+  ret = fwrite(data, 1, size, fHandle) == size ? 0 : -1;
+  if (fclose(fHandle))
+	ret = -1;
+  return ret;
+}
+
+/*
+ * keep a copy of an input
+ * @return 0 on success, -1 when out of memory
+ */
+static int addInput(Corpus *corpus, const uint8_t *data, size_t size)
+{
+  uint8_t *copy;
+
+  if (corpus->count == corpus->capacity)
+  {
+	size_t capacity = corpus->capacity ? corpus->capacity * 2 : 64;
+	uint8_t **inputs = realloc(corpus->data, capacity * sizeof(uint8_t *));
+	size_t *sizes;
+
+	if (!inputs)
+	  return -1;
+	corpus->data = inputs;
+	sizes = realloc(corpus->size, capacity * sizeof(size_t));
+	if (!sizes)
+	  return -1;
+	corpus->size = sizes;
+	corpus->capacity = capacity;
+  }
+  copy = malloc(size ? size : 1);
+  if (!copy)
+	return -1;
+  memcpy(copy, data, size);
+  corpus->data[corpus->count] = copy;
+  corpus->size[corpus->count++] = size;
+  return 0;
+}
+
+static void freeCorpus(Corpus *corpus)
+{
+  size_t i;
+
+  for (i = 0; i < corpus->count; i++)
+	free(corpus->data[i]);
+  free(corpus->data);
+  free(corpus->size);
+}
+
+/*
+ * load every file of a directory as a seed
+ * @return 0 on success, -1 when the directory can't be read
+ */
+static int loadSeeds(Corpus *corpus, const char *dir, size_t maxLength)
+{
+  DIR *handle = opendir(dir);
+  struct dirent *entry;
+  char path[4096];
+
+  if (!handle)
+	return -1;
+  while ((entry = readdir(handle)))
+  {
+	uint8_t *data;
+	size_t size;
+
+	if (entry->d_name[0] == '.')
+	  continue;
+	snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+	data = ReadFile8080(path, &size);
+	if (!data)
+	  continue;
+	addInput(corpus, data, size < maxLength ? size : maxLength);
+	free(data);
+  }
+  closedir(handle);
+  return 0;
+}
+
+/*
+ * change an input in place, the way AFL's havoc stage does
+ * @return the new length
+ */
+static size_t mutate(uint8_t *data, size_t size, size_t maxLength,
+                     const Corpus *corpus)
+{
+  static const uint8_t interesting[] = {
+	0x00, 0x01, 0x7f, 0x80, 0xff, 0x10, 0x20, 0x40, 0x0a, 0x0d
+  };
+  int n = 1 + randomBelow(MAX_STACKED), k;
+
+  for (k = 0; k < n; k++)
+  {
+	size_t pos = randomBelow(size), len;
+
+	switch (randomBelow(size ? 7 : 1))
+	{
+	  case 0: // insert a byte
+		if (size < maxLength)
+		{
+		  pos = randomBelow(size + 1);
+		  memmove(data + pos + 1, data + pos, size - pos);
+		  data[pos] = nextRandom();
+		  size++;
+		}
+		break;
+	  case 1: data[pos] ^= 1 << randomBelow(8); break;
+	  case 2: data[pos] = nextRandom(); break;
+	  case 3: data[pos] += 1 + randomBelow(35) - 18; break;
+	  case 4: data[pos] = interesting[randomBelow(sizeof(interesting))]; break;
+	  case 5: // delete a run of bytes
+		len = 1 + randomBelow(size - pos);
+		memmove(data + pos, data + pos + len, size - pos - len);
+		size -= len;
+		break;
+	  default: // splice in part of another input
+		{
+		  size_t other = randomBelow(corpus->count);
+		  size_t from;
+
+		  if (!corpus->count || !corpus->size[other])
+			break;
+		  from = randomBelow(corpus->size[other]);
+		  len = corpus->size[other] - from;
+		  if (pos + len > maxLength)
+			len = maxLength - pos;
+		  memcpy(data + pos, corpus->data[other] + from, len);
+		  if (pos + len > size)
+			size = pos + len;
+		}
+		break;
+	}
+  }
+  return size;
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-o load address] [-a input address] [-m max input]\n"
+          "       [-i input port] [-x crash port] [-c cycles per input]\n"
+          "       [-n execs] [-t seconds] [-s seed] [-C corpus dir] rom\n"
+          "       fuzzes a program in process, inputs that reach new\n"
+          "       edges go to the corpus dir, crashes to crash-<exec>\n",
+          name);
+}
+
+int main(int argc, char **argv)
+{
+  FuzzOptions8080 options = { 0, 0x8000, DEFAULT_MAX_LENGTH, -1, -1, 0 };
+  const char *corpusDir = NULL;
+  uint64_t maxExecs = 0, crashes = 0, timeouts = 0;
+  double seconds = 0, start, lastReport;
+  size_t maxLength = DEFAULT_MAX_LENGTH, size;
+  uint8_t *seen, *input, *rom;
+  FuzzTarget8080 *target;
+  Corpus corpus = { NULL, NULL, 0, 0 };
+  int opt, ret = 0;
+  char path[4096];
+
+  while ((opt = getopt(argc, argv, "o:a:m:i:x:c:n:t:s:C:")) != -1)
+  {
+	switch (opt)
+	{
+	  case 'o': options.loadAddress = strtoul(optarg, NULL, 0); break;
+	  case 'a': options.inputAddress = strtoul(optarg, NULL, 0); break;
+	  case 'm': maxLength = strtoul(optarg, NULL, 0); break;
+	  case 'i': options.inputPort = strtol(optarg, NULL, 0) & 0xff; break;
+	  case 'x': options.crashPort = strtol(optarg, NULL, 0) & 0xff; break;
+	  case 'c': options.maxCycles = strtoull(optarg, NULL, 0); break;
+	  case 'n': maxExecs = strtoull(optarg, NULL, 0); break;
+	  case 't': seconds = strtod(optarg, NULL); break;
+	  case 's': rngState = strtoull(optarg, NULL, 0) | 1; break;
+	  case 'C': corpusDir = optarg; break;
+	  default:
+		usage(argv[0]);
+		return 1;
+	}
+  }
+  if (optind + 1 != argc || !maxLength)
+  {
+	usage(argv[0]);
+	return 1;
+  }
+  rom = ReadFile8080(argv[optind], &size);
+  if (!rom)
+  {
+	printf("failed to open %s!\n", argv[optind]);
+	return 1;
+  }
+  options.inputMax = maxLength;
+  target = CreateFuzzTarget8080(rom, size, &options);
+  free(rom);
+  seen = calloc(1, COVER8080_MAP_SIZE);
+  input = malloc(maxLength);
+  if (!target || !seen || !input)
+  {
+	printf("out of memory!\n");
+	return 1;
+  }
+  if (corpusDir && loadSeeds(&corpus, corpusDir, maxLength))
+	fprintf(stderr, "can't read %s, starting empty\n", corpusDir);
+  if (!corpus.count)
+	addInput(&corpus, (const uint8_t *)"", 0);
+
+  start = lastReport = now();
+  while ((!maxExecs || target->execs < maxExecs) &&
+		 (!seconds || now() - start < seconds))
+  {
+	// seeds run as they are first, then get mutated
+	size_t pick = target->execs < corpus.count ? target->execs :
+	  randomBelow(corpus.count);
+	FuzzResult8080 result;
+	size_t fresh;
+
+	size = corpus.size[pick];
+	memcpy(input, corpus.data[pick], size);
+	if (target->execs >= corpus.count)
+	  size = mutate(input, size, maxLength, &corpus);
+
+	result = RunFuzzInput8080(target, input, size);
+	fresh = target->machine.coverage &&
+	  MergeCoverage8080(seen, target->machine.coverage);
+
+	// the first crash is kept, later ones when they took a new path
+	if (result == FUZZ8080_CRASH && (fresh || !crashes))
+	{
+	  snprintf(path, sizeof(path), "crash-%llu",
+	           (unsigned long long)target->execs);
+	  if (writeFile(path, input, size))
+		fprintf(stderr, "can't write %s!\n", path);
+	  else
+		fprintf(stderr, "crash, A=%02x, saved %s\n", target->crashValue,
+		        path);
+	}
+	if (result == FUZZ8080_CRASH)
+	  crashes++;
+	else if (result == FUZZ8080_TIMEOUT)
+	  timeouts++;
+
+	if (fresh && target->execs > corpus.count && result != FUZZ8080_CRASH)
+	{
+	  addInput(&corpus, input, size);
+	  if (corpusDir)
+	  {
+		snprintf(path, sizeof(path), "%s/id-%06zu", corpusDir,
+		         corpus.count - 1);
+		if (writeFile(path, input, size))
+		  fprintf(stderr, "can't write %s!\n", path);
+	  }
+	}
+
+	if (now() - lastReport >= 1.0)
+	{
+	  lastReport = now();
+	  fprintf(stderr, "#%llu edges %zu corpus %zu crashes %llu "
+	          "timeouts %llu exec/s %.0f\n",
+	          (unsigned long long)target->execs, CountCoverage8080(seen),
+	          corpus.count, (unsigned long long)crashes,
+	          (unsigned long long)timeouts,
+	          target->execs / (lastReport - start));
+	}
+  }
+
+  start = now() - start;
+  printf("execs %llu edges %zu corpus %zu crashes %llu timeouts %llu "
+         "exec/s %.0f\n", (unsigned long long)target->execs,
+         CountCoverage8080(seen), corpus.count,
+         (unsigned long long)crashes, (unsigned long long)timeouts,
+         start > 0 ? target->execs / start : 0.0);
+  if (crashes)
+	ret = 1;
+
+  freeCorpus(&corpus);
+  DestroyFuzzTarget8080(target);
+  free(seen);
+  free(input);
+  return ret;
+}
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emulatorShell.h"
+#include "coverage8080.h"
+#include "fuzz8080.h"
+
+/*
+ * libFuzzer entry points, built by make libfuzzer8080 with clang
+ * -fsanitize=fuzzer. the program and the options come from the
+ * environment:
+ *   EMU8080_FUZZ_ROM     program to fuzz, required
+ *   EMU8080_FUZZ_LOAD    load address, default 0
+ *   EMU8080_FUZZ_INPUT   input address, default 0x8000
+ *   EMU8080_FUZZ_MAX     bytes of input copied to memory, default 256
+ *   EMU8080_FUZZ_PORT    input port, default none
+ *   EMU8080_FUZZ_CRASH   crash port, default none
+ *   EMU8080_FUZZ_CYCLES  machine states per input
+ * the guest's edge counters sit in libFuzzer's extra counters
+ * section, so libFuzzer sees guest coverage next to its own
+ * coverage of the emulator. a crash of the guest aborts.
+ */
+
+__attribute__((section("__libfuzzer_extra_counters")))
+static Coverage8080 guestCoverage;
+
+static FuzzTarget8080 *target;
+
+static long envNumber(const char *name, long fallback)
+{
+  const char *value = getenv(name);
+
+  return value ? strtol(value, NULL, 0) : fallback;
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+  FuzzOptions8080 options;
+  const char *path = getenv("EMU8080_FUZZ_ROM");
+  FILE *fHandle = path ? fopen(path, "rb") : NULL;
+  static uint8_t rom[0x10000];
+  size_t size;
+
+  (void)argc;
+  (void)argv;
+  if (!fHandle)
+  {
+	fprintf(stderr, "set EMU8080_FUZZ_ROM to the program to fuzz!\n");
+	exit(1);
+  }
+  size = fread(rom, 1, sizeof(rom), fHandle);
+  fclose(fHandle);
+
+  options.loadAddress = envNumber("EMU8080_FUZZ_LOAD", 0);
+  options.inputAddress = envNumber("EMU8080_FUZZ_INPUT", 0x8000);
+  options.inputMax = envNumber("EMU8080_FUZZ_MAX", 256);
+  options.inputPort = envNumber("EMU8080_FUZZ_PORT", -1);
+  options.crashPort = envNumber("EMU8080_FUZZ_CRASH", -1);
+  options.maxCycles = envNumber("EMU8080_FUZZ_CYCLES", 0);
+  target = CreateFuzzTarget8080(rom, size, &options);
+  if (!target)
+  {
+	fprintf(stderr, "out of memory!\n");
+	exit(1);
+  }
+  DisableCoverage8080(&target->machine);
+  target->machine.coverage = &guestCoverage;
+  return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  if (RunFuzzInput8080(target, data, size) == FUZZ8080_CRASH)
+  {
+	fprintf(stderr, "guest crash, A=%02x\n", target->crashValue);
+	abort();
+  }
+  return 0;
+}
@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "opcodes8080.h"
+#include "flowGraph8080.h"
+#include "emulatorShell.h"
+#include "aot8080.h"
+#include "file8080.h"
+
+#define MAX_ENTRIES 256 // -e entry points
+#define ADDRESS_SPACE 0x10000
+#define MAP_BYTES (ADDRESS_SPACE / 8)
+
+/*
+ * what the C output is made from
+ */
+typedef struct Unit {
+	const uint8_t *image;
+	uint16_t origin;
+	size_t size;
+	const FlowGraph8080 *graph;
+	uint8_t codeMap[MAP_BYTES]; // instruction bytes
+	uint8_t entryMap[MAP_BYTES]; // addresses with a label
+	uint8_t blockMap[MAP_BYTES]; // block starts
+	uint8_t emitted[MAP_BYTES]; // labels written so far
+	FILE *out;
+}Unit;
+
+static void setBit(uint8_t *map, uint16_t addr)
+{
+  map[addr >> 3] |= 1 << (addr & 7);
+}
+
+static int getBit(const uint8_t *map, uint16_t addr)
+{
+  return (map[addr >> 3] >> (addr & 7)) & 1;
+}
+
+static int inImage(const Unit *unit, uint32_t addr, int length)
+{
+  uint32_t offset = (addr - unit->origin) & 0xffff;
+
+  return offset + length <= unit->size;
+}
+
+static uint8_t imageByte(const Unit *unit, uint16_t addr)
+{
+  return unit->image[(uint16_t)(addr - unit->origin)];
+}
+
+/*
+ * @return 1 if the whole instruction at addr is in the image, only
+ * those get labels
+ */
+static int fits(const Unit *unit, uint16_t addr)
+{
+  return inImage(unit, addr, 1) &&
+	inImage(unit, addr, opcodeTable8080[imageByte(unit, addr)].length);
+}
+
+/*
+ * mark the instruction bytes and the labels: block starts and the
+ * instructions after an OPA_STOP instruction, where a run resumes.
+ * a label belongs to the function of its page, a resume point past
+ * the page of its block gets none.
+ */
+static void mapUnit(Unit *unit)
+{
+  const FlowGraph8080 *graph = unit->graph;
+  uint32_t b, i;
+
+  for (b = 0; b < graph->blockCount; b++)
+	if (fits(unit, graph->blocks[b].start))
+	{
+	  setBit(unit->entryMap, graph->blocks[b].start);
+	  setBit(unit->blockMap, graph->blocks[b].start);
+	}
+  for (b = 0; b < graph->blockCount; b++)
+  {
+	const FlowBlock8080 *block = &graph->blocks[b];
+	uint16_t addr = block->start;
+
+	for (i = 0; i < block->count; i++)
+	{
+	  const OpcodeInfo8080 *info = &opcodeTable8080[imageByte(unit, addr)];
+	  int k;
+
+	  if (!inImage(unit, addr, info->length))
+		break;
+	  for (k = 0; k < info->length; k++)
+		setBit(unit->codeMap, addr + k);
+	  addr += info->length;
+	  if ((info->attr & OPA_STOP) && i + 1 < block->count &&
+		  addr >> 8 == block->start >> 8 && fits(unit, addr))
+		setBit(unit->entryMap, addr);
+	}
+  }
+}
+
+static void emitMap(const Unit *unit, const char *name, const uint8_t *map)
+{
+  int i, n = 0;
+
+  fprintf(unit->out, "static const uint8_t %s[%d] = {", name, MAP_BYTES);
+  for (i = 0; i < MAP_BYTES; i++)
+	if (map[i])
+	  fprintf(unit->out, "%s[%d] = 0x%02x,", n++ % 6 ? " " : "\n  ", i,
+	          map[i]);
+  fprintf(unit->out, "\n};\n\n");
+}
+
+static void emitLabel(Unit *unit, uint16_t addr)
+{
+  setBit(unit->emitted, addr);
+  fprintf(unit->out, "b_%04x:\n"
+          "  if (cycles >= cycle_budget)\n"
+          "\tgoto done;\n", addr);
+}
+
+/*
+ * one basic block, ending with direct gotos to the successors in the
+ * same page and the page's dispatcher for everything else
+ */
+static void emitBlock(Unit *unit, const FlowBlock8080 *block)
+{
+  const FlowGraph8080 *graph = unit->graph;
+  uint16_t addr = block->start;
+  uint32_t i, e;
+
+  fprintf(unit->out, "\n");
+  emitLabel(unit, addr);
+  for (i = 0; i < block->count; i++)
+  {
+	uint8_t opcode = imageByte(unit, addr);
+	const OpcodeInfo8080 *info = &opcodeTable8080[opcode];
+	uint8_t lo = info->length > 1 ? imageByte(unit, addr + 1) : 0;
+	uint8_t hi = info->length > 2 ? imageByte(unit, addr + 2) : 0;
+	uint16_t next = addr + info->length;
+
+	// operands past the image aren't known, interpret from here
+	if (!inImage(unit, addr, info->length))
+	{
+	  fprintf(unit->out, "  state->pc = 0x%04x;\n"
+	          "  goto miss;\n", addr);
+	  return;
+	}
+	fprintf(unit->out, "  state->pc = 0x%04x; // %04x %s\n"
+	        "  cycles += %d + op8080_0x%02x(state, 0x%02x, 0x%02x);\n",
+	        next, addr, info->mnemonic, info->cycles, opcode, lo, hi);
+	if (info->attr & OPA_MEMWRITE)
+	  fprintf(unit->out, "  if (aot->stale)\n"
+	          "\tgoto miss;\n");
+	if (info->attr & OPA_STOP)
+	  fprintf(unit->out, "  reason = stopReason8080(state, %d, &cycles);\n"
+	          "  if (reason != RUN8080_RUNNING)\n"
+	          "\tgoto stop;\n", info->kind);
+	addr = next;
+	if (!(info->attr & OPA_STOP) || i + 1 == block->count)
+	  continue;
+
+	// the rest of the block is a resume point, unless mapUnit gave it
+	// no label or overlapping code has it under another label already
+	if (addr >> 8 != block->start >> 8 || !getBit(unit->entryMap, addr))
+	{
+	  fprintf(unit->out, "  goto miss;\n");
+	  return;
+	}
+	if (getBit(unit->blockMap, addr) || getBit(unit->emitted, addr))
+	{
+	  fprintf(unit->out, "  goto b_%04x;\n", addr);
+	  return;
+	}
+	emitLabel(unit, addr);
+  }
+
+  for (e = block->firstEdge; e < block->firstEdge + block->edgeCount; e++)
+  {
+	uint16_t to = graph->edges[e].to;
+
+	if (to >> 8 == block->start >> 8 && getBit(unit->entryMap, to))
+	  fprintf(unit->out, "  if (state->pc == 0x%04x)\n"
+	          "\tgoto b_%04x;\n", to, to);
+  }
+  fprintf(unit->out, "  goto dispatch;\n");
+}
+
+/*
+ * the blocks starting in one page as one function, so the C compiler
+ * never sees more than a page of code at once
+ * @return index of the first block of the next page
+ */
+static uint32_t emitPage(Unit *unit, uint32_t first)
+{
+  const FlowGraph8080 *graph = unit->graph;
+  int page = graph->blocks[first].start >> 8;
+  uint32_t b, addr;
+
+  fprintf(unit->out,
+          "static StopReason8080 page_%02x(State8080 *state, "
+          "uint64_t cycle_budget,\n"
+          "                              uint64_t *spent)\n"
+          "{\n"
+          "  const Aot8080 *aot = state->aot;\n"
+          "  StopReason8080 reason;\n"
+          "  uint64_t cycles = *spent;\n\n"
+          "  (void)aot;\n"
+          "dispatch:\n"
+          "  if (cycles >= cycle_budget)\n"
+          "\tgoto done;\n"
+          "  switch (state->pc)\n"
+          "  {\n", page);
+  for (addr = page << 8; addr < (uint32_t)(page + 1) << 8; addr++)
+	if (getBit(unit->entryMap, addr))
+	  fprintf(unit->out, "\tcase 0x%04x: goto b_%04x;\n", addr, addr);
+  fprintf(unit->out, "\tdefault: goto miss;\n"
+          "  }\n");
+
+  for (b = first; b < graph->blockCount &&
+	   graph->blocks[b].start >> 8 == page; b++)
+	if (getBit(unit->blockMap, graph->blocks[b].start))
+	  emitBlock(unit, &graph->blocks[b]);
+
+  fprintf(unit->out,
+          "\n"
+          "done:\n"
+          "  reason = RUN8080_BUDGET;\n"
+          "  goto stop;\n"
+          "miss:\n"
+          "  reason = RUN8080_RUNNING;\n"
+          "stop:\n"
+          "  *spent = cycles;\n"
+          "  return reason;\n"
+          "}\n\n");
+  return b;
+}
+
+static void emitUnit(Unit *unit, const char *name)
+{
+  const FlowGraph8080 *graph = unit->graph;
+  size_t i;
+  uint32_t b;
+  int page;
+
+  fprintf(unit->out,
+          "/*\n"
+          " * compiled by recompiler from %s, origin 0x%04x, do not edit.\n"
+          " * build it with the emulator's flags plus -O2 -shared -fPIC\n"
+          " */\n\n"
+          "#include <stdint.h>\n\n"
+          "#include \"emulatorShell.h\"\n"
+          "#include \"ops8080.h\"\n"
+          "#include \"aot8080.h\"\n\n", name, unit->origin);
+
+  fprintf(unit->out, "static const uint8_t image[%zu] = {", unit->size);
+  for (i = 0; i < unit->size; i++)
+	fprintf(unit->out, "%s0x%02x,", i % 12 ? " " : "\n  ", unit->image[i]);
+  fprintf(unit->out, "\n};\n\n");
+  emitMap(unit, "codeMap", unit->codeMap);
+  emitMap(unit, "entryMap", unit->entryMap);
+
+  fprintf(unit->out, "typedef StopReason8080 (*Page)(State8080 *state, "
+          "uint64_t cycle_budget,\n"
+          "                              uint64_t *spent);\n\n");
+  for (b = 0; b < graph->blockCount;)
+	b = emitPage(unit, b);
+
+  fprintf(unit->out, "static const Page pages[256] = {");
+  for (b = 0, page = -1; b < graph->blockCount; b++)
+	if (graph->blocks[b].start >> 8 != page)
+	{
+	  page = graph->blocks[b].start >> 8;
+	  fprintf(unit->out, "\n  [0x%02x] = page_%02x,", page, page);
+	}
+  fprintf(unit->out, "\n};\n\n");
+
+  // pages hand back RUN8080_RUNNING when the pc leaves them
+  fprintf(unit->out,
+          "static RunResult8080 run(State8080 *state, uint64_t cycle_budget)\n"
+          "{\n"
+          "  RunResult8080 result = { 0, RUN8080_RUNNING };\n"
+          "  const Aot8080 *aot = state->aot;\n\n"
+          "  while (!aot->stale && aotBit8080(entryMap, state->pc))\n"
+          "  {\n"
+          "\tresult.reason = pages[state->pc >> 8](state, cycle_budget,\n"
+          "\t                                      &result.cycles);\n"
+          "\tif (result.reason != RUN8080_RUNNING)\n"
+          "\t  break;\n"
+          "  }\n"
+          "  state->cycles += result.cycles;\n"
+          "  return result;\n"
+          "}\n\n"
+          "const AotModule8080 " AOT8080_SYMBOL " = {\n"
+          "  AOT8080_VERSION, sizeof(State8080), 0x%08xu, 0x%04x, %zu,\n"
+          "  image, codeMap, entryMap, run\n"
+          "};\n", FlowImageHash8080(unit->image, unit->size), unit->origin,
+          unit->size);
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-o origin] [-e entry]... [-x index] rom [out.c]\n"
+          "       translates the code reachable from the entries (default\n"
+          "       the origin) into C for a module EnableAot8080 loads,\n"
+          "       with -x the code of the index disassmbler -r -x wrote\n"
+          "       for the rom\n"
+          "       %s -n rom\n"
+          "       prints the file name the module has to have\n",
+          name, name);
+}
+
+int main(int argc, char **argv)
+{
+  static Unit unit;
+  uint16_t entries[MAX_ENTRIES];
+  size_t entryCount = 0;
+  const char *indexPath = NULL;
+  FlowGraph8080 *graph;
+  uint8_t *rom;
+  int opt, printName = 0, ret = 0;
+  long origin = 0;
+
+  while ((opt = getopt(argc, argv, "o:e:x:n")) != -1)
+  {
+	switch (opt)
+	{
+	  case 'o':
+		origin = strtol(optarg, NULL, 0);
+		if (origin < 0 || origin >= ADDRESS_SPACE)
+		{
+		  usage(argv[0]);
+		  return 1;
+		}
+		break;
+	  case 'e':
+		if (entryCount == MAX_ENTRIES)
+		{
+		  usage(argv[0]);
+		  return 1;
+		}
+		entries[entryCount++] = strtol(optarg, NULL, 0);
+		break;
+	  case 'x': indexPath = optarg; break;
+	  case 'n': printName = 1; break;
+	  default:
+		usage(argv[0]);
+		return 1;
+	}
+  }
+  if (optind >= argc || argc - optind > 2 - printName)
+  {
+	usage(argv[0]);
+	return 1;
+  }
+
+  rom = ReadFile8080(argv[optind], &unit.size);
+  if (!rom)
+  {
+	fprintf(stderr, "failed to open %s!\n", argv[optind]);
+	return 1;
+  }
+  if (unit.size > (size_t)ADDRESS_SPACE - origin)
+	unit.size = ADDRESS_SPACE - origin;
+  if (printName)
+  {
+	char name[32];
+
+	AotModuleName8080(name, sizeof(name), rom, unit.size);
+	printf("%s\n", name);
+	free(rom);
+	return 0;
+  }
+
+  graph = OpenFlowGraph8080(indexPath, rom, origin, unit.size,
+                            entryCount ? entries : NULL, entryCount);
+  if (!graph)
+  {
+	fprintf(stderr, "out of memory!\n");
+	free(rom);
+	return 1;
+  }
+  unit.image = rom;
+  unit.origin = origin;
+  unit.graph = graph;
+  unit.out = optind + 1 < argc ? fopen(argv[optind + 1], "w") : stdout;
+  if (!unit.out)
+  {
+	fprintf(stderr, "failed to open %s!\n", argv[optind + 1]);
+	ret = 1;
+  }
+  else
+  {
+	mapUnit(&unit);
+	emitUnit(&unit, argv[optind]);
+	if (unit.out != stdout ? fclose(unit.out) : fflush(stdout))
+	{
+	  fprintf(stderr, "failed to write the output!\n");
+	  ret = 1;
+	}
+  }
+
+  FreeFlowGraph8080(graph);
+  free(rom);
+  return ret;
+}
@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "emulatorShell.h"
+#include "flags8080.h"
+#include "memory8080.h"
+#include "blockCache8080.h"
+#include "jit8080.h"
+#include "aot8080.h"
+#include "test8080.h"
+
+/*
+ * every group of checks, in the order they run
+ */
+static const struct {
+	const char *name; // for -k
+	void (*check)(const TestOptions8080 *options);
+}groups[] = {
+  { "core", checkCore8080 },
+  { "flags", checkFlags8080 },
+  { "run", checkRun8080 },
+  { "tiers", checkTiers8080 },
+  { "batch", checkBatch8080 },
+  { "lockstep", checkLockstep8080 },
+  { "memory", checkMemory8080 },
+  { "bus", checkBus8080 },
+  { "savestate", checkSaveState8080 },
+  { "disassembler", checkDisassembler8080 },
+  { "flowgraph", checkFlowGraph8080 },
+  { "profile", checkProfile8080 },
+  { "trace", checkTrace8080 },
+  { "scheduler", checkScheduler8080 },
+  { "validate", checkValidate8080 },
+  { "fuzz", checkFuzz8080 },
+  { "aot", checkAot8080 },
+  { "video", checkVideo8080 },
+  { "debug", checkDebug8080 },
+  { "gdb", checkGdb8080 },
+  { "explore", checkExplore8080 },
+};
+
+static int failures;
+
+/*
+ * count a mismatch of a check
+ * @return 1 while it is one of the first few, to be printed
+ */
+int mismatch8080(int *bad)
+{
+  failures++;
+  return ++*bad <= TEST8080_REPORTS;
+}
+
+void report8080(const char *name, int bad, uint64_t cases)
+{
+  printf("%-24s %s, %llu cases", name, bad ? "FAILED" : "ok",
+         (unsigned long long)cases);
+  if (bad)
+	printf(", %d bad", bad);
+  printf("\n");
+}
+
+/*
+ * xorshift, the same roms on every run
+ */
+uint32_t nextRandom8080(uint32_t *seed)
+{
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return *seed;
+}
+
+/*
+ * random bytes without HLT, so the runs last
+ * @param n which of the roms, the same bytes for the same n
+ */
+void makeRom8080(uint8_t *rom, int n)
+{
+  uint32_t seed = 0x8080 + n * 0x10001;
+  int i;
+
+  for (i = 0; i < TEST8080_ROM_SIZE; i++)
+  {
+	rom[i] = nextRandom8080(&seed);
+	if (rom[i] == 0x76)
+	  rom[i] = 0;
+  }
+}
+
+void loadMachine8080(State8080 *state, const uint8_t *code, size_t size)
+{
+  memset(state, 0, sizeof(State8080));
+  InitMemory8080(state);
+  LoadMemory8080(state, 0, code, size);
+}
+
+void freeMachine8080(State8080 *state)
+{
+  DisableAot8080(state);
+  DisableJit8080(state);
+  DisableBlockCache8080(state);
+  FreeMemory8080(state);
+}
+
+void snapshot8080(Snapshot8080 *snap, const State8080 *state)
+{
+  snap->a = state->a;
+  snap->b = state->b;
+  snap->c = state->c;
+  snap->d = state->d;
+  snap->e = state->e;
+  snap->h = state->h;
+  snap->l = state->l;
+  snap->psw = peekFlags8080(state);
+  snap->sp = state->sp;
+  snap->pc = state->pc;
+  snap->int_enable = state->int_enable;
+  snap->halted = state->halted;
+  snap->cycles = state->cycles;
+  snap->memory = MemoryHash8080(state);
+}
+
+int sameSnapshot8080(const Snapshot8080 *x, const Snapshot8080 *y)
+{
+  return x->a == y->a && x->b == y->b && x->c == y->c && x->d == y->d &&
+         x->e == y->e && x->h == y->h && x->l == y->l && x->psw == y->psw &&
+         x->sp == y->sp && x->pc == y->pc && x->int_enable == y->int_enable &&
+         x->halted == y->halted && x->cycles == y->cycles &&
+         x->memory == y->memory;
+}
+
+void printSnapshot8080(const char *label, const Snapshot8080 *snap)
+{
+  printf("  %-10s a=%02x b=%02x c=%02x d=%02x e=%02x h=%02x l=%02x "
+         "psw=%02x sp=%04x pc=%04x ie=%d halted=%d cycles=%llu "
+         "memory=%016llx\n", label, snap->a, snap->b, snap->c, snap->d,
+         snap->e, snap->h, snap->l, snap->psw, snap->sp, snap->pc,
+         snap->int_enable, snap->halted, (unsigned long long)snap->cycles,
+         (unsigned long long)snap->memory);
+}
+
+/*
+ * run a machine in slices until the cycles are spent or it halts,
+ * IN reads a value made from the port and the cycle count
+ */
+void runMachine8080(State8080 *state,
+                    RunResult8080 (*run)(State8080 *state, uint64_t budget),
+                    uint64_t cycles)
+{
+  uint64_t end = state->cycles + cycles;
+
+  while (state->cycles < end)
+  {
+	uint64_t budget = end - state->cycles;
+	RunResult8080 result = run(state, budget < TEST8080_SLICE ?
+	                           budget : TEST8080_SLICE);
+
+	if (result.reason == RUN8080_HALT)
+	  break;
+	if (result.reason == RUN8080_IN)
+	  state->a = state->ioPort * 7 + (uint8_t)state->cycles;
+  }
+}
+
+/*
+ * write the random roms, for make aot
+ */
+static int writeRoms(const char *dir)
+{
+  static uint8_t rom[TEST8080_ROM_SIZE];
+  char path[4096];
+  int n;
+
+  for (n = 0; n < TEST8080_ROM_COUNT; n++)
+  {
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s/rom%d.bin", dir, n);
+	makeRom8080(rom, n);
+	file = fopen(path, "wb");
+	if (!file || fwrite(rom, 1, sizeof(rom), file) != sizeof(rom))
+	{
+	  printf("failed to write %s!\n", path);
+	  if (file)
+		fclose(file);
+	  return 1;
+	}
+	fclose(file);
+  }
+  return 0;
+}
+
+static void usage(const char *name)
+{
+  size_t g;
+
+  fprintf(stderr,
+          "usage: %s [-A aot module directory] [-w scratch directory]\n"
+          "       [-d disassembler binary] [-k group]...\n"
+          "       %s -g directory\n"
+          "       runs the checks of every group, or of the -k groups.\n"
+          "       -g writes the random roms for make aot. groups:",
+          name, name);
+  for (g = 0; g < sizeof(groups) / sizeof(groups[0]); g++)
+	fprintf(stderr, " %s", groups[g].name);
+  fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+  TestOptions8080 options = { NULL, ".", NULL };
+  const char *romDir = NULL;
+  const char *picked[sizeof(groups) / sizeof(groups[0])];
+  size_t g, k, pickCount = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "A:w:d:g:k:")) != -1)
+  {
+	switch (opt)
+	{
+	  case 'A': options.aotDir = optarg; break;
+	  case 'w': options.workDir = optarg; break;
+	  case 'd': options.disassembler = optarg; break;
+	  case 'g': romDir = optarg; break;
+	  case 'k':
+		if (pickCount < sizeof(picked) / sizeof(picked[0]))
+		{
+		  picked[pickCount++] = optarg;
+		  break;
+		}
+		// fall through
+	  default:
+		usage(argv[0]);
+		return 1;
+	}
+  }
+  if (optind != argc)
+  {
+	usage(argv[0]);
+	return 1;
+  }
+  if (romDir)
+	return writeRoms(romDir);
+
+  for (k = 0; k < pickCount; k++)
+  {
+	for (g = 0; g < sizeof(groups) / sizeof(groups[0]); g++)
+	  if (!strcmp(picked[k], groups[g].name))
+		break;
+	if (g == sizeof(groups) / sizeof(groups[0]))
+	{
+	  usage(argv[0]);
+	  return 1;
+	}
+  }
+  for (g = 0; g < sizeof(groups) / sizeof(groups[0]); g++)
+  {
+	for (k = 0; k < pickCount; k++)
+	  if (!strcmp(picked[k], groups[g].name))
+		break;
+	if (!pickCount || k < pickCount)
+	  groups[g].check(&options);
+  }
+  if (failures)
+  {
+	printf("%d failures\n", failures);
+	return 1;
+  }
+  printf("all passed\n");
+  return 0;
+}
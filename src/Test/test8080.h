@@ -0,0 +1,77 @@
+#ifndef TEST_8080_H
+#define TEST_8080_H
+
+/*
+ * test8080.h
+ * make test. every feature has its checks in a file of its own,
+ * src/Test/test<Feature>8080.c, run in order by test8080.c. a check
+ * prints one line with report8080, and the first few mismatches
+ * before it.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emulatorShell.h"
+
+#define TEST8080_ROM_SIZE 4096
+#define TEST8080_ROM_COUNT 8 // random roms, rom0.bin ... with -g
+#define TEST8080_SLICE 10007 // odd, so budgets end in the middle of blocks
+#define TEST8080_REPORTS 8 // mismatches printed per check
+
+/*
+ * the command line of test8080
+ */
+typedef struct TestOptions8080 {
+	const char *aotDir; // modules of the random roms, NULL skips them
+	const char *workDir; // scratch files
+	const char *disassembler; // disassmbler binary, NULL skips it
+}TestOptions8080;
+
+/*
+ * what two machines have to agree on
+ */
+typedef struct Snapshot8080 {
+	uint8_t a, b, c, d, e, h, l, psw;
+	uint16_t sp, pc;
+	uint8_t int_enable, halted;
+	uint64_t cycles;
+	uint64_t memory; // MemoryHash8080
+}Snapshot8080;
+
+int mismatch8080(int *bad);
+void report8080(const char *name, int bad, uint64_t cases);
+uint32_t nextRandom8080(uint32_t *seed);
+void makeRom8080(uint8_t *rom, int n);
+void loadMachine8080(State8080 *state, const uint8_t *code, size_t size);
+void freeMachine8080(State8080 *state);
+void snapshot8080(Snapshot8080 *snap, const State8080 *state);
+int sameSnapshot8080(const Snapshot8080 *x, const Snapshot8080 *y);
+void printSnapshot8080(const char *label, const Snapshot8080 *snap);
+void runMachine8080(State8080 *state,
+                    RunResult8080 (*run)(State8080 *state, uint64_t budget),
+                    uint64_t cycles);
+
+void checkCore8080(const TestOptions8080 *options);
+void checkFlags8080(const TestOptions8080 *options);
+void checkRun8080(const TestOptions8080 *options);
+void checkTiers8080(const TestOptions8080 *options);
+void checkBatch8080(const TestOptions8080 *options);
+void checkLockstep8080(const TestOptions8080 *options);
+void checkMemory8080(const TestOptions8080 *options);
+void checkBus8080(const TestOptions8080 *options);
+void checkSaveState8080(const TestOptions8080 *options);
+void checkDisassembler8080(const TestOptions8080 *options);
+void checkFlowGraph8080(const TestOptions8080 *options);
+void checkProfile8080(const TestOptions8080 *options);
+void checkTrace8080(const TestOptions8080 *options);
+void checkScheduler8080(const TestOptions8080 *options);
+void checkValidate8080(const TestOptions8080 *options);
+void checkFuzz8080(const TestOptions8080 *options);
+void checkAot8080(const TestOptions8080 *options);
+void checkVideo8080(const TestOptions8080 *options);
+void checkDebug8080(const TestOptions8080 *options);
+void checkGdb8080(const TestOptions8080 *options);
+void checkExplore8080(const TestOptions8080 *options);
+
+#endif
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "aot8080.h"
+#include "test8080.h"
+
+#define RUN_CYCLES 500000 // machine states before and after the change
+
+typedef enum Change {
+  CHANGE_STORE, // a store into compiled code while running
+  CHANGE_RESTORE // a restore to a snapshot with other code
+}Change;
+
+/*
+ * the last instruction byte of the module
+ * @return its address, -1 when the module of the rom doesn't load
+ */
+static int findCode(const TestOptions8080 *options, const uint8_t *rom)
+{
+  State8080 state;
+  int addr = -1;
+
+  loadMachine8080(&state, rom, TEST8080_ROM_SIZE);
+  if (!EnableAot8080(&state, options->aotDir, rom, 0, TEST8080_ROM_SIZE))
+	for (addr = TEST8080_ROM_SIZE - 1; addr >= 0 &&
+	     !aotBit8080(state.aot->module->codeMap, addr); addr--)
+	  ;
+  freeMachine8080(&state);
+  return addr;
+}
+
+/*
+ * run a rom, change a byte of its code, run on
+ * @param aot run on the module, else on the interpreter
+ * @return 0 when it ran and the module was dropped
+ */
+static int runChanged(Snapshot8080 *snap, const TestOptions8080 *options,
+                      const uint8_t *rom, int addr, Change change, int aot)
+{
+  State8080 state, saved;
+  int dropped = !aot;
+
+  loadMachine8080(&state, rom, TEST8080_ROM_SIZE);
+  if (aot && EnableAot8080(&state, options->aotDir, rom, 0,
+                           TEST8080_ROM_SIZE))
+  {
+	freeMachine8080(&state);
+	return -1;
+  }
+  if (change == CHANGE_RESTORE)
+  {
+	Fork8080(&state, &saved);
+	writeMemory8080(&saved, addr, rom[addr] ^ 1);
+  }
+  runMachine8080(&state, aot ? RunAot8080 : Run8080, RUN_CYCLES);
+  if (change == CHANGE_RESTORE)
+  {
+	Restore8080(&state, &saved);
+	FreeMemory8080(&saved);
+  }
+  else
+	writeMemory8080(&state, addr, rom[addr] ^ 1);
+  runMachine8080(&state, aot ? RunAot8080 : Run8080, RUN_CYCLES);
+  snapshot8080(snap, &state);
+  if (aot)
+	dropped = state.aot->disabled;
+  freeMachine8080(&state);
+  return dropped ? 0 : -1;
+}
+
+/*
+ * a module changed under, by a store or by a restore, is dropped
+ * and the machine goes on interpreted, as if it had been all along
+ */
+static void checkChanged(const TestOptions8080 *options, Change change,
+                         const char *name)
+{
+  static uint8_t rom[TEST8080_ROM_SIZE];
+  int n, bad = 0;
+
+  for (n = 0; n < TEST8080_ROM_COUNT; n++)
+  {
+	Snapshot8080 want, got;
+	int addr;
+
+	makeRom8080(rom, n);
+	addr = findCode(options, rom);
+	if (addr < 0)
+	{
+	  if (mismatch8080(&bad))
+		printf("  rom%d: no module or no code to patch\n", n);
+	  continue;
+	}
+	runChanged(&want, options, rom, addr, change, 0);
+	if (runChanged(&got, options, rom, addr, change, 1))
+	{
+	  if (mismatch8080(&bad))
+		printf("  rom%d: the module outlived the change at %04x\n", n, addr);
+	}
+	else if (!sameSnapshot8080(&want, &got) && mismatch8080(&bad))
+	{
+	  printf("  rom%d, changed at %04x:\n", n, addr);
+	  printSnapshot8080("interp", &want);
+	  printSnapshot8080("aot", &got);
+	}
+  }
+  report8080(name, bad, TEST8080_ROM_COUNT);
+}
+
+/*
+ * a page holding compiled code, copied by a store next to the code
+ * and swapped back by a restore with the same bytes, keeps the
+ * module, and the machine runs on as the interpreter's does
+ */
+static void checkRestored(const TestOptions8080 *options)
+{
+  static uint8_t rom[TEST8080_ROM_SIZE];
+  int n, bad = 0;
+
+  for (n = 0; n < TEST8080_ROM_COUNT; n++)
+  {
+	Snapshot8080 want, got;
+	int aot, addr = -1, dropped = 0;
+
+	makeRom8080(rom, n);
+	if (findCode(options, rom) >= 0)
+	{
+	  State8080 state;
+	  const uint8_t *codeMap;
+
+	  // a data byte in a page whose first byte is code
+	  loadMachine8080(&state, rom, TEST8080_ROM_SIZE);
+	  EnableAot8080(&state, options->aotDir, rom, 0, TEST8080_ROM_SIZE);
+	  codeMap = state.aot->module->codeMap;
+	  for (addr = 0; addr < TEST8080_ROM_SIZE; addr++)
+		if (aotBit8080(codeMap, addr & 0xff00) && !aotBit8080(codeMap, addr))
+		  break;
+	  freeMachine8080(&state);
+	}
+	if (addr < 0 || addr == TEST8080_ROM_SIZE)
+	{
+	  if (mismatch8080(&bad))
+		printf("  rom%d: no module or no data next to code\n", n);
+	  continue;
+	}
+	// the interpreter stops on the block boundary the module ran to
+	for (aot = 1; aot >= 0; aot--)
+	{
+	  State8080 state, pristine;
+
+	  loadMachine8080(&state, rom, TEST8080_ROM_SIZE);
+	  if (aot)
+		EnableAot8080(&state, options->aotDir, rom, 0, TEST8080_ROM_SIZE);
+	  Fork8080(&state, &pristine);
+	  writeMemory8080(&state, addr, rom[addr] ^ 1);
+	  Restore8080(&state, &pristine);
+	  FreeMemory8080(&pristine);
+	  if (aot)
+	  {
+		// one slice checks the pages, a store of its own only counts
+		// on the next
+		RunAot8080(&state, 1);
+		dropped = state.aot->disabled;
+	  }
+	  if (aot)
+		runMachine8080(&state, RunAot8080, RUN_CYCLES);
+	  else
+		runMachine8080(&state, Run8080, got.cycles - state.cycles);
+	  snapshot8080(aot ? &got : &want, &state);
+	  freeMachine8080(&state);
+	}
+	if (dropped)
+	{
+	  if (mismatch8080(&bad))
+		printf("  rom%d: restoring the page at %04x dropped the module\n", n,
+		       addr);
+	}
+	else if (!sameSnapshot8080(&want, &got) && mismatch8080(&bad))
+	{
+	  printf("  rom%d, restored at %04x:\n", n, addr);
+	  printSnapshot8080("interp", &want);
+	  printSnapshot8080("aot", &got);
+	}
+  }
+  report8080("aot restore of data", bad, TEST8080_ROM_COUNT);
+}
+
+/*
+ * a module doesn't load for other bytes, another origin, or memory
+ * that no longer holds its code
+ */
+static void checkRefused(const TestOptions8080 *options)
+{
+  static uint8_t rom[TEST8080_ROM_SIZE];
+  State8080 state;
+  int addr, bad = 0;
+
+  makeRom8080(rom, 0);
+  addr = findCode(options, rom);
+  if (addr < 0)
+  {
+	printf("no module for rom0!\n");
+	mismatch8080(&bad);
+	report8080("aot refused", bad, 0);
+	return;
+  }
+  loadMachine8080(&state, rom, TEST8080_ROM_SIZE);
+  if (!EnableAot8080(&state, options->aotDir, rom, 0x100, TEST8080_ROM_SIZE) &&
+	  mismatch8080(&bad))
+	printf("  loaded for another origin\n");
+  DisableAot8080(&state);
+  writeMemory8080(&state, addr, rom[addr] ^ 1);
+  if (!EnableAot8080(&state, options->aotDir, rom, 0, TEST8080_ROM_SIZE) &&
+	  mismatch8080(&bad))
+	printf("  loaded over other code at %04x\n", addr);
+  DisableAot8080(&state);
+  rom[addr] ^= 1;
+  if (!EnableAot8080(&state, options->aotDir, rom, 0, TEST8080_ROM_SIZE) &&
+	  mismatch8080(&bad))
+	printf("  loaded for other bytes\n");
+  freeMachine8080(&state);
+  report8080("aot refused", bad, 3);
+}
+
+/*
+ * the modules are compiled for the random roms by make test into
+ * options->aotDir
+ */
+void checkAot8080(const TestOptions8080 *options)
+{
+  if (!options->aotDir)
+  {
+	printf("%-24s skipped, no -A\n", "aot");
+	return;
+  }
+  checkChanged(options, CHANGE_STORE, "aot store into code");
+  checkChanged(options, CHANGE_RESTORE, "aot restore of code");
+  checkRestored(options);
+  checkRefused(options);
+}
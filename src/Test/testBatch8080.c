@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "batch8080.h"
+#include "test8080.h"
+
+#define BATCH_JOBS 24
+#define BATCH_SLICE 5000 // short, so jobs go round the workers many times
+
+/*
+ * B times: C = 255 - 8n times: A = A + 1 + C, stored at HL++,
+ * CALL to INR E; then HLT. B is set per job.
+ */
+static const uint8_t counting[] = {
+  0x31, 0x00, 0xf0, // LXI SP,f000
+  0x21, 0x00, 0x20, // LXI H,2000
+  0x0e, 0x00, // 0006: MVI C,patched
+  0x3c, 0x81, 0x77, 0x23, // 0008: INR A  ADD C  MOV M,A  INX H
+  0xcd, 0x20, 0x00, // CALL 0020
+  0x0d, 0xc2, 0x08, 0x00, // DCR C  JNZ 0008
+  0x05, 0xc2, 0x06, 0x00, // DCR B  JNZ 0006
+  0x76, 0, 0, 0, 0, 0, 0, 0, 0, // HLT
+  0x1c, 0xc9 // 0020: INR E  RET
+};
+
+/*
+ * job n of the batch: its own counts, every other one stopped by
+ * maxCycles before it halts
+ */
+static void makeJob(BatchJob8080 *job, uint8_t *rom, int n, int limited)
+{
+  memcpy(rom, counting, sizeof(counting));
+  rom[7] = 255 - 8 * n;
+  memset(job, 0, sizeof(BatchJob8080));
+  job->rom = rom;
+  job->romSize = sizeof(counting);
+  job->initial.b = 1 + n % 5;
+  job->maxCycles = limited && (n & 1) ? 3000 + 997 * n : 0;
+}
+
+/*
+ * the job run alone through Run8080
+ */
+static StopReason8080 runAlone(const BatchJob8080 *job, Snapshot8080 *snap)
+{
+  uint64_t limit = job->maxCycles ? job->maxCycles : UINT64_MAX;
+  StopReason8080 reason = RUN8080_BUDGET;
+  State8080 state;
+
+  loadMachine8080(&state, job->rom, job->romSize);
+  state.b = job->initial.b;
+  while (state.cycles < limit)
+	if (Run8080(&state, limit - state.cycles).reason == RUN8080_HALT)
+	{
+	  reason = RUN8080_HALT;
+	  break;
+	}
+  snapshot8080(snap, &state);
+  freeMachine8080(&state);
+  return reason;
+}
+
+/*
+ * a batch on a few workers with short slices ends every job where
+ * running it alone does. tiers that overshoot their budget only
+ * run jobs to HLT.
+ */
+static void checkBatch(const char *name, ExecTier8080 tier, int threads,
+                       int exact)
+{
+  static uint8_t roms[BATCH_JOBS][sizeof(counting)];
+  BatchOptions8080 options;
+  BatchJob8080 jobs[BATCH_JOBS];
+  int n, bad = 0;
+
+  memset(&options, 0, sizeof(options));
+  options.threads = threads;
+  options.sliceCycles = BATCH_SLICE;
+  options.tier = tier;
+  options.keepMemory = 1;
+  for (n = 0; n < BATCH_JOBS; n++)
+	makeJob(&jobs[n], roms[n], n, exact);
+  if (RunBatch8080(jobs, BATCH_JOBS, &options) && mismatch8080(&bad))
+	printf("  %s: batch failed\n", name);
+
+  for (n = 0; n < BATCH_JOBS; n++)
+  {
+	Snapshot8080 want, got;
+	StopReason8080 reason = runAlone(&jobs[n], &want);
+
+	snapshot8080(&got, &jobs[n].final);
+	FreeMemory8080(&jobs[n].final);
+	if ((jobs[n].error || jobs[n].reason != reason ||
+	     jobs[n].cycles != jobs[n].final.cycles ||
+	     !sameSnapshot8080(&want, &got)) && mismatch8080(&bad))
+	{
+	  printf("  %s job %d: error %d, reason %d, expected %d\n", name, n,
+	         jobs[n].error, jobs[n].reason, reason);
+	  printSnapshot8080("alone", &want);
+	  printSnapshot8080("batch", &got);
+	}
+  }
+  report8080(name, bad, BATCH_JOBS);
+}
+
+void checkBatch8080(const TestOptions8080 *options)
+{
+  (void)options;
+  checkBatch("batch interp", TIER_INTERPRETER, 3, 1);
+  checkBatch("batch blocks", TIER_BLOCKS, 4, 1);
+  checkBatch("batch jit", TIER_JIT, 5, 0);
+  checkBatch("batch lockstep", TIER_LOCKSTEP, 3, 1);
+  checkBatch("batch one thread", TIER_INTERPRETER, 1, 1);
+}
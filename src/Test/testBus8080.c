@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "bus8080.h"
+#include "trace8080.h"
+#include "test8080.h"
+
+#define RAM 0x4000 // a memory page
+#define RAM_MIRROR 0x8000 // shows it
+#define DEVICE 0x1000 // a device page
+#define DEVICE_MIRROR 0x9000 // shows it
+
+// MVI A,5; STA 8010; MVI A,6; STA 9020; HLT
+static const uint8_t mirrorStores[] = {
+  0x3e, 0x05, 0x32, 0x10, 0x80, 0x3e, 0x06, 0x32, 0x20, 0x90, 0x76 };
+
+/*
+ * a device that is a page of memory and remembers where it was
+ * last read or written
+ */
+typedef struct Device {
+	uint8_t data[PAGE8080_SIZE];
+	uint16_t last;
+	int writes;
+}Device;
+
+static uint8_t deviceRead(void *opaque, uint16_t addr)
+{
+  Device *device = opaque;
+
+  device->last = addr;
+  return device->data[addr & (PAGE8080_SIZE - 1)];
+}
+
+static void deviceWrite(void *opaque, uint16_t addr, uint8_t value)
+{
+  Device *device = opaque;
+
+  device->last = addr;
+  device->data[addr & (PAGE8080_SIZE - 1)] = value;
+  device->writes++;
+}
+
+static void makeBus(Bus8080 *bus, Device *device)
+{
+  memset(device, 0, sizeof(Device));
+  InitBus8080(bus);
+  MapDevice8080(bus, DEVICE, PAGE8080_SIZE, deviceRead, deviceWrite, device);
+  MapMirror8080(bus, RAM_MIRROR, PAGE8080_SIZE, RAM);
+  MapMirror8080(bus, DEVICE_MIRROR, PAGE8080_SIZE, DEVICE);
+}
+
+static void expectByte(int *bad, const char *what, uint8_t got, uint8_t want)
+{
+  if (got != want && mismatch8080(bad))
+	printf("  %s: %02x, expected %02x\n", what, got, want);
+}
+
+/*
+ * reads and writes of a mirror and of the page it shows see the same
+ * bytes, for memory and for devices, and a device hears the address
+ * it was mapped at
+ */
+static void checkMirrors(void)
+{
+  State8080 state;
+  Device device;
+  Bus8080 bus;
+  int bad = 0;
+
+  makeBus(&bus, &device);
+  loadMachine8080(&state, NULL, 0);
+  AttachBus8080(&state, &bus);
+
+  writeMemory8080(&state, RAM_MIRROR + 5, 0x11);
+  expectByte(&bad, "ram through the mirror", readMemory8080(&state, RAM + 5),
+             0x11);
+  writeMemory8080(&state, RAM + 6, 0x22);
+  expectByte(&bad, "mirror of ram", readMemory8080(&state, RAM_MIRROR + 6),
+             0x22);
+
+  writeMemory8080(&state, DEVICE_MIRROR + 7, 0x33);
+  expectByte(&bad, "device through the mirror", device.data[7], 0x33);
+  if (device.last != DEVICE + 7 && mismatch8080(&bad))
+	printf("  device written at %04x\n", device.last);
+  device.data[8] = 0x44;
+  expectByte(&bad, "mirror of the device",
+             readMemory8080(&state, DEVICE_MIRROR + 8), 0x44);
+  if (device.last != DEVICE + 8 && mismatch8080(&bad))
+	printf("  device read at %04x\n", device.last);
+  expectByte(&bad, "device page", readMemory8080(&state, DEVICE + 7), 0x33);
+
+  FreeMemory8080(&state);
+  report8080("bus mirrors", bad, 6);
+}
+
+/*
+ * a traced store through a mirror is recorded once, at the address
+ * the instruction stored to
+ */
+static void checkTracedMirror(const TestOptions8080 *options)
+{
+  TraceReader8080 *reader;
+  TraceEvent8080 event;
+  State8080 state;
+  Device device;
+  Bus8080 bus;
+  char path[4096];
+  int bad = 0;
+
+  snprintf(path, sizeof(path), "%s/bus.trace", options->workDir);
+  makeBus(&bus, &device);
+  loadMachine8080(&state, mirrorStores, sizeof(mirrorStores));
+  AttachBus8080(&state, &bus);
+  if (EnableTrace8080(&state, path, TRACE8080_KEY_INTERVAL))
+  {
+	printf("can't record %s!\n", path);
+	mismatch8080(&bad);
+	FreeMemory8080(&state);
+	report8080("bus traced mirror", bad, 2);
+	return;
+  }
+  while (!state.halted)
+	state.cycles += Emulate8080Op(&state);
+  if (DisableTrace8080(&state))
+	mismatch8080(&bad);
+  FreeMemory8080(&state);
+  expectByte(&bad, "device store", device.data[0x20], 6);
+
+  reader = OpenTrace8080(path);
+  if (!reader)
+  {
+	printf("can't open %s!\n", path);
+	mismatch8080(&bad);
+	report8080("bus traced mirror", bad, 2);
+	return;
+  }
+  loadMachine8080(&state, NULL, 0);
+  while (NextTrace8080(reader, &state, &event) > 0)
+  {
+	uint16_t want = event.pc == 2 ? RAM_MIRROR + 0x10 : DEVICE_MIRROR + 0x20;
+
+	if (event.opcode != 0x32)
+	  continue;
+	if ((event.writeCount != 1 || event.writeAddr[0] != want) &&
+		mismatch8080(&bad))
+	  printf("  STA at %04x: %d stores, the first at %04x\n", event.pc,
+	         event.writeCount, event.writeAddr[0]);
+  }
+  CloseTrace8080(reader);
+  FreeMemory8080(&state);
+  unlink(path);
+  report8080("bus traced mirror", bad, 2);
+}
+
+void checkBus8080(const TestOptions8080 *options)
+{
+  checkMirrors();
+  checkTracedMirror(options);
+}
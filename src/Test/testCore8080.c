@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "opcodes8080.h"
+#include "flags8080.h"
+#include "memory8080.h"
+#include "test8080.h"
+
+#define CORE_PC 0x4000 // where the instruction under test sits
+#define CORE_SP 0x8000
+#define CORE_TARGET 0x1234 // its address operand
+#define CORE_RETURN 0x5678 // on the stack
+#define CORE_HL 0x5566
+
+static void setupMachine(State8080 *state, uint8_t opcode, uint8_t psw)
+{
+  memset(state, 0, sizeof(State8080));
+  InitMemory8080(state);
+  writeMemory8080(state, CORE_PC, opcode);
+  writeMemory8080(state, CORE_PC + 1, CORE_TARGET & 0xff);
+  writeMemory8080(state, CORE_PC + 2, CORE_TARGET >> 8);
+  writeMemory8080(state, CORE_SP, CORE_RETURN & 0xff);
+  writeMemory8080(state, CORE_SP + 1, CORE_RETURN >> 8);
+  state->a = 0x77;
+  state->b = 0x11;
+  state->c = 0x22;
+  state->d = 0x33;
+  state->e = 0x44;
+  state->h = CORE_HL >> 8;
+  state->l = CORE_HL & 0xff;
+  state->sp = CORE_SP;
+  state->pc = CORE_PC;
+  writeFlags8080(state, psw);
+}
+
+/*
+ * where the instruction has to leave pc, and the machine states it
+ * has to take, from its opcode table entry
+ * @param set all flags set, else all clear
+ */
+static uint16_t expectedPc(uint8_t opcode, int set, int *cycles)
+{
+  const OpcodeInfo8080 *info = &opcodeTable8080[opcode];
+  // NZ Z NC C PO PE P M, the odd ones hold with every flag set
+  int taken = ((opcode >> 3) & 1) == set;
+  uint16_t next = CORE_PC + info->length;
+
+  *cycles = info->cycles;
+  switch (info->kind)
+  {
+	case OPK_JMP:
+	case OPK_CALL:
+	  return CORE_TARGET;
+	case OPK_JCC:
+	  return taken ? CORE_TARGET : next;
+	case OPK_CCC:
+	  *cycles = taken ? info->cyclesTaken : info->cycles;
+	  return taken ? CORE_TARGET : next;
+	case OPK_RET:
+	  return CORE_RETURN;
+	case OPK_RCC:
+	  *cycles = taken ? info->cyclesTaken : info->cycles;
+	  return taken ? CORE_RETURN : next;
+	case OPK_RST:
+	  return opcode & 0x38;
+	case OPK_PCHL:
+	  return CORE_HL;
+	default:
+	  return next;
+  }
+}
+
+/*
+ * every opcode steps by the length and machine states of its table
+ * entry, only changes the flags the entry says it writes, and runs
+ * the same through Emulate8080Op and Run8080
+ */
+void checkCore8080(const TestOptions8080 *options)
+{
+  uint64_t cases = 0;
+  int opcode, set, bad = 0;
+
+  (void)options;
+  for (opcode = 0; opcode < 256; opcode++)
+	for (set = 0; set < 2; set++)
+	{
+	  const OpcodeInfo8080 *info = &opcodeTable8080[opcode];
+	  uint8_t psw = set ? FLAGS_DEFINED : FLAGS_FIXED;
+	  Snapshot8080 stepped, ran;
+	  State8080 state;
+	  int cycles, want;
+	  uint16_t pc = expectedPc(opcode, set, &want);
+
+	  setupMachine(&state, opcode, psw);
+	  cycles = Emulate8080Op(&state);
+	  state.cycles += cycles;
+	  cases++;
+	  if ((state.pc != pc || cycles != want) && mismatch8080(&bad))
+		printf("  %02x %-4s psw=%02x: pc=%04x %d states, expected pc=%04x "
+		       "%d states\n", opcode, info->mnemonic, psw, state.pc, cycles,
+		       pc, want);
+	  if (((peekFlags8080(&state) ^ psw) & ~info->flagsWritten) &&
+		  mismatch8080(&bad))
+		printf("  %02x %-4s psw=%02x: psw=%02x, writes only %02x\n", opcode,
+		       info->mnemonic, psw, peekFlags8080(&state), info->flagsWritten);
+	  snapshot8080(&stepped, &state);
+	  FreeMemory8080(&state);
+
+	  setupMachine(&state, opcode, psw);
+	  Run8080(&state, 1);
+	  snapshot8080(&ran, &state);
+	  FreeMemory8080(&state);
+	  if (!sameSnapshot8080(&stepped, &ran) && mismatch8080(&bad))
+	  {
+		printf("  %02x %-4s psw=%02x:\n", opcode, info->mnemonic, psw);
+		printSnapshot8080("stepped", &stepped);
+		printSnapshot8080("run", &ran);
+	  }
+	}
+  report8080("opcode table", bad, cases);
+}
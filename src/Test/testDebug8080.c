@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "jit8080.h"
+#include "debug8080.h"
+#include "test8080.h"
+
+#define WARM_CYCLES 100000 // states the JIT runs before the steps
+#define STEPS 256
+
+// MVI A,5; STA 2000h; JMP 0
+static const uint8_t watchProg[] = {
+  0x3e, 0x05, 0x32, 0x00, 0x20, 0xc3, 0x00, 0x00 };
+
+// LXI SP,F000; LXI H,2000; INR A; INR B; DCR C; INR L; MOV M,A;
+// ADD B; PUSH B; POP B; JNZ 0006; JMP 0003
+static const uint8_t loopProg[] = {
+  0x31, 0x00, 0xf0, 0x21, 0x00, 0x20, 0x3c, 0x04, 0x0d, 0x2c, 0x77, 0x80,
+  0xc5, 0xc1, 0xc2, 0x06, 0x00, 0xc3, 0x03, 0x00 };
+
+/*
+ * a store that hits a watchpoint stops the run even when it is the
+ * instruction that spends the budget
+ */
+static void checkWatchBudget(void)
+{
+  uint64_t budget;
+  int bad = 0;
+
+  // MVI takes 7 states, STA 13 more
+  for (budget = 8; budget <= 20; budget++)
+  {
+	RunResult8080 result;
+	State8080 state;
+
+	loadMachine8080(&state, watchProg, sizeof(watchProg));
+	if (EnableDebug8080(&state, Run8080) ||
+		SetWatchpoint8080(&state, 0x2000))
+	{
+	  if (mismatch8080(&bad))
+		printf("  can't watch 2000\n");
+	  DisableDebug8080(&state);
+	  freeMachine8080(&state);
+	  continue;
+	}
+	result = RunDebug8080(&state, budget);
+	if ((result.reason != RUN8080_BREAK || result.cycles != 20 ||
+	     state.pc != 5 || state.debug->hit != DEBUG8080_WATCHPOINT ||
+	     state.debug->hitAddr != 0x2000) && mismatch8080(&bad))
+	  printf("  budget %llu: reason %d, %llu states, pc=%04x, hit %d at "
+	         "%04x\n", (unsigned long long)budget, result.reason,
+	         (unsigned long long)result.cycles, state.pc, state.debug->hit,
+	         state.debug->hitAddr);
+	DisableDebug8080(&state);
+	freeMachine8080(&state);
+  }
+  report8080("debug watch budget", bad, 20 - 8 + 1);
+}
+
+/*
+ * single steps of a debugged machine on the JIT run one instruction
+ * each, however hot its blocks are
+ */
+static void checkJitStep(void)
+{
+  Snapshot8080 want, got;
+  State8080 state, ref;
+  int k, bad = 0;
+
+  loadMachine8080(&state, loopProg, sizeof(loopProg));
+  if (EnableJit8080(&state) || EnableDebug8080(&state, RunJit8080))
+  {
+	printf("can't debug on the JIT!\n");
+	mismatch8080(&bad);
+	DisableDebug8080(&state);
+	freeMachine8080(&state);
+	report8080("debug jit step", bad, STEPS);
+	return;
+  }
+  RunDebug8080(&state, WARM_CYCLES);
+  loadMachine8080(&ref, loopProg, sizeof(loopProg));
+  runMachine8080(&ref, Run8080, state.cycles);
+  for (k = 0; k < STEPS; k++)
+  {
+	RunResult8080 stepped = RunDebug8080(&state, 1);
+	RunResult8080 ran = Run8080(&ref, 1);
+
+	snapshot8080(&got, &state);
+	snapshot8080(&want, &ref);
+	if ((!sameSnapshot8080(&want, &got) || stepped.cycles != ran.cycles) &&
+		mismatch8080(&bad))
+	{
+	  printf("  step %d, %llu states:\n", k,
+	         (unsigned long long)stepped.cycles);
+	  printSnapshot8080("interp", &want);
+	  printSnapshot8080("jit", &got);
+	}
+  }
+  freeMachine8080(&ref);
+  DisableDebug8080(&state);
+  freeMachine8080(&state);
+  report8080("debug jit step", bad, STEPS);
+}
+
+/*
+ * restoring or loading a page with watchpoints, at its first byte
+ * and further in, is no store and hits none of them
+ */
+static void checkWatchReplace(void)
+{
+  static const uint8_t bytes[] = { 0x11, 0x22 };
+  State8080 state, saved;
+  int bad = 0;
+
+  loadMachine8080(&state, watchProg, sizeof(watchProg));
+  if (EnableDebug8080(&state, Run8080) ||
+	  SetWatchpoint8080(&state, 0x2000) || SetWatchpoint8080(&state, 0x2040))
+  {
+	printf("can't watch 2000!\n");
+	mismatch8080(&bad);
+	DisableDebug8080(&state);
+	freeMachine8080(&state);
+	report8080("debug watch replace", bad, 0);
+	return;
+  }
+  Fork8080(&state, &saved);
+  writeMemory8080(&saved, 0x2000, 0x33);
+  writeMemory8080(&saved, 0x2040, 0x44);
+  Restore8080(&state, &saved);
+  if (state.debug->hit && mismatch8080(&bad))
+	printf("  Restore8080 hit %04x\n", state.debug->hitAddr);
+  state.debug->hit = DEBUG8080_NONE;
+  LoadMemory8080(&state, 0x2000, bytes, sizeof(bytes));
+  if (state.debug->hit && mismatch8080(&bad))
+	printf("  LoadMemory8080 hit %04x\n", state.debug->hitAddr);
+  FreeMemory8080(&saved);
+  DisableDebug8080(&state);
+  freeMachine8080(&state);
+  report8080("debug watch replace", bad, 2);
+}
+
+void checkDebug8080(const TestOptions8080 *options)
+{
+  (void)options;
+  checkWatchBudget();
+  checkJitStep();
+  checkWatchReplace();
+}
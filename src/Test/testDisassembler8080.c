@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "file8080.h"
+#include "test8080.h"
+
+#define INPUT_SIZE ((3 << 20) + 12345) // several chunks, ends in the middle
+
+/*
+ * random bytes for the disassembler, the same on every run, then a
+ * run of LXI B opcodes whose paths from different offsets never meet
+ * @return 0 on success
+ */
+static int writeInput(const char *path)
+{
+  static uint8_t data[INPUT_SIZE];
+  uint32_t seed = 0xd15a;
+  FILE *file;
+  size_t i;
+
+  for (i = 0; i < sizeof(data); i++)
+	data[i] = i < sizeof(data) / 2 ? nextRandom8080(&seed) : 0x01;
+  file = fopen(path, "wb");
+  if (!file)
+	return -1;
+  if (fwrite(data, 1, sizeof(data), file) != sizeof(data))
+  {
+	fclose(file);
+	return -1;
+  }
+  return fclose(file);
+}
+
+/*
+ * run the disassembler through the shell
+ * @param how the command with %s for the binary, the input and the
+ * output, in that order
+ * @return 0 when it succeeded
+ */
+static int disassemble(const TestOptions8080 *options, const char *how,
+                       const char *input, const char *output)
+{
+  char command[3 * 4096 + 64];
+
+  snprintf(command, sizeof(command), how, options->disassembler, input,
+           output);
+  return system(command);
+}
+
+/*
+ * @return 1 when both files have the same bytes
+ */
+static int sameFile(const char *x, const char *y)
+{
+  size_t xSize, ySize;
+  uint8_t *xData = ReadFile8080(x, &xSize);
+  uint8_t *yData = ReadFile8080(y, &ySize);
+  int same = xData && yData && xSize == ySize && xSize &&
+             !memcmp(xData, yData, xSize);
+
+  free(xData);
+  free(yData);
+  return same;
+}
+
+/*
+ * every way of feeding the disassembler writes the same text as a
+ * mapped file decoded on one thread, also in parallel chunks that
+ * have to resynchronize on the instruction boundaries of -j 1
+ */
+static void checkOutputs(const TestOptions8080 *options)
+{
+  static const struct { const char *name, *how; } ways[] = {
+	{ "stdin", "cat '%2$s' | '%1$s' - > '%3$s'" },
+	{ "-j 2", "'%s' -j 2 '%s' > '%s'" },
+	{ "-j 3", "'%s' -j 3 '%s' > '%s'" },
+	{ "-j 8", "'%s' -j 8 '%s' > '%s'" },
+	{ "-j 0", "'%s' -j 0 '%s' > '%s'" },
+  };
+  char input[4096], want[4096], got[4096];
+  size_t w;
+  int bad = 0;
+
+  snprintf(input, sizeof(input), "%s/disassembler.bin", options->workDir);
+  snprintf(want, sizeof(want), "%s/disassembler.want", options->workDir);
+  snprintf(got, sizeof(got), "%s/disassembler.got", options->workDir);
+  if (writeInput(input) ||
+	  disassemble(options, "'%s' -j 1 '%s' > '%s'", input, want))
+  {
+	printf("can't disassemble %s!\n", input);
+	mismatch8080(&bad);
+	report8080("disassembler outputs", bad, 0);
+	return;
+  }
+  for (w = 0; w < sizeof(ways) / sizeof(ways[0]); w++)
+  {
+	if ((disassemble(options, ways[w].how, input, got) ||
+	     !sameFile(want, got)) && mismatch8080(&bad))
+	  printf("  %s: not the text of -j 1\n", ways[w].name);
+	unlink(got);
+  }
+  unlink(want);
+  unlink(input);
+  report8080("disassembler outputs", bad, w);
+}
+
+void checkDisassembler8080(const TestOptions8080 *options)
+{
+  if (!options->disassembler)
+  {
+	printf("%-24s skipped, no -d\n", "disassembler");
+	return;
+  }
+  checkOutputs(options);
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "explore8080.h"
+#include "test8080.h"
+
+#define INPUT_PORT 1
+#define GOAL_PORT 2
+#define CODE_LENGTH 4
+#define CODE_ADDR 0x0040
+#define ALPHABET 8
+
+// a combination lock: 0000 LXI B,0; 0003 IN 1; LXI H,0040; DAD B;
+// CMP M; JNZ 0000; INR C; MOV A,C; CPI 4; JNZ 0003; OUT 2; HLT
+// a wrong digit starts over, the code is at 0040
+static const uint8_t program[] = {
+  0x01, 0x00, 0x00, 0xdb, INPUT_PORT, 0x21, CODE_ADDR, 0x00, 0x09, 0xbe,
+  0xc2, 0x00, 0x00, 0x0c, 0x79, 0xfe, CODE_LENGTH, 0xc2, 0x03, 0x00, 0xd3,
+  GOAL_PORT, 0x76,
+  [CODE_ADDR] = 5, 2, 7, 3 };
+
+/*
+ * what a search found
+ */
+typedef struct Found {
+	int count; // calls of found
+	uint8_t inputs[64]; // of the first path, up to 64 inputs
+	uint32_t depth;
+}Found;
+
+static void found(const State8080 *state, const uint8_t *inputs,
+                  uint32_t depth, void *opaque)
+{
+  Found *f = opaque;
+
+  (void)state;
+  if (!f->count++)
+  {
+	f->depth = depth;
+	memcpy(f->inputs, inputs, depth < 64 ? depth : 64);
+  }
+}
+
+// the digits entered so far
+static uint64_t score(const State8080 *state, void *opaque)
+{
+  (void)opaque;
+  return state->c;
+}
+
+/*
+ * the search ends with every state expanded and the one path to the
+ * open lock reported, ending in the code. breadth first on one
+ * thread it is the code alone.
+ * @param states the states of the first search, the others have to
+ * find as many
+ */
+static void explore(int *bad, ExploreStrategy8080 strategy, int threads,
+                    uint64_t *states)
+{
+  static const char *names[] = { "bfs", "dfs", "priority" };
+  uint8_t alphabet[ALPHABET];
+  ExploreOptions8080 options;
+  ExploreStats8080 stats;
+  State8080 state;
+  Found f;
+  int i;
+
+  for (i = 0; i < ALPHABET; i++)
+	alphabet[i] = i;
+  memset(&options, 0, sizeof(options));
+  options.threads = threads;
+  options.strategy = strategy;
+  options.inputPort = INPUT_PORT;
+  options.inputs = alphabet;
+  options.inputCount = ALPHABET;
+  options.goalPort = GOAL_PORT;
+  options.score = strategy == EXPLORE8080_PRIORITY ? score : NULL;
+  options.found = found;
+  options.opaque = &f;
+  memset(&f, 0, sizeof(f));
+
+  loadMachine8080(&state, program, sizeof(program));
+  if (Explore8080(&state, &options, &stats))
+  {
+	if (mismatch8080(bad))
+	  printf("  %s, %d threads: failed\n", names[strategy], threads);
+	freeMachine8080(&state);
+	return;
+  }
+  freeMachine8080(&state);
+  if (!*states)
+	*states = stats.states;
+  if ((!stats.complete || stats.states != *states || stats.goals != 1 ||
+	   !stats.duplicates) && mismatch8080(bad))
+	printf("  %s, %d threads: complete %d, %llu states, expected %llu, "
+	       "%llu goals, %llu duplicates\n", names[strategy], threads,
+	       stats.complete, (unsigned long long)stats.states,
+	       (unsigned long long)*states, (unsigned long long)stats.goals,
+	       (unsigned long long)stats.duplicates);
+  if (f.count != 1 || f.depth < CODE_LENGTH || f.depth > 64 ||
+	  memcmp(f.inputs + f.depth - CODE_LENGTH, program + CODE_ADDR,
+	         CODE_LENGTH) ||
+	  (strategy == EXPLORE8080_BFS && threads == 1 &&
+	   f.depth != CODE_LENGTH))
+  {
+	if (mismatch8080(bad))
+	{
+	  printf("  %s, %d threads: %d paths, the first", names[strategy],
+	         threads, f.count);
+	  for (i = 0; i < (int)f.depth && i < 64; i++)
+		printf(" %d", f.inputs[i]);
+	  printf("\n");
+	}
+  }
+}
+
+/*
+ * every strategy on one and on several threads
+ */
+static void checkLock(void)
+{
+  uint64_t states = 0;
+  int strategy, bad = 0;
+
+  for (strategy = EXPLORE8080_BFS; strategy <= EXPLORE8080_PRIORITY;
+	   strategy++)
+  {
+	explore(&bad, strategy, 1, &states);
+	explore(&bad, strategy, 4, &states);
+  }
+  report8080("explore lock", bad, 6);
+}
+
+void checkExplore8080(const TestOptions8080 *options)
+{
+  (void)options;
+  checkLock();
+}
@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "opcodes8080.h"
+#include "flags8080.h"
+#include "memory8080.h"
+#include "core8080.h"
+#include "blockCache8080.h"
+#include "test8080.h"
+
+#define STACK 0x1000 // where PUSH PSW leaves the flags of a case
+#define OPERAND 0x2000 // (HL) of the cases
+
+/*
+ * the flags byte of the reference ALU
+ */
+static uint8_t refFlags(uint8_t res, int ac, int cy)
+{
+  int parity = 1, i;
+
+  for (i = 0; i < 8; i++)
+	parity ^= (res >> i) & 1;
+  return (res & 0x80 ? FLAG_S : 0) | (res ? 0 : FLAG_Z) |
+         (ac ? FLAG_AC : 0) | (parity ? FLAG_P : 0) | FLAGS_FIXED |
+         (cy ? FLAG_CY : 0);
+}
+
+/*
+ * the eight accumulator operations, ADD ADC SUB SBB ANA XRA ORA CMP,
+ * as the 8080 data book has them. subtraction adds the complement,
+ * AC is the carry out of bit 3 of that sum. ANA sets AC from bit 3
+ * of the operands.
+ */
+static uint8_t refAlu(int group, uint8_t a, uint8_t v, uint8_t psw,
+                      uint8_t *flags)
+{
+  int carry = (group == 1 || group == 3) && (psw & FLAG_CY);
+  int res;
+
+  switch (group)
+  {
+	case 0:
+	case 1:
+	  res = a + v + carry;
+	  *flags = refFlags(res, (a & 0x0f) + (v & 0x0f) + carry > 0x0f,
+	                    res > 0xff);
+	  return res;
+	case 2:
+	case 3:
+	case 7:
+	  res = a - v - carry;
+	  *flags = refFlags(res, (a & 0x0f) + (~v & 0x0f) + !carry > 0x0f,
+	                    a < v + carry);
+	  return group == 7 ? a : res;
+	case 4:
+	  *flags = refFlags(a & v, ((a | v) & 0x08) != 0, 0);
+	  return a & v;
+	case 5:
+	  *flags = refFlags(a ^ v, 0, 0);
+	  return a ^ v;
+	default:
+	  *flags = refFlags(a | v, 0, 0);
+	  return a | v;
+  }
+}
+
+/*
+ * DAA the data book way, the low digit first, then the high one
+ * of the corrected value
+ */
+static uint8_t refDaa(uint8_t a, uint8_t psw, uint8_t *flags)
+{
+  int cy = psw & FLAG_CY, ac = 0;
+  unsigned res = a;
+
+  if ((a & 0x0f) > 9 || (psw & FLAG_AC))
+  {
+	ac = (a & 0x0f) + 6 > 0x0f;
+	res += 6;
+  }
+  if ((res >> 4) > 9 || cy)
+  {
+	res += 0x60;
+	cy = 1;
+  }
+  *flags = refFlags(res, ac, cy);
+  return res;
+}
+
+/*
+ * RLC RRC RAL RAR CMA STC CMC, the other flags kept
+ */
+static uint8_t refMisc(int op, uint8_t a, uint8_t psw, uint8_t *flags)
+{
+  int cy = psw & FLAG_CY;
+  uint8_t res = a;
+
+  switch (op)
+  {
+	case 0: cy = a >> 7; res = a << 1 | cy; break;
+	case 1: cy = a & 1; res = a >> 1 | cy << 7; break;
+	case 2: res = a << 1 | cy; cy = a >> 7; break;
+	case 3: res = a >> 1 | cy << 7; cy = a & 1; break;
+	case 5: res = ~a; break;
+	case 6: cy = 1; break;
+	case 7: cy = !cy; break;
+  }
+  *flags = (psw & ~FLAG_CY) | (cy ? FLAG_CY : 0);
+  return res;
+}
+
+/*
+ * the register an opcode field names, NULL for (HL)
+ */
+static uint8_t *regOf(State8080 *state, int reg)
+{
+  uint8_t *regs[8] = { &state->b, &state->c, &state->d, &state->e,
+                       &state->h, &state->l, NULL, &state->a };
+
+  return regs[reg];
+}
+
+/*
+ * run the instruction at 0 and the PUSH PSW after it
+ * @return the flags it left, as the core reads them back
+ */
+static uint8_t runCase(State8080 *state, uint8_t psw)
+{
+  state->pc = 0;
+  state->sp = STACK;
+  writeFlags8080(state, psw);
+  Emulate8080Op(state);
+  Emulate8080Op(state);
+  return readMemory8080(state, STACK - 2);
+}
+
+static void putCode(State8080 *state, uint8_t op, uint8_t lo, int length)
+{
+  writeMemory8080(state, 0, op);
+  if (length > 1)
+	writeMemory8080(state, 1, lo);
+  writeMemory8080(state, length, 0xf5); // PUSH PSW
+}
+
+/*
+ * every accumulator operation on every operand register and the
+ * immediate forms, for all values of A, the operand, CY and AC
+ */
+static void checkAlu(State8080 *state, const char *core)
+{
+  static const char *names[8] = {
+	"ADD", "ADC", "SUB", "SBB", "ANA", "XRA", "ORA", "CMP" };
+  static const char *sources[9] = {
+	"B", "C", "D", "E", "H", "L", "M", "A", "D8" };
+  uint64_t cases = 0;
+  char name[32];
+  int group, src, a, v, f, bad = 0;
+
+  for (group = 0; group < 8; group++)
+	for (src = 0; src <= 8; src++)
+	{
+	  // src 8 is the immediate form
+	  if (src == 8)
+		putCode(state, 0xc6 | group << 3, 0, 2);
+	  else
+		putCode(state, 0x80 | group << 3 | src, 0, 1);
+	  for (a = 0; a < 256; a++)
+		// A as the operand only has A's value
+		for (v = 0; v < (src == 7 ? 1 : 256); v++)
+		  for (f = 0; f < 4; f++)
+		  {
+			uint8_t psw = FLAGS_FIXED | (f & 1 ? FLAG_CY : 0) |
+			              (f & 2 ? FLAG_AC : 0);
+			uint8_t operand = src == 7 ? a : v, want, wantFlags, got;
+
+			state->a = a;
+			if (src == 8)
+			  writeMemory8080(state, 1, v);
+			else if (src == 6)
+			{
+			  state->h = OPERAND >> 8;
+			  state->l = OPERAND & 0xff;
+			  writeMemory8080(state, OPERAND, v);
+			}
+			else if (src != 7)
+			  *regOf(state, src) = v;
+			want = refAlu(group, a, operand, psw, &wantFlags);
+			got = runCase(state, psw);
+			cases++;
+			if ((state->a != want || got != wantFlags) && mismatch8080(&bad))
+			  printf("  %s %s a=%02x v=%02x psw=%02x: a=%02x psw=%02x, "
+			         "expected a=%02x psw=%02x\n", names[group], sources[src],
+			         a, operand, psw, state->a, got, want, wantFlags);
+		  }
+	}
+  snprintf(name, sizeof(name), "alu %s", core);
+  report8080(name, bad, cases);
+}
+
+/*
+ * INR and DCR on every register, DAA, the rotates and the carry
+ * instructions, for all values and all CY and AC inputs
+ */
+static void checkUnary(State8080 *state, const char *core)
+{
+  static const uint8_t misc[8] = {
+	0x07, 0x0f, 0x17, 0x1f, 0x27, 0x2f, 0x37, 0x3f };
+  uint64_t cases = 0;
+  char name[32];
+  int reg, dec, op, v, f, bad = 0;
+
+  for (reg = 0; reg < 8; reg++)
+	for (dec = 0; dec < 2; dec++)
+	{
+	  putCode(state, 0x04 | reg << 3 | dec, 0, 1);
+	  for (v = 0; v < 256; v++)
+		for (f = 0; f < 4; f++)
+		{
+		  uint8_t psw = FLAGS_FIXED | (f & 1 ? FLAG_CY : 0) |
+		                (f & 2 ? FLAG_AC : 0);
+		  uint8_t want = dec ? v - 1 : v + 1, value, got;
+		  uint8_t wantFlags = refFlags(want, dec ? (v & 0x0f) != 0 :
+		                               (v & 0x0f) == 0x0f, f & 1);
+
+		  if (reg == 6)
+		  {
+			state->h = OPERAND >> 8;
+			state->l = OPERAND & 0xff;
+			writeMemory8080(state, OPERAND, v);
+		  }
+		  else
+			*regOf(state, reg) = v;
+		  got = runCase(state, psw);
+		  value = reg == 6 ? readMemory8080(state, OPERAND) :
+		                     *regOf(state, reg);
+		  cases++;
+		  if ((value != want || got != wantFlags) && mismatch8080(&bad))
+			printf("  %s %d v=%02x psw=%02x: %02x psw=%02x, expected %02x "
+			       "psw=%02x\n", dec ? "DCR" : "INR", reg, v, psw, value, got,
+			       want, wantFlags);
+		}
+	}
+
+  for (op = 0; op < 8; op++)
+  {
+	putCode(state, misc[op], 0, 1);
+	for (v = 0; v < 256; v++)
+	  for (f = 0; f < 4; f++)
+	  {
+		uint8_t psw = FLAGS_FIXED | (f & 1 ? FLAG_CY : 0) |
+		              (f & 2 ? FLAG_AC : 0);
+		uint8_t want, wantFlags, got;
+
+		if (op == 4)
+		  want = refDaa(v, psw, &wantFlags);
+		else
+		  want = refMisc(op, v, psw, &wantFlags);
+		state->a = v;
+		got = runCase(state, psw);
+		cases++;
+		if ((state->a != want || got != wantFlags) && mismatch8080(&bad))
+		  printf("  %02x a=%02x psw=%02x: a=%02x psw=%02x, expected a=%02x "
+		         "psw=%02x\n", misc[op], v, psw, state->a, got, want,
+		         wantFlags);
+	  }
+  }
+  snprintf(name, sizeof(name), "unary %s", core);
+  report8080(name, bad, cases);
+}
+
+/*
+ * an accumulator operation stepped on the lazy interpreter, then a
+ * conditional jump run strictly, on Run8080 or on the block cache.
+ * the jump has to see the flags the lazy step left, and so does a
+ * reader of the PSW after it.
+ */
+static void checkMixed(void)
+{
+  static const struct {
+	const char *name;
+	RunResult8080 (*run)(State8080 *state, uint64_t cycle_budget);
+  }runs[] = { { "interp", Run8080 }, { "blocks", RunBlocks8080 } };
+  State8080 state;
+  uint64_t cases = 0;
+  size_t r;
+  int group, cond, a, bad = 0;
+
+  memset(&state, 0, sizeof(state));
+  InitMemory8080(&state);
+  if (EnableBlockCache8080(&state))
+  {
+	printf("can't enable the block cache!\n");
+	mismatch8080(&bad);
+  }
+  writeMemory8080(&state, 4, 0x76); // HLT, the jump not taken
+  writeMemory8080(&state, 8, 0x76); // HLT, taken
+  for (group = 0; group < 8; group++)
+	for (cond = 0; cond < 8; cond++)
+	{
+	  // ALU B; Jcc 0008
+	  writeMemory8080(&state, 0, 0x80 | group << 3);
+	  writeMemory8080(&state, 1, 0xc2 | cond << 3);
+	  writeMemory8080(&state, 2, 0x08);
+	  writeMemory8080(&state, 3, 0x00);
+	  for (a = 0; a < 256; a++)
+		for (r = 0; r < sizeof(runs) / sizeof(runs[0]); r++)
+		{
+		  uint8_t v = a * 37 + 11, wantFlags, got;
+		  int taken;
+		  uint16_t want;
+
+		  refAlu(group, a, v, FLAGS_FIXED, &wantFlags);
+		  switch (cond >> 1)
+		  {
+			case 0: taken = (wantFlags & FLAG_Z) != 0; break;
+			case 1: taken = (wantFlags & FLAG_CY) != 0; break;
+			case 2: taken = (wantFlags & FLAG_P) != 0; break;
+			default: taken = (wantFlags & FLAG_S) != 0; break;
+		  }
+		  want = taken == (cond & 1) ? 9 : 5;
+		  state.pc = 0;
+		  state.halted = 0;
+		  state.a = a;
+		  state.b = v;
+		  writeFlags8080(&state, FLAGS_FIXED);
+		  SelectCore8080(&state, CORE8080_LAZY);
+		  Emulate8080Op(&state);
+		  SelectCore8080(&state, 0);
+		  runs[r].run(&state, 100);
+		  got = peekFlags8080(&state);
+		  cases++;
+		  if ((state.pc != want || got != wantFlags) && mismatch8080(&bad))
+			printf("  %s %02x a=%02x b=%02x then %02x: pc=%04x psw=%02x, "
+			       "expected pc=%04x psw=%02x\n", runs[r].name,
+			       0x80 | group << 3, a, v, 0xc2 | cond << 3, state.pc, got,
+			       want, wantFlags);
+		}
+	}
+  DisableBlockCache8080(&state);
+  FreeMemory8080(&state);
+  report8080("lazy then strict", bad, cases);
+}
+
+/*
+ * the flag engine on the strict and the lazy interpreter
+ */
+void checkFlags8080(const TestOptions8080 *options)
+{
+  static const struct { const char *name; unsigned features; } cores[] = {
+	{ "strict", 0 }, { "lazy", CORE8080_LAZY } };
+  State8080 state;
+  size_t c;
+
+  (void)options;
+  for (c = 0; c < sizeof(cores) / sizeof(cores[0]); c++)
+  {
+	memset(&state, 0, sizeof(state));
+	InitMemory8080(&state);
+	SelectCore8080(&state, cores[c].features);
+	checkAlu(&state, cores[c].name);
+	checkUnary(&state, cores[c].name);
+	FreeMemory8080(&state);
+  }
+  checkMixed();
+}
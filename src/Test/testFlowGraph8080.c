@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "flowGraph8080.h"
+#include "test8080.h"
+
+// 0000 LXI SP,F000; 0003 CALL 0010; 0006 JNZ 0003; 0009 JMP 0009;
+// 000c data; 0010 MVI A,1; 0012 RET
+static const uint8_t program[] = {
+  0x31, 0x00, 0xf0, 0xcd, 0x10, 0x00, 0xc2, 0x03, 0x00, 0xc3, 0x09, 0x00,
+  0xff, 0xff, 0xff, 0xff, 0x3e, 0x01, 0xc9 };
+
+/*
+ * the graph of program, edges in the order the builder keeps them
+ */
+static const struct {
+	uint16_t start;
+	uint8_t flags;
+	uint32_t length, count;
+	int edgeCount;
+	FlowEdge8080 edges[2];
+}wantBlocks[] = {
+  { 0x0000, FLOW_ENTRY, 3, 1, 1, { { 0x0000, 0x0003, EDGE_FALL, { 0 } } } },
+  { 0x0003, 0, 3, 1, 2, { { 0x0003, 0x0010, EDGE_CALL, { 0 } },
+                          { 0x0003, 0x0006, EDGE_FALL, { 0 } } } },
+  { 0x0006, 0, 3, 1, 2, { { 0x0006, 0x0003, EDGE_JUMP, { 0 } },
+                          { 0x0006, 0x0009, EDGE_FALL, { 0 } } } },
+  { 0x0009, 0, 3, 1, 1, { { 0x0009, 0x0009, EDGE_JUMP, { 0 } } } },
+  { 0x0010, FLOW_FUNCTION, 3, 2, 0, { { 0 } } },
+};
+
+/*
+ * the blocks, their edges and the references to each block
+ */
+static void expectGraph(int *bad, const char *what,
+                        const FlowGraph8080 *graph)
+{
+  size_t b;
+  int e;
+
+  if (graph->blockCount != sizeof(wantBlocks) / sizeof(wantBlocks[0]))
+  {
+	if (mismatch8080(bad))
+	  printf("  %s: %u blocks\n", what, graph->blockCount);
+	return;
+  }
+  for (b = 0; b < graph->blockCount; b++)
+  {
+	const FlowBlock8080 *block = &graph->blocks[b];
+	uint32_t x;
+
+	if ((block->start != wantBlocks[b].start ||
+	     block->flags != wantBlocks[b].flags ||
+	     block->length != wantBlocks[b].length ||
+	     block->count != wantBlocks[b].count ||
+	     block->edgeCount != (uint32_t)wantBlocks[b].edgeCount) &&
+		mismatch8080(bad))
+	  printf("  %s: block %04x flags %d, %u bytes, %u instructions, %u "
+	         "edges\n", what, block->start, block->flags, block->length,
+	         block->count, block->edgeCount);
+	for (e = 0; e < wantBlocks[b].edgeCount && e < (int)block->edgeCount;
+	     e++)
+	{
+	  const FlowEdge8080 *edge = &graph->edges[block->firstEdge + e];
+	  const FlowEdge8080 *want = &wantBlocks[b].edges[e];
+
+	  if ((edge->from != want->from || edge->to != want->to ||
+	       edge->type != want->type) && mismatch8080(bad))
+		printf("  %s: edge %04x -> %04x type %d, expected %04x -> %04x "
+		       "type %d\n", what, edge->from, edge->to, edge->type,
+		       want->from, want->to, want->type);
+	}
+	for (x = 0; x < block->xrefCount; x++)
+	{
+	  const FlowEdge8080 *edge = &graph->edges[graph->xrefs[block->firstXref +
+	                                                        x]];
+
+	  if (edge->to != block->start && mismatch8080(bad))
+		printf("  %s: xref of %04x from %04x to %04x\n", what, block->start,
+		       edge->from, edge->to);
+	}
+  }
+  if ((FindBlock8080(graph, 0x000d) ||
+       !FindBlock8080(graph, 0x0011) ||
+       FindBlock8080(graph, 0x0011)->start != 0x0010) && mismatch8080(bad))
+	printf("  %s: FindBlock8080 of data or the middle of a block\n", what);
+}
+
+/*
+ * recursive descent finds the blocks, calls and jumps of a small
+ * program and skips its data, and the index file saved from the graph
+ * loads back to the same arrays. an index of other bytes is ignored.
+ */
+static void checkGraph(const TestOptions8080 *options)
+{
+  FlowGraph8080 *built, *loaded, *other;
+  uint8_t changed[sizeof(program)];
+  uint16_t entry = 0;
+  char path[4096];
+  int bad = 0;
+
+  snprintf(path, sizeof(path), "%s/flow.idx", options->workDir);
+  built = BuildFlowGraph8080(program, 0, sizeof(program), &entry, 1);
+  if (!built || SaveFlowGraph8080(built, path))
+  {
+	printf("can't build or save the flow graph!\n");
+	mismatch8080(&bad);
+	FreeFlowGraph8080(built);
+	report8080("flow graph", bad, 0);
+	return;
+  }
+  expectGraph(&bad, "built", built);
+
+  loaded = OpenFlowGraph8080(path, program, 0, sizeof(program), &entry, 1);
+  if (!loaded || !loaded->mapped)
+  {
+	if (mismatch8080(&bad))
+	  printf("  the index didn't load\n");
+  }
+  else if ((loaded->imageHash != built->imageHash ||
+	        loaded->blockCount != built->blockCount ||
+	        loaded->edgeCount != built->edgeCount ||
+	        loaded->xrefCount != built->xrefCount ||
+	        memcmp(loaded->blocks, built->blocks,
+	               built->blockCount * sizeof(FlowBlock8080)) ||
+	        memcmp(loaded->edges, built->edges,
+	               built->edgeCount * sizeof(FlowEdge8080)) ||
+	        memcmp(loaded->xrefs, built->xrefs,
+	               built->xrefCount * sizeof(uint32_t))) &&
+	       mismatch8080(&bad))
+	printf("  the index loaded other arrays\n");
+  if (loaded)
+	expectGraph(&bad, "loaded", loaded);
+
+  // JNZ 0003 becomes JNZ 000c, the stale index must not be used
+  memcpy(changed, program, sizeof(program));
+  changed[7] = 0x0c;
+  other = OpenFlowGraph8080(path, changed, 0, sizeof(changed), &entry, 1);
+  if ((!other || other->mapped || !FindBlock8080(other, 0x000c)) &&
+	  mismatch8080(&bad))
+	printf("  the index of other bytes was used\n");
+
+  FreeFlowGraph8080(other);
+  FreeFlowGraph8080(loaded);
+  FreeFlowGraph8080(built);
+  unlink(path);
+  report8080("flow graph", bad, 3);
+}
+
+void checkFlowGraph8080(const TestOptions8080 *options)
+{
+  checkGraph(options);
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "coverage8080.h"
+#include "fuzz8080.h"
+#include "test8080.h"
+
+#define INPUT_ADDR 0x2000
+#define INPUT_PORT 1
+#define CRASH_PORT 0xff
+#define MAX_CYCLES 100000
+#define ROUNDS 3 // passes over the inputs
+
+// 0000 LDA 3000; ORA A; JNZ 0030 (left over from the last input);
+// 0007 INR A; STA 3000; MOV A,C; CPI 3; JC 0020; 0011 MOV A,M;
+// CPI 'L'; JZ 0022; CPI 'B'; JNZ 0020; JMP 0040; 0020 HLT;
+// 0022 JMP 0022; 0030 MVI A,EE; OUT FF; HLT;
+// 0040 IN 1; IN 1; CPI 'U'; JNZ 0020; INX H; INX H; MOV A,M; CPI 'G';
+// JNZ 0020; MVI A,42; OUT FF; HLT
+static const uint8_t program[] = {
+  0x3a, 0x00, 0x30, 0xb7, 0xc2, 0x30, 0x00, 0x3c, 0x32, 0x00, 0x30, 0x79,
+  0xfe, 0x03, 0xda, 0x20, 0x00, 0x7e, 0xfe, 'L', 0xca, 0x22, 0x00, 0xfe,
+  'B', 0xc2, 0x20, 0x00, 0xc3, 0x40, 0x00,
+  [0x20] = 0x76, 0x00, 0xc3, 0x22, 0x00,
+  [0x30] = 0x3e, 0xee, 0xd3, CRASH_PORT, 0x76,
+  [0x40] = 0xdb, INPUT_PORT, 0xdb, INPUT_PORT, 0xfe, 'U', 0xc2, 0x20, 0x00,
+  0x23, 0x23, 0x7e, 0xfe, 'G', 0xc2, 0x20, 0x00, 0x3e, 0x42, 0xd3,
+  CRASH_PORT, 0x76 };
+
+static const struct {
+	const char *data;
+	FuzzResult8080 result;
+}inputs[] = {
+  { "xy", FUZZ8080_HALT },
+  { "BUX", FUZZ8080_HALT },
+  { "Lzz", FUZZ8080_TIMEOUT },
+  { "BUG", FUZZ8080_CRASH },
+};
+
+#define INPUTS (sizeof(inputs) / sizeof(inputs[0]))
+
+static FuzzTarget8080 *createTarget(void)
+{
+  FuzzOptions8080 options;
+
+  options.loadAddress = 0;
+  options.inputAddress = INPUT_ADDR;
+  options.inputMax = 16;
+  options.inputPort = INPUT_PORT;
+  options.crashPort = CRASH_PORT;
+  options.maxCycles = MAX_CYCLES;
+  return CreateFuzzTarget8080(program, sizeof(program), &options);
+}
+
+/*
+ * each input ends the same way every time it runs, whatever ran
+ * before it: the program crashes when it finds its own store from an
+ * earlier input, so a rollback that misses a page shows up
+ */
+static void checkResults(void)
+{
+  FuzzTarget8080 *target = createTarget();
+  size_t i;
+  int round, bad = 0;
+
+  if (!target)
+  {
+	printf("can't create the fuzz target!\n");
+	mismatch8080(&bad);
+	report8080("fuzz results", bad, 0);
+	return;
+  }
+  for (round = 0; round < ROUNDS; round++)
+	for (i = 0; i < INPUTS; i++)
+	{
+	  FuzzResult8080 result = RunFuzzInput8080(target,
+	                            (const uint8_t *)inputs[i].data,
+	                            strlen(inputs[i].data));
+
+	  if (result != inputs[i].result && mismatch8080(&bad))
+		printf("  \"%s\": ended %d, expected %d\n", inputs[i].data, result,
+		       inputs[i].result);
+	  if (result == FUZZ8080_CRASH && target->crashValue != 0x42 &&
+		  mismatch8080(&bad))
+		printf("  \"%s\": crashed with %02x\n", inputs[i].data,
+		       target->crashValue);
+	}
+  if (target->execs != ROUNDS * INPUTS && mismatch8080(&bad))
+	printf("  %llu execs\n", (unsigned long long)target->execs);
+  DestroyFuzzTarget8080(target);
+  report8080("fuzz results", bad, ROUNDS * INPUTS);
+}
+
+/*
+ * every input that gets further into the program finds new edges,
+ * running one again finds none, and the map of a run holds that run
+ * only
+ */
+static void checkCoverage(void)
+{
+  static uint8_t seen[COVER8080_MAP_SIZE];
+  static Coverage8080 first;
+  FuzzTarget8080 *target = createTarget();
+  size_t i;
+  int bad = 0;
+
+  if (!target)
+  {
+	printf("can't create the fuzz target!\n");
+	mismatch8080(&bad);
+	report8080("fuzz coverage", bad, 0);
+	return;
+  }
+  memset(seen, 0, sizeof(seen));
+  for (i = 0; i < INPUTS; i++)
+  {
+	const uint8_t *data = (const uint8_t *)inputs[i].data;
+	size_t size = strlen(inputs[i].data), found;
+
+	RunFuzzInput8080(target, data, size);
+	memcpy(&first, target->machine.coverage, sizeof(first));
+	found = MergeCoverage8080(seen, target->machine.coverage);
+	if (!found && mismatch8080(&bad))
+	  printf("  \"%s\": no new edges\n", inputs[i].data);
+
+	RunFuzzInput8080(target, data, size);
+	if (memcmp(&first, target->machine.coverage, sizeof(first)) &&
+		mismatch8080(&bad))
+	  printf("  \"%s\": another map the second time\n", inputs[i].data);
+	found = MergeCoverage8080(seen, target->machine.coverage);
+	if (found && mismatch8080(&bad))
+	  printf("  \"%s\": %zu new edges the second time\n", inputs[i].data,
+	         found);
+  }
+  if (!CountCoverage8080(seen) && mismatch8080(&bad))
+	printf("  no edges seen\n");
+  DestroyFuzzTarget8080(target);
+  report8080("fuzz coverage", bad, INPUTS * 3);
+}
+
+void checkFuzz8080(const TestOptions8080 *options)
+{
+  (void)options;
+  checkResults();
+  checkCoverage();
+}
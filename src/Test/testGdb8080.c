@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "bus8080.h"
+#include "debug8080.h"
+#include "gdb8080.h"
+#include "test8080.h"
+
+#define DEVICE 0x4000 // a device page, the stub doesn't read it
+#define SCRIPT_SIZE 2048
+
+// 0000 MVI A,5; STA 2000; 0005 INR A; JMP 0005
+static const uint8_t program[] = {
+  0x3e, 0x05, 0x32, 0x00, 0x20, 0x3c, 0xc3, 0x05, 0x00 };
+
+// AF BC DE HL SP PC of G, then the 7 registers that read as 0
+#define REGISTERS "d711" "3322" "5544" "7766" "00f0" "0000" \
+                  "0000000000000000000000000000"
+
+/*
+ * what the client sends and what the stub should answer
+ */
+typedef struct Script {
+	char send[SCRIPT_SIZE];
+	char expect[SCRIPT_SIZE];
+}Script;
+
+static int deviceWrites;
+static uint8_t deviceValue;
+
+static uint8_t deviceRead(void *opaque, uint16_t addr)
+{
+  (void)opaque;
+  (void)addr;
+  return 0xff;
+}
+
+static void deviceWrite(void *opaque, uint16_t addr, uint8_t value)
+{
+  (void)opaque;
+  if (addr == DEVICE)
+	deviceValue = value;
+  deviceWrites++;
+}
+
+static StopReason8080 runDebugged(State8080 *state, void *opaque,
+                                  uint64_t cycle_budget)
+{
+  (void)opaque;
+  return RunDebug8080(state, cycle_budget).reason == RUN8080_HALT ?
+	RUN8080_HALT : RUN8080_RUNNING;
+}
+
+/*
+ * append data framed as $data#checksum
+ * @param checksum NULL for the right one
+ */
+static void frame(char *out, const char *data, const char *checksum)
+{
+  uint8_t sum = 0;
+  const char *c;
+
+  for (c = data; *c; c++)
+	sum += (uint8_t)*c;
+  out += strlen(out);
+  if (checksum)
+	sprintf(out, "$%s#%s", data, checksum);
+  else
+	sprintf(out, "$%s#%02x", data, sum);
+}
+
+// a packet acknowledged and answered
+static void exchange(Script *script, const char *packet, const char *reply)
+{
+  frame(script->send, packet, NULL);
+  strcat(script->expect, "+");
+  frame(script->expect, reply, NULL);
+}
+
+/*
+ * send the whole script, serve it, and compare everything the stub
+ * sent back
+ * @return what ServeGdb8080 returned
+ */
+static StopReason8080 serve(int *bad, const char *what,
+                            const Script *script, State8080 *state)
+{
+  static char got[SCRIPT_SIZE];
+  StopReason8080 end;
+  GdbStub8080 stub;
+  size_t length = 0;
+  ssize_t n;
+  int fds[2];
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+  {
+	if (mismatch8080(bad))
+	  printf("  %s: no socket pair\n", what);
+	return RUN8080_RUNNING;
+  }
+  memset(&stub, 0, sizeof(stub));
+  stub.listenFd = -1;
+  stub.fd = fds[0];
+  if (write(fds[1], script->send, strlen(script->send)) !=
+	  (ssize_t)strlen(script->send) && mismatch8080(bad))
+	printf("  %s: can't send the script\n", what);
+  end = ServeGdb8080(&stub, state, runDebugged, NULL);
+  // the stub closed its end when the client left
+  while (length < sizeof(got) - 1 &&
+	     (n = read(fds[1], got + length, sizeof(got) - 1 - length)) > 0)
+	length += n;
+  got[length] = 0;
+  close(fds[1]);
+  if (strcmp(got, script->expect) && mismatch8080(bad))
+	printf("  %s:\n    sent %s\n    got %s\n    expected %s\n", what,
+	       script->send, got, script->expect);
+  return end;
+}
+
+/*
+ * registers, memory with a device page, both kinds of points, steps
+ * and continues with their stop replies, a NAK each way, Ctrl-C and
+ * a detach leaving the machine clear of points
+ */
+static void checkSession(State8080 *state)
+{
+  static Script script;
+  int bad = 0;
+
+  memset(&script, 0, sizeof(script));
+  exchange(&script, "G" REGISTERS, "OK");
+  exchange(&script, "g", REGISTERS);
+  strcat(script.send, "+");
+  exchange(&script, "p1", "3322");
+  exchange(&script, "P3=cdab", "OK");
+  // a bad checksum gets a NAK and the packet again, a NAK from the
+  // client gets the reply again
+  frame(script.send, "p3", "00");
+  strcat(script.expect, "-");
+  exchange(&script, "p3", "cdab");
+  strcat(script.send, "-");
+  frame(script.expect, "cdab", NULL);
+  exchange(&script, "M3000,2:a55a", "OK");
+  exchange(&script, "m3000,2", "a55a");
+  exchange(&script, "M4000,1:77", "OK");
+  exchange(&script, "m4000,1", "E0e");
+  // MVI and STA run, the breakpoint stops the loop
+  exchange(&script, "Z0,5,1", "OK");
+  exchange(&script, "c", "S05");
+  exchange(&script, "z0,5,1", "OK");
+  exchange(&script, "Z2,2000,1", "OK");
+  exchange(&script, "P5=0000", "OK");
+  exchange(&script, "s", "S05");
+  exchange(&script, "s", "T05watch:2000;");
+  exchange(&script, "z2,2000,1", "OK");
+  // the loop runs until the client interrupts it
+  exchange(&script, "c", "S02");
+  strcat(script.send, "\x03");
+  exchange(&script, "D", "OK");
+
+  if (serve(&bad, "session", &script, state) != RUN8080_RUNNING &&
+	  mismatch8080(&bad))
+	printf("  the detach ended the machine\n");
+  if ((state->h != 0xab || state->l != 0xcd || state->sp != 0xf000 ||
+	   state->pc < 5 || state->pc > 6) &&
+	  mismatch8080(&bad))
+	printf("  registers after the session: hl=%02x%02x sp=%04x pc=%04x\n",
+	       state->h, state->l, state->sp, state->pc);
+  if ((readMemory8080(state, 0x3000) != 0xa5 ||
+	   readMemory8080(state, 0x3001) != 0x5a ||
+	   readMemory8080(state, 0x2000) != 5) && mismatch8080(&bad))
+	printf("  memory after the session\n");
+  if ((deviceWrites != 1 || deviceValue != 0x77) && mismatch8080(&bad))
+	printf("  the device saw %d writes, the last %02x\n", deviceWrites,
+	       deviceValue);
+  if ((state->debug->breakCount || state->debug->watchCount) &&
+	  mismatch8080(&bad))
+	printf("  points left after the detach\n");
+  report8080("gdb session", bad, 6);
+}
+
+/*
+ * without acknowledgments nothing but replies comes back, and a kill
+ * ends the machine
+ */
+static void checkKill(State8080 *state)
+{
+  static Script script;
+  int bad = 0;
+
+  memset(&script, 0, sizeof(script));
+  exchange(&script, "QStartNoAckMode", "OK");
+  frame(script.send, "qC", NULL);
+  frame(script.expect, "QC1", NULL);
+  frame(script.send, "k", NULL);
+  if (serve(&bad, "kill", &script, state) != RUN8080_BUDGET &&
+	  mismatch8080(&bad))
+	printf("  the kill didn't end the machine\n");
+  report8080("gdb no ack and kill", bad, 2);
+}
+
+void checkGdb8080(const TestOptions8080 *options)
+{
+  State8080 state;
+  Bus8080 bus;
+
+  (void)options;
+  InitBus8080(&bus);
+  MapDevice8080(&bus, DEVICE, PAGE8080_SIZE, deviceRead, deviceWrite, NULL);
+  loadMachine8080(&state, program, sizeof(program));
+  AttachBus8080(&state, &bus);
+  if (EnableDebug8080(&state, Run8080))
+  {
+	int bad = 0;
+
+	printf("can't debug!\n");
+	mismatch8080(&bad);
+	report8080("gdb session", bad, 0);
+  }
+  else
+  {
+	checkSession(&state);
+	checkKill(&state);
+  }
+  DisableDebug8080(&state);
+  freeMachine8080(&state);
+}
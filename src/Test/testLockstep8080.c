@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "lockstep8080.h"
+#include "batch8080.h"
+#include "test8080.h"
+
+#define LANES 13 // not a multiple of the SIMD width
+#define LANE_CYCLES 300000
+#define LANE_SLICE 997
+
+/*
+ * lanes start on registers of their own, split into two groups on a
+ * JNZ and meet again. C counts down, with odd B the lanes take the
+ * branch and patch an MVI further down the code they run.
+ */
+static const uint8_t diverging[] = {
+  0x31, 0x00, 0xf0, // LXI SP,f000
+  0x21, 0x00, 0x20, // 0003: LXI H,2000
+  0x78, 0xe6, 0x01, // 0006: MOV A,B  ANI 01
+  0xc2, 0x18, 0x00, // JNZ 0018
+  0x3e, 0x05, // MVI A,05
+  0x81, 0x77, 0x23, 0x4f, // ADD C  MOV M,A  INX H  MOV C,A
+  0xc3, 0x23, 0x00, // JMP 0023
+  0, 0, 0,
+  0x79, 0x32, 0x1d, 0x00, // 0018: MOV A,C  STA 001d
+  0x3e, 0x05, 0x82, 0x57, // MVI A,patched  ADD D  MOV D,A
+  0xcd, 0x2b, 0x00, // CALL 002b
+  0x0d, 0xc2, 0x06, 0x00, // 0023: DCR C  JNZ 0006
+  0x05, 0xc3, 0x03, 0x00, // DCR B  JMP 0003
+  0xd5, 0xe3, 0xe3, 0xd1, // 002b: PUSH D  XTHL  XTHL  POP D
+  0x1c, 0xc9 // INR E  RET
+};
+
+/*
+ * every lane takes the same way, so groups stay together up to the
+ * end of the budget: seven calls, then back round
+ */
+static const uint8_t together[] = {
+  0x31, 0x00, 0xf0, // LXI SP,f000
+  0x16, 0x07, // 0003: MVI D,07
+  0x80, 0xcd, 0x10, 0x00, // 0005: ADD B  CALL 0010
+  0x15, 0xc2, 0x05, 0x00, // DCR D  JNZ 0005
+  0xc3, 0x03, 0x00, // JMP 0003
+  0xc5, 0x0c, 0xc1, 0xc9 // 0010: PUSH B  INR C  POP B  RET
+};
+
+/*
+ * the registers lane k starts on, lanes a few apart alike but for C,
+ * so they take the same branches but store different values. odd
+ * lanes start on odd B.
+ */
+static void seedLane(State8080 *state, size_t k)
+{
+  uint32_t seed = 0x5a5a + (k % 4) * 0x10001;
+
+  state->a = nextRandom8080(&seed);
+  state->b = (nextRandom8080(&seed) & 0xfe) | (k & 1);
+  state->c = nextRandom8080(&seed) + k * 37;
+  state->d = nextRandom8080(&seed);
+  state->e = nextRandom8080(&seed);
+  state->h = nextRandom8080(&seed);
+  state->l = nextRandom8080(&seed);
+  state->sp = 0xf000;
+}
+
+/*
+ * the cycle count the run of lane k stops at, some far short of the
+ * others
+ */
+static uint64_t laneLimit(size_t k)
+{
+  return k % 3 ? LANE_CYCLES : LANE_CYCLES / 3 + 101 * k;
+}
+
+/*
+ * lanes loaded with the same code run in lockstep, in slices, and
+ * each has to end where stepping its machine alone to the same
+ * cycle count does
+ * @param name of the program, for the mismatches
+ * @param fork lanes forked from one machine share its pages, until
+ * they store into them
+ */
+static void checkLanes(const char *name, const uint8_t *code, size_t size,
+                       int fork, int *bad)
+{
+  static State8080 machines[LANES];
+  Lockstep8080 *engine = CreateLockstep8080(LANES);
+  State8080 image;
+  size_t k;
+
+  if (!engine)
+  {
+	if (mismatch8080(bad))
+	  printf("  %s: can't create the engine\n", name);
+	return;
+  }
+  loadMachine8080(&image, code, size);
+  for (k = 0; k < LANES; k++)
+  {
+	if (fork)
+	  Fork8080(&image, &machines[k]);
+	else
+	  loadMachine8080(&machines[k], code, size);
+	seedLane(&machines[k], k);
+	LoadLane8080(engine, k, &machines[k]);
+	engine->limit[k] = laneLimit(k);
+  }
+  freeMachine8080(&image);
+  while (RunLockstep8080(engine, LANE_SLICE))
+  {
+	for (k = 0; k < LANES; k++)
+	  if (engine->cycles[k] < engine->limit[k] && !engine->halted[k])
+		break;
+	if (k == LANES)
+	  break;
+  }
+
+  for (k = 0; k < LANES; k++)
+  {
+	Snapshot8080 want, got;
+	State8080 state;
+
+	StoreLane8080(engine, k, &machines[k]);
+	snapshot8080(&got, &machines[k]);
+	freeMachine8080(&machines[k]);
+
+	loadMachine8080(&state, code, size);
+	seedLane(&state, k);
+	while (state.cycles < laneLimit(k) && !state.halted)
+	  state.cycles += Emulate8080Op(&state);
+	snapshot8080(&want, &state);
+	freeMachine8080(&state);
+	if (!sameSnapshot8080(&want, &got) && mismatch8080(bad))
+	{
+	  printf("  %s lane %d:\n", name, (int)k);
+	  printSnapshot8080("stepped", &want);
+	  printSnapshot8080("lockstep", &got);
+	}
+  }
+  DestroyLockstep8080(engine);
+}
+
+/*
+ * a lockstep batch ends every job where the interpreter does
+ */
+static void checkBatch(void)
+{
+  static uint8_t roms[LANES][sizeof(diverging)];
+  BatchOptions8080 options;
+  BatchJob8080 jobs[LANES];
+  size_t k;
+  int bad = 0;
+
+  memset(&options, 0, sizeof(options));
+  options.threads = 3;
+  options.sliceCycles = LANE_SLICE;
+  options.tier = TIER_LOCKSTEP;
+  options.keepMemory = 1;
+  for (k = 0; k < LANES; k++)
+  {
+	memcpy(roms[k], diverging, sizeof(diverging));
+	memset(&jobs[k], 0, sizeof(BatchJob8080));
+	jobs[k].rom = roms[k];
+	jobs[k].romSize = sizeof(diverging);
+	jobs[k].initial.b = 1 + k % 4;
+	jobs[k].maxCycles = laneLimit(k);
+  }
+  if (RunBatch8080(jobs, LANES, &options) && mismatch8080(&bad))
+	printf("  lockstep batch failed\n");
+
+  for (k = 0; k < LANES; k++)
+  {
+	Snapshot8080 want, got;
+	State8080 state;
+
+	loadMachine8080(&state, diverging, sizeof(diverging));
+	state.b = jobs[k].initial.b;
+	while (state.cycles < laneLimit(k) && !state.halted)
+	  state.cycles += Emulate8080Op(&state);
+	snapshot8080(&want, &state);
+	freeMachine8080(&state);
+	snapshot8080(&got, &jobs[k].final);
+	FreeMemory8080(&jobs[k].final);
+	if ((jobs[k].error || jobs[k].reason != RUN8080_BUDGET ||
+	     !sameSnapshot8080(&want, &got)) && mismatch8080(&bad))
+	{
+	  printf("  job %d: error %d, reason %d\n", (int)k, jobs[k].error,
+	         jobs[k].reason);
+	  printSnapshot8080("stepped", &want);
+	  printSnapshot8080("batch", &got);
+	}
+  }
+  report8080("lockstep batch", bad, LANES);
+}
+
+void checkLockstep8080(const TestOptions8080 *options)
+{
+  static uint8_t rom[TEST8080_ROM_SIZE];
+  char name[16];
+  int n, bad = 0;
+
+  (void)options;
+  for (n = 0; n < TEST8080_ROM_COUNT; n++)
+  {
+	makeRom8080(rom, n);
+	snprintf(name, sizeof(name), "rom%d", n);
+	checkLanes(name, rom, sizeof(rom), n & 1, &bad);
+  }
+  checkLanes("diverging", diverging, sizeof(diverging), 0, &bad);
+  checkLanes("diverging forks", diverging, sizeof(diverging), 1, &bad);
+  checkLanes("together", together, sizeof(together), 1, &bad);
+  report8080("lockstep lanes", bad, (TEST8080_ROM_COUNT + 3) * LANES);
+  checkBatch();
+}
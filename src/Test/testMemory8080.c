@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "blockCache8080.h"
+#include "test8080.h"
+
+#define FORK_AT 100000 // states run before the fork or snapshot
+#define FORK_RUN 300000 // states each machine runs after it
+#define RESTORES 3
+
+// MVI A,55h; STA 0010; LDA 0010; HLT, 99h at 0010
+static const uint8_t romWrite[] = {
+  0x3e, 0x55, 0x32, 0x10, 0x00, 0x3a, 0x10, 0x00, 0x76, 0, 0, 0, 0, 0, 0, 0,
+  0x99 };
+
+/*
+ * the interpreter alone run from the start for some states
+ */
+static void runFresh(Snapshot8080 *snap, const uint8_t *rom, uint64_t cycles)
+{
+  State8080 state;
+
+  loadMachine8080(&state, rom, TEST8080_ROM_SIZE);
+  runMachine8080(&state, Run8080, cycles);
+  snapshot8080(snap, &state);
+  freeMachine8080(&state);
+}
+
+static void expectSame(int *bad, const char *what, int n,
+                       const Snapshot8080 *want, const State8080 *state)
+{
+  Snapshot8080 got;
+
+  snapshot8080(&got, state);
+  if (!sameSnapshot8080(want, &got) && mismatch8080(bad))
+  {
+	printf("  rom%d %s:\n", n, what);
+	printSnapshot8080("fresh", want);
+	printSnapshot8080(what, &got);
+  }
+}
+
+/*
+ * a fork shares every page of its parent, then parent and child run
+ * on apart, by turns, and each ends where a machine run alone does
+ */
+static void checkFork(void)
+{
+  static uint8_t rom[TEST8080_ROM_SIZE];
+  int n, bad = 0;
+
+  for (n = 0; n < TEST8080_ROM_COUNT; n++)
+  {
+	Snapshot8080 parentWant, childWant;
+	State8080 parent, child;
+	int p, shared = 0;
+
+	makeRom8080(rom, n);
+	loadMachine8080(&parent, rom, sizeof(rom));
+	runMachine8080(&parent, Run8080, FORK_AT);
+	Fork8080(&parent, &child);
+	for (p = 0; p < PAGE8080_COUNT; p++)
+	  shared += parent.pages[p] == child.pages[p];
+	if (shared != PAGE8080_COUNT && mismatch8080(&bad))
+	  printf("  rom%d: the fork shares %d pages\n", n, shared);
+
+	runMachine8080(&parent, Run8080, FORK_RUN);
+	runMachine8080(&child, Run8080, FORK_RUN / 2);
+	runMachine8080(&parent, Run8080, FORK_RUN / 3);
+	runFresh(&parentWant, rom, parent.cycles);
+	runFresh(&childWant, rom, child.cycles);
+	expectSame(&bad, "parent", n, &parentWant, &parent);
+	expectSame(&bad, "child", n, &childWant, &child);
+	freeMachine8080(&child);
+	freeMachine8080(&parent);
+  }
+  report8080("memory fork", bad, TEST8080_ROM_COUNT);
+}
+
+/*
+ * a machine on the block cache rolled back to a snapshot again and
+ * again runs the same way each time, the snapshot doesn't change
+ */
+static void checkRestore(void)
+{
+  static uint8_t rom[TEST8080_ROM_SIZE];
+  int n, bad = 0;
+
+  for (n = 0; n < TEST8080_ROM_COUNT; n++)
+  {
+	Snapshot8080 at, after;
+	State8080 state, snapshot;
+	int k;
+
+	makeRom8080(rom, n);
+	loadMachine8080(&state, rom, sizeof(rom));
+	if (EnableBlockCache8080(&state))
+	{
+	  if (mismatch8080(&bad))
+		printf("  rom%d: can't enable the block cache\n", n);
+	  freeMachine8080(&state);
+	  continue;
+	}
+	runMachine8080(&state, RunBlocks8080, FORK_AT);
+	Fork8080(&state, &snapshot);
+	snapshot8080(&at, &snapshot);
+	for (k = 0; k < RESTORES; k++)
+	{
+	  runMachine8080(&state, RunBlocks8080, FORK_RUN);
+	  if (!k)
+		runFresh(&after, rom, state.cycles);
+	  expectSame(&bad, "run", n, &after, &state);
+	  Restore8080(&state, &snapshot);
+	  expectSame(&bad, "restored", n, &at, &state);
+	  expectSame(&bad, "snapshot", n, &at, &snapshot);
+	}
+	freeMachine8080(&snapshot);
+	freeMachine8080(&state);
+  }
+  report8080("memory restore", bad, TEST8080_ROM_COUNT * RESTORES);
+}
+
+/*
+ * machines mapping one image: a ROM image drops their writes, a RAM
+ * image is copied by the machine that writes it
+ */
+static void checkImages(void)
+{
+  State8080 machines[2];
+  int rom, k, bad = 0;
+
+  for (rom = 0; rom < 2; rom++)
+  {
+	Image8080 *image = CreateImage8080(romWrite, sizeof(romWrite), 0, rom);
+	uint8_t want = rom ? 0x99 : 0x55;
+
+	if (!image)
+	{
+	  if (mismatch8080(&bad))
+		printf("  can't create the image\n");
+	  continue;
+	}
+	for (k = 0; k < 2; k++)
+	{
+	  memset(&machines[k], 0, sizeof(State8080));
+	  InitMemory8080(&machines[k]);
+	  MapImage8080(&machines[k], image);
+	}
+	runMachine8080(&machines[0], Run8080, 1000);
+	if ((machines[0].a != want || readMemory8080(&machines[0], 0x10) != want ||
+	     image->pages[0]->data[0x10] != 0x99 ||
+	     readMemory8080(&machines[1], 0x10) != 0x99) && mismatch8080(&bad))
+	  printf("  %s image: a=%02x, (0010)=%02x, image %02x, other machine "
+	         "%02x\n", rom ? "rom" : "ram", machines[0].a,
+	         readMemory8080(&machines[0], 0x10), image->pages[0]->data[0x10],
+	         readMemory8080(&machines[1], 0x10));
+	ReleaseImage8080(image);
+	for (k = 0; k < 2; k++)
+	  freeMachine8080(&machines[k]);
+  }
+  report8080("memory images", bad, 2);
+}
+
+void checkMemory8080(const TestOptions8080 *options)
+{
+  (void)options;
+  checkFork();
+  checkRestore();
+  checkImages();
+}
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "profile8080.h"
+#include "test8080.h"
+
+#define CALLS 10
+#define SAMPLE_PERIOD 4
+
+// 0000 LXI SP,F000; 0003 MVI B,CALLS; 0005 CALL 0010; 0008 DCR B;
+// 0009 JNZ 0005; 000c HLT; 0010 NOP; 0011 RET
+static const uint8_t program[] = {
+  0x31, 0x00, 0xf0, 0x06, CALLS, 0xcd, 0x10, 0x00, 0x05, 0xc2, 0x05, 0x00,
+  0x76, 0, 0, 0, 0x00, 0xc9 };
+
+#define INSTRUCTIONS (2 + 5 * CALLS + 1) // of program
+#define STATES (10 + 7 + CALLS * (17 + 5 + 10 + 4 + 10) + 7)
+
+static void expectCount(int *bad, const char *what, uint64_t got,
+                        uint64_t want)
+{
+  if (got != want && mismatch8080(bad))
+	printf("  %s: %llu, expected %llu\n", what, (unsigned long long)got,
+	       (unsigned long long)want);
+}
+
+/*
+ * run program to its HLT with a profile attached
+ * @return the profile, detached from the machine, NULL on errors
+ */
+static Profile8080 *runProfiled(uint32_t period)
+{
+  static Profile8080 copy;
+  State8080 state;
+
+  loadMachine8080(&state, program, sizeof(program));
+  if (EnableProfile8080(&state, period))
+  {
+	freeMachine8080(&state);
+	return NULL;
+  }
+  runMachine8080(&state, Run8080, STATES * 2);
+  memcpy(&copy, state.profile, sizeof(copy));
+  DisableProfile8080(&state);
+  freeMachine8080(&state);
+  return &copy;
+}
+
+/*
+ * every instruction of program is counted at its address and opcode,
+ * the subroutine is charged its calls and the states from its entry
+ * up to and including the RET
+ */
+static void checkCounts(void)
+{
+  const Profile8080 *profile = runProfiled(1);
+  uint64_t hits = 0, cycles = 0;
+  int addr, bad = 0;
+
+  if (!profile)
+  {
+	printf("can't profile!\n");
+	mismatch8080(&bad);
+	report8080("profile counts", bad, 0);
+	return;
+  }
+  for (addr = 0; addr < 0x10000; addr++)
+  {
+	hits += profile->hits[addr];
+	cycles += profile->cycles[addr];
+  }
+  expectCount(&bad, "instructions", profile->instructions, INSTRUCTIONS);
+  expectCount(&bad, "clock", profile->clock, STATES);
+  expectCount(&bad, "hits", hits, INSTRUCTIONS);
+  expectCount(&bad, "states", cycles, STATES);
+  expectCount(&bad, "hits of 0000", profile->hits[0x0000], 1);
+  expectCount(&bad, "hits of 0005", profile->hits[0x0005], CALLS);
+  expectCount(&bad, "states of 0005", profile->cycles[0x0005], CALLS * 17);
+  expectCount(&bad, "hits of 0011", profile->hits[0x0011], CALLS);
+  expectCount(&bad, "hits of CALL", profile->opcodeHits[0xcd], CALLS);
+  expectCount(&bad, "states of RET", profile->opcodeCycles[0xc9],
+              CALLS * 10);
+  expectCount(&bad, "calls of 0010", profile->calls[0x0010], CALLS);
+  expectCount(&bad, "states of 0010", profile->callCycles[0x0010],
+              CALLS * (4 + 10));
+  expectCount(&bad, "depth", profile->depth, 0);
+  report8080("profile counts", bad, 13);
+}
+
+/*
+ * with a period only one instruction in it is recorded, calls are
+ * still all counted
+ */
+static void checkSampled(void)
+{
+  const Profile8080 *profile = runProfiled(SAMPLE_PERIOD);
+  uint64_t hits = 0;
+  int addr, bad = 0;
+
+  if (!profile)
+  {
+	printf("can't profile!\n");
+	mismatch8080(&bad);
+	report8080("profile sampled", bad, 0);
+	return;
+  }
+  for (addr = 0; addr < 0x10000; addr++)
+	hits += profile->hits[addr];
+  expectCount(&bad, "instructions", profile->instructions, INSTRUCTIONS);
+  expectCount(&bad, "sampled hits", hits, INSTRUCTIONS / SAMPLE_PERIOD);
+  expectCount(&bad, "calls of 0010", profile->calls[0x0010], CALLS);
+  report8080("profile sampled", bad, 3);
+}
+
+void checkProfile8080(const TestOptions8080 *options)
+{
+  (void)options;
+  checkCounts();
+  checkSampled();
+}
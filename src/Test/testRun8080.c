@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "test8080.h"
+
+// MVI A,42h; OUT 10h; IN 20h; NOP; EI; HLT
+static const uint8_t stops[] = {
+  0x3e, 0x42, 0xd3, 0x10, 0xdb, 0x20, 0x00, 0xfb, 0x76 };
+
+/*
+ * Run8080 stops on the first instruction boundary at or past the
+ * budget, the same one stepping reaches
+ */
+static void checkBudget(void)
+{
+  static uint8_t rom[TEST8080_ROM_SIZE];
+  uint64_t budget, cases = 0;
+  int n, bad = 0;
+
+  for (n = 0; n < 2; n++)
+  {
+	makeRom8080(rom, n);
+	for (budget = 1; budget < 400; budget += 7)
+	{
+	  Snapshot8080 stepped, ran;
+	  RunResult8080 result;
+	  State8080 state;
+
+	  loadMachine8080(&state, rom, sizeof(rom));
+	  while (state.cycles < budget && !state.halted)
+		state.cycles += Emulate8080Op(&state);
+	  snapshot8080(&stepped, &state);
+	  freeMachine8080(&state);
+
+	  loadMachine8080(&state, rom, sizeof(rom));
+	  result = Run8080(&state, budget);
+	  snapshot8080(&ran, &state);
+	  freeMachine8080(&state);
+	  cases++;
+	  // the random roms stop on IN and OUT, the stepping doesn't
+	  if (result.reason != RUN8080_BUDGET)
+		continue;
+	  if ((!sameSnapshot8080(&stepped, &ran) || result.cycles != ran.cycles) &&
+		  mismatch8080(&bad))
+	  {
+		printf("  rom%d budget %llu, %llu states:\n", n,
+		       (unsigned long long)budget,
+		       (unsigned long long)result.cycles);
+		printSnapshot8080("stepped", &stepped);
+		printSnapshot8080("run", &ran);
+	  }
+	}
+  }
+  report8080("run budget", bad, cases);
+}
+
+static void expectStop(int *bad, const char *what, RunResult8080 result,
+                       StopReason8080 reason, uint64_t cycles,
+                       const State8080 *state, uint16_t pc)
+{
+  if ((result.reason != reason || result.cycles != cycles ||
+       state->pc != pc) && mismatch8080(bad))
+	printf("  %s: reason %d, %llu states, pc=%04x, expected reason %d, "
+	       "%llu states, pc=%04x\n", what, result.reason,
+	       (unsigned long long)result.cycles, state->pc, reason,
+	       (unsigned long long)cycles, pc);
+}
+
+/*
+ * HLT, IN, OUT and an interrupt taken on EI hand the machine back,
+ * with the machine states spent up to and including them
+ */
+static void checkStops(void)
+{
+  RunResult8080 result;
+  State8080 state;
+  int bad = 0;
+
+  loadMachine8080(&state, stops, sizeof(stops));
+  result = Run8080(&state, 1000);
+  expectStop(&bad, "OUT", result, RUN8080_OUT, 7 + 10, &state, 4);
+  if ((state.ioPort != 0x10 || state.a != 0x42) && mismatch8080(&bad))
+	printf("  OUT: port %02x a=%02x\n", state.ioPort, state.a);
+  result = Run8080(&state, 1000);
+  expectStop(&bad, "IN", result, RUN8080_IN, 10, &state, 6);
+  if (state.ioPort != 0x20 && mismatch8080(&bad))
+	printf("  IN: port %02x\n", state.ioPort);
+  result = Run8080(&state, 1000);
+  expectStop(&bad, "HLT", result, RUN8080_HALT, 4 + 4 + 7, &state, 9);
+  result = Run8080(&state, 1000);
+  expectStop(&bad, "halted", result, RUN8080_HALT, 0, &state, 9);
+  if (state.cycles != 7 + 10 + 10 + 4 + 4 + 7 && mismatch8080(&bad))
+	printf("  %llu states in all\n", (unsigned long long)state.cycles);
+  freeMachine8080(&state);
+
+  // an interrupt raised while disabled waits for the EI
+  loadMachine8080(&state, stops, sizeof(stops));
+  state.pc = 6;
+  state.sp = 0x2000;
+  if (Interrupt8080(&state, 1) && mismatch8080(&bad))
+	printf("  interrupt taken while disabled\n");
+  result = Run8080(&state, 1000);
+  expectStop(&bad, "EI", result, RUN8080_INTERRUPT, 4 + 4 + 11, &state, 8);
+  if ((readMemory8080(&state, 0x1ffe) != 8 || state.int_enable) &&
+	  mismatch8080(&bad))
+	printf("  EI: returns to %02x, interrupts %d\n",
+	       readMemory8080(&state, 0x1ffe), state.int_enable);
+  freeMachine8080(&state);
+
+  // a halted machine wakes up for an interrupt and counts its RST
+  loadMachine8080(&state, stops, sizeof(stops));
+  state.pc = 8;
+  state.sp = 0x2000;
+  Run8080(&state, 1000);
+  state.int_enable = 1;
+  Interrupt8080(&state, 0);
+  if (state.halted && mismatch8080(&bad))
+	printf("  still halted after an interrupt\n");
+  result = Run8080(&state, 1000);
+  expectStop(&bad, "woken", result, RUN8080_OUT, 7 + 10, &state, 4);
+  freeMachine8080(&state);
+  report8080("run stops", bad, 7);
+}
+
+void checkRun8080(const TestOptions8080 *options)
+{
+  (void)options;
+  checkBudget();
+  checkStops();
+}
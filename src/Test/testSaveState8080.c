@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "saveState8080.h"
+#include "test8080.h"
+
+#define SAVE_COUNT 16 // save states in the chain, the first one full
+#define SAVE_RUN (TEST8080_SLICE * 5) // states run between them
+
+/*
+ * save a full state and a chain of deltas while a random rom runs,
+ * then load them one by one into a new machine. a delta loaded out
+ * of sequence is rejected.
+ */
+static void checkChain(void)
+{
+  static uint8_t rom[TEST8080_ROM_SIZE];
+  Snapshot8080 saved[SAVE_COUNT], got;
+  long offsets[SAVE_COUNT];
+  State8080 state;
+  FILE *file = tmpfile();
+  int n, bad = 0;
+
+  if (!file)
+  {
+	printf("can't create a temporary file!\n");
+	mismatch8080(&bad);
+	report8080("save state chain", bad, SAVE_COUNT);
+	return;
+  }
+  makeRom8080(rom, 1);
+  loadMachine8080(&state, rom, sizeof(rom));
+  for (n = 0; n < SAVE_COUNT; n++)
+  {
+	offsets[n] = ftell(file);
+	if (SaveState8080(file, &state, n ? SAVE8080_DELTA : SAVE8080_FULL,
+	                  NULL, 0) && mismatch8080(&bad))
+	  printf("  can't save state %d\n", n);
+	snapshot8080(&saved[n], &state);
+	runMachine8080(&state, Run8080, SAVE_RUN);
+  }
+  freeMachine8080(&state);
+
+  rewind(file);
+  loadMachine8080(&state, NULL, 0);
+  for (n = 0; n < SAVE_COUNT; n++)
+  {
+	if (LoadState8080(file, &state, NULL, 0))
+	{
+	  if (mismatch8080(&bad))
+		printf("  can't load state %d\n", n);
+	  break;
+	}
+	snapshot8080(&got, &state);
+	if (!sameSnapshot8080(&saved[n], &got) && mismatch8080(&bad))
+	{
+	  printf("  state %d:\n", n);
+	  printSnapshot8080("saved", &saved[n]);
+	  printSnapshot8080("loaded", &got);
+	}
+  }
+  freeMachine8080(&state);
+
+  // a delta has to follow the record before it
+  rewind(file);
+  loadMachine8080(&state, NULL, 0);
+  if (LoadState8080(file, &state, NULL, 0))
+	mismatch8080(&bad);
+  fseek(file, offsets[2], SEEK_SET);
+  if (!LoadState8080(file, &state, NULL, 0) && mismatch8080(&bad))
+	printf("  a delta out of sequence loaded\n");
+  freeMachine8080(&state);
+  fclose(file);
+  report8080("save state chain", bad, SAVE_COUNT);
+}
+
+#define DEVICE_ID 0x54494d52 // "TIMR"
+
+/*
+ * a device with a 4 byte counter
+ */
+typedef struct Device {
+	uint32_t counter;
+	int loads;
+}Device;
+
+static size_t saveDevice(void *opaque, uint8_t *buf, size_t size)
+{
+  Device *device = opaque;
+
+  if (buf && size >= 4)
+	memcpy(buf, &device->counter, 4);
+  return 4;
+}
+
+// an older device, its state is 2 bytes
+static size_t saveShort(void *opaque, uint8_t *buf, size_t size)
+{
+  Device *device = opaque;
+
+  if (buf && size >= 2)
+	memcpy(buf, &device->counter, 2);
+  return 2;
+}
+
+static int checkDevice(void *opaque, const uint8_t *buf, size_t size)
+{
+  (void)opaque;
+  (void)buf;
+  return size == 4 ? 0 : -1;
+}
+
+static int loadDevice(void *opaque, const uint8_t *buf, size_t size)
+{
+  Device *device = opaque;
+
+  if (size != 4)
+	return -1;
+  memcpy(&device->counter, buf, 4);
+  device->loads++;
+  return 0;
+}
+
+/*
+ * a device state is loaded back, and one its check rejects leaves
+ * the machine, its checkpoint and the device as they were, so the
+ * next record in sequence still loads
+ */
+static void checkDevices(void)
+{
+  static uint8_t rom[TEST8080_ROM_SIZE];
+  Device device = { 0, 0 };
+  DeviceState8080 hooks = { DEVICE_ID, saveDevice, checkDevice, loadDevice,
+                            &device };
+  DeviceState8080 older = { DEVICE_ID, saveShort, NULL, NULL, &device };
+  Snapshot8080 loaded, got;
+  State8080 state;
+  FILE *file = tmpfile();
+  long full, rejected, delta;
+  uint32_t checkpoint;
+  int bad = 0;
+
+  if (!file)
+  {
+	printf("can't create a temporary file!\n");
+	mismatch8080(&bad);
+	report8080("save state devices", bad, 0);
+	return;
+  }
+  makeRom8080(rom, 2);
+  loadMachine8080(&state, rom, sizeof(rom));
+  device.counter = 0x12345678;
+  full = ftell(file);
+  SaveState8080(file, &state, SAVE8080_FULL, &hooks, 1);
+  runMachine8080(&state, Run8080, SAVE_RUN);
+  // a delta with the short state, then one in its place as it should be
+  rejected = ftell(file);
+  SaveState8080(file, &state, SAVE8080_DELTA, &older, 1);
+  state.checkpoint--;
+  delta = ftell(file);
+  SaveState8080(file, &state, SAVE8080_DELTA, &hooks, 1);
+  freeMachine8080(&state);
+
+  fseek(file, full, SEEK_SET);
+  device.counter = 0;
+  loadMachine8080(&state, NULL, 0);
+  if ((LoadState8080(file, &state, &hooks, 1) ||
+	   device.counter != 0x12345678 || device.loads != 1) &&
+	  mismatch8080(&bad))
+	printf("  the device state didn't load\n");
+
+  checkpoint = state.checkpoint;
+  snapshot8080(&loaded, &state);
+  fseek(file, rejected, SEEK_SET);
+  if (!LoadState8080(file, &state, &hooks, 1) && mismatch8080(&bad))
+	printf("  a rejected device state loaded\n");
+  snapshot8080(&got, &state);
+  if ((!sameSnapshot8080(&loaded, &got) || state.checkpoint != checkpoint ||
+	   device.loads != 1) && mismatch8080(&bad))
+	printf("  a rejected record changed the machine\n");
+
+  fseek(file, delta, SEEK_SET);
+  if ((LoadState8080(file, &state, &hooks, 1) || device.loads != 2) &&
+	  mismatch8080(&bad))
+	printf("  the delta after a rejected one didn't load\n");
+  freeMachine8080(&state);
+  fclose(file);
+  report8080("save state devices", bad, 3);
+}
+
+void checkSaveState8080(const TestOptions8080 *options)
+{
+  (void)options;
+  checkChain();
+  checkDevices();
+}
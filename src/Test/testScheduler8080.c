@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "scheduler8080.h"
+#include "test8080.h"
+
+#define PERIOD 1009 // states between the interrupts
+#define IDLE_PERIOD 20011 // long enough for the idle loop to be probed
+#define RUN_CYCLES 200000
+#define RST 1
+
+// 0000 LXI SP,F000; 0003 EI; 0004 HLT; 0005 JMP 0003;
+// 0008 INR B; EI; RET
+static const uint8_t halting[] = {
+  0x31, 0x00, 0xf0, 0xfb, 0x76, 0xc3, 0x03, 0x00, 0x04, 0xfb, 0xc9 };
+
+// 0000 LXI SP,F000; EI; JMP 0040; 0008 JMP 0020
+// 0020 PUSH PSW; INR B; MOV A,B; CPI 5; JNZ 002B; STA 2000;
+// 002B POP PSW; EI; RET
+// 0040 LDA 2000; ORA A; JZ 0040; 0047 HLT; JMP 0047
+static const uint8_t spinning[] = {
+  0x31, 0x00, 0xf0, 0xfb, 0xc3, 0x40, 0x00, 0x00, 0xc3, 0x20, 0x00,
+  [0x20] = 0xf5, 0x04, 0x78, 0xfe, 5, 0xc2, 0x2b, 0x00, 0x32, 0x00, 0x20,
+  0xf1, 0xfb, 0xc9,
+  [0x40] = 0x3a, 0x00, 0x20, 0xb7, 0xca, 0x40, 0x00, 0x76, 0xc3, 0x47, 0x00 };
+
+/*
+ * the machine without a scheduler: stepped one instruction at a time,
+ * a halted CPU ticks one state at a time, and the interrupt is raised
+ * after the instruction or tick that reaches its deadline
+ */
+static void runPlain(State8080 *state, uint64_t period, uint64_t cycles)
+{
+  uint64_t end = state->cycles + cycles, next = period;
+
+  for (;;)
+  {
+	while (next <= state->cycles)
+	{
+	  Interrupt8080(state, RST);
+	  next += period;
+	}
+	if (state->cycles >= end)
+	  break;
+	if (state->halted)
+	  state->cycles++;
+	else
+	  Run8080(state, 1);
+  }
+}
+
+/*
+ * run a program on the scheduler with a periodic interrupt and
+ * compare it with the plain run to the same cycle
+ * @param skipped set to the states fast-forwarded while halted
+ * @param spun set to the states fast-forwarded in idle loops
+ */
+static void compareRuns(int *bad, const char *what, const uint8_t *code,
+                        size_t size, uint64_t period, int skipIdle,
+                        uint64_t *skipped, uint64_t *spun)
+{
+  Snapshot8080 want, got;
+  Scheduler8080 scheduler;
+  State8080 state;
+
+  loadMachine8080(&state, code, size);
+  InitScheduler8080(&scheduler);
+  scheduler.skipIdle = skipIdle;
+  ScheduleEvent8080(&scheduler, period, period, EVENT8080_WAKE,
+                    RaiseInterrupt8080, (void *)(uintptr_t)RST);
+  RunScheduled8080(&state, &scheduler, Run8080, RUN_CYCLES);
+  snapshot8080(&got, &state);
+  *skipped = scheduler.skipped;
+  *spun = scheduler.spun;
+  FreeScheduler8080(&scheduler);
+  freeMachine8080(&state);
+
+  loadMachine8080(&state, code, size);
+  runPlain(&state, period, got.cycles);
+  snapshot8080(&want, &state);
+  freeMachine8080(&state);
+  if (!sameSnapshot8080(&want, &got) && mismatch8080(bad))
+  {
+	printf("  %s:\n", what);
+	printSnapshot8080("plain", &want);
+	printSnapshot8080("scheduled", &got);
+  }
+}
+
+/*
+ * a CPU halted between interrupts is fast-forwarded to each deadline
+ * and lands on the cycle a plain run wakes up on
+ */
+static void checkHalted(void)
+{
+  uint64_t skipped, spun;
+  int bad = 0;
+
+  compareRuns(&bad, "halted", halting, sizeof(halting), PERIOD, 0,
+              &skipped, &spun);
+  if (!skipped && mismatch8080(&bad))
+	printf("  nothing fast-forwarded\n");
+  report8080("scheduler halted", bad, 2);
+}
+
+/*
+ * a loop polling memory until the 5th interrupt stores to it is
+ * skipped by whole passes, and the machine leaves it on the cycle
+ * and in the state a plain run does
+ */
+static void checkIdle(void)
+{
+  uint64_t skipped, spun;
+  int bad = 0;
+
+  compareRuns(&bad, "idle", spinning, sizeof(spinning), IDLE_PERIOD,
+              1, &skipped, &spun);
+  if (!spun && mismatch8080(&bad))
+	printf("  no idle loop skipped\n");
+  report8080("scheduler idle loop", bad, 2);
+}
+
+void checkScheduler8080(const TestOptions8080 *options)
+{
+  (void)options;
+  checkHalted();
+  checkIdle();
+}
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "blockCache8080.h"
+#include "jit8080.h"
+#include "aot8080.h"
+#include "core8080.h"
+#include "test8080.h"
+
+#define RUN_CYCLES 2000000 // machine states each tier runs a rom for
+#define LOOP_COUNT 8 // looping programs, run after the random roms
+#define LOOP_START 0x0100 // the loop of a program
+#define LOOP_END 0x0700
+#define LOOP_SUB 0x0800 // the subroutine it calls
+#define LOOP_SUB_END 0x0900
+#define LOOP_DATA 0x20 // first of the 8 pages the programs work on
+#define LOOP_STACK 0xf000
+
+/*
+ * a looping program being put together
+ */
+typedef struct Program {
+	uint8_t *rom;
+	uint16_t pc;
+	uint32_t seed;
+	uint16_t immediates[64]; // of MVI, the program stores to them
+	int immediateCount;
+}Program;
+
+typedef struct Tier {
+	const char *name;
+	// @return 0 when the machine can run on the tier
+	int (*enable)(State8080 *state, const uint8_t *rom,
+	              const TestOptions8080 *options);
+	RunResult8080 (*run)(State8080 *state, uint64_t cycle_budget);
+	int exact; // stops where the interpreter does for the same budget,
+	           // the others may overshoot by a block
+}Tier;
+
+static int enableLazy(State8080 *state, const uint8_t *rom,
+                      const TestOptions8080 *options)
+{
+  (void)rom;
+  (void)options;
+  SelectCore8080(state, CORE8080_LAZY);
+  return 0;
+}
+
+static int enableBlocks(State8080 *state, const uint8_t *rom,
+                        const TestOptions8080 *options)
+{
+  (void)rom;
+  (void)options;
+  return EnableBlockCache8080(state);
+}
+
+static int enableJit(State8080 *state, const uint8_t *rom,
+                     const TestOptions8080 *options)
+{
+  (void)rom;
+  (void)options;
+  return EnableJit8080(state);
+}
+
+static int enableAot(State8080 *state, const uint8_t *rom,
+                     const TestOptions8080 *options)
+{
+  return EnableAot8080(state, options->aotDir, rom, 0, TEST8080_ROM_SIZE);
+}
+
+static void put(Program *prog, uint8_t byte)
+{
+  prog->rom[prog->pc++] = byte;
+}
+
+static void putWord(Program *prog, uint8_t opcode, uint16_t word)
+{
+  put(prog, opcode);
+  put(prog, word & 0xff);
+  put(prog, word >> 8);
+}
+
+/*
+ * one random instruction that doesn't leave the program: register
+ * and ALU work, loads and stores through HL, BC, DE or an address in
+ * the data pages, stores into the program's own immediates, pushes
+ * and pops in pairs, conditional skips, and in the loop calls of
+ * the subroutine and the RST vectors
+ * @param sub in the subroutine, which may return early instead
+ */
+static void putInstruction(Program *prog, int sub)
+{
+  uint32_t r = nextRandom8080(&prog->seed);
+  uint8_t page = LOOP_DATA + ((r >> 8) & 7);
+  uint8_t opcode, pair;
+
+  switch (r % 12)
+  {
+	case 0: case 1: case 2: // MOV r,r, ALU r, with M in a data page
+	  opcode = 0x40 + ((r >> 12) & 0x7f);
+	  if (opcode == 0x76)
+		opcode = 0x77;
+	  if ((opcode & 7) == 6 || (opcode < 0x80 && (opcode & 0x38) == 0x30))
+	  {
+		put(prog, 0x26); // MVI H,page
+		put(prog, page);
+	  }
+	  put(prog, opcode);
+	  break;
+	case 3: // INR, DCR, MVI, with M in a data page
+	  opcode = 0x04 + ((r >> 12) & 0x38) + ((r >> 16) % 3);
+	  if ((opcode & 0x38) == 0x30)
+	  {
+		put(prog, 0x26);
+		put(prog, page);
+	  }
+	  if ((opcode & 7) == 6 && prog->immediateCount < 64)
+		prog->immediates[prog->immediateCount++] = prog->pc + 1;
+	  put(prog, opcode);
+	  if ((opcode & 7) == 6)
+		put(prog, r >> 20);
+	  break;
+	case 4: // rotates, DAA, CMA, STC, CMC, INX, DCX, DAD, XCHG
+	  {
+		static const uint8_t ops[] = {
+		  0x07, 0x0f, 0x17, 0x1f, 0x27, 0x2f, 0x37, 0x3f, 0x03, 0x13, 0x23,
+		  0x0b, 0x1b, 0x2b, 0x09, 0x19, 0x29, 0x39, 0xeb
+		};
+		put(prog, ops[(r >> 12) % sizeof(ops)]);
+	  }
+	  break;
+	case 5: // ALU D8, LXI
+	  if (r & 0x100000)
+		put(prog, 0xc6 + ((r >> 12) & 0x38));
+	  else
+		put(prog, 0x01 + ((r >> 12) & 0x30) % 0x30);
+	  put(prog, r >> 24);
+	  if (prog->rom[prog->pc - 2] < 0x40)
+		put(prog, r >> 16);
+	  break;
+	case 6: // LDA, STA, LHLD, SHLD
+	  putWord(prog, (r >> 12) & 1 ? 0x3a : 0x32, page << 8 | (r >> 16 & 0xff));
+	  if (r & 0x1000000)
+		putWord(prog, (r >> 13) & 1 ? 0x2a : 0x22,
+		        page << 8 | (r >> 16 & 0xff));
+	  break;
+	case 7: // LDAX, STAX
+	  pair = (r >> 12) & 0x10;
+	  put(prog, 0x06 + pair); // MVI B/D,page
+	  put(prog, page);
+	  put(prog, (r >> 13) & 1 ? 0x0a + pair : 0x02 + pair);
+	  break;
+	case 8: // STA into an MVI of the program itself
+	  if (prog->immediateCount)
+		putWord(prog, 0x32,
+		        prog->immediates[(r >> 12) % prog->immediateCount]);
+	  break;
+	case 9: // PUSH, maybe XTHL, POP
+	  put(prog, 0xc5 + ((r >> 12) & 0x30));
+	  if (r & 0x10000)
+		put(prog, 0xe3);
+	  put(prog, 0xc1 + ((r >> 20) & 0x30));
+	  break;
+	case 10: // Jcc over an INR or DCR of a register
+	  opcode = 0x04 + ((r >> 16) & 0x38) + ((r >> 20) & 1);
+	  putWord(prog, 0xc2 + ((r >> 12) & 0x38), prog->pc + 4);
+	  put(prog, (opcode & 0x38) == 0x30 ? opcode | 0x38 : opcode);
+	  break;
+	default: // CALL, Ccc, RST in the loop, Rcc in the subroutine
+	  if (sub)
+		put(prog, 0xc0 + ((r >> 12) & 0x38));
+	  else if (r & 0x1000)
+		put(prog, 0xc7 + (1 + (r >> 16) % 7) * 8);
+	  else
+		putWord(prog, r & 0x2000 ? 0xcd : 0xc4 + ((r >> 16) & 0x38),
+		        LOOP_SUB);
+	  break;
+  }
+}
+
+/*
+ * a program looping through random instructions, to get blocks hot
+ * and keep them running
+ * @param n which of the programs, the same bytes for the same n
+ */
+static void makeLoop(uint8_t *rom, int n)
+{
+  Program prog = { rom, 0, 0x8080 + n * 0x10001 + 0x1234, { 0 }, 0 };
+  int i;
+
+  memset(rom, 0, TEST8080_ROM_SIZE);
+  putWord(&prog, 0x31, LOOP_STACK); // LXI SP
+  putWord(&prog, 0xc3, LOOP_START);
+  for (i = 1; i < 8; i++)
+	rom[i * 8] = 0xc9; // RET
+  prog.pc = LOOP_SUB;
+  while (prog.pc < LOOP_SUB_END)
+	putInstruction(&prog, 1);
+  put(&prog, 0xc9);
+  prog.pc = LOOP_START;
+  while (prog.pc < LOOP_END)
+	putInstruction(&prog, 0);
+  putWord(&prog, 0xc3, LOOP_START);
+}
+
+static const Tier tiers[] = {
+  { "interp-lazy", enableLazy, Run8080, 1 },
+  { "blocks", enableBlocks, RunBlocks8080, 1 },
+  { "jit", enableJit, RunJit8080, 0 },
+  { "aot", enableAot, RunAot8080, 0 },
+};
+
+/*
+ * every tier runs each random rom and looping program for the same
+ * budget and has to leave the machine exactly as the interpreter
+ * does at the same cycle count. AOT modules are only compiled for
+ * the random roms, by make test into options->aotDir.
+ */
+void checkTiers8080(const TestOptions8080 *options)
+{
+  static uint8_t rom[TEST8080_ROM_SIZE];
+  size_t t;
+  int n;
+
+  for (t = 0; t < sizeof(tiers) / sizeof(tiers[0]); t++)
+  {
+	const Tier *tier = &tiers[t];
+	int count = TEST8080_ROM_COUNT + LOOP_COUNT;
+	char name[32];
+	int bad = 0;
+
+	snprintf(name, sizeof(name), "tiers %s", tier->name);
+	if (tier->enable == enableAot)
+	{
+	  if (!options->aotDir)
+	  {
+		printf("%-24s skipped, no -A\n", name);
+		continue;
+	  }
+	  count = TEST8080_ROM_COUNT;
+	}
+	for (n = 0; n < count; n++)
+	{
+	  Snapshot8080 want, got;
+	  State8080 state;
+
+	  if (n < TEST8080_ROM_COUNT)
+		makeRom8080(rom, n);
+	  else
+		makeLoop(rom, n - TEST8080_ROM_COUNT);
+	  loadMachine8080(&state, rom, sizeof(rom));
+	  if (tier->enable(&state, rom, options))
+	  {
+		if (mismatch8080(&bad))
+		  printf("  rom%d: can't enable %s\n", n, tier->name);
+		freeMachine8080(&state);
+		continue;
+	  }
+	  runMachine8080(&state, tier->run, RUN_CYCLES);
+	  snapshot8080(&got, &state);
+	  freeMachine8080(&state);
+
+	  // a block boundary is an instruction boundary, the interpreter
+	  // stops on it when given the cycles the tier ran
+	  loadMachine8080(&state, rom, sizeof(rom));
+	  runMachine8080(&state, Run8080, tier->exact ? RUN_CYCLES : got.cycles);
+	  snapshot8080(&want, &state);
+	  freeMachine8080(&state);
+	  if (!sameSnapshot8080(&want, &got) && mismatch8080(&bad))
+	  {
+		printf("  rom%d:\n", n);
+		printSnapshot8080("interp", &want);
+		printSnapshot8080(tier->name, &got);
+	  }
+	}
+	report8080(name, bad, count);
+  }
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "trace8080.h"
+#include "test8080.h"
+
+#define TRACE_STEPS 60000 // instructions recorded into the trace
+#define TRACE_KEYS 997 // instructions between its keyframes
+#define TRACE_POINT 1013 // instructions between the points compared
+#define TRACE_SEEKS 64
+
+/*
+ * record a trace of a random rom, then seek back and forth in it
+ * and compare with the machine at each recorded point, the last one
+ * being the end of the trace
+ */
+static void checkSeek(const TestOptions8080 *options)
+{
+  static Snapshot8080 points[TRACE_STEPS / TRACE_POINT + 2];
+  static uint64_t indices[TRACE_STEPS / TRACE_POINT + 2];
+  static uint8_t rom[TEST8080_ROM_SIZE];
+  TraceReader8080 *reader;
+  State8080 state;
+  char path[4096];
+  uint64_t steps;
+  int count = 0, i, bad = 0;
+
+  snprintf(path, sizeof(path), "%s/test.trace", options->workDir);
+  makeRom8080(rom, 0);
+  loadMachine8080(&state, rom, sizeof(rom));
+  if (EnableTrace8080(&state, path, TRACE_KEYS))
+  {
+	printf("can't record %s!\n", path);
+	mismatch8080(&bad);
+	freeMachine8080(&state);
+	report8080("trace seek", bad, 0);
+	return;
+  }
+  // points off the keyframes
+  for (steps = 0; steps < TRACE_STEPS && !state.halted; steps++)
+  {
+	if (steps % TRACE_POINT == 0)
+	{
+	  indices[count] = steps;
+	  snapshot8080(&points[count++], &state);
+	}
+	state.cycles += Emulate8080Op(&state);
+  }
+  indices[count] = steps;
+  snapshot8080(&points[count++], &state);
+  if (DisableTrace8080(&state))
+	mismatch8080(&bad);
+  freeMachine8080(&state);
+
+  reader = OpenTrace8080(path);
+  if (!reader)
+  {
+	printf("can't open %s!\n", path);
+	mismatch8080(&bad);
+	report8080("trace seek", bad, 0);
+	return;
+  }
+  if (TraceLength8080(reader) != steps && mismatch8080(&bad))
+	printf("  %llu instructions, %llu recorded\n",
+	       (unsigned long long)TraceLength8080(reader),
+	       (unsigned long long)steps);
+
+  loadMachine8080(&state, NULL, 0);
+  // a fixed shuffle, seeks go both ways, then the end
+  for (i = 0; i <= TRACE_SEEKS; i++)
+  {
+	int p = i == TRACE_SEEKS ? count - 1 :
+	        (i * 37 + (i & 1 ? count / 2 : 0)) % count;
+	Snapshot8080 got;
+
+	if (SeekTrace8080(reader, &state, indices[p]))
+	{
+	  if (mismatch8080(&bad))
+		printf("  can't seek to %llu\n", (unsigned long long)indices[p]);
+	  continue;
+	}
+	snapshot8080(&got, &state);
+	if (!sameSnapshot8080(&points[p], &got) && mismatch8080(&bad))
+	{
+	  printf("  seek to %llu:\n", (unsigned long long)indices[p]);
+	  printSnapshot8080("recorded", &points[p]);
+	  printSnapshot8080("seeked", &got);
+	}
+  }
+  if (!SeekTrace8080(reader, &state, steps + 1) && mismatch8080(&bad))
+	printf("  seek past the end succeeded\n");
+  CloseTrace8080(reader);
+  freeMachine8080(&state);
+  unlink(path);
+  report8080("trace seek", bad, TRACE_SEEKS + 1);
+}
+
+void checkTrace8080(const TestOptions8080 *options)
+{
+  checkSeek(options);
+}
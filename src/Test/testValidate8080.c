@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "blockCache8080.h"
+#include "jit8080.h"
+#include "validate8080.h"
+#include "test8080.h"
+
+#define RUN_CYCLES 500000
+#define BREAK_AT 200000 // states before the broken tier goes wrong
+#define BROKEN_ADDR 0x3000 // the byte it flips
+
+typedef struct Tier {
+	const char *name;
+	int (*enable)(State8080 *state); // NULL for none
+	RunTier8080 run;
+}Tier;
+
+static int broken; // the broken tier went wrong
+
+/*
+ * the interpreter, except that once it passes BREAK_AT it flips a
+ * byte of memory behind the machine's back
+ */
+static RunResult8080 runBroken(State8080 *state, uint64_t cycle_budget)
+{
+  RunResult8080 result = Run8080(state, cycle_budget);
+
+  if (!broken && state->cycles >= BREAK_AT)
+  {
+	writeMemory8080(state, BROKEN_ADDR,
+	                readMemory8080(state, BROKEN_ADDR) ^ 0x40);
+	broken = 1;
+  }
+  return result;
+}
+
+static const Tier tiers[] = {
+  { "interp", NULL, Run8080 },
+  { "blocks", EnableBlockCache8080, RunBlocks8080 },
+  { "jit", EnableJit8080, RunJit8080 },
+};
+
+/*
+ * a reference and a candidate forked from one machine with a random
+ * rom
+ * @return 0 when the candidate's tier is on
+ */
+static int forkMachines(State8080 *reference, State8080 *candidate,
+                        const uint8_t *rom, const Tier *tier)
+{
+  loadMachine8080(reference, rom, TEST8080_ROM_SIZE);
+  Fork8080(reference, candidate);
+  CheckpointMemory8080(reference);
+  CheckpointMemory8080(candidate);
+  return tier && tier->enable ? tier->enable(candidate) : 0;
+}
+
+/*
+ * every page the run changed still carries its dirty mark
+ * @return 1 when one doesn't
+ */
+static int lostDirty(const State8080 *state, const uint8_t *rom)
+{
+  int addr;
+
+  for (addr = 0; addr < 0x10000; addr++)
+  {
+	uint8_t was = addr < TEST8080_ROM_SIZE ? rom[addr] : 0;
+
+	if (readMemory8080(state, addr) != was && !state->dirtyPages[addr >> 8])
+	  return 1;
+  }
+  return 0;
+}
+
+/*
+ * the tiers agree with the reference on the random roms, and the
+ * pages they wrote are still marked dirty afterwards
+ */
+static void checkAgree(void)
+{
+  static uint8_t rom[TEST8080_ROM_SIZE];
+  size_t t;
+  int n;
+
+  for (t = 0; t < sizeof(tiers) / sizeof(tiers[0]); t++)
+  {
+	char name[32];
+	int bad = 0;
+
+	for (n = 0; n < TEST8080_ROM_COUNT; n++)
+	{
+	  State8080 reference, candidate;
+	  Divergence8080 divergence;
+
+	  makeRom8080(rom, n);
+	  if (forkMachines(&reference, &candidate, rom, &tiers[t]))
+	  {
+		if (mismatch8080(&bad))
+		  printf("  rom%d: can't enable %s\n", n, tiers[t].name);
+	  }
+	  else if (Validate8080(&reference, &candidate, tiers[t].run, RUN_CYCLES,
+	                        &divergence))
+	  {
+		if (mismatch8080(&bad))
+		{
+		  printf("  rom%d:\n", n);
+		  ReportDivergence8080(stdout, &reference, &candidate, &divergence);
+		}
+	  }
+	  else if ((lostDirty(&reference, rom) || lostDirty(&candidate, rom)) &&
+	           mismatch8080(&bad))
+		printf("  rom%d: a written page lost its dirty mark\n", n);
+	  freeMachine8080(&candidate);
+	  freeMachine8080(&reference);
+	}
+	snprintf(name, sizeof(name), "validate %s", tiers[t].name);
+	report8080(name, bad, TEST8080_ROM_COUNT);
+  }
+}
+
+/*
+ * a tier that corrupts memory is caught on the block that did it,
+ * with the byte it changed
+ */
+static void checkDiverge(void)
+{
+  static uint8_t rom[TEST8080_ROM_SIZE];
+  State8080 reference, candidate;
+  Divergence8080 divergence;
+  uint8_t want;
+  int bad = 0;
+
+  makeRom8080(rom, 0);
+  forkMachines(&reference, &candidate, rom, NULL);
+  broken = 0;
+  if (!Validate8080(&reference, &candidate, runBroken, RUN_CYCLES,
+                    &divergence))
+  {
+	if (mismatch8080(&bad))
+	  printf("  the broken tier went unnoticed\n");
+  }
+  else
+  {
+	want = readMemory8080(&reference, BROKEN_ADDR);
+	if ((divergence.what != DIFF_MEMORY ||
+	     divergence.addr != BROKEN_ADDR ||
+	     divergence.referenceByte != want ||
+	     divergence.candidateByte != (want ^ 0x40) ||
+	     divergence.cycles >= BREAK_AT ||
+	     candidate.cycles < BREAK_AT) && mismatch8080(&bad))
+	  ReportDivergence8080(stdout, &reference, &candidate, &divergence);
+  }
+  freeMachine8080(&candidate);
+  freeMachine8080(&reference);
+  report8080("validate divergence", bad, 1);
+}
+
+void checkValidate8080(const TestOptions8080 *options)
+{
+  (void)options;
+  checkAgree();
+  checkDiverge();
+}
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "emulatorShell.h"
+#include "memory8080.h"
+#include "blockCache8080.h"
+#include "jit8080.h"
+#include "scheduler8080.h"
+#include "video8080.h"
+#include "test8080.h"
+
+#define FRAMES 64
+#define FRAME_CYCLES 100000 // more than a frame of program takes
+
+// 0000 LXI SP,F000; MVI B,0; 0005 LXI H,2400; MVI D,0; MOV E,B;
+// MVI C,60; 000d DAD D; DCR C; JNZ 000d; MVI C,40; 0014 MOV A,B;
+// XRA L; MOV M,A; INX H; XCHG; STAX D; XCHG; INX H; DCR C; JNZ 0014;
+// SPHL; PUSH B; PUSH D; HLT; INR B; JMP 0005
+// frame B stores through HL, DE and SP from 2400 + B * 60
+static const uint8_t program[] = {
+  0x31, 0x00, 0xf0, 0x06, 0x00, 0x21, 0x00, 0x24, 0x16, 0x00, 0x58, 0x0e,
+  0x60, 0x19, 0x0d, 0xc2, 0x0d, 0x00, 0x0e, 0x40, 0x78, 0xad, 0x77, 0x23,
+  0xeb, 0x12, 0xeb, 0x23, 0x0d, 0xc2, 0x14, 0x00, 0xf9, 0xc5, 0xd5, 0x76,
+  0x04, 0xc3, 0x05, 0x00 };
+
+typedef struct Tier {
+	const char *name;
+	int (*enable)(State8080 *state); // NULL for none
+	RunTier8080 run;
+}Tier;
+
+static const Tier tiers[] = {
+  { "interp", NULL, Run8080 },
+  { "blocks", EnableBlockCache8080, RunBlocks8080 },
+  { "jit", EnableJit8080, RunJit8080 },
+};
+
+#define TIERS (sizeof(tiers) / sizeof(tiers[0]))
+
+static const struct {
+	const char *name;
+	VideoConfig8080 config;
+	int sameAs; // index of a config with the same pixels, -1 for none
+}configs[] = {
+  { "rgba", { 0x2400, 256, 224, VIDEO8080_ROTATE_NONE, VIDEO8080_RGBA,
+              { 255, 255, 255, 255 }, { 0, 0, 0, 255 },
+              VIDEO8080_KERNEL_AUTO }, -1 },
+  { "gray scalar", { 0x2400, 256, 224, VIDEO8080_ROTATE_NONE, VIDEO8080_GRAY,
+                     { 255 }, { 0 }, VIDEO8080_KERNEL_SCALAR }, -1 },
+  { "rotated", { 0x2400, 256, 224, VIDEO8080_ROTATE_CCW, VIDEO8080_RGBA,
+                 { 255, 255, 255, 255 }, { 0, 0, 0, 255 },
+                 VIDEO8080_KERNEL_AUTO }, -1 },
+  { "rotated scalar", { 0x2400, 256, 224, VIDEO8080_ROTATE_CCW,
+                        VIDEO8080_RGBA, { 255, 255, 255, 255 },
+                        { 0, 0, 0, 255 }, VIDEO8080_KERNEL_SCALAR }, 2 },
+};
+
+#define CONFIGS (sizeof(configs) / sizeof(configs[0]))
+
+/*
+ * the frames of program on one tier
+ */
+typedef struct Frames {
+	uint64_t hashes[FRAMES];
+	uint8_t *pixels; // of the last frame
+	size_t size;
+	int stale; // the last frame differs from a full conversion
+}Frames;
+
+/*
+ * run program to its HLT once per frame and render the frame there,
+ * then convert the whole frame buffer afresh to check the last one
+ * @return 0 on success, -1 when the tier or the video didn't start
+ */
+static int runFrames(Frames *frames, const VideoConfig8080 *config,
+                     const Tier *tier)
+{
+  State8080 state;
+  int f;
+
+  loadMachine8080(&state, program, sizeof(program));
+  if ((tier->enable && tier->enable(&state)) ||
+	  EnableVideo8080(&state, config))
+  {
+	freeMachine8080(&state);
+	return -1;
+  }
+  for (f = 0; f < FRAMES; f++)
+  {
+	runMachine8080(&state, tier->run, FRAME_CYCLES);
+	state.halted = 0;
+	RenderFrame8080(&state);
+	frames->hashes[f] = state.video->hash;
+  }
+  frames->size = state.video->frameSize;
+  frames->pixels = malloc(frames->size);
+  if (frames->pixels)
+	memcpy(frames->pixels, state.video->pixels, frames->size);
+  DisableVideo8080(&state);
+
+  EnableVideo8080(&state, config);
+  RenderFrame8080(&state);
+  frames->stale = !frames->pixels ||
+	state.video->hash != frames->hashes[FRAMES - 1] ||
+	memcmp(state.video->pixels, frames->pixels, frames->size);
+  DisableVideo8080(&state);
+  freeMachine8080(&state);
+  return frames->pixels ? 0 : -1;
+}
+
+/*
+ * every tier and layout gets the same frame hashes, each frame
+ * converts to the pixels of a full conversion, and the tiers and
+ * kernels agree on the pixels
+ */
+static void checkFrames(void)
+{
+  static Frames want[CONFIGS];
+  size_t c, t;
+
+  for (c = 0; c < CONFIGS; c++)
+  {
+	const Frames *ref = configs[c].sameAs >= 0 ?
+	  &want[configs[c].sameAs] : &want[c];
+	char name[48];
+	int bad = 0;
+
+	for (t = 0; t < TIERS; t++)
+	{
+	  Frames got;
+	  int f;
+
+	  if (runFrames(t ? &got : &want[c], &configs[c].config, &tiers[t]))
+	  {
+		if (mismatch8080(&bad))
+		  printf("  %s: can't run\n", tiers[t].name);
+		continue;
+	  }
+	  if (!t)
+		got = want[c];
+	  if (got.stale && mismatch8080(&bad))
+		printf("  %s: the last frame isn't a full conversion\n",
+		       tiers[t].name);
+	  for (f = 0; f < FRAMES; f++)
+		if (got.hashes[f] != want[0].hashes[f])
+		{
+		  if (mismatch8080(&bad))
+			printf("  %s: frame %d hash %016llx, expected %016llx\n",
+			       tiers[t].name, f, (unsigned long long)got.hashes[f],
+			       (unsigned long long)want[0].hashes[f]);
+		  break;
+		}
+	  if (ref->pixels && (got.size != ref->size ||
+		                      memcmp(got.pixels, ref->pixels, ref->size)) &&
+		  mismatch8080(&bad))
+		printf("  %s: other pixels\n", tiers[t].name);
+	  if (t)
+		free(got.pixels);
+	}
+	snprintf(name, sizeof(name), "video %s", configs[c].name);
+	report8080(name, bad, TIERS * 3);
+  }
+  for (c = 0; c < CONFIGS; c++)
+	free(want[c].pixels);
+}
+
+void checkVideo8080(const TestOptions8080 *options)
+{
+  (void)options;
+  checkFrames();
+}
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "emulatorShell.h"
+#include "flags8080.h"
+#include "memory8080.h"
+#include "trace8080.h"
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-s first instruction] [-n instructions] trace\n"
+          "       prints the machine after -s instructions, then each\n"
+          "       replayed instruction with its stores\n", name);
+}
+
+static void printState(const State8080 *s)
+{
+  printf("a=%02x b=%02x c=%02x d=%02x e=%02x h=%02x l=%02x psw=%02x "
+         "sp=%04x", s->a, s->b, s->c, s->d, s->e, s->h, s->l,
+         peekFlags8080(s), s->sp);
+}
+
+int main(int argc, char **argv)
+{
+  TraceReader8080 *reader;
+  TraceEvent8080 event;
+  State8080 state;
+  uint64_t first = 0, count = UINT64_MAX, n;
+  int opt, i, ret = 0;
+
+  while ((opt = getopt(argc, argv, "s:n:")) != -1)
+  {
+	switch (opt)
+	{
+	  case 's': first = strtoull(optarg, NULL, 0); break;
+	  case 'n': count = strtoull(optarg, NULL, 0); break;
+	  default:
+		usage(argv[0]);
+		return 1;
+	}
+  }
+  if (optind + 1 != argc)
+  {
+	usage(argv[0]);
+	return 1;
+  }
+
+  reader = OpenTrace8080(argv[optind]);
+  if (!reader)
+  {
+	printf("failed to open %s!\n", argv[optind]);
+	return 1;
+  }
+  memset(&state, 0, sizeof(state));
+  InitMemory8080(&state);
+  if (SeekTrace8080(reader, &state, first))
+  {
+	printf("can't seek to instruction %llu of %llu!\n",
+	       (unsigned long long)first,
+	       (unsigned long long)TraceLength8080(reader));
+	ret = 1;
+	goto out;
+  }
+
+  printf("%llu instructions, at %llu pc=%04x cycles=%llu ",
+         (unsigned long long)TraceLength8080(reader),
+         (unsigned long long)first, state.pc,
+         (unsigned long long)state.cycles);
+  printState(&state);
+  printf("\n");
+
+  for (n = 0; n < count; n++)
+  {
+	int next = NextTrace8080(reader, &state, &event);
+
+	if (next <= 0)
+	{
+	  if (next < 0)
+	  {
+		printf("trace damaged at instruction %llu!\n",
+		       (unsigned long long)(first + n));
+		ret = 1;
+	  }
+	  break;
+	}
+	printf("%10llu %04x %-11s ", (unsigned long long)event.index, event.pc,
+	       opcodeTable8080[event.opcode].mnemonic);
+	printState(&state);
+	for (i = 0; i < event.writeCount; i++)
+	  printf(" [%04x]=%02x", event.writeAddr[i], event.writeValue[i]);
+	printf("\n");
+  }
+
+out:
+  CloseTrace8080(reader);
+  FreeMemory8080(&state);
+  return ret;
+}